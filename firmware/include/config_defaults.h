@@ -0,0 +1,215 @@
+#ifndef CONFIG_DEFAULTS_H
+#define CONFIG_DEFAULTS_H
+
+// Valores por defecto para los parámetros que no estén definidos en config.h.
+// config.h contiene credenciales y no se versiona; cualquier #define que
+// aparezca allí tiene prioridad sobre los de este archivo.
+#include <config.h>
+
+// =============================================================================
+// TOPICS MQTT
+// =============================================================================
+// Los tópicos se generan al arrancar: <TOPIC_BASE>/<DEVICE_SITE>/<dispositivo>/<tipo>
+#ifndef TOPIC_BASE
+#define TOPIC_BASE "5a728254-5316-45c6-bf3c-de194f1afa53"  // Tenant, primer nivel
+#endif
+#ifndef DEVICE_SITE
+#define DEVICE_SITE "default"             // Sitio o sala; sin '/', '+' ni '#'
+#endif
+
+// =============================================================================
+// ENTREGA MQTT QoS 1
+// =============================================================================
+#ifndef MQTT_PROTOCOL_VERSION
+#define MQTT_PROTOCOL_VERSION 5           // 5 con alias de tópico; 4 fuerza MQTT 3.1.1
+#endif
+#ifndef RECONNECT_DELAY
+#define RECONNECT_DELAY 10000             // Espera entre intentos de conexión MQTT (ms)
+#endif
+#ifndef MQTT_INFLIGHT_WINDOW
+#define MQTT_INFLIGHT_WINDOW 8            // Mensajes QoS 1 sin PUBACK a la vez
+#endif
+#ifndef MQTT_OUTBOX_CAPACITY
+#define MQTT_OUTBOX_CAPACITY 32           // Mensajes en cola (MQTT_OUTBOX_SLOT_DATA bytes c/u)
+#endif
+#ifndef MQTT_MESSAGE_MAX_AGE
+#define MQTT_MESSAGE_MAX_AGE 3600000      // Mensajes más antiguos se descartan (ms)
+#endif
+#ifndef STATE_TEMP_DELTA
+#define STATE_TEMP_DELTA 0.5f             // °C de cambio para actualizar el estado retenido
+#endif
+#ifndef STATE_HUM_DELTA
+#define STATE_HUM_DELTA 2.0f              // % de humedad de cambio para actualizar el estado retenido
+#endif
+
+// =============================================================================
+// TLS
+// =============================================================================
+#ifndef MQTT_TLS
+#define MQTT_TLS 0                        // 1 cifra la conexión (MQTT_PORT suele ser 8883)
+#endif
+#ifndef MQTT_TLS_CA_CERT
+#define MQTT_TLS_CA_CERT nullptr          // CA en PEM; nullptr acepta cualquier certificado (solo pruebas)
+#endif
+#ifndef MQTT_TLS_ECDSA
+#define MQTT_TLS_ECDSA 0                  // 1 ofrece solo ECDHE-ECDSA P-256 (broker con clave ECDSA)
+#endif
+#ifndef MQTT_TLS_RESUME
+#define MQTT_TLS_RESUME 1                 // Reanuda la sesión TLS anterior al reconectar
+#endif
+
+// =============================================================================
+// SINCRONIZACIÓN HORARIA (SNTP)
+// =============================================================================
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"         // Puede apuntar a un servidor NTP local
+#endif
+#ifndef NTP_PORT
+#define NTP_PORT 123
+#endif
+#ifndef NTP_SYNC_INTERVAL
+#define NTP_SYNC_INTERVAL 3600000         // Resincronización periódica (ms)
+#endif
+#ifndef NTP_RETRY_INTERVAL
+#define NTP_RETRY_INTERVAL 10000          // Reintento si no hay respuesta (ms)
+#endif
+#ifndef NTP_MAX_SLEW_PPM
+#define NTP_MAX_SLEW_PPM 500              // Velocidad máxima de corrección gradual
+#endif
+#ifndef NTP_STEP_THRESHOLD
+#define NTP_STEP_THRESHOLD 60000          // Desfases mayores se corrigen de golpe (ms)
+#endif
+
+// =============================================================================
+// MUESTREO ADAPTATIVO
+// =============================================================================
+#ifndef SAMPLE_INTERVAL_MIN
+#define SAMPLE_INTERVAL_MIN 2000          // Mínimo del DHT22 entre lecturas (ms)
+#endif
+#ifndef SAMPLE_INTERVAL_MAX
+#define SAMPLE_INTERVAL_MAX 60000         // Máximo intervalo con señal estable (ms)
+#endif
+#ifndef PUBLISH_INTERVAL
+#define PUBLISH_INTERVAL 5000             // Intervalo fijo de referencia (ms)
+#endif
+#ifndef SAMPLE_TEMP_RATE_ENTER
+#define SAMPLE_TEMP_RATE_ENTER 0.05f      // °C/s que activan el modo rápido
+#endif
+#ifndef SAMPLE_TEMP_RATE_EXIT
+#define SAMPLE_TEMP_RATE_EXIT 0.01f       // °C/s por debajo de los cuales se relaja
+#endif
+#ifndef SAMPLE_HUM_RATE_ENTER
+#define SAMPLE_HUM_RATE_ENTER 0.25f       // %RH/s que activan el modo rápido
+#endif
+#ifndef SAMPLE_HUM_RATE_EXIT
+#define SAMPLE_HUM_RATE_EXIT 0.05f        // %RH/s por debajo de los cuales se relaja
+#endif
+#ifndef SAMPLE_TEMP_STDDEV_ENTER
+#define SAMPLE_TEMP_STDDEV_ENTER 0.30f    // Desviación (°C) que activa el modo rápido
+#endif
+#ifndef SAMPLE_TEMP_STDDEV_EXIT
+#define SAMPLE_TEMP_STDDEV_EXIT 0.15f
+#endif
+#ifndef SAMPLE_HUM_STDDEV_ENTER
+#define SAMPLE_HUM_STDDEV_ENTER 1.50f     // Desviación (%RH) que activa el modo rápido
+#endif
+#ifndef SAMPLE_HUM_STDDEV_EXIT
+#define SAMPLE_HUM_STDDEV_EXIT 0.75f
+#endif
+#ifndef SAMPLE_CALM_SAMPLES
+#define SAMPLE_CALM_SAMPLES 3             // Muestras estables antes de alargar el intervalo
+#endif
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 3                       // 0 nada, 1 errores, 2 info, 3 cada lectura
+#endif
+#ifndef SAMPLE_STATS_EVERY
+#define SAMPLE_STATS_EVERY 20             // Cada cuántas muestras se imprime el resumen
+#endif
+
+
+// =============================================================================
+// DETECCIÓN DE ANOMALÍAS
+// =============================================================================
+#ifndef ALERT_TEMP_MIN
+#define ALERT_TEMP_MIN 0.0f               // °C por debajo de los cuales se alerta
+#endif
+#ifndef ALERT_TEMP_MAX
+#define ALERT_TEMP_MAX 35.0f              // °C por encima de los cuales se alerta
+#endif
+#ifndef ALERT_HUM_MIN
+#define ALERT_HUM_MIN 10.0f
+#endif
+#ifndef ALERT_HUM_MAX
+#define ALERT_HUM_MAX 90.0f
+#endif
+#ifndef ALERT_Z_ENTER
+#define ALERT_Z_ENTER 4.0f                // Desviaciones respecto a la media EWMA
+#endif
+#ifndef ALERT_Z_CLEAR
+#define ALERT_Z_CLEAR 2.0f
+#endif
+#ifndef ALERT_WARMUP_SAMPLES
+#define ALERT_WARMUP_SAMPLES 20           // Lecturas antes de evaluar el z-score
+#endif
+
+
+// =============================================================================
+// HISTORIAL DE LECTURAS
+// =============================================================================
+#ifndef HISTORY_PARTITION
+#define HISTORY_PARTITION "history"       // Etiqueta en partitions.csv
+#endif
+#ifndef HISTORY_CHUNK_RECORDS
+#define HISTORY_CHUNK_RECORDS 32          // Lecturas por fragmento si la petición no lo indica
+#endif
+#ifndef HISTORY_CHUNK_MAX_RECORDS
+#define HISTORY_CHUNK_MAX_RECORDS 64      // Tamaño de los búferes estáticos del envío
+#endif
+#ifndef HISTORY_DOWNSAMPLE_WINDOW
+#define HISTORY_DOWNSAMPLE_WINDOW 256     // Lecturas que se reducen de una vez (16 B cada una)
+#endif
+#ifndef HISTORY_BACKLOG_MIN_GAP
+#define HISTORY_BACKLOG_MIN_GAP 60000     // ms sin broker a partir de los que se reenvía el hueco
+#endif
+#ifndef HISTORY_BACKLOG_POINTS
+#define HISTORY_BACKLOG_POINTS 500        // Puntos para cubrir el hueco, sea cual sea su duración
+#endif
+#ifndef HISTORY_BACKLOG_METHOD
+#define HISTORY_BACKLOG_METHOD 1          // 0 todas las lecturas, 1 LTTB, 2 mín/máx
+#endif
+
+
+// =============================================================================
+// ACTUALIZACIÓN OTA POR DELTA
+// =============================================================================
+#ifndef OTA_VALIDATE_TIMEOUT
+#define OTA_VALIDATE_TIMEOUT 300000       // ms para llegar al broker tras actualizar; si no, se revierte
+#endif
+#ifndef OTA_MAX_BOOT_ATTEMPTS
+#define OTA_MAX_BOOT_ATTEMPTS 3           // Arranques de la imagen nueva sin confirmar antes de revertir
+#endif
+#ifndef OTA_HTTP_TIMEOUT
+#define OTA_HTTP_TIMEOUT 15000            // ms sin datos antes de abandonar la descarga
+#endif
+#ifndef OTA_TASK_STACK
+#define OTA_TASK_STACK 8192               // Pila de la tarea de descarga (bytes)
+#endif
+
+
+// =============================================================================
+// MEMORIA
+// =============================================================================
+#ifndef MESSAGE_ARENA_SIZE
+#define MESSAGE_ARENA_SIZE 3584           // Búferes de mensajes, tópicos y comandos (bytes, sin heap)
+#endif
+#ifndef MEMORY_SAMPLE_INTERVAL
+#define MEMORY_SAMPLE_INTERVAL 1000       // ms entre medidas del heap
+#endif
+#ifndef MEMORY_FREE_WARN
+#define MEMORY_FREE_WARN 32768            // Aviso si el heap libre baja de aquí (bytes)
+#endif
+#ifndef MEMORY_BLOCK_WARN
+#define MEMORY_BLOCK_WARN 16384           // Aviso si el mayor bloque libre baja de aquí (un registro TLS)
+#endif
+
+#endif
@@ -0,0 +1,135 @@
+#include "AdaptiveSampler.h"
+
+#include <math.h>
+
+AdaptiveSampler::AdaptiveSampler(const Config& config)
+    : config_(config),
+      primed_(false),
+      active_(true),
+      calmCount_(0),
+      interval_(config.minIntervalMs),
+      firstMs_(0),
+      lastMs_(0),
+      samples_(0),
+      fastEntries_(0) {
+    if (config_.channels > kMaxChannels) {
+        config_.channels = kMaxChannels;
+    }
+    for (uint8_t i = 0; i < kMaxChannels; i++) {
+        state_[i] = ChannelState{0.0f, 0.0f, 0.0f, 0.0f};
+    }
+}
+
+uint32_t AdaptiveSampler::update(const float* values, uint32_t nowMs) {
+    samples_++;
+
+    if (!primed_) {
+        for (uint8_t i = 0; i < config_.channels; i++) {
+            state_[i] = ChannelState{values[i], values[i], 0.0f, 0.0f};
+        }
+        primed_ = true;
+        firstMs_ = nowMs;
+        lastMs_ = nowMs;
+        interval_ = config_.minIntervalMs;
+        return interval_;
+    }
+
+    uint32_t dtMs = nowMs - lastMs_;
+    lastMs_ = nowMs;
+    float dt = dtMs > 0 ? dtMs / 1000.0f : 0.001f;
+    // Weight of this reading for the time it stands for
+    float a = 1.0f - expf(-(float)dtMs / config_.tauMs);
+
+    for (uint8_t i = 0; i < config_.channels; i++) {
+        ChannelState& s = state_[i];
+        float x = values[i];
+        // Signed slope so that sensor quantisation noise averages out
+        float rate = (x - s.last) / dt;
+        s.last = x;
+        s.rate += a * (rate - s.rate);
+        // Incremental EWMA variance (West, 1979)
+        float diff = x - s.mean;
+        float incr = a * diff;
+        s.mean += incr;
+        s.variance = (1.0f - a) * (s.variance + diff * incr);
+    }
+
+    bool anyAboveEnter = false;
+    bool allBelowExit = true;
+    for (uint8_t i = 0; i < config_.channels; i++) {
+        if (channelAbove(i, true)) {
+            anyAboveEnter = true;
+        }
+        if (channelAbove(i, false)) {
+            allBelowExit = false;
+        }
+    }
+
+    if (anyAboveEnter) {
+        if (!active_) {
+            fastEntries_++;
+        }
+        active_ = true;
+        calmCount_ = 0;
+        interval_ = config_.minIntervalMs;
+    } else if (active_) {
+        // Between the exit and enter limits we hold the current state
+        if (allBelowExit) {
+            if (++calmCount_ >= config_.calmSamples) {
+                active_ = false;
+            }
+        } else {
+            calmCount_ = 0;
+        }
+    }
+
+    if (!active_) {
+        float grown = interval_ * config_.growFactor;
+        interval_ = grown >= config_.maxIntervalMs ? config_.maxIntervalMs : (uint32_t)grown;
+    }
+    return interval_;
+}
+
+void AdaptiveSampler::forceFast() {
+    active_ = true;
+    calmCount_ = 0;
+    interval_ = config_.minIntervalMs;
+}
+
+void AdaptiveSampler::setIntervals(uint32_t minIntervalMs, uint32_t maxIntervalMs) {
+    config_.minIntervalMs = minIntervalMs;
+    config_.maxIntervalMs = maxIntervalMs < minIntervalMs ? minIntervalMs : maxIntervalMs;
+    if (interval_ < config_.minIntervalMs) {
+        interval_ = config_.minIntervalMs;
+    }
+    if (interval_ > config_.maxIntervalMs) {
+        interval_ = config_.maxIntervalMs;
+    }
+}
+
+void AdaptiveSampler::setRateLimits(uint8_t channel, float rateEnter, float rateExit) {
+    if (channel < kMaxChannels) {
+        config_.limits[channel].rateEnter = rateEnter;
+        config_.limits[channel].rateExit = rateExit;
+    }
+}
+
+float AdaptiveSampler::stddev(uint8_t channel) const {
+    return sqrtf(state_[channel].variance);
+}
+
+bool AdaptiveSampler::channelAbove(uint8_t channel, bool enter) const {
+    const ChannelLimits& l = config_.limits[channel];
+    float rateLimit = enter ? l.rateEnter : l.rateExit;
+    float sdLimit = enter ? l.stddevEnter : l.stddevExit;
+    return fabsf(state_[channel].rate) > rateLimit || stddev(channel) > sdLimit;
+}
+
+AdaptiveSampler::Stats AdaptiveSampler::stats() const {
+    Stats s;
+    s.samplesTaken = samples_;
+    s.elapsedMs = primed_ ? lastMs_ - firstMs_ : 0;
+    s.fixedScheduleSamples = primed_ ? s.elapsedMs / config_.fixedIntervalMs + 1 : 0;
+    s.fastEntries = fastEntries_;
+    return s;
+}
@@ -0,0 +1,89 @@
+#ifndef ADAPTIVE_SAMPLER_H
+#define ADAPTIVE_SAMPLER_H
+
+#include <stdint.h>
+
+// Chooses the delay until the next sensor reading from how fast the signal is
+// moving. Each channel keeps an EWMA of its rate of change and of its
+// variance; if any channel crosses its "enter" limit the sampler drops to the
+// minimum interval, and only after several consecutive readings below every
+// "exit" limit does it start stretching again towards the maximum. The gap
+// between enter and exit limits is the hysteresis that stops it oscillating.
+//
+// The EWMAs have a time constant rather than a weight per reading. With a
+// fixed weight their memory shrank with the interval, so at 2 s a slow ramp
+// looked calm, the interval grew, and at a minute the same ramp looked
+// active again.
+//
+// Pure C++ with no Arduino dependency so it can be driven from recorded traces
+// on the host.
+class AdaptiveSampler {
+public:
+    static const uint8_t kMaxChannels = 2;
+
+    struct ChannelLimits {
+        float rateEnter;    // units/s
+        float rateExit;
+        float stddevEnter;  // units
+        float stddevExit;
+    };
+
+    struct Config {
+        uint32_t minIntervalMs;
+        uint32_t maxIntervalMs;
+        uint32_t fixedIntervalMs;   // reference schedule used for the stats
+        uint32_t tauMs;             // EWMA time constant
+        float growFactor;           // interval multiplier per calm reading
+        uint8_t calmSamples;        // calm readings required before growing
+        uint8_t channels;
+        ChannelLimits limits[kMaxChannels];
+    };
+
+    struct Stats {
+        uint32_t samplesTaken;
+        uint32_t fixedScheduleSamples;  // what PUBLISH_INTERVAL would have taken
+        uint32_t fastEntries;           // calm -> active transitions
+        uint32_t elapsedMs;
+    };
+
+    explicit AdaptiveSampler(const Config& config);
+
+    // Feeds one reading per configured channel taken at nowMs and returns the
+    // delay in ms until the next reading should be taken.
+    uint32_t update(const float* values, uint32_t nowMs);
+
+    // Drops back to the minimum interval, e.g. after a read-now request.
+    void forceFast();
+
+    void setIntervals(uint32_t minIntervalMs, uint32_t maxIntervalMs);
+    void setRateLimits(uint8_t channel, float rateEnter, float rateExit);
+
+    uint32_t intervalMs() const { return interval_; }
+    bool isActive() const { return active_; }
+    float rate(uint8_t channel) const { return state_[channel].rate; }
+    float stddev(uint8_t channel) const;
+    Stats stats() const;
+
+private:
+    struct ChannelState {
+        float last;
+        float mean;
+        float variance;
+        float rate;
+    };
+
+    bool channelAbove(uint8_t channel, bool enter) const;
+
+    Config config_;
+    ChannelState state_[kMaxChannels];
+    bool primed_;
+    bool active_;
+    uint8_t calmCount_;
+    uint32_t interval_;
+    uint32_t firstMs_;
+    uint32_t lastMs_;
+    uint32_t samples_;
+    uint32_t fastEntries_;
+};
+
+#endif
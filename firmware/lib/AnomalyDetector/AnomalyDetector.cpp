@@ -0,0 +1,81 @@
+#include "AnomalyDetector.h"
+
+#include <math.h>
+
+AnomalyDetector::AnomalyDetector(const Config& config)
+    : config_(config), eventsRaised_(0) {
+    if (config_.channels > kMaxChannels) {
+        config_.channels = kMaxChannels;
+    }
+    for (uint8_t i = 0; i < kMaxChannels; i++) {
+        state_[i] = ChannelState{0.0f, 0.0f, 0, false};
+    }
+}
+
+uint8_t AnomalyDetector::update(const float* values, Event* events) {
+    uint8_t raised = 0;
+    float a = config_.alpha;
+
+    for (uint8_t i = 0; i < config_.channels; i++) {
+        ChannelState& s = state_[i];
+        const ChannelLimits& l = config_.limits[i];
+        float x = values[i];
+
+        if (s.samples == 0) {
+            s.mean = x;
+        }
+
+        // Score against the baseline before this reading is folded into it
+        float sd = sqrtf(s.variance);
+        if (sd < config_.minStddev) {
+            sd = config_.minStddev;
+        }
+        float z = (x - s.mean) / sd;
+        bool warm = s.samples >= config_.warmupSamples;
+
+        Kind kind = kNone;
+        if (x > l.maxValue) {
+            kind = kAboveMax;
+        } else if (x < l.minValue) {
+            kind = kBelowMin;
+        } else if (warm && fabsf(z) > config_.zEnter) {
+            kind = kZScore;
+        }
+
+        if (kind != kNone && !s.alarm) {
+            s.alarm = true;
+            events[raised++] = Event{kind, i, x, s.mean, z};
+            eventsRaised_++;
+        } else if (kind == kNone && s.alarm) {
+            bool insideBand = x <= l.maxValue - l.hysteresis && x >= l.minValue + l.hysteresis;
+            if (insideBand && fabsf(z) < config_.zClear) {
+                s.alarm = false;
+            }
+        }
+
+        float diff = x - s.mean;
+        float incr = a * diff;
+        s.mean += incr;
+        s.variance = (1.0f - a) * (s.variance + diff * incr);
+        if (s.samples < 0xFFFF) {
+            s.samples++;
+        }
+    }
+    return raised;
+}
+
+void AnomalyDetector::setBand(uint8_t channel, float minValue, float maxValue) {
+    if (channel < kMaxChannels) {
+        config_.limits[channel].minValue = minValue;
+        config_.limits[channel].maxValue = maxValue;
+    }
+}
+
+const char* AnomalyDetector::kindName(Kind kind) {
+    switch (kind) {
+        case kAboveMax: return "above_max";
+        case kBelowMin: return "below_min";
+        case kZScore: return "z_score";
+        default: return "none";
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef ANOMALY_DETECTOR_H
+#define ANOMALY_DETECTOR_H
+
+#include <stdint.h>
+
+// Streaming per-channel anomaly detector in fixed memory. Each channel keeps
+// an EWMA mean and variance; a reading is anomalous when it falls outside the
+// absolute [minValue, maxValue] band or more than zEnter standard deviations
+// from the mean once the channel has warmed up. A channel raises one event on
+// entering the alarm state and stays quiet until it has come back inside the
+// band and under zClear, so a sustained excursion does not flood the alert
+// topic.
+class AnomalyDetector {
+public:
+    static const uint8_t kMaxChannels = 2;
+
+    enum Kind : uint8_t {
+        kNone = 0,
+        kAboveMax,
+        kBelowMin,
+        kZScore,
+    };
+
+    struct ChannelLimits {
+        float minValue;
+        float maxValue;
+        float hysteresis;   // units inside the band required to clear
+    };
+
+    struct Config {
+        float alpha;
+        float zEnter;
+        float zClear;
+        float minStddev;        // floor so a perfectly flat signal can't alarm on noise
+        uint16_t warmupSamples;
+        uint8_t channels;
+        ChannelLimits limits[kMaxChannels];
+    };
+
+    struct Event {
+        Kind kind;
+        uint8_t channel;
+        float value;
+        float mean;
+        float z;
+    };
+
+    explicit AnomalyDetector(const Config& config);
+
+    // Feeds one reading per channel. Writes at most one event per channel into
+    // events and returns how many were raised.
+    uint8_t update(const float* values, Event* events);
+
+    void setBand(uint8_t channel, float minValue, float maxValue);
+    void setZEnter(float zEnter) { config_.zEnter = zEnter; }
+
+    bool inAlarm(uint8_t channel) const { return state_[channel].alarm; }
+    uint32_t eventsRaised() const { return eventsRaised_; }
+
+    static const char* kindName(Kind kind);
+
+private:
+    struct ChannelState {
+        float mean;
+        float variance;
+        uint16_t samples;
+        bool alarm;
+    };
+
+    Config config_;
+    ChannelState state_[kMaxChannels];
+    uint32_t eventsRaised_;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "CommandDispatcher.h"
+
+#include <string.h>
+
+namespace command {
+
+uint32_t hash(const char* s, size_t length) {
+    uint32_t h = kFnvOffset;
+    for (size_t i = 0; i < length; i++) {
+        h = (h ^ (uint8_t)s[i]) * kFnvPrime;
+    }
+    return h;
+}
+
+}  // namespace command
+
+void TopicMatcher::set(const char* topic) {
+    topic_ = topic;
+    length_ = strlen(topic);
+    hash_ = command::hash(topic, length_);
+}
+
+bool TopicMatcher::matches(const char* topic, size_t length) const {
+    return topic_ != nullptr && length == length_ && command::hash(topic, length) == hash_ &&
+           memcmp(topic, topic_, length) == 0;
+}
+
+bool TopicMatcher::matches(const char* topic) const {
+    return matches(topic, strlen(topic));
+}
+
+CommandDispatcher::CommandDispatcher(const command::Entry* table, size_t count, uint32_t (*microsFn)())
+    : table_(table), count_(count), micros_(microsFn), stats_() {}
+
+const command::Entry* CommandDispatcher::find(const char* action) const {
+    uint32_t h = command::hash(action, strlen(action));
+    for (size_t i = 0; i < count_; i++) {
+        if (table_[i].hash == h && strcmp(table_[i].name, action) == 0) {
+            return &table_[i];
+        }
+    }
+    return nullptr;
+}
+
+CommandDispatcher::Result CommandDispatcher::dispatch(uint8_t* payload, size_t length,
+                                                      JsonDocument& request, JsonDocument& response) {
+    uint32_t start = micros_();
+    Result result;
+    response.clear();
+    JsonObject out = response.to<JsonObject>();
+
+    // Non-const char* input selects ArduinoJson's zero-copy mode
+    DeserializationError error = deserializeJson(request, (char*)payload, length);
+    const char* action = error ? nullptr : request["action"].as<const char*>();
+    if (!error) {
+        out["id"] = request["id"].as<const char*>();
+        out["action"] = action;
+    }
+
+    const command::Entry* entry = nullptr;
+    if (error) {
+        result = kParseError;
+    } else if (action == nullptr) {
+        result = kMissingAction;
+    } else if ((entry = find(action)) == nullptr) {
+        result = kUnknownAction;
+    } else {
+        JsonObjectConst params = request["parameters"].as<JsonObjectConst>();
+        result = entry->handler(params, out) ? kOk : kFailed;
+    }
+
+    out["ok"] = result == kOk;
+    if (result != kOk && result != kFailed) {
+        out["error"] = resultName(result);
+    }
+
+    uint32_t elapsed = micros_() - start;
+    if (entry != nullptr) {
+        stats_.dispatched++;
+    } else {
+        stats_.rejected++;
+    }
+    stats_.lastUs = elapsed;
+    stats_.totalUs += elapsed;
+    if (elapsed > stats_.maxUs) {
+        stats_.maxUs = elapsed;
+    }
+    return result;
+}
+
+const char* CommandDispatcher::resultName(Result result) {
+    switch (result) {
+        case kOk: return "ok";
+        case kFailed: return "failed";
+        case kParseError: return "parse_error";
+        case kMissingAction: return "missing_action";
+        case kUnknownAction: return "unknown_action";
+    }
+    return "unknown";
+}
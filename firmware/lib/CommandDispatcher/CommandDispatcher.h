@@ -0,0 +1,93 @@
+#ifndef COMMAND_DISPATCHER_H
+#define COMMAND_DISPATCHER_H
+
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Table-driven dispatcher for the /commands topic.
+//
+// The payload is parsed in place: ArduinoJson's zero-copy mode leaves every
+// string pointing into the MQTT receive buffer, so nothing is copied into a
+// String. The action name is hashed once and looked up in a table whose
+// hashes are computed at compile time; strcmp only confirms the match.
+namespace command {
+
+constexpr uint32_t kFnvOffset = 2166136261u;
+constexpr uint32_t kFnvPrime = 16777619u;
+
+// FNV-1a, usable in constant expressions for the handler table
+constexpr uint32_t hash(const char* s, uint32_t h = kFnvOffset) {
+    return *s ? hash(s + 1, (h ^ (uint8_t)*s) * kFnvPrime) : h;
+}
+
+uint32_t hash(const char* s, size_t length);
+
+// Handlers read the request and fill in the response; returning false marks
+// the response as failed (set "error" to say why).
+typedef bool (*Handler)(JsonObjectConst request, JsonObject response);
+
+struct Entry {
+    uint32_t hash;
+    const char* name;
+    Handler handler;
+};
+
+}  // namespace command
+
+#define COMMAND_ENTRY(name, handler) { command::hash(name), name, handler }
+
+// Matches an incoming topic against one fixed topic by length, then hash,
+// then bytes, so mismatches are rejected without touching the string twice.
+class TopicMatcher {
+public:
+    TopicMatcher() : topic_(nullptr), length_(0), hash_(0) {}
+
+    void set(const char* topic);
+    bool matches(const char* topic, size_t length) const;
+    bool matches(const char* topic) const;
+    const char* topic() const { return topic_; }
+
+private:
+    const char* topic_;
+    size_t length_;
+    uint32_t hash_;
+};
+
+class CommandDispatcher {
+public:
+    enum Result : uint8_t {
+        kOk = 0,
+        kFailed,
+        kParseError,
+        kMissingAction,
+        kUnknownAction,
+    };
+
+    struct Stats {
+        uint32_t dispatched;
+        uint32_t rejected;      // parse errors, missing or unknown actions
+        uint32_t lastUs;
+        uint32_t maxUs;
+        uint32_t totalUs;
+    };
+
+    CommandDispatcher(const command::Entry* table, size_t count, uint32_t (*microsFn)());
+
+    // payload is modified by the in-place parse and must outlive response,
+    // which may reference strings inside it ("id", "action").
+    Result dispatch(uint8_t* payload, size_t length, JsonDocument& request, JsonDocument& response);
+
+    const Stats& stats() const { return stats_; }
+    static const char* resultName(Result result);
+
+private:
+    const command::Entry* find(const char* action) const;
+
+    const command::Entry* table_;
+    size_t count_;
+    uint32_t (*micros_)();
+    Stats stats_;
+};
+
+#endif
@@ -0,0 +1,324 @@
+#include "DeltaPatch.h"
+
+#include <string.h>
+
+namespace delta {
+
+namespace {
+
+const uint8_t kMagic[4] = {'D', 'P', 'T', '1'};
+
+void put32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+uint32_t get32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+}  // namespace
+
+void writeHeader(const Header& header, uint8_t out[kHeaderSize]) {
+    memcpy(out, kMagic, 4);
+    out[4] = header.version;
+    out[5] = header.windowBits;
+    out[6] = header.lengthBits;
+    out[7] = 0;
+    put32(out + 8, header.oldSize);
+    put32(out + 12, header.newSize);
+    memcpy(out + 16, header.oldHash, Sha256::kDigestSize);
+    memcpy(out + 48, header.newHash, Sha256::kDigestSize);
+}
+
+bool parseHeader(const uint8_t data[kHeaderSize], Header* out) {
+    if (memcmp(data, kMagic, 4) != 0) {
+        return false;
+    }
+    out->version = data[4];
+    out->windowBits = data[5];
+    out->lengthBits = data[6];
+    out->oldSize = get32(data + 8);
+    out->newSize = get32(data + 12);
+    memcpy(out->oldHash, data + 16, Sha256::kDigestSize);
+    memcpy(out->newHash, data + 48, Sha256::kDigestSize);
+    return out->version == kVersion && out->windowBits >= kMinWindowBits &&
+           out->windowBits <= DELTA_MAX_WINDOW_BITS && out->lengthBits >= kMinLengthBits &&
+           out->lengthBits <= kMaxLengthBits;
+}
+
+const char* statusName(Status status) {
+    switch (status) {
+        case kNeedMore: return "in progress";
+        case kDone: return "done";
+        case kBadHeader: return "bad header";
+        case kOldMismatch: return "old image mismatch";
+        case kBadPatch: return "bad patch";
+        case kReadError: return "read error";
+        case kWriteError: return "write error";
+        case kNewMismatch: return "new image mismatch";
+    }
+    return "?";
+}
+
+Applier::Applier(ImageReader& oldImage, ImageWriter& newImage) : old_(oldImage), new_(newImage) {
+    reset();
+}
+
+void Applier::reset() {
+    status_ = kNeedMore;
+    memset(&header_, 0, sizeof(header_));
+    headerFill_ = 0;
+    consumed_ = 0;
+    decoded_ = 0;
+    bits_ = 0;
+    bitCount_ = 0;
+    lzss_ = kTag;
+    index_ = 0;
+    entry_ = kAddLength;
+    varint_ = 0;
+    varintShift_ = 0;
+    addLeft_ = extraLeft_ = 0;
+    seek_ = 0;
+    oldPos_ = 0;
+    oldBufferStart_ = oldBufferLength_ = 0;
+    outFill_ = 0;
+    written_ = 0;
+    sha_.reset();
+}
+
+Status Applier::feed(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length && status_ == kNeedMore; i++) {
+        consumed_++;
+        if (headerFill_ < kHeaderSize) {
+            headerBytes_[headerFill_++] = data[i];
+            if (headerFill_ == kHeaderSize) {
+                startBody();
+            }
+        } else {
+            decode(data[i]);
+        }
+    }
+    return status_;
+}
+
+// Checks the header and that the old image is the one the patch expects
+void Applier::startBody() {
+    if (!parseHeader(headerBytes_, &header_)) {
+        fail(kBadHeader);
+        return;
+    }
+    Sha256 oldSha;
+    for (uint32_t offset = 0; offset < header_.oldSize; offset += sizeof(oldBuffer_)) {
+        uint32_t length = header_.oldSize - offset < sizeof(oldBuffer_) ? header_.oldSize - offset : sizeof(oldBuffer_);
+        if (!old_.read(offset, oldBuffer_, length)) {
+            fail(kReadError);
+            return;
+        }
+        oldSha.update(oldBuffer_, length);
+    }
+    uint8_t digest[Sha256::kDigestSize];
+    oldSha.finish(digest);
+    if (memcmp(digest, header_.oldHash, sizeof(digest)) != 0) {
+        fail(kOldMismatch);
+        return;
+    }
+    if (header_.newSize == 0) {
+        flush();
+    }
+}
+
+bool Applier::takeBits(uint8_t count, uint32_t* value) {
+    if (bitCount_ < count) {
+        return false;
+    }
+    bitCount_ -= count;
+    *value = (bits_ >> bitCount_) & ((1u << count) - 1);
+    return true;
+}
+
+bool Applier::decode(uint8_t byte) {
+    bits_ = (bits_ << 8) | byte;
+    bitCount_ += 8;
+    uint32_t value;
+    for (;;) {
+        switch (lzss_) {
+            case kTag:
+                if (!takeBits(1, &value)) {
+                    return true;
+                }
+                lzss_ = value ? kLiteral : kIndex;
+                break;
+            case kLiteral:
+                if (!takeBits(8, &value)) {
+                    return true;
+                }
+                lzss_ = kTag;
+                if (!emit(value)) {
+                    return false;
+                }
+                break;
+            case kIndex:
+                if (!takeBits(header_.windowBits, &index_)) {
+                    return true;
+                }
+                lzss_ = kCount;
+                break;
+            case kCount: {
+                if (!takeBits(header_.lengthBits, &value)) {
+                    return true;
+                }
+                lzss_ = kTag;
+                uint32_t distance = index_ + 1;
+                if (distance > decoded_) {
+                    return fail(kBadPatch);
+                }
+                // Byte by byte, so a distance shorter than the length repeats
+                uint32_t mask = (1u << header_.windowBits) - 1;
+                for (uint32_t n = value + kMinMatch; n > 0; n--) {
+                    if (!emit(window_[(decoded_ - distance) & mask])) {
+                        return false;
+                    }
+                }
+                break;
+            }
+        }
+        if (status_ != kNeedMore) {
+            return status_ == kDone;
+        }
+    }
+}
+
+bool Applier::emit(uint8_t byte) {
+    window_[decoded_ & ((1u << header_.windowBits) - 1)] = byte;
+    decoded_++;
+    return entryByte(byte);
+}
+
+bool Applier::entryByte(uint8_t byte) {
+    if (status_ != kNeedMore) {
+        return false;
+    }
+    switch (entry_) {
+        case kAddLength:
+        case kExtraLength:
+        case kSeek:
+            if (varintShift_ > 28) {
+                return fail(kBadPatch);
+            }
+            varint_ |= (uint32_t)(byte & 0x7F) << varintShift_;
+            varintShift_ += 7;
+            if (byte & 0x80) {
+                return true;
+            }
+            if (entry_ == kAddLength) {
+                addLeft_ = varint_;
+                entry_ = kExtraLength;
+            } else if (entry_ == kExtraLength) {
+                extraLeft_ = varint_;
+                entry_ = kSeek;
+            } else {
+                seek_ = (int32_t)(varint_ >> 1) ^ -(int32_t)(varint_ & 1);
+                if (addLeft_ > header_.newSize - written_ - outFill_ ||
+                    extraLeft_ > header_.newSize - written_ - outFill_ - addLeft_ ||
+                    addLeft_ > header_.oldSize - oldPos_) {
+                    return fail(kBadPatch);
+                }
+                entry_ = kAdd;
+            }
+            varint_ = 0;
+            varintShift_ = 0;
+            break;
+
+        case kAdd: {
+            uint8_t old;
+            if (!oldByte(oldPos_, &old) || !output(old + byte)) {
+                return false;
+            }
+            oldPos_++;
+            addLeft_--;
+            break;
+        }
+
+        case kExtra:
+            if (!output(byte)) {
+                return false;
+            }
+            extraLeft_--;
+            break;
+    }
+    if (entry_ == kAdd && addLeft_ == 0) {
+        entry_ = kExtra;
+    }
+    if (entry_ == kExtra && extraLeft_ == 0) {
+        return endEntry();
+    }
+    return true;
+}
+
+bool Applier::endEntry() {
+    int64_t pos = (int64_t)oldPos_ + seek_;
+    if (pos < 0 || pos > header_.oldSize) {
+        return fail(kBadPatch);
+    }
+    oldPos_ = pos;
+    entry_ = kAddLength;
+    if (written_ + outFill_ == header_.newSize) {
+        return flush();
+    }
+    return true;
+}
+
+bool Applier::oldByte(uint32_t offset, uint8_t* value) {
+    if (offset - oldBufferStart_ >= oldBufferLength_) {
+        uint32_t length = header_.oldSize - offset;
+        if (length > sizeof(oldBuffer_)) {
+            length = sizeof(oldBuffer_);
+        }
+        if (!old_.read(offset, oldBuffer_, length)) {
+            return fail(kReadError);
+        }
+        oldBufferStart_ = offset;
+        oldBufferLength_ = length;
+    }
+    *value = oldBuffer_[offset - oldBufferStart_];
+    return true;
+}
+
+bool Applier::output(uint8_t byte) {
+    outBuffer_[outFill_++] = byte;
+    if (outFill_ == sizeof(outBuffer_)) {
+        if (!new_.write(outBuffer_, outFill_)) {
+            return fail(kWriteError);
+        }
+        sha_.update(outBuffer_, outFill_);
+        written_ += outFill_;
+        outFill_ = 0;
+    }
+    return true;
+}
+
+// Writes what is left and checks the new image; only called at the end
+bool Applier::flush() {
+    if (outFill_ > 0) {
+        if (!new_.write(outBuffer_, outFill_)) {
+            return fail(kWriteError);
+        }
+        sha_.update(outBuffer_, outFill_);
+        written_ += outFill_;
+        outFill_ = 0;
+    }
+    uint8_t digest[Sha256::kDigestSize];
+    sha_.finish(digest);
+    status_ = memcmp(digest, header_.newHash, sizeof(digest)) == 0 ? kDone : kNewMismatch;
+    return status_ == kDone;
+}
+
+bool Applier::fail(Status status) {
+    status_ = status;
+    return false;
+}
+
+}  // namespace delta
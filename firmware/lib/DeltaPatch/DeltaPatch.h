@@ -0,0 +1,154 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Sha256.h"
+
+#ifndef DELTA_MAX_WINDOW_BITS
+#define DELTA_MAX_WINDOW_BITS 12    // largest LZSS window a patch may use (4 KB)
+#endif
+#ifndef DELTA_OLD_BUFFER
+#define DELTA_OLD_BUFFER 256        // old image bytes read from flash at a time
+#endif
+#ifndef DELTA_OUT_BUFFER
+#define DELTA_OUT_BUFFER 512        // new image bytes handed to the writer at a time
+#endif
+
+// Binary delta between two firmware images, applied as a stream.
+//
+// A patch is an 80-byte header followed by an LZSS-compressed body (the
+// heatshrink scheme: a 1 tag bit, then either an 8-bit literal or a
+// windowBits distance and a lengthBits length, MSB first). The body is a
+// list of bsdiff-style entries:
+//
+//   varint addLength, varint extraLength, zigzag varint seek,
+//   addLength bytes added to the old image at the old cursor,
+//   extraLength bytes copied verbatim,
+//   then the old cursor moves by seek.
+//
+// Code that only moved keeps its bytes but shifts the addresses inside it, so
+// most add bytes are zero or a few repeated small values, which LZSS
+// compresses well. The applier reads the old image at random, writes the new
+// one strictly in order and holds only the LZSS window and two small buffers,
+// so it fits the ESP32 however big the images are. Headers carry the SHA-256
+// of both images: the old one is checked before anything is written, the new
+// one after the last byte.
+namespace delta {
+
+const size_t kHeaderSize = 80;
+const uint8_t kVersion = 1;
+const uint8_t kMinWindowBits = 8;
+const uint8_t kMinLengthBits = 3;
+const uint8_t kMaxLengthBits = 8;
+const uint8_t kMinMatch = 3;        // shortest LZSS back-reference
+
+struct Header {
+    uint8_t version;
+    uint8_t windowBits;
+    uint8_t lengthBits;
+    uint32_t oldSize;
+    uint32_t newSize;
+    uint8_t oldHash[Sha256::kDigestSize];
+    uint8_t newHash[Sha256::kDigestSize];
+};
+
+// Layout on the wire, little-endian: "DPT1", version, windowBits, lengthBits,
+// a reserved byte, oldSize, newSize, oldHash, newHash.
+void writeHeader(const Header& header, uint8_t out[kHeaderSize]);
+bool parseHeader(const uint8_t data[kHeaderSize], Header* out);
+
+class ImageReader {
+public:
+    virtual ~ImageReader() {}
+    virtual bool read(uint32_t offset, uint8_t* data, size_t length) = 0;
+};
+
+class ImageWriter {
+public:
+    virtual ~ImageWriter() {}
+    virtual bool write(const uint8_t* data, size_t length) = 0;
+};
+
+enum Status : uint8_t {
+    kNeedMore,          // keep feeding
+    kDone,              // new image written and its hash matches
+    kBadHeader,
+    kOldMismatch,       // the running image is not the one the patch was made from
+    kBadPatch,
+    kReadError,
+    kWriteError,
+    kNewMismatch,
+};
+
+const char* statusName(Status status);
+
+class Applier {
+public:
+    Applier(ImageReader& oldImage, ImageWriter& newImage);
+
+    void reset();
+
+    // Consumes patch bytes in chunks of any size. Once the status leaves
+    // kNeedMore it stays there and further input is ignored.
+    Status feed(const uint8_t* data, size_t length);
+
+    Status status() const { return status_; }
+    bool headerReady() const { return headerFill_ == kHeaderSize && status_ != kBadHeader; }
+    const Header& header() const { return header_; }
+    uint32_t written() const { return written_; }
+    uint32_t consumed() const { return consumed_; }
+
+private:
+    enum Lzss : uint8_t { kTag, kLiteral, kIndex, kCount };
+    enum Entry : uint8_t { kAddLength, kExtraLength, kSeek, kAdd, kExtra };
+
+    void startBody();
+    bool takeBits(uint8_t count, uint32_t* value);
+    bool decode(uint8_t byte);
+    bool emit(uint8_t byte);
+    bool entryByte(uint8_t byte);
+    bool endEntry();
+    bool oldByte(uint32_t offset, uint8_t* value);
+    bool output(uint8_t byte);
+    bool flush();
+    bool fail(Status status);
+
+    ImageReader& old_;
+    ImageWriter& new_;
+    Status status_;
+    Header header_;
+    uint8_t headerBytes_[kHeaderSize];
+    size_t headerFill_;
+    uint32_t consumed_;
+
+    // LZSS
+    uint8_t window_[1 << DELTA_MAX_WINDOW_BITS];
+    uint32_t decoded_;
+    uint32_t bits_;
+    uint8_t bitCount_;
+    Lzss lzss_;
+    uint32_t index_;
+
+    // Entries
+    Entry entry_;
+    uint32_t varint_;
+    uint8_t varintShift_;
+    uint32_t addLeft_;
+    uint32_t extraLeft_;
+    int32_t seek_;
+    uint32_t oldPos_;
+
+    uint8_t oldBuffer_[DELTA_OLD_BUFFER];
+    uint32_t oldBufferStart_;
+    uint32_t oldBufferLength_;
+    uint8_t outBuffer_[DELTA_OUT_BUFFER];
+    size_t outFill_;
+    uint32_t written_;
+    Sha256 sha_;
+};
+
+}  // namespace delta
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Incremental SHA-256 (FIPS 180-4), portable so the patch applier hashes the
+// same way on the ESP32 and on the host.
+class Sha256 {
+public:
+    static const size_t kDigestSize = 32;
+
+    Sha256() { reset(); }
+
+    void reset();
+    void update(const void* data, size_t length);
+    void finish(uint8_t digest[kDigestSize]);
+
+private:
+    void compress(const uint8_t block[64]);
+
+    uint32_t state_[8];
+    uint64_t length_;
+    uint8_t block_[64];
+    size_t fill_;
+};
+
+#endif
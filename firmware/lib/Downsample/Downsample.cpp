@@ -0,0 +1,126 @@
+#include "Downsample.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace downsample {
+
+namespace {
+
+size_t selectAll(size_t count, uint16_t* selected) {
+    for (size_t i = 0; i < count; i++) {
+        selected[i] = (uint16_t)i;
+    }
+    return count;
+}
+
+}  // namespace
+
+size_t lttb(const Point* points, size_t count, size_t threshold, uint16_t* selected) {
+    if (threshold >= count || threshold < 3) {
+        return selectAll(count, selected);
+    }
+
+    // The first and last points are fixed; the rest is split into
+    // threshold - 2 buckets. From each bucket keep the point that makes the
+    // largest triangle with the point kept before it and the average of the
+    // next bucket.
+    float every = (float)(count - 2) / (float)(threshold - 2);
+    size_t kept = 0;
+    size_t a = 0;
+    selected[kept++] = 0;
+
+    for (size_t bucket = 0; bucket < threshold - 2; bucket++) {
+        size_t nextStart = (size_t)((bucket + 1) * every) + 1;
+        size_t nextEnd = (size_t)((bucket + 2) * every) + 1;
+        if (nextEnd > count) {
+            nextEnd = count;
+        }
+        float avgX = 0, avgY = 0;
+        for (size_t i = nextStart; i < nextEnd; i++) {
+            avgX += points[i].x;
+            avgY += points[i].y;
+        }
+        size_t nextLength = nextEnd - nextStart;
+        if (nextLength > 0) {
+            avgX /= nextLength;
+            avgY /= nextLength;
+        } else {
+            avgX = points[count - 1].x;
+            avgY = points[count - 1].y;
+        }
+
+        size_t start = (size_t)(bucket * every) + 1;
+        size_t end = nextStart;
+        float ax = points[a].x, ay = points[a].y;
+        float maxArea = -1;
+        size_t chosen = start;
+        for (size_t i = start; i < end; i++) {
+            // Twice the area; only the comparison matters
+            float area = fabsf((ax - avgX) * (points[i].y - ay) - (ax - points[i].x) * (avgY - ay));
+            if (area > maxArea) {
+                maxArea = area;
+                chosen = i;
+            }
+        }
+        selected[kept++] = (uint16_t)chosen;
+        a = chosen;
+    }
+
+    selected[kept++] = (uint16_t)(count - 1);
+    return kept;
+}
+
+size_t minMax(const Point* points, size_t count, size_t buckets, uint16_t* selected) {
+    if (buckets == 0 || buckets * 2 >= count) {
+        return selectAll(count, selected);
+    }
+    size_t kept = 0;
+    for (size_t bucket = 0; bucket < buckets; bucket++) {
+        size_t start = bucket * count / buckets;
+        size_t end = (bucket + 1) * count / buckets;
+        size_t low = start, high = start;
+        for (size_t i = start + 1; i < end; i++) {
+            if (points[i].y < points[low].y) low = i;
+            if (points[i].y > points[high].y) high = i;
+        }
+        size_t first = low < high ? low : high;
+        size_t second = low < high ? high : low;
+        selected[kept++] = (uint16_t)first;
+        if (second != first) {
+            selected[kept++] = (uint16_t)second;
+        }
+    }
+    return kept;
+}
+
+size_t run(Method method, const Point* points, size_t count, size_t target, uint16_t* selected) {
+    switch (method) {
+        case kLttb:
+            return lttb(points, count, target, selected);
+        case kMinMax:
+            return minMax(points, count, target / 2, selected);
+        default:
+            return selectAll(count, selected);
+    }
+}
+
+const char* methodName(Method method) {
+    switch (method) {
+        case kLttb: return "lttb";
+        case kMinMax: return "minmax";
+        default: return "none";
+    }
+}
+
+bool parseMethod(const char* name, Method* method) {
+    for (uint8_t m = kNone; m <= kMinMax; m++) {
+        if (name != nullptr && strcmp(name, methodName((Method)m)) == 0) {
+            *method = (Method)m;
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace downsample
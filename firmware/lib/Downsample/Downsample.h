@@ -0,0 +1,96 @@
+#ifndef DOWNSAMPLE_H
+#define DOWNSAMPLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Downsampling kernels for buffered series. They pick which points to keep
+// and write their indices, in order, to selected; the caller keeps whatever
+// full records those indices refer to. No allocation and no state: memory is
+// the caller's input and output arrays.
+namespace downsample {
+
+enum Method : uint8_t {
+    kNone,
+    kLttb,      // Largest-Triangle-Three-Buckets: keeps the visual shape
+    kMinMax,    // min and max of each bucket: keeps every peak
+};
+
+struct Point {
+    float x;    // time, in any unit relative to the start of the series
+    float y;
+};
+
+// Keeps threshold points (first and last always among them). Returns the
+// number selected: count itself if threshold >= count or threshold < 3.
+size_t lttb(const Point* points, size_t count, size_t threshold, uint16_t* selected);
+
+// Splits the series into buckets and keeps the lowest and highest point of
+// each, in time order; up to 2 * buckets points.
+size_t minMax(const Point* points, size_t count, size_t buckets, uint16_t* selected);
+
+// Min/max preselection, so a fixed window can stand for more readings than
+// it holds: items are fed one at a time and each group of `size` of them is
+// reduced to its lowest and highest, in arrival order. Running the kernels
+// over the preselected window (MinMaxLTTB) costs little fidelity and keeps
+// every peak.
+template <typename T>
+class GroupExtremes {
+public:
+    explicit GroupExtremes(uint32_t size = 1) { reset(size); }
+
+    void reset(uint32_t size) {
+        size_ = size > 0 ? size : 1;
+        count_ = 0;
+    }
+    uint32_t size() const { return size_; }
+    uint32_t count() const { return count_; }
+
+    // Returns true when this item completed a group; take() it then.
+    bool add(const T& item, float value) {
+        if (count_ == 0 || value < lowValue_) {
+            low_ = item;
+            lowValue_ = value;
+            lowAt_ = count_;
+        }
+        if (count_ == 0 || value > highValue_) {
+            high_ = item;
+            highValue_ = value;
+            highAt_ = count_;
+        }
+        return ++count_ >= size_;
+    }
+
+    // Writes the group's 1 or 2 survivors to out and starts a new group.
+    size_t take(T* out) {
+        size_t n = 0;
+        if (count_ > 0) {
+            out[n++] = lowAt_ <= highAt_ ? low_ : high_;
+            if (lowAt_ != highAt_) {
+                out[n++] = lowAt_ <= highAt_ ? high_ : low_;
+            }
+        }
+        count_ = 0;
+        return n;
+    }
+
+private:
+    uint32_t size_;
+    uint32_t count_;
+    T low_;
+    T high_;
+    float lowValue_;
+    float highValue_;
+    uint32_t lowAt_;
+    uint32_t highAt_;
+};
+
+// Dispatches on method for a target of about points outputs.
+size_t run(Method method, const Point* points, size_t count, size_t target, uint16_t* selected);
+
+const char* methodName(Method method);
+bool parseMethod(const char* name, Method* method);
+
+}  // namespace downsample
+
+#endif
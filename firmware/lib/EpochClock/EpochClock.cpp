@@ -0,0 +1,85 @@
+#include "EpochClock.h"
+
+EpochClock::EpochClock(const Config& config)
+    : config_(config),
+      synced_(false),
+      syncs_(0),
+      anchorMono_(0),
+      anchorEpoch_(0.0),
+      pendingSlewMs_(0.0),
+      driftPpm_(0.0),
+      lastOffsetMs_(0),
+      lastSyncMono_(0),
+      lastReturned_(0) {}
+
+double EpochClock::computeAt(uint64_t monoMs) const {
+    double elapsed = (double)(monoMs - anchorMono_);
+    double epoch = anchorEpoch_ + elapsed * (1.0 + driftPpm_ / 1e6);
+
+    double maxSlew = elapsed * config_.maxSlewPpm / 1e6;
+    double slew = pendingSlewMs_;
+    if (slew > maxSlew) {
+        slew = maxSlew;
+    } else if (slew < -maxSlew) {
+        slew = -maxSlew;
+    }
+    return epoch + slew;
+}
+
+int64_t EpochClock::now(uint64_t monoMs) {
+    if (!synced_) {
+        return (int64_t)monoMs;
+    }
+    int64_t t = (int64_t)computeAt(monoMs);
+    if (t < lastReturned_) {
+        t = lastReturned_;
+    }
+    lastReturned_ = t;
+    return t;
+}
+
+void EpochClock::sync(int64_t serverEpochMs, uint64_t monoMs) {
+    syncs_++;
+
+    if (!synced_) {
+        synced_ = true;
+        anchorMono_ = monoMs;
+        anchorEpoch_ = (double)serverEpochMs;
+        pendingSlewMs_ = 0.0;
+        lastOffsetMs_ = 0;
+        lastSyncMono_ = monoMs;
+        lastReturned_ = serverEpochMs;
+        return;
+    }
+
+    double local = computeAt(monoMs);
+    double offset = (double)serverEpochMs - local;
+    lastOffsetMs_ = (int64_t)offset;
+
+    // Whatever was left unslewed at this point is part of the new offset, so
+    // only the remainder counts towards the drift estimate.
+    double elapsed = (double)(monoMs - anchorMono_);
+    double unslewed = pendingSlewMs_ - (local - anchorEpoch_ - elapsed * (1.0 + driftPpm_ / 1e6));
+    double sinceSync = (double)(monoMs - lastSyncMono_);
+    if (sinceSync > 0.0) {
+        double measuredPpm = driftPpm_ + (offset - unslewed) / sinceSync * 1e6;
+        driftPpm_ += 0.5 * (measuredPpm - driftPpm_);
+        if (driftPpm_ > config_.maxDriftPpm) {
+            driftPpm_ = config_.maxDriftPpm;
+        } else if (driftPpm_ < -config_.maxDriftPpm) {
+            driftPpm_ = -config_.maxDriftPpm;
+        }
+    }
+
+    anchorMono_ = monoMs;
+    lastSyncMono_ = monoMs;
+    if (offset > (double)config_.stepThresholdMs || offset < -(double)config_.stepThresholdMs) {
+        // Too far off to slew in reasonable time; now() still refuses to go
+        // backwards, so a negative step just holds the clock until it catches up
+        anchorEpoch_ = (double)serverEpochMs;
+        pendingSlewMs_ = 0.0;
+    } else {
+        anchorEpoch_ = local;
+        pendingSlewMs_ = offset;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef EPOCH_CLOCK_H
+#define EPOCH_CLOCK_H
+
+#include <stdint.h>
+
+// Wall-clock epoch time in milliseconds derived from a monotonic tick count.
+//
+// The first sync steps the clock. After that, measured offsets are slewed in
+// at no more than maxSlewPpm so timestamps never jump, and the rate error of
+// the local oscillator is learned from consecutive syncs so the clock drifts
+// less between them. now() never returns a value smaller than a previous one.
+// Until the first sync it returns the monotonic time itself and synced() is
+// false, which readings carry as a flag.
+class EpochClock {
+public:
+    struct Config {
+        uint32_t maxSlewPpm;      // max correction rate while slewing
+        int32_t maxDriftPpm;      // clamp on the learned oscillator error
+        uint32_t stepThresholdMs; // offsets above this are stepped, not slewed
+    };
+
+    explicit EpochClock(const Config& config);
+
+    int64_t now(uint64_t monoMs);
+
+    // serverEpochMs is the server's time at the monotonic instant monoMs
+    // (already corrected for half the round trip).
+    void sync(int64_t serverEpochMs, uint64_t monoMs);
+
+    bool synced() const { return synced_; }
+    uint32_t syncCount() const { return syncs_; }
+    int64_t lastOffsetMs() const { return lastOffsetMs_; }
+    float driftPpm() const { return (float)driftPpm_; }
+
+private:
+    double computeAt(uint64_t monoMs) const;
+
+    Config config_;
+    bool synced_;
+    uint32_t syncs_;
+    uint64_t anchorMono_;
+    double anchorEpoch_;
+    double pendingSlewMs_;
+    double driftPpm_;
+    int64_t lastOffsetMs_;
+    uint64_t lastSyncMono_;
+    int64_t lastReturned_;
+};
+
+#endif
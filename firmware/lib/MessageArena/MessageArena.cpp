@@ -0,0 +1,50 @@
+#include "MessageArena.h"
+
+namespace {
+
+// Word alignment is enough for the byte and char buffers handed out here
+const size_t kAlign = sizeof(uint32_t);
+
+}  // namespace
+
+MessageArena::MessageArena(uint8_t* storage, size_t capacity)
+    : storage_(storage),
+      capacity_(capacity),
+      reserved_(0),
+      used_(0),
+      highWater_(0),
+      failures_(0),
+      scopes_(0) {}
+
+void* MessageArena::reserve(size_t size) {
+    if (scopes_ > 0) {
+        failures_++;
+        return nullptr;
+    }
+    void* block = take(size);
+    reserved_ = used_;
+    return block;
+}
+
+void* MessageArena::take(size_t size) {
+    size_t start = (used_ + kAlign - 1) & ~(kAlign - 1);
+    if (size == 0 || start > capacity_ || size > capacity_ - start) {
+        failures_++;
+        return nullptr;
+    }
+    used_ = start + size;
+    if (used_ > highWater_) {
+        highWater_ = used_;
+    }
+    return storage_ + start;
+}
+
+MessageArena::Stats MessageArena::stats() const {
+    Stats stats;
+    stats.capacity = capacity_;
+    stats.reserved = reserved_;
+    stats.used = used_;
+    stats.highWater = highWater_;
+    stats.failures = failures_;
+    return stats;
+}
@@ -0,0 +1,66 @@
+#ifndef MESSAGE_ARENA_H
+#define MESSAGE_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump allocator over caller-provided RAM for the firmware's message, topic
+// and command buffers, so building and sending messages never touches the
+// heap. Buffers that live for the whole run are reserved once at startup;
+// buffers for one message are taken through a Scope and handed back when it
+// ends, so scopes nest like the stack but the total is fixed at compile time
+// and visible in stats(). Nothing is ever freed individually, so the arena
+// cannot fragment.
+class MessageArena {
+public:
+    struct Stats {
+        uint32_t capacity;
+        uint32_t reserved;      // held for the whole run
+        uint32_t used;          // reserved plus the scopes open right now
+        uint32_t highWater;     // most ever used at once
+        uint32_t failures;      // requests that did not fit
+    };
+
+    // Scratch for the life of one message. Requests that do not fit return
+    // null and are counted; callers drop the message.
+    class Scope {
+    public:
+        explicit Scope(MessageArena& arena) : arena_(arena), mark_(arena.used_) { arena_.scopes_++; }
+        ~Scope() {
+            arena_.used_ = mark_;
+            arena_.scopes_--;
+        }
+
+        char* chars(size_t size) { return (char*)arena_.take(size); }
+        uint8_t* bytes(size_t size) { return (uint8_t*)arena_.take(size); }
+
+    private:
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+
+        MessageArena& arena_;
+        size_t mark_;
+    };
+
+    MessageArena(uint8_t* storage, size_t capacity);
+
+    // A buffer for the whole run. Only while no Scope is open, i.e. from
+    // setup(); null if it does not fit.
+    void* reserve(size_t size);
+
+    size_t remaining() const { return capacity_ - used_; }
+    Stats stats() const;
+
+private:
+    void* take(size_t size);
+
+    uint8_t* storage_;
+    size_t capacity_;
+    size_t reserved_;
+    size_t used_;
+    size_t highWater_;
+    uint32_t failures_;
+    uint8_t scopes_;
+};
+
+#endif
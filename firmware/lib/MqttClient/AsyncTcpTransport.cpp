@@ -0,0 +1,106 @@
+#if defined(ESP32) || defined(VIRTUAL_ESP32)
+
+#include "AsyncTcpTransport.h"
+
+AsyncTcpTransport::AsyncTcpTransport()
+    : connected_(false),
+      overflow_(false),
+      tx_(txStorage_, sizeof(txStorage_)),
+      rx_(rxStorage_, sizeof(rxStorage_)) {
+    client_.onConnect(&AsyncTcpTransport::onConnect, this);
+    client_.onDisconnect(&AsyncTcpTransport::onDisconnect, this);
+    client_.onData(&AsyncTcpTransport::onData, this);
+    client_.onError(&AsyncTcpTransport::onError, this);
+}
+
+bool AsyncTcpTransport::connect(const char* host, uint16_t port) {
+    stop();
+    tx_.clear();
+    rx_.clear();
+    overflow_ = false;
+    // Returns once DNS/SYN are under way; onConnect() reports completion
+    return client_.connect(host, port);
+}
+
+bool AsyncTcpTransport::connected() {
+    return connected_ && !overflow_;
+}
+
+size_t AsyncTcpTransport::writable() {
+    return connected_ ? tx_.free() : 0;
+}
+
+size_t AsyncTcpTransport::write(const uint8_t* data, size_t length) {
+    if (!connected_ || !tx_.push(data, length)) {
+        return 0;
+    }
+    return length;
+}
+
+size_t AsyncTcpTransport::read(uint8_t* data, size_t length) {
+    size_t n = rx_.pop(data, length);
+    if (n > 0 && connected_) {
+        client_.ack(n);
+    }
+    return n;
+}
+
+void AsyncTcpTransport::stop() {
+    if (client_.connected() || client_.connecting()) {
+        client_.close(true);
+    }
+    connected_ = false;
+}
+
+void AsyncTcpTransport::poll() {
+    if (!connected_) {
+        return;
+    }
+    size_t queued = 0;
+    while (tx_.size() > 0) {
+        size_t room = client_.space();
+        size_t length;
+        const uint8_t* data = tx_.contiguous(&length);
+        if (room == 0 || length == 0) {
+            break;
+        }
+        if (length > room) {
+            length = room;
+        }
+        size_t added = client_.add((const char*)data, length, ASYNC_WRITE_FLAG_COPY);
+        if (added == 0) {
+            break;
+        }
+        tx_.consume(added);
+        queued += added;
+    }
+    if (queued > 0) {
+        client_.send();
+    }
+}
+
+void AsyncTcpTransport::onConnect(void* arg, AsyncClient* client) {
+    AsyncTcpTransport* self = static_cast<AsyncTcpTransport*>(arg);
+    client->setNoDelay(true);
+    self->connected_ = true;
+}
+
+void AsyncTcpTransport::onDisconnect(void* arg, AsyncClient*) {
+    static_cast<AsyncTcpTransport*>(arg)->connected_ = false;
+}
+
+void AsyncTcpTransport::onError(void* arg, AsyncClient*, int8_t) {
+    static_cast<AsyncTcpTransport*>(arg)->connected_ = false;
+}
+
+void AsyncTcpTransport::onData(void* arg, AsyncClient* client, void* data, size_t length) {
+    AsyncTcpTransport* self = static_cast<AsyncTcpTransport*>(arg);
+    // Acked from read() once consumed, so TCP flow control covers the ring
+    client->ackLater();
+    if (!self->rx_.push(static_cast<const uint8_t*>(data), length)) {
+        // Only possible if the peer ignores our window; treat as a dead link
+        self->overflow_ = true;
+    }
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef ASYNC_TCP_TRANSPORT_H
+#define ASYNC_TCP_TRANSPORT_H
+
+#if defined(ESP32) || defined(VIRTUAL_ESP32)
+
+#include <AsyncTCP.h>
+#include <atomic>
+
+#include "ByteRing.h"
+#include "MqttTransport.h"
+
+#ifndef MQTT_ASYNC_TX_BUFFER
+#define MQTT_ASYNC_TX_BUFFER 4096
+#endif
+#ifndef MQTT_ASYNC_RX_BUFFER
+#define MQTT_ASYNC_RX_BUFFER 8192   // at least the lwIP TCP window (5744)
+#endif
+static_assert(ByteRing::validCapacity(MQTT_ASYNC_TX_BUFFER), "MQTT_ASYNC_TX_BUFFER must be a power of two");
+static_assert(ByteRing::validCapacity(MQTT_ASYNC_RX_BUFFER), "MQTT_ASYNC_RX_BUFFER must be a power of two");
+
+// Non-blocking transport on AsyncTCP (lwIP raw API). write() only copies into
+// a TX ring; poll(), called from loop(), moves as much of it into the TCP
+// send buffer as lwIP has room for, so a slow broker or a closed TCP window
+// backs up into the ring instead of stalling the caller.
+//
+// Received data is copied into an RX ring from the AsyncTCP task and only
+// acknowledged to TCP once read() has consumed it, so the advertised window
+// throttles the broker instead of the ring overflowing.
+class AsyncTcpTransport : public MqttTransport {
+public:
+    AsyncTcpTransport();
+
+    bool connect(const char* host, uint16_t port) override;
+    bool connected() override;
+    size_t writable() override;
+    size_t write(const uint8_t* data, size_t length) override;
+    size_t read(uint8_t* data, size_t length) override;
+    void stop() override;
+    void poll() override;
+
+    size_t txCapacity() const { return tx_.capacity(); }
+    size_t txQueued() const { return tx_.size(); }
+
+private:
+    static void onConnect(void* arg, AsyncClient* client);
+    static void onDisconnect(void* arg, AsyncClient* client);
+    static void onData(void* arg, AsyncClient* client, void* data, size_t length);
+    static void onError(void* arg, AsyncClient* client, int8_t error);
+
+    AsyncClient client_;
+    std::atomic<bool> connected_;
+    std::atomic<bool> overflow_;
+    uint8_t txStorage_[MQTT_ASYNC_TX_BUFFER];
+    uint8_t rxStorage_[MQTT_ASYNC_RX_BUFFER];
+    ByteRing tx_;
+    ByteRing rx_;
+};
+
+#endif
+
+#endif
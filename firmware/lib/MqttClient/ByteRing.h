@@ -0,0 +1,85 @@
+#ifndef BYTE_RING_H
+#define BYTE_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Single-producer/single-consumer byte ring over caller-provided storage.
+// One side may run in another task (e.g. the lwIP callback task) without
+// locking; each index is only ever written by its own side. Indices run
+// freely, so capacity must be a power of two to survive their wrap-around;
+// callers check theirs with validCapacity() in a static_assert.
+class ByteRing {
+public:
+    static constexpr bool validCapacity(size_t capacity) { return capacity != 0 && (capacity & (capacity - 1)) == 0; }
+
+    ByteRing(uint8_t* storage, size_t capacity)
+        : storage_(storage), capacity_(capacity), head_(0), tail_(0) {}
+
+    size_t size() const { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire); }
+    size_t free() const { return capacity_ - size(); }
+    size_t capacity() const { return capacity_; }
+
+    // All-or-nothing so a packet is never split across a full ring.
+    bool push(const uint8_t* data, size_t length) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        if (capacity_ - (tail - head) < length) {
+            return false;
+        }
+        size_t offset = tail % capacity_;
+        size_t first = capacity_ - offset < length ? capacity_ - offset : length;
+        memcpy(storage_ + offset, data, first);
+        memcpy(storage_, data + first, length - first);
+        tail_.store(tail + length, std::memory_order_release);
+        return true;
+    }
+
+    size_t peek(uint8_t* data, size_t length) const {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t available = tail_.load(std::memory_order_acquire) - head;
+        if (length > available) {
+            length = available;
+        }
+        size_t offset = head % capacity_;
+        size_t first = capacity_ - offset < length ? capacity_ - offset : length;
+        memcpy(data, storage_ + offset, first);
+        memcpy(data + first, storage_, length - first);
+        return length;
+    }
+
+    // Contiguous readable region starting at the head, for zero-copy sends.
+    const uint8_t* contiguous(size_t* length) const {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t available = tail_.load(std::memory_order_acquire) - head;
+        size_t offset = head % capacity_;
+        *length = capacity_ - offset < available ? capacity_ - offset : available;
+        return storage_ + offset;
+    }
+
+    void consume(size_t length) {
+        head_.store(head_.load(std::memory_order_relaxed) + length, std::memory_order_release);
+    }
+
+    size_t pop(uint8_t* data, size_t length) {
+        length = peek(data, length);
+        consume(length);
+        return length;
+    }
+
+    // Only safe while neither side is active.
+    void clear() {
+        head_.store(0);
+        tail_.store(0);
+    }
+
+private:
+    uint8_t* storage_;
+    size_t capacity_;
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+};
+
+#endif
@@ -0,0 +1,455 @@
+#include "MqttClient.h"
+
+#include <string.h>
+
+namespace {
+
+const uint32_t kConnectTimeoutMs = 15000;
+
+// MQTT 5 CONNACK reason codes mapped onto the 3.1.1 states callers know
+int connackState(uint8_t reasonCode) {
+    switch (reasonCode) {
+        case 1: case 2: case 3: case 4: case 5:
+            return reasonCode;
+        case 0x84: return MQTT_CONNECT_BAD_PROTOCOL;
+        case 0x85: return MQTT_CONNECT_BAD_CLIENT_ID;
+        case 0x86: return MQTT_CONNECT_BAD_CREDENTIALS;
+        case 0x87: case 0x8A: return MQTT_CONNECT_UNAUTHORIZED;
+        case 0x88: case 0x89: return MQTT_CONNECT_UNAVAILABLE;
+        default: return MQTT_CONNECT_FAILED;
+    }
+}
+
+}  // namespace
+
+MqttClient::MqttClient(MqttTransport& transport, MqttOutbox& outbox, uint32_t (*nowMs)())
+    : transport_(transport),
+      outbox_(outbox),
+      nowMs_(nowMs),
+      callback_(nullptr),
+      connectedCallback_(nullptr),
+      host_(nullptr),
+      port_(1883),
+      keepAliveS_(15),
+      transportCapacity_(0),
+      username_(nullptr),
+      password_(nullptr),
+      willTopic_(nullptr),
+      willPayload_(nullptr),
+      willLength_(0),
+      willRetain_(false),
+      phase_(kIdle),
+      state_(MQTT_DISCONNECTED),
+      congested_(false),
+      packetId_(0),
+      phaseStartMs_(0),
+      lastOutMs_(0),
+      lastInMs_(0),
+      pingOutstanding_(false),
+      bytesIn_(0),
+      publishesIn_(0),
+      bytesOut_(0),
+      protocol_(mqtt::kProtocol311),
+      retainAvailable_(true),
+      receiveMaximum_(65535),
+      aliasMaximum_(0),
+      aliasCount_(0),
+      chunkPos_(0),
+      chunkLength_(0),
+      reader_(rxBuffer_, sizeof(rxBuffer_)) {
+    clientId_[0] = '\0';
+}
+
+void MqttClient::setServer(const char* host, uint16_t port) {
+    host_ = host;
+    port_ = port;
+}
+
+void MqttClient::setWill(const char* topic, const uint8_t* payload, size_t length, bool retain) {
+    willTopic_ = topic;
+    willPayload_ = payload;
+    willLength_ = length;
+    willRetain_ = retain;
+}
+
+bool MqttClient::connect(const char* clientId, const char* username, const char* password) {
+    if (phase_ != kIdle) {
+        return true;
+    }
+    strncpy(clientId_, clientId, sizeof(clientId_) - 1);
+    clientId_[sizeof(clientId_) - 1] = '\0';
+    username_ = username;
+    password_ = password;
+
+    reader_.reset();
+    chunkPos_ = chunkLength_ = 0;
+    if (!transport_.connect(host_, port_)) {
+        state_ = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    phase_ = kTransportPending;
+    phaseStartMs_ = nowMs_();
+    // A blocking transport is already up, so CONNECT can go out right away
+    if (transport_.connected()) {
+        return sendConnect();
+    }
+    return true;
+}
+
+bool MqttClient::sendConnect() {
+    mqtt::ConnectOptions options = {};
+    options.clientId = clientId_;
+    options.username = username_;
+    options.password = password_;
+    options.keepAliveS = keepAliveS_;
+    options.cleanSession = true;
+    options.protocolLevel = protocol_;
+    options.willTopic = willTopic_;
+    options.willPayload = willPayload_;
+    options.willLength = willLength_;
+    options.willQos = 1;
+    options.willRetain = willRetain_;
+    // Under MQTT 5 the broker then drops what would not fit rxBuffer_ instead
+    // of sending it for us to read and discard
+    options.maximumPacketSize = sizeof(rxBuffer_);
+
+    uint8_t packet[384];
+    size_t length = mqtt::encodeConnect(packet, sizeof(packet), options);
+    if (length == 0 || transport_.writable() < length || !writeAll(packet, length)) {
+        fail(MQTT_CONNECT_FAILED);
+        return false;
+    }
+    phase_ = kAwaitConnack;
+    return true;
+}
+
+bool MqttClient::connected() {
+    if (phase_ != kConnected) {
+        return false;
+    }
+    if (!transport_.connected()) {
+        fail(MQTT_CONNECTION_LOST);
+        return false;
+    }
+    return true;
+}
+
+void MqttClient::disconnect() {
+    if (phase_ == kConnected) {
+        uint8_t packet[2];
+        size_t length = mqtt::encodeEmpty(packet, sizeof(packet), mqtt::kDisconnect);
+        if (transport_.writable() >= length) {
+            transport_.write(packet, length);
+            transport_.poll();
+        }
+    }
+    fail(MQTT_DISCONNECTED);
+}
+
+void MqttClient::fail(int state) {
+    transport_.stop();
+    phase_ = kIdle;
+    state_ = state;
+    pingOutstanding_ = false;
+    outbox_.requeueInflight();
+}
+
+bool MqttClient::loop() {
+    uint32_t now = nowMs_();
+    outbox_.expire(now);
+    transport_.poll();
+
+    if (phase_ == kTransportPending || phase_ == kAwaitConnack) {
+        if (now - phaseStartMs_ > kConnectTimeoutMs) {
+            fail(MQTT_CONNECTION_TIMEOUT);
+        } else if (phase_ == kTransportPending && transport_.connected()) {
+            sendConnect();
+        }
+    } else if (phase_ == kConnected && !transport_.connected()) {
+        fail(MQTT_CONNECTION_LOST);
+    }
+
+    while (phase_ != kIdle && readPacket()) {
+        handlePacket();
+        reader_.reset();
+    }
+
+    if (phase_ == kConnected) {
+        uint32_t keepAliveMs = keepAliveS_ * 1000UL;
+        now = nowMs_();
+        if (keepAliveMs > 0) {
+            if (pingOutstanding_ && now - lastInMs_ > keepAliveMs + keepAliveMs / 2) {
+                fail(MQTT_CONNECTION_LOST);
+            } else if (!pingOutstanding_ && (now - lastOutMs_ >= keepAliveMs || now - lastInMs_ >= keepAliveMs)) {
+                uint8_t packet[2];
+                size_t length = mqtt::encodeEmpty(packet, sizeof(packet), mqtt::kPingreq);
+                if (transport_.writable() >= length && writeAll(packet, length)) {
+                    pingOutstanding_ = true;
+                }
+            }
+        }
+        flushOutbox();
+        transport_.poll();
+    }
+
+    updateCongestion();
+    return phase_ == kConnected;
+}
+
+bool MqttClient::publish(const char* topic, const uint8_t* payload, size_t length, bool retain) {
+    if (phase_ != kConnected) {
+        return false;
+    }
+    return writePublish(topic, strlen(topic), payload, length, 0, retain, false, 0);
+}
+
+bool MqttClient::publish(const char* topic, const char* payload, bool retain) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload), retain);
+}
+
+bool MqttClient::enqueue(const char* topic, const uint8_t* payload, size_t length, bool retain) {
+    if (!outbox_.push(topic, payload, length, retain, nowMs_())) {
+        return false;
+    }
+    // Hand it to the transport now if the window and buffer allow; otherwise
+    // loop() picks it up. Either way nothing here waits on the network.
+    flushOutbox();
+    updateCongestion();
+    return true;
+}
+
+bool MqttClient::subscribe(const char* topic, uint8_t qos) {
+    if (phase_ != kConnected) {
+        return false;
+    }
+    uint8_t packet[160];
+    size_t length = mqtt::encodeSubscribe(packet, sizeof(packet), nextPacketId(), topic, qos, protocol_);
+    return length > 0 && transport_.writable() >= length && writeAll(packet, length);
+}
+
+void MqttClient::flush() {
+    flushOutbox();
+    transport_.poll();
+    updateCongestion();
+}
+
+void MqttClient::flushOutbox() {
+    MqttOutbox::Slot* slot;
+    while (phase_ == kConnected && outbox_.inflight() < receiveMaximum_ &&
+           (slot = outbox_.nextToSend()) != nullptr) {
+        // Stop rather than block when the transport buffer is full; the PUBLISH
+        // is at most its payload plus topic plus a few header bytes
+        if (transport_.writable() < (size_t)slot->topicLength + slot->payloadLength + 13) {
+            return;
+        }
+        uint16_t packetId = nextPacketId();
+        if (!writePublish(slot->topic(), slot->topicLength, slot->payload(), slot->payloadLength,
+                          1, slot->retain, slot->dup, packetId)) {
+            return;
+        }
+        outbox_.markSent(slot, packetId);
+    }
+}
+
+void MqttClient::updateCongestion() {
+    // Whichever of the outbox or the transport buffer is fuller decides
+    uint32_t fill = outbox_.capacity() > 0 ? outbox_.depth() * 100UL / outbox_.capacity() : 0;
+    if (transportCapacity_ > 0 && phase_ == kConnected) {
+        size_t writable = transport_.writable();
+        size_t used = writable < transportCapacity_ ? transportCapacity_ - writable : 0;
+        uint32_t transportFill = used * 100UL / transportCapacity_;
+        if (transportFill > fill) {
+            fill = transportFill;
+        }
+    }
+    if (fill >= 75) {
+        congested_ = true;
+    } else if (fill < 50) {
+        congested_ = false;
+    }
+}
+
+uint16_t MqttClient::nextPacketId() {
+    do {
+        if (++packetId_ == 0) {
+            packetId_ = 1;
+        }
+    } while (outbox_.isInflight(packetId_));
+    return packetId_;
+}
+
+bool MqttClient::writeAll(const uint8_t* data, size_t length) {
+    if (length == 0 || transport_.write(data, length) != length) {
+        fail(MQTT_CONNECTION_LOST);
+        return false;
+    }
+    lastOutMs_ = nowMs_();
+    bytesOut_ += length;
+    return true;
+}
+
+uint16_t MqttClient::findTopicAlias(const char* topic, size_t topicLength) const {
+    for (uint16_t i = 0; i < aliasCount_; i++) {
+        if (aliases_[i].length == topicLength && memcmp(aliases_[i].topic, topic, topicLength) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+bool MqttClient::writePublish(const char* topic, size_t topicLength, const uint8_t* payload, size_t length,
+                              uint8_t qos, bool retain, bool dup, uint16_t packetId) {
+    // A known topic goes out as its alias alone; a new one carries both, and
+    // is remembered only once the broker has actually been sent the pair
+    uint16_t alias = 0;
+    bool announce = false;
+    if (protocol_ == mqtt::kProtocol5) {
+        alias = findTopicAlias(topic, topicLength);
+        if (alias == 0 && aliasCount_ < aliasMaximum_ && aliasCount_ < MQTT_TOPIC_ALIASES &&
+            topicLength <= MQTT_TOPIC_ALIAS_LENGTH) {
+            alias = aliasCount_ + 1;
+            announce = true;
+        }
+    }
+    size_t sentTopicLength = alias > 0 && !announce ? 0 : topicLength;
+
+    uint8_t header[16 + MQTT_OUTBOX_SLOT_DATA];
+    size_t headerLength = mqtt::encodePublishHeader(header, sizeof(header), topic, sentTopicLength, length,
+                                                    qos, retain && retainAvailable_, dup, packetId,
+                                                    protocol_, alias);
+    if (headerLength == 0 || transport_.writable() < headerLength + length) {
+        return false;
+    }
+    // One write when it fits, so the PUBLISH usually leaves in one TCP segment
+    bool written;
+    if (headerLength + length <= sizeof(header)) {
+        memcpy(header + headerLength, payload, length);
+        written = writeAll(header, headerLength + length);
+    } else {
+        written = writeAll(header, headerLength) && writeAll(payload, length);
+    }
+    if (written && announce) {
+        memcpy(aliases_[aliasCount_].topic, topic, topicLength);
+        aliases_[aliasCount_].length = topicLength;
+        aliasCount_++;
+    }
+    return written;
+}
+
+bool MqttClient::readPacket() {
+    while (!reader_.ready()) {
+        if (chunkPos_ == chunkLength_) {
+            chunkPos_ = 0;
+            chunkLength_ = transport_.read(chunk_, sizeof(chunk_));
+            if (chunkLength_ == 0) {
+                return false;
+            }
+            bytesIn_ += chunkLength_;
+        }
+        chunkPos_ += reader_.feed(chunk_ + chunkPos_, chunkLength_ - chunkPos_);
+    }
+    lastInMs_ = nowMs_();
+    return true;
+}
+
+void MqttClient::handlePacket() {
+    pingOutstanding_ = false;
+    if (reader_.overflowed()) {
+        return;
+    }
+    uint8_t* body = reader_.body();
+    size_t length = reader_.bodyLength();
+
+    switch (reader_.type()) {
+        case mqtt::kConnack: {
+            if (phase_ != kAwaitConnack) {
+                break;
+            }
+            mqtt::Connack connack;
+            if (!mqtt::parseConnack(body, length, protocol_, &connack)) {
+                fail(MQTT_CONNECT_FAILED);
+                break;
+            }
+            if (connack.reasonCode != 0) {
+                // A broker without MQTT 5 refuses the protocol level (3.1.1
+                // return code 1); the next attempt speaks 3.1.1
+                if (protocol_ == mqtt::kProtocol5 &&
+                    (connack.reasonCode == 1 || connack.reasonCode == mqtt::kReasonUnsupportedProtocol)) {
+                    protocol_ = mqtt::kProtocol311;
+                }
+                fail(connackState(connack.reasonCode));
+                break;
+            }
+            // Aliases only live as long as the connection that assigned them
+            aliasCount_ = 0;
+            aliasMaximum_ = connack.topicAliasMaximum;
+            receiveMaximum_ = connack.receiveMaximum > 0 ? connack.receiveMaximum : 65535;
+            retainAvailable_ = connack.retainAvailable;
+            if (connack.serverKeepAliveS > 0) {
+                keepAliveS_ = connack.serverKeepAliveS;
+            }
+            phase_ = kConnected;
+            state_ = MQTT_CONNECTED;
+            lastOutMs_ = lastInMs_ = nowMs_();
+            // Anything unacknowledged from the previous session goes out again first
+            outbox_.requeueInflight();
+            if (connectedCallback_ != nullptr) {
+                connectedCallback_();
+            }
+            flushOutbox();
+            break;
+        }
+
+        case mqtt::kPuback:
+            if (length >= 2) {
+                outbox_.acknowledge(mqtt::read16(body));
+            }
+            break;
+
+        case mqtt::kPublish: {
+            if (length < 2) {
+                break;
+            }
+            uint8_t qos = (reader_.flags() >> 1) & 0x03;
+            size_t topicLength = mqtt::read16(body);
+            size_t offset = 2 + topicLength + (qos > 0 ? 2 : 0);
+            if (offset > length) {
+                break;
+            }
+            uint16_t packetId = qos > 0 ? mqtt::read16(body + 2 + topicLength) : 0;
+            if (protocol_ == mqtt::kProtocol5) {
+                // No property of an inbound PUBLISH is used; the payload follows them
+                uint32_t propertiesLength;
+                size_t used = mqtt::readVarint(body + offset, length - offset, &propertiesLength);
+                if (used == 0 || offset + used + propertiesLength > length) {
+                    break;
+                }
+                offset += used + propertiesLength;
+            }
+            // Shift the topic over its length prefix to NUL-terminate it in place
+            memmove(body, body + 2, topicLength);
+            body[topicLength] = '\0';
+            publishesIn_++;
+            if (callback_ != nullptr) {
+                callback_((char*)body, body + offset, (unsigned int)(length - offset));
+            }
+            if (qos == 1) {
+                uint8_t ack[4];
+                size_t ackLength = mqtt::encodePuback(ack, sizeof(ack), packetId);
+                if (transport_.writable() >= ackLength) {
+                    writeAll(ack, ackLength);
+                }
+            }
+            break;
+        }
+
+        case mqtt::kDisconnect:
+            // Only MQTT 5 brokers send it, e.g. for a protocol error or a takeover
+            fail(MQTT_CONNECTION_LOST);
+            break;
+
+        default:
+            // PINGRESP and SUBACK only need to count as inbound traffic
+            break;
+    }
+}
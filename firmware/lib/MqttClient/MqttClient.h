@@ -0,0 +1,156 @@
+#ifndef MQTT_CLIENT_H
+#define MQTT_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MqttOutbox.h"
+#include "MqttPacket.h"
+#include "MqttTransport.h"
+
+#ifndef MQTT_RX_BUFFER_SIZE
+#define MQTT_RX_BUFFER_SIZE 512
+#endif
+
+// MQTT 5 topic aliases kept per connection, each with a copy of its topic
+#ifndef MQTT_TOPIC_ALIASES
+#define MQTT_TOPIC_ALIASES 4
+#endif
+#ifndef MQTT_TOPIC_ALIAS_LENGTH
+#define MQTT_TOPIC_ALIAS_LENGTH 128
+#endif
+
+// Connection states, numbered like PubSubClient's so logs stay comparable
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+#define MQTT_CONNECT_BAD_PROTOCOL    1
+#define MQTT_CONNECT_BAD_CLIENT_ID   2
+#define MQTT_CONNECT_UNAVAILABLE     3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED    5
+
+// Event-driven MQTT 3.1.1 / 5 client with QoS 1 publishing through an MqttOutbox.
+//
+// Nothing here waits on the network: connect() only starts the attempt and
+// loop() drives it to CONNACK, then reads, keeps alive and sends. publish()
+// sends QoS 0 at once if the transport has room, for traffic that must not
+// wait behind the queue (alerts). enqueue() hands a QoS 1 message to the
+// outbox; loop() keeps up to the outbox window in flight, matches PUBACKs by
+// packet id and re-sends what was unacknowledged after a reconnect.
+//
+// congested() is the backpressure signal: it turns on when the outbox or the
+// transport buffer passes 3/4 full and off again below 1/2.
+//
+// Under MQTT 5 the first PUBLISH to a topic on each connection also assigns
+// it an alias, up to the Topic Alias Maximum from CONNACK, and later ones send
+// only the 2-byte alias with an empty topic. The broker's Receive Maximum caps
+// the QoS 1 window and Retain Available drops the retain flag. If the broker
+// refuses the protocol level, the client falls back to 3.1.1 for the next
+// attempt and stays there until setProtocol() is called again.
+class MqttClient {
+public:
+    typedef void (*Callback)(char* topic, uint8_t* payload, unsigned int length);
+    typedef void (*ConnectedCallback)();
+
+    MqttClient(MqttTransport& transport, MqttOutbox& outbox, uint32_t (*nowMs)());
+
+    void setServer(const char* host, uint16_t port);
+    void setCallback(Callback callback) { callback_ = callback; }
+    // Called once CONNACK arrives; the place to subscribe
+    void setConnectedCallback(ConnectedCallback callback) { connectedCallback_ = callback; }
+    void setKeepAlive(uint16_t seconds) { keepAliveS_ = seconds; }
+    // Transport buffer size, so congestion can be judged against it
+    void setTransportCapacity(size_t bytes) { transportCapacity_ = bytes; }
+    // mqtt::kProtocol5 or mqtt::kProtocol311, from the next connect() on
+    void setProtocol(uint8_t level) { protocol_ = level; }
+    // Last Will the broker publishes (QoS 1) if the connection drops without a
+    // DISCONNECT. Pointers are kept, not copied; from the next connect() on.
+    void setWill(const char* topic, const uint8_t* payload, size_t length, bool retain);
+
+    // Starts a connection attempt; false if it could not even be started.
+    bool connect(const char* clientId, const char* username = nullptr, const char* password = nullptr);
+    bool connected();
+    bool connecting() const { return phase_ == kTransportPending || phase_ == kAwaitConnack; }
+    void disconnect();
+    bool loop();
+
+    bool publish(const char* topic, const uint8_t* payload, size_t length, bool retain);
+    bool publish(const char* topic, const char* payload, bool retain);
+    bool enqueue(const char* topic, const uint8_t* payload, size_t length, bool retain);
+    bool subscribe(const char* topic, uint8_t qos = 0);
+    // Pushes queued messages to the transport now instead of on the next loop()
+    void flush();
+
+    bool congested() const { return congested_; }
+    // Everything read from the broker, for checking what subscriptions cost
+    uint32_t bytesIn() const { return bytesIn_; }
+    uint32_t publishesIn() const { return publishesIn_; }
+    uint32_t bytesOut() const { return bytesOut_; }
+    // Protocol level the current or next connection uses
+    uint8_t protocol() const { return protocol_; }
+    uint16_t topicAliasesInUse() const { return aliasCount_; }
+    int state() const { return state_; }
+    MqttOutbox::Stats stats() const { return outbox_.stats(); }
+
+private:
+    enum Phase : uint8_t { kIdle, kTransportPending, kAwaitConnack, kConnected };
+
+    bool writeAll(const uint8_t* data, size_t length);
+    bool writePublish(const char* topic, size_t topicLength, const uint8_t* payload, size_t length,
+                      uint8_t qos, bool retain, bool dup, uint16_t packetId);
+    bool sendConnect();
+    uint16_t findTopicAlias(const char* topic, size_t topicLength) const;
+    bool readPacket();
+    void handlePacket();
+    void flushOutbox();
+    void updateCongestion();
+    uint16_t nextPacketId();
+    void fail(int state);
+
+    MqttTransport& transport_;
+    MqttOutbox& outbox_;
+    uint32_t (*nowMs_)();
+    Callback callback_;
+    ConnectedCallback connectedCallback_;
+    const char* host_;
+    uint16_t port_;
+    uint16_t keepAliveS_;
+    size_t transportCapacity_;
+    char clientId_[64];
+    const char* username_;
+    const char* password_;
+    const char* willTopic_;
+    const uint8_t* willPayload_;
+    uint16_t willLength_;
+    bool willRetain_;
+    Phase phase_;
+    int state_;
+    bool congested_;
+    uint16_t packetId_;
+    uint32_t phaseStartMs_;
+    uint32_t lastOutMs_;
+    uint32_t lastInMs_;
+    bool pingOutstanding_;
+    uint32_t bytesIn_;
+    uint32_t publishesIn_;
+    uint32_t bytesOut_;
+    uint8_t protocol_;
+    bool retainAvailable_;
+    uint16_t receiveMaximum_;
+    uint16_t aliasMaximum_;
+    uint16_t aliasCount_;
+    struct TopicAlias {
+        uint16_t length;
+        char topic[MQTT_TOPIC_ALIAS_LENGTH];
+    } aliases_[MQTT_TOPIC_ALIASES];
+    uint8_t rxBuffer_[MQTT_RX_BUFFER_SIZE];
+    uint8_t chunk_[64];
+    size_t chunkPos_;
+    size_t chunkLength_;
+    mqtt::PacketReader reader_;
+};
+
+#endif
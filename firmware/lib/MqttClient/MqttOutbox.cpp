@@ -0,0 +1,186 @@
+#include "MqttOutbox.h"
+
+#include <string.h>
+
+MqttOutbox::MqttOutbox(Slot* slots, uint16_t capacity, uint8_t window, uint32_t maxAgeMs)
+    : slots_(slots),
+      capacity_(capacity),
+      window_(window),
+      maxAgeMs_(maxAgeMs),
+      head_(0),
+      count_(0),
+      inflight_(0),
+      queued_(0),
+      delivered_(0),
+      retransmitted_(0),
+      expired_(0) {
+    for (uint16_t i = 0; i < capacity_; i++) {
+        slots_[i].state = kFree;
+    }
+}
+
+bool MqttOutbox::push(const char* topic, const uint8_t* payload, size_t length, bool retain, uint32_t nowMs) {
+    size_t topicLength = strlen(topic);
+    if (topicLength + length > MQTT_OUTBOX_SLOT_DATA || capacity_ == 0) {
+        return false;
+    }
+    Slot* target = nullptr;
+    if (retain) {
+        for (uint16_t i = 0; i < count_ && target == nullptr; i++) {
+            Slot& queued = at(i);
+            if (queued.state == kQueued && queued.retain && queued.topicLength == topicLength &&
+                memcmp(queued.data, topic, topicLength) == 0) {
+                target = &queued;
+            }
+        }
+    }
+    if (target == nullptr) {
+        if (count_ == capacity_) {
+            // The oldest message that is not retained; the head if all are
+            uint16_t victim = 0;
+            while (victim < count_ && at(victim).retain) {
+                victim++;
+            }
+            dropAt(victim < count_ ? victim : 0);
+        }
+        target = &slots_[(head_ + count_) % capacity_];
+        count_++;
+    }
+
+    Slot& slot = *target;
+    slot.enqueuedMs = nowMs;
+    slot.packetId = 0;
+    slot.topicLength = (uint16_t)topicLength;
+    slot.payloadLength = (uint16_t)length;
+    slot.state = kQueued;
+    slot.retain = retain;
+    slot.dup = false;
+    memcpy(slot.data, topic, topicLength);
+    memcpy(slot.data + topicLength, payload, length);
+    queued_++;
+    return true;
+}
+
+MqttOutbox::Slot* MqttOutbox::nextToSend() {
+    if (inflight_ >= window_) {
+        return nullptr;
+    }
+    for (uint16_t i = 0; i < count_; i++) {
+        Slot& slot = at(i);
+        if (slot.state == kQueued) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+void MqttOutbox::markSent(Slot* slot, uint16_t packetId) {
+    if (slot->dup) {
+        retransmitted_++;
+    }
+    slot->packetId = packetId;
+    slot->state = kInflight;
+    inflight_++;
+}
+
+bool MqttOutbox::acknowledge(uint16_t packetId) {
+    for (uint16_t i = 0; i < count_; i++) {
+        Slot& slot = at(i);
+        if (slot.state == kInflight && slot.packetId == packetId) {
+            slot.state = kAcked;
+            inflight_--;
+            delivered_++;
+            // Acks normally arrive in order, so this usually frees the head
+            while (count_ > 0 && at(0).state == kAcked) {
+                popHead();
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MqttOutbox::isInflight(uint16_t packetId) const {
+    for (uint16_t i = 0; i < count_; i++) {
+        const Slot& slot = at(i);
+        if (slot.state == kInflight && slot.packetId == packetId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MqttOutbox::requeueInflight() {
+    for (uint16_t i = 0; i < count_; i++) {
+        Slot& slot = at(i);
+        if (slot.state == kInflight) {
+            slot.state = kQueued;
+            slot.dup = true;
+        }
+    }
+    inflight_ = 0;
+}
+
+void MqttOutbox::expire(uint32_t nowMs) {
+    uint16_t i = 0;
+    while (i < count_) {
+        const Slot& slot = at(i);
+        if (!slot.retain && slot.state != kAcked && nowMs - slot.enqueuedMs > maxAgeMs_) {
+            dropAt(i);
+        } else {
+            i++;
+        }
+    }
+    while (count_ > 0 && at(0).state == kAcked) {
+        popHead();
+    }
+}
+
+void MqttOutbox::popHead() {
+    at(0).state = kFree;
+    head_ = (head_ + 1) % capacity_;
+    count_--;
+}
+
+void MqttOutbox::dropHead() {
+    Slot& slot = at(0);
+    if (slot.state == kInflight) {
+        inflight_--;
+    }
+    if (slot.state != kAcked) {
+        expired_++;
+    }
+    popHead();
+}
+
+void MqttOutbox::dropAt(uint16_t i) {
+    if (i == 0) {
+        dropHead();
+        return;
+    }
+    Slot& slot = at(i);
+    if (slot.state == kInflight) {
+        inflight_--;
+    }
+    if (slot.state != kAcked) {
+        expired_++;
+    }
+    // Rare (a full queue, or an old message behind a retained one), so
+    // shifting whole slots is fine
+    for (uint16_t j = i; j + 1 < count_; j++) {
+        at(j) = at(j + 1);
+    }
+    at(count_ - 1).state = kFree;
+    count_--;
+}
+
+MqttOutbox::Stats MqttOutbox::stats() const {
+    Stats s;
+    s.queued = queued_;
+    s.delivered = delivered_;
+    s.retransmitted = retransmitted_;
+    s.expired = expired_;
+    s.depth = count_;
+    s.inflight = inflight_;
+    return s;
+}
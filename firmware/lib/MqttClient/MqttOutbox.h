@@ -0,0 +1,94 @@
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MQTT_OUTBOX_SLOT_DATA
+#define MQTT_OUTBOX_SLOT_DATA 320   // topic + payload bytes per queued message
+#endif
+
+// Queue of QoS 1 messages in caller-provided RAM. Up to `window` of them can
+// be in flight (sent, awaiting PUBACK) at once, so a slow ack never turns the
+// link into stop-and-wait; the rest wait their turn in FIFO order. Messages
+// in flight when the connection drops are re-sent with DUP on reconnect.
+// Messages older than maxAgeMs, or pushed out by a full queue, expire.
+//
+// Retained messages are a topic's last value rather than a stream: a newer
+// one replaces one still queued for the same topic, and they are neither
+// pushed out nor expired, so the broker is left holding the last one pushed.
+// That bounds them to two per topic (one in flight, one queued).
+class MqttOutbox {
+public:
+    struct Slot {
+        uint32_t enqueuedMs;
+        uint16_t packetId;
+        uint16_t topicLength;
+        uint16_t payloadLength;
+        uint8_t state;
+        bool retain;
+        bool dup;
+        uint8_t data[MQTT_OUTBOX_SLOT_DATA];
+
+        const char* topic() const { return (const char*)data; }
+        const uint8_t* payload() const { return data + topicLength; }
+    };
+
+    struct Stats {
+        uint32_t queued;
+        uint32_t delivered;
+        uint32_t retransmitted;
+        uint32_t expired;
+        uint16_t depth;
+        uint16_t inflight;
+    };
+
+    MqttOutbox(Slot* slots, uint16_t capacity, uint8_t window, uint32_t maxAgeMs);
+
+    // Copies the message in. Returns false only if it can never fit a slot.
+    bool push(const char* topic, const uint8_t* payload, size_t length, bool retain, uint32_t nowMs);
+
+    // Oldest message not yet in flight, or null when the window is full.
+    Slot* nextToSend();
+    void markSent(Slot* slot, uint16_t packetId);
+
+    // Returns false for unknown ids, e.g. a PUBACK for an expired message.
+    bool acknowledge(uint16_t packetId);
+
+    // Moves everything in flight back to the queue, flagged DUP.
+    void requeueInflight();
+
+    void expire(uint32_t nowMs);
+    bool isInflight(uint16_t packetId) const;
+    // Shrinking below the number in flight just stops new sends until acks arrive
+    void setWindow(uint8_t window) { window_ = window; }
+
+    uint16_t depth() const { return count_; }
+    uint16_t inflight() const { return inflight_; }
+    uint16_t capacity() const { return capacity_; }
+    Stats stats() const;
+
+private:
+    enum SlotState : uint8_t { kFree = 0, kQueued, kInflight, kAcked };
+
+    Slot& at(uint16_t i) { return slots_[(head_ + i) % capacity_]; }
+    const Slot& at(uint16_t i) const { return slots_[(head_ + i) % capacity_]; }
+    void popHead();
+    void dropHead();
+    // Expires the message i places from the head, closing the gap
+    void dropAt(uint16_t i);
+
+    Slot* slots_;
+    uint16_t capacity_;
+    uint8_t window_;
+    uint32_t maxAgeMs_;
+    uint16_t head_;
+    uint16_t count_;
+    uint16_t inflight_;
+    uint32_t queued_;
+    uint32_t delivered_;
+    uint32_t retransmitted_;
+    uint32_t expired_;
+};
+
+#endif
@@ -0,0 +1,307 @@
+#include "MqttPacket.h"
+
+#include <string.h>
+
+namespace mqtt {
+
+namespace {
+
+size_t remainingLengthSize(size_t length) {
+    if (length < 128) return 1;
+    if (length < 16384) return 2;
+    if (length < 2097152) return 3;
+    return 4;
+}
+
+uint8_t* writeVarint(uint8_t* p, size_t length) {
+    do {
+        uint8_t digit = length % 128;
+        length /= 128;
+        if (length > 0) {
+            digit |= 0x80;
+        }
+        *p++ = digit;
+    } while (length > 0);
+    return p;
+}
+
+uint8_t* writeFixedHeader(uint8_t* p, uint8_t header, size_t length) {
+    *p++ = header;
+    return writeVarint(p, length);
+}
+
+uint8_t* write16(uint8_t* p, uint16_t v) {
+    *p++ = v >> 8;
+    *p++ = v & 0xFF;
+    return p;
+}
+
+uint8_t* write32(uint8_t* p, uint32_t v) {
+    p = write16(p, v >> 16);
+    return write16(p, v & 0xFFFF);
+}
+
+uint8_t* writeString(uint8_t* p, const void* s, size_t length) {
+    p = write16(p, (uint16_t)length);
+    memcpy(p, s, length);
+    return p + length;
+}
+
+// Size of an MQTT 5 property value, from its identifier; 0 for an unknown
+// identifier or a value that runs past the end.
+size_t propertyValueSize(uint8_t id, const uint8_t* p, size_t available) {
+    size_t size;
+    switch (id) {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            size = 1;
+            break;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            size = 2;
+            break;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            size = 4;
+            break;
+        case 0x0B: {
+            uint32_t ignored;
+            return readVarint(p, available, &ignored);
+        }
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+            size = available >= 2 ? 2 + read16(p) : 0;
+            break;
+        case 0x26:  // user property: two strings
+            size = available >= 2 ? 2 + read16(p) : 0;
+            if (size > 0 && available >= size + 2) {
+                size += 2 + read16(p + size);
+            }
+            break;
+        default:
+            return 0;
+    }
+    return size <= available ? size : 0;
+}
+
+}  // namespace
+
+size_t encodeConnect(uint8_t* buf, size_t cap, const ConnectOptions& o) {
+    bool v5 = o.protocolLevel == kProtocol5;
+    size_t propertiesLength = v5 && o.maximumPacketSize > 0 ? 5 : 0;
+    size_t clientIdLength = strlen(o.clientId);
+    size_t length = 10 + 2 + clientIdLength + (v5 ? 1 + propertiesLength : 0);
+    uint8_t connectFlags = o.cleanSession ? 0x02 : 0x00;
+
+    if (o.willTopic != nullptr) {
+        length += 2 + strlen(o.willTopic) + 2 + o.willLength + (v5 ? 1 : 0);
+        connectFlags |= 0x04 | ((o.willQos & 0x03) << 3) | (o.willRetain ? 0x20 : 0x00);
+    }
+    if (o.username != nullptr) {
+        length += 2 + strlen(o.username);
+        connectFlags |= 0x80;
+        if (o.password != nullptr) {
+            length += 2 + strlen(o.password);
+            connectFlags |= 0x40;
+        }
+    }
+    if (1 + remainingLengthSize(length) + length > cap) {
+        return 0;
+    }
+
+    uint8_t* p = writeFixedHeader(buf, kConnect << 4, length);
+    p = writeString(p, "MQTT", 4);
+    *p++ = v5 ? kProtocol5 : kProtocol311;
+    *p++ = connectFlags;
+    p = write16(p, o.keepAliveS);
+    if (v5) {
+        *p++ = propertiesLength;
+        if (o.maximumPacketSize > 0) {
+            *p++ = 0x27;
+            p = write32(p, o.maximumPacketSize);
+        }
+    }
+    p = writeString(p, o.clientId, clientIdLength);
+    if (o.willTopic != nullptr) {
+        if (v5) {
+            *p++ = 0;  // no will properties
+        }
+        p = writeString(p, o.willTopic, strlen(o.willTopic));
+        p = writeString(p, o.willPayload, o.willLength);
+    }
+    if (o.username != nullptr) {
+        p = writeString(p, o.username, strlen(o.username));
+        if (o.password != nullptr) {
+            p = writeString(p, o.password, strlen(o.password));
+        }
+    }
+    return p - buf;
+}
+
+size_t encodePublishHeader(uint8_t* buf, size_t cap, const char* topic, size_t topicLength,
+                           size_t payloadLength, uint8_t qos, bool retain, bool dup,
+                           uint16_t packetId, uint8_t protocolLevel, uint16_t topicAlias) {
+    bool v5 = protocolLevel == kProtocol5;
+    size_t propertiesLength = v5 && topicAlias > 0 ? 3 : 0;
+    size_t length = 2 + topicLength + (qos > 0 ? 2 : 0) + (v5 ? 1 + propertiesLength : 0) + payloadLength;
+    size_t headerLength = 1 + remainingLengthSize(length) + length - payloadLength;
+    if (headerLength > cap) {
+        return 0;
+    }
+    uint8_t header = (kPublish << 4) | ((qos & 0x03) << 1) | (retain ? 0x01 : 0x00) | (dup ? 0x08 : 0x00);
+    uint8_t* p = writeFixedHeader(buf, header, length);
+    p = writeString(p, topic, topicLength);
+    if (qos > 0) {
+        p = write16(p, packetId);
+    }
+    if (v5) {
+        *p++ = propertiesLength;
+        if (topicAlias > 0) {
+            *p++ = 0x23;
+            p = write16(p, topicAlias);
+        }
+    }
+    return p - buf;
+}
+
+size_t encodePuback(uint8_t* buf, size_t cap, uint16_t packetId) {
+    if (cap < 4) {
+        return 0;
+    }
+    uint8_t* p = writeFixedHeader(buf, kPuback << 4, 2);
+    p = write16(p, packetId);
+    return p - buf;
+}
+
+size_t encodeSubscribe(uint8_t* buf, size_t cap, uint16_t packetId, const char* topic, uint8_t qos,
+                       uint8_t protocolLevel) {
+    bool v5 = protocolLevel == kProtocol5;
+    size_t topicLength = strlen(topic);
+    size_t length = 2 + (v5 ? 1 : 0) + 2 + topicLength + 1;
+    if (1 + remainingLengthSize(length) + length > cap) {
+        return 0;
+    }
+    // SUBSCRIBE has reserved flags 0b0010
+    uint8_t* p = writeFixedHeader(buf, (kSubscribe << 4) | 0x02, length);
+    p = write16(p, packetId);
+    if (v5) {
+        *p++ = 0;  // no properties
+    }
+    p = writeString(p, topic, topicLength);
+    *p++ = qos & 0x03;
+    return p - buf;
+}
+
+size_t encodeEmpty(uint8_t* buf, size_t cap, PacketType type) {
+    if (cap < 2) {
+        return 0;
+    }
+    buf[0] = type << 4;
+    buf[1] = 0;
+    return 2;
+}
+
+bool parseConnack(const uint8_t* body, size_t length, uint8_t protocolLevel, Connack* out) {
+    memset(out, 0, sizeof(*out));
+    out->receiveMaximum = 65535;
+    out->retainAvailable = true;
+    if (length < 2) {
+        return false;
+    }
+    out->sessionPresent = body[0] & 0x01;
+    out->reasonCode = body[1];
+    // A 3.1.1 broker answering an MQTT 5 CONNECT sends a bare 3.1.1 CONNACK
+    if (protocolLevel != kProtocol5 || length == 2) {
+        return true;
+    }
+
+    uint32_t propertiesLength;
+    size_t used = readVarint(body + 2, length - 2, &propertiesLength);
+    if (used == 0 || 2 + used + propertiesLength > length) {
+        return false;
+    }
+    const uint8_t* p = body + 2 + used;
+    const uint8_t* end = p + propertiesLength;
+    while (p < end) {
+        uint8_t id = *p++;
+        size_t size = propertyValueSize(id, p, end - p);
+        if (size == 0) {
+            return false;
+        }
+        switch (id) {
+            case 0x13: out->serverKeepAliveS = read16(p); break;
+            case 0x21: out->receiveMaximum = read16(p); break;
+            case 0x22: out->topicAliasMaximum = read16(p); break;
+            case 0x25: out->retainAvailable = *p != 0; break;
+            default: break;
+        }
+        p += size;
+    }
+    return true;
+}
+
+size_t readVarint(const uint8_t* p, size_t length, uint32_t* value) {
+    uint32_t result = 0;
+    for (size_t i = 0; i < 4 && i < length; i++) {
+        result |= (uint32_t)(p[i] & 0x7F) << (7 * i);
+        if ((p[i] & 0x80) == 0) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+PacketReader::PacketReader(uint8_t* buffer, size_t capacity)
+    : buffer_(buffer), capacity_(capacity) {
+    reset();
+}
+
+void PacketReader::reset() {
+    state_ = kHeader;
+    header_ = 0;
+    lengthBytes_ = 0;
+    multiplier_ = 1;
+    remaining_ = 0;
+    received_ = 0;
+    overflowed_ = false;
+}
+
+size_t PacketReader::feed(const uint8_t* data, size_t length) {
+    size_t used = 0;
+    while (used < length && state_ != kDone) {
+        uint8_t b = data[used];
+        switch (state_) {
+            case kHeader:
+                header_ = b;
+                state_ = kLength;
+                used++;
+                break;
+            case kLength:
+                remaining_ += (b & 0x7F) * multiplier_;
+                multiplier_ *= 128;
+                used++;
+                if ((b & 0x80) == 0 || ++lengthBytes_ == 4) {
+                    overflowed_ = remaining_ > capacity_;
+                    state_ = remaining_ == 0 ? kDone : kBody;
+                }
+                break;
+            case kBody: {
+                size_t chunk = length - used;
+                if (chunk > remaining_ - received_) {
+                    chunk = remaining_ - received_;
+                }
+                if (!overflowed_) {
+                    memcpy(buffer_ + received_, data + used, chunk);
+                }
+                received_ += chunk;
+                used += chunk;
+                if (received_ == remaining_) {
+                    state_ = kDone;
+                }
+                break;
+            }
+            case kDone:
+                break;
+        }
+    }
+    return used;
+}
+
+}  // namespace mqtt
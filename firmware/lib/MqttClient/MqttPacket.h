@@ -0,0 +1,115 @@
+#ifndef MQTT_PACKET_H
+#define MQTT_PACKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MQTT 3.1.1 and 5 wire format: encoders that write into caller buffers and
+// an incremental reader that reassembles packets from arbitrary byte chunks.
+// Under MQTT 5 only the properties the client uses are written or parsed;
+// everything else is skipped over.
+namespace mqtt {
+
+const uint8_t kProtocol311 = 4;
+const uint8_t kProtocol5 = 5;
+
+enum PacketType : uint8_t {
+    kConnect = 1,
+    kConnack = 2,
+    kPublish = 3,
+    kPuback = 4,
+    kSubscribe = 8,
+    kSuback = 9,
+    kPingreq = 12,
+    kPingresp = 13,
+    kDisconnect = 14,
+};
+
+struct ConnectOptions {
+    const char* clientId;
+    const char* username;       // may be null
+    const char* password;       // may be null
+    uint16_t keepAliveS;
+    bool cleanSession;
+    const char* willTopic;      // may be null
+    const uint8_t* willPayload;
+    uint16_t willLength;
+    uint8_t willQos;
+    bool willRetain;
+    uint8_t protocolLevel;      // kProtocol311 or kProtocol5; 0 means 3.1.1
+    uint32_t maximumPacketSize; // MQTT 5: largest packet we can take, 0 = no limit
+};
+
+// What CONNACK granted. Under 3.1.1 only sessionPresent and reasonCode are set.
+struct Connack {
+    bool sessionPresent;
+    uint8_t reasonCode;         // 0 accepted; 3.1.1 return codes are 1-5, MQTT 5 ones >= 0x80
+    uint16_t topicAliasMaximum; // highest alias we may use, 0 = none
+    uint16_t receiveMaximum;    // QoS 1 messages the broker takes unacknowledged
+    bool retainAvailable;
+    uint16_t serverKeepAliveS;  // keep alive the broker imposes, 0 = ours stands
+};
+
+// MQTT 5 reason codes the client acts on
+const uint8_t kReasonUnsupportedProtocol = 0x84;
+
+// Each encoder returns the number of bytes written, or 0 if cap is too small.
+size_t encodeConnect(uint8_t* buf, size_t cap, const ConnectOptions& options);
+// Under MQTT 5 a non-zero topicAlias is sent as a property; with topicLength 0
+// the broker uses the topic it last saw with that alias.
+size_t encodePublishHeader(uint8_t* buf, size_t cap, const char* topic, size_t topicLength,
+                           size_t payloadLength, uint8_t qos, bool retain, bool dup,
+                           uint16_t packetId, uint8_t protocolLevel = kProtocol311,
+                           uint16_t topicAlias = 0);
+size_t encodePuback(uint8_t* buf, size_t cap, uint16_t packetId);
+size_t encodeSubscribe(uint8_t* buf, size_t cap, uint16_t packetId, const char* topic, uint8_t qos,
+                       uint8_t protocolLevel = kProtocol311);
+size_t encodeEmpty(uint8_t* buf, size_t cap, PacketType type);
+
+// Parses a CONNACK body; false if it is malformed.
+bool parseConnack(const uint8_t* body, size_t length, uint8_t protocolLevel, Connack* out);
+
+// Reads a variable byte integer (remaining length, property length). Returns
+// the bytes used, 0 if it runs past length or is longer than 4 bytes.
+size_t readVarint(const uint8_t* p, size_t length, uint32_t* value);
+
+// Reassembles one packet at a time into a fixed buffer. Packets larger than
+// the buffer are consumed and dropped; overflowed() reports it.
+class PacketReader {
+public:
+    PacketReader(uint8_t* buffer, size_t capacity);
+
+    // Consumes bytes until a packet is complete. Returns how many bytes of
+    // data were used; the caller feeds the rest after handling the packet.
+    size_t feed(const uint8_t* data, size_t length);
+
+    bool ready() const { return state_ == kDone; }
+    bool overflowed() const { return overflowed_; }
+    void reset();
+
+    uint8_t type() const { return header_ >> 4; }
+    uint8_t flags() const { return header_ & 0x0F; }
+    uint8_t* body() { return buffer_; }
+    size_t bodyLength() const { return remaining_; }
+
+private:
+    enum State : uint8_t { kHeader, kLength, kBody, kDone };
+
+    uint8_t* buffer_;
+    size_t capacity_;
+    State state_;
+    uint8_t header_;
+    uint8_t lengthBytes_;
+    uint32_t multiplier_;
+    size_t remaining_;
+    size_t received_;
+    bool overflowed_;
+};
+
+inline uint16_t read16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+}  // namespace mqtt
+
+#endif
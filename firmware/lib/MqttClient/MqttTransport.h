@@ -0,0 +1,57 @@
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte stream underneath MqttClient. Keeping it abstract lets the same client
+// run over WiFiClient or AsyncTCP on the ESP32 and over sockets on the host.
+//
+// Asynchronous transports return from connect() as soon as the attempt has
+// started and report connected() once it completes; write() must never block
+// and only accepts what writable() said would fit.
+class MqttTransport {
+public:
+    virtual ~MqttTransport() {}
+
+    virtual bool connect(const char* host, uint16_t port) = 0;
+    virtual bool connected() = 0;
+    // Bytes write() will accept right now without blocking.
+    virtual size_t writable() = 0;
+    // Returns the number of bytes accepted; less than length means failure.
+    virtual size_t write(const uint8_t* data, size_t length) = 0;
+    // Returns bytes read, 0 if nothing is available yet.
+    virtual size_t read(uint8_t* data, size_t length) = 0;
+    virtual void stop() = 0;
+    // Called from MqttClient::loop() so buffered transports can make progress.
+    virtual void poll() {}
+};
+
+#ifdef ARDUINO
+#include <Client.h>
+
+// Adapter for any blocking Arduino Client (WiFiClient, WiFiClientSecure...).
+class ArduinoClientTransport : public MqttTransport {
+public:
+    explicit ArduinoClientTransport(Client& client) : client_(client) {}
+
+    bool connect(const char* host, uint16_t port) override { return client_.connect(host, port); }
+    bool connected() override { return client_.connected(); }
+    size_t writable() override { return (size_t)-1; }
+    size_t write(const uint8_t* data, size_t length) override { return client_.write(data, length); }
+    size_t read(uint8_t* data, size_t length) override {
+        int available = client_.available();
+        if (available <= 0) {
+            return 0;
+        }
+        int n = client_.read(data, (size_t)available < length ? available : length);
+        return n > 0 ? n : 0;
+    }
+    void stop() override { client_.stop(); }
+
+private:
+    Client& client_;
+};
+#endif
+
+#endif
@@ -0,0 +1,352 @@
+#if defined(ESP32)
+
+#include "TlsTransport.h"
+
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <mbedtls/net_sockets.h>
+#include <string.h>
+
+namespace {
+
+const uint32_t kRtcSessionMagic = 0x544C5331;  // "TLS1"
+
+// Survives software resets and deep sleep, not power loss
+struct RtcSession {
+    uint32_t magic;
+    uint32_t key;
+    uint32_t check;
+    uint16_t length;
+    uint8_t data[MQTT_TLS_RTC_SESSION_SIZE];
+};
+RTC_NOINIT_ATTR RtcSession rtcSession;
+
+uint32_t fnv1a(const void* data, size_t length, uint32_t hash = 2166136261u) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t rtc_check() {
+    return fnv1a(rtcSession.data, rtcSession.length, rtcSession.key ^ rtcSession.length);
+}
+
+uint32_t free_heap() {
+    return heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+}  // namespace
+
+TlsTransport::TlsTransport(MqttTransport& inner)
+    : inner_(inner),
+      ready_(false),
+      resume_(false),
+      sessionValid_(false),
+      sessionKey_(0),
+      hostKey_(0),
+      phase_(kIdle),
+      offeredSession_(false),
+      sawCertificate_(false),
+      handshakeStartUs_(0),
+      handshakeCpuUs_(0),
+      heapBefore_(0),
+      heapMin_(0),
+      stats_() {
+    mbedtls_ssl_init(&ssl_);
+    mbedtls_ssl_config_init(&conf_);
+    mbedtls_ctr_drbg_init(&drbg_);
+    mbedtls_entropy_init(&entropy_);
+    mbedtls_x509_crt_init(&ca_);
+    mbedtls_ssl_session_init(&session_);
+}
+
+TlsTransport::~TlsTransport() {
+    mbedtls_ssl_session_free(&session_);
+    mbedtls_ssl_free(&ssl_);
+    mbedtls_ssl_config_free(&conf_);
+    mbedtls_x509_crt_free(&ca_);
+    mbedtls_ctr_drbg_free(&drbg_);
+    mbedtls_entropy_free(&entropy_);
+}
+
+bool TlsTransport::begin(const char* caPem, bool ecdsaOnly, bool resumeSessions) {
+    uint32_t heapStart = free_heap();
+    resume_ = resumeSessions;
+
+    int ret = mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_,
+                                    (const unsigned char*)"mqtt-tls", 8);
+    if (ret == 0) {
+        ret = mbedtls_ssl_config_defaults(&conf_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (ret == 0 && caPem != nullptr) {
+        ret = mbedtls_x509_crt_parse(&ca_, (const unsigned char*)caPem, strlen(caPem) + 1);
+    }
+    if (ret != 0) {
+        stats_.lastError = ret;
+        return false;
+    }
+
+    if (caPem != nullptr) {
+        mbedtls_ssl_conf_ca_chain(&conf_, &ca_, nullptr);
+        mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else {
+        mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_NONE);
+    }
+    mbedtls_ssl_conf_rng(&conf_, mbedtls_ctr_drbg_random, &drbg_);
+
+    if (ecdsaOnly) {
+        // P-256 ECDHE plus an ECDSA signature: two cheap scalar multiplications
+        // on the client instead of an RSA verify plus a full ECDHE on any curve
+        static const int suites[] = {MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256, 0};
+        static const mbedtls_ecp_group_id curves[] = {MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_NONE};
+        mbedtls_ssl_conf_ciphersuites(&conf_, suites);
+        mbedtls_ssl_conf_curves(&conf_, curves);
+    }
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&conf_, resume_ ? MBEDTLS_SSL_SESSION_TICKETS_ENABLED
+                                                     : MBEDTLS_SSL_SESSION_TICKETS_DISABLED);
+#endif
+
+    // Allocates the record buffers once, rather than on every reconnect
+    ret = mbedtls_ssl_setup(&ssl_, &conf_);
+    if (ret != 0) {
+        stats_.lastError = ret;
+        return false;
+    }
+    mbedtls_ssl_set_bio(&ssl_, this, &TlsTransport::bioSend, &TlsTransport::bioRecv, nullptr);
+    stats_.setupHeap = heapStart - free_heap();
+    ready_ = true;
+    return true;
+}
+
+bool TlsTransport::connect(const char* host, uint16_t port) {
+    stop();
+    if (!ready_ || mbedtls_ssl_session_reset(&ssl_) != 0 || mbedtls_ssl_set_hostname(&ssl_, host) != 0) {
+        return false;
+    }
+    hostKey_ = fnv1a(&port, sizeof(port), fnv1a(host, strlen(host)));
+    offeredSession_ = resume_ && restoreSession();
+    sawCertificate_ = false;
+    phase_ = kTcpPending;
+    return inner_.connect(host, port);
+}
+
+bool TlsTransport::connected() {
+    return phase_ == kOpen && inner_.connected();
+}
+
+size_t TlsTransport::writable() {
+    if (phase_ != kOpen) {
+        return 0;
+    }
+    // Room for one whole record, so write() never leaves one half sent
+    size_t room = inner_.writable();
+    int expansion = mbedtls_ssl_get_record_expansion(&ssl_);
+    if (expansion < 0 || room <= (size_t)expansion) {
+        return 0;
+    }
+    room -= expansion;
+    int maxPayload = mbedtls_ssl_get_max_out_record_payload(&ssl_);
+    if (maxPayload > 0 && room > (size_t)maxPayload) {
+        room = maxPayload;
+    }
+    return room;
+}
+
+size_t TlsTransport::write(const uint8_t* data, size_t length) {
+    if (phase_ != kOpen) {
+        return 0;
+    }
+    size_t written = 0;
+    while (written < length) {
+        int ret = mbedtls_ssl_write(&ssl_, data + written, length - written);
+        if (ret <= 0) {
+            // Including WANT_WRITE: mbedTLS would then expect the same bytes
+            // again, which MqttClient does not do, so the link is unusable
+            stats_.lastError = ret;
+            stop();
+            break;
+        }
+        written += ret;
+    }
+    return written;
+}
+
+size_t TlsTransport::read(uint8_t* data, size_t length) {
+    if (phase_ != kOpen) {
+        return 0;
+    }
+    int ret = mbedtls_ssl_read(&ssl_, data, length);
+    if (ret > 0) {
+        return ret;
+    }
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        // Close notify or a fatal alert
+        stats_.lastError = ret;
+        stop();
+    }
+    return 0;
+}
+
+void TlsTransport::stop() {
+    if (phase_ == kOpen) {
+        mbedtls_ssl_close_notify(&ssl_);
+        inner_.poll();
+    }
+    inner_.stop();
+    phase_ = kIdle;
+}
+
+void TlsTransport::poll() {
+    inner_.poll();
+    if (phase_ == kTcpPending && inner_.connected()) {
+        phase_ = kHandshake;
+        handshakeStartUs_ = esp_timer_get_time();
+        handshakeCpuUs_ = 0;
+        heapBefore_ = heapMin_ = free_heap();
+    }
+    if (phase_ == kHandshake) {
+        handshake();
+        // Push out whatever the last step produced (Finished, key exchange)
+        inner_.poll();
+    }
+}
+
+void TlsTransport::handshake() {
+    int64_t startUs = esp_timer_get_time();
+    int ret = 0;
+    // Step by step rather than mbedtls_ssl_handshake(), to see which states
+    // are visited: a resumed session jumps from ServerHello straight to the
+    // broker's ChangeCipherSpec, a full one goes through its Certificate
+    while (ssl_.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+        ret = mbedtls_ssl_handshake_step(&ssl_);
+        if (ssl_.state == MBEDTLS_SSL_SERVER_CERTIFICATE) {
+            sawCertificate_ = true;
+        }
+        sampleHeap();
+        if (ret != 0) {
+            break;
+        }
+    }
+    handshakeCpuUs_ += esp_timer_get_time() - startUs;
+
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return;
+    }
+    if (ret != 0) {
+        stats_.failedHandshakes++;
+        stats_.lastError = ret;
+        // Never offer a session again that a failed handshake was built on
+        if (offeredSession_) {
+            forgetSession();
+        }
+        inner_.stop();
+        phase_ = kIdle;
+        return;
+    }
+
+    bool resumed = offeredSession_ && !sawCertificate_;
+    uint32_t cpuMs = handshakeCpuUs_ / 1000;
+    stats_.lastResumed = resumed;
+    stats_.lastHandshakeMs = (esp_timer_get_time() - handshakeStartUs_) / 1000;
+    stats_.lastHandshakeCpuMs = cpuMs;
+    if (resumed) {
+        stats_.resumedHandshakes++;
+        stats_.resumedCpuMsMax = cpuMs > stats_.resumedCpuMsMax ? cpuMs : stats_.resumedCpuMsMax;
+    } else {
+        stats_.fullHandshakes++;
+        stats_.fullCpuMsMax = cpuMs > stats_.fullCpuMsMax ? cpuMs : stats_.fullCpuMsMax;
+    }
+    uint32_t heapUsed = heapBefore_ - heapMin_;
+    if (heapUsed > stats_.handshakeHeapMax) {
+        stats_.handshakeHeapMax = heapUsed;
+    }
+    if (resume_) {
+        saveSession();
+    }
+    phase_ = kOpen;
+}
+
+void TlsTransport::sampleHeap() {
+    uint32_t heap = free_heap();
+    if (heap < heapMin_) {
+        heapMin_ = heap;
+    }
+}
+
+bool TlsTransport::restoreSession() {
+    if (!sessionValid_ && rtcSession.magic == kRtcSessionMagic && rtcSession.key == hostKey_ &&
+        rtcSession.length <= sizeof(rtcSession.data) && rtcSession.check == rtc_check()) {
+        mbedtls_ssl_session_free(&session_);
+        mbedtls_ssl_session_init(&session_);
+        if (mbedtls_ssl_session_load(&session_, rtcSession.data, rtcSession.length) == 0) {
+            sessionValid_ = true;
+            sessionKey_ = hostKey_;
+            stats_.sessionBytes = rtcSession.length;
+            stats_.sessionInRtc = true;
+        }
+    }
+    return sessionValid_ && sessionKey_ == hostKey_ && mbedtls_ssl_set_session(&ssl_, &session_) == 0;
+}
+
+void TlsTransport::saveSession() {
+    mbedtls_ssl_session_free(&session_);
+    mbedtls_ssl_session_init(&session_);
+    sessionValid_ = mbedtls_ssl_get_session(&ssl_, &session_) == 0;
+    sessionKey_ = hostKey_;
+    if (!sessionValid_) {
+        return;
+    }
+    size_t length = 0;
+    int ret = mbedtls_ssl_session_save(&session_, rtcSession.data, sizeof(rtcSession.data), &length);
+    stats_.sessionBytes = length;
+    stats_.sessionInRtc = ret == 0;
+    if (ret == 0) {
+        rtcSession.length = length;
+        rtcSession.key = hostKey_;
+        rtcSession.check = rtc_check();
+        rtcSession.magic = kRtcSessionMagic;
+    } else {
+        // Too big (e.g. a long certificate chain kept with the session): RAM only
+        rtcSession.magic = 0;
+    }
+}
+
+void TlsTransport::forgetSession() {
+    mbedtls_ssl_session_free(&session_);
+    mbedtls_ssl_session_init(&session_);
+    sessionValid_ = false;
+    rtcSession.magic = 0;
+    stats_.sessionBytes = 0;
+    stats_.sessionInRtc = false;
+}
+
+int TlsTransport::bioSend(void* ctx, const unsigned char* data, size_t length) {
+    MqttTransport& inner = static_cast<TlsTransport*>(ctx)->inner_;
+    if (!inner.connected()) {
+        return MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    size_t room = inner.writable();
+    if (room == 0) {
+        return MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+    if (length > room) {
+        length = room;
+    }
+    return inner.write(data, length) == length ? (int)length : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+int TlsTransport::bioRecv(void* ctx, unsigned char* data, size_t length) {
+    MqttTransport& inner = static_cast<TlsTransport*>(ctx)->inner_;
+    size_t n = inner.read(data, length);
+    if (n > 0) {
+        return n;
+    }
+    return inner.connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+}
+
+#endif
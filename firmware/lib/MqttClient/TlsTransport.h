@@ -0,0 +1,103 @@
+#ifndef TLS_TRANSPORT_H
+#define TLS_TRANSPORT_H
+
+#if defined(ESP32)
+
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+
+#include "MqttTransport.h"
+
+#ifndef MQTT_TLS_RTC_SESSION_SIZE
+#define MQTT_TLS_RTC_SESSION_SIZE 2048  // serialized session kept across reboots
+#endif
+
+// TLS on top of another MqttTransport (normally AsyncTcpTransport), with
+// mbedTLS in non-blocking mode: poll() runs the handshake as far as the data
+// received allows and returns, and connected() only turns true once it is
+// done, so MqttClient sends CONNECT over an established TLS session.
+//
+// After each successful handshake the session (ID and ticket, if the broker
+// issues one) is kept in RAM and, when it fits, serialized into RTC memory,
+// which survives software resets and deep sleep. The next connect() to the
+// same host and port offers it; if the broker accepts, the handshake skips
+// the certificate and key exchange, which is where nearly all its CPU goes.
+// A broker that does not accept it simply gets a full handshake.
+//
+// Written against mbedTLS 2.x as shipped with the Arduino ESP32 core 2.x.
+class TlsTransport : public MqttTransport {
+public:
+    struct Stats {
+        uint32_t fullHandshakes;
+        uint32_t resumedHandshakes;
+        uint32_t failedHandshakes;
+        int lastError;                // mbedTLS code of the last failure
+        bool lastResumed;
+        uint32_t lastHandshakeMs;     // TCP connected to handshake done
+        uint32_t lastHandshakeCpuMs;  // of which spent inside mbedTLS
+        uint32_t fullCpuMsMax;
+        uint32_t resumedCpuMsMax;
+        uint32_t handshakeHeapMax;    // heap one handshake took, sampled per step
+        uint32_t setupHeap;           // held for good by begin() (record buffers)
+        uint16_t sessionBytes;        // serialized session size, 0 if none yet
+        bool sessionInRtc;
+    };
+
+    explicit TlsTransport(MqttTransport& inner);
+    ~TlsTransport();
+
+    // Call once before connect(). caPem null accepts any certificate, for
+    // testing only. ecdsaOnly offers just ECDHE-ECDSA on P-256, the cheapest
+    // handshake for the ESP32, which needs the broker to have an ECDSA key.
+    bool begin(const char* caPem, bool ecdsaOnly, bool resumeSessions);
+
+    bool connect(const char* host, uint16_t port) override;
+    bool connected() override;
+    size_t writable() override;
+    size_t write(const uint8_t* data, size_t length) override;
+    size_t read(uint8_t* data, size_t length) override;
+    void stop() override;
+    void poll() override;
+
+    // Drops the cached session so the next handshake is a full one.
+    void forgetSession();
+    Stats stats() const { return stats_; }
+
+private:
+    enum Phase : uint8_t { kIdle, kTcpPending, kHandshake, kOpen };
+
+    static int bioSend(void* ctx, const unsigned char* data, size_t length);
+    static int bioRecv(void* ctx, unsigned char* data, size_t length);
+
+    void handshake();
+    bool restoreSession();
+    void saveSession();
+    void sampleHeap();
+
+    MqttTransport& inner_;
+    mbedtls_ssl_context ssl_;
+    mbedtls_ssl_config conf_;
+    mbedtls_ctr_drbg_context drbg_;
+    mbedtls_entropy_context entropy_;
+    mbedtls_x509_crt ca_;
+    mbedtls_ssl_session session_;
+    bool ready_;
+    bool resume_;
+    bool sessionValid_;
+    uint32_t sessionKey_;
+    uint32_t hostKey_;
+    Phase phase_;
+    bool offeredSession_;
+    bool sawCertificate_;
+    int64_t handshakeStartUs_;
+    int64_t handshakeCpuUs_;
+    uint32_t heapBefore_;
+    uint32_t heapMin_;
+    Stats stats_;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef FLASH_DEVICE_H
+#define FLASH_DEVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// NOR flash region: erase works on whole sectors (to 0xFF) and writes can only
+// clear bits. Addresses are relative to the start of the region.
+class FlashDevice {
+public:
+    virtual ~FlashDevice() {}
+
+    virtual uint32_t size() const = 0;
+    virtual uint32_t sectorSize() const = 0;
+    virtual bool read(uint32_t address, void* data, size_t length) = 0;
+    virtual bool write(uint32_t address, const void* data, size_t length) = 0;
+    virtual bool eraseSector(uint32_t address) = 0;
+};
+
+#if defined(ESP32) || defined(VIRTUAL_ESP32)
+#include <esp_partition.h>
+
+// A data partition from partitions.csv, found by label.
+class PartitionFlash : public FlashDevice {
+public:
+    explicit PartitionFlash(const char* label)
+        : partition_(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label)) {}
+
+    bool valid() const { return partition_ != nullptr; }
+    uint32_t size() const override { return partition_ != nullptr ? partition_->size : 0; }
+    uint32_t sectorSize() const override { return SPI_FLASH_SEC_SIZE; }
+    bool read(uint32_t address, void* data, size_t length) override {
+        return esp_partition_read(partition_, address, data, length) == ESP_OK;
+    }
+    bool write(uint32_t address, const void* data, size_t length) override {
+        return esp_partition_write(partition_, address, data, length) == ESP_OK;
+    }
+    bool eraseSector(uint32_t address) override {
+        return esp_partition_erase_range(partition_, address, SPI_FLASH_SEC_SIZE) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t* partition_;
+};
+#endif
+
+#endif
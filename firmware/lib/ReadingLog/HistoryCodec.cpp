@@ -0,0 +1,128 @@
+#include "HistoryCodec.h"
+
+#include <string.h>
+
+namespace history {
+
+namespace {
+
+size_t putVarint(uint8_t* out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            return false;
+        }
+        uint8_t byte = *p++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+void put(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+uint64_t get(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+}  // namespace
+
+size_t encodeChunk(uint8_t* out, size_t capacity, const LogRecord* records, size_t count,
+                   uint32_t nextCursor, bool last) {
+    if (capacity < maxChunkSize(count) || count > 0xFFFF) {
+        return 0;
+    }
+    int64_t baseMs = count > 0 ? records[0].timestampMs : 0;
+    out[0] = kVersion;
+    out[1] = last ? kLastChunk : 0;
+    put(out + 2, count, 2);
+    put(out + 4, nextCursor, 4);
+    put(out + 8, (uint64_t)baseMs, 8);
+
+    size_t n = kHeaderSize;
+    int64_t previousMs = baseMs;
+    int32_t previousTemp = 0;
+    int32_t previousHum = 0;
+    for (size_t i = 0; i < count; i++) {
+        const LogRecord& record = records[i];
+        // Records are in log order, which is time order once synced
+        uint64_t deltaMs = record.timestampMs > previousMs ? (uint64_t)(record.timestampMs - previousMs) : 0;
+        n += putVarint(out + n, deltaMs);
+        n += putVarint(out + n, zigzag(record.temperatureCenti - previousTemp));
+        n += putVarint(out + n, zigzag((int32_t)record.humidityCenti - previousHum));
+        out[n++] = (uint8_t)record.rssi;
+        previousMs += deltaMs;
+        previousTemp = record.temperatureCenti;
+        previousHum = record.humidityCenti;
+    }
+    return n;
+}
+
+int decodeChunk(const uint8_t* data, size_t length, ChunkHeader* header, LogRecord* out, size_t max) {
+    if (length < kHeaderSize || data[0] != kVersion) {
+        return -1;
+    }
+    header->flags = data[1];
+    header->count = (uint16_t)get(data + 2, 2);
+    header->nextCursor = (uint32_t)get(data + 4, 4);
+    header->baseMs = (int64_t)get(data + 8, 8);
+
+    const uint8_t* p = data + kHeaderSize;
+    const uint8_t* end = data + length;
+    int64_t timestampMs = header->baseMs;
+    int32_t temp = 0;
+    int32_t hum = 0;
+    size_t decoded = 0;
+    for (size_t i = 0; i < header->count; i++) {
+        uint64_t deltaMs, tempDelta, humDelta;
+        if (!getVarint(p, end, &deltaMs) || !getVarint(p, end, &tempDelta) || !getVarint(p, end, &humDelta) ||
+            p == end) {
+            return -1;
+        }
+        timestampMs += (int64_t)deltaMs;
+        temp += unzigzag((uint32_t)tempDelta);
+        hum += unzigzag((uint32_t)humDelta);
+        int8_t rssi = (int8_t)*p++;
+        if (decoded < max) {
+            LogRecord& record = out[decoded++];
+            memset(&record, 0, sizeof(record));
+            record.timestampMs = timestampMs;
+            record.temperatureCenti = (int16_t)temp;
+            record.humidityCenti = (uint16_t)hum;
+            record.rssi = rssi;
+            record.flags = LogRecord::kTimeSynced;
+        }
+    }
+    return p == end ? (int)decoded : -1;
+}
+
+}  // namespace history
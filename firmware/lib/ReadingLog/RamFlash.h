@@ -0,0 +1,75 @@
+#ifndef RAM_FLASH_H
+#define RAM_FLASH_H
+
+#include <string.h>
+
+#include "FlashDevice.h"
+
+// FlashDevice over a caller-provided buffer, for running ReadingLog on the
+// host. It keeps NOR rules (writes can only clear bits, erase sets a whole
+// sector to 0xFF) and counts traffic so the cost of a query can be measured.
+class RamFlash : public FlashDevice {
+public:
+    struct Stats {
+        uint32_t reads;
+        uint64_t bytesRead;
+        uint32_t writes;
+        uint64_t bytesWritten;
+        uint32_t erases;
+        uint32_t bitsRaised;    // writes that tried to turn a 0 back into a 1
+    };
+
+    RamFlash(uint8_t* memory, uint32_t size, uint32_t sectorSize = 4096)
+        : memory_(memory), size_(size), sectorSize_(sectorSize), stats_() {
+        memset(memory_, 0xFF, size_);
+    }
+
+    uint32_t size() const override { return size_; }
+    uint32_t sectorSize() const override { return sectorSize_; }
+
+    bool read(uint32_t address, void* data, size_t length) override {
+        if (address + length > size_) {
+            return false;
+        }
+        memcpy(data, memory_ + address, length);
+        stats_.reads++;
+        stats_.bytesRead += length;
+        return true;
+    }
+
+    bool write(uint32_t address, const void* data, size_t length) override {
+        if (address + length > size_) {
+            return false;
+        }
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < length; i++) {
+            if (bytes[i] & ~memory_[address + i]) {
+                stats_.bitsRaised++;
+            }
+            memory_[address + i] &= bytes[i];
+        }
+        stats_.writes++;
+        stats_.bytesWritten += length;
+        return true;
+    }
+
+    bool eraseSector(uint32_t address) override {
+        if (address % sectorSize_ != 0 || address >= size_) {
+            return false;
+        }
+        memset(memory_ + address, 0xFF, sectorSize_);
+        stats_.erases++;
+        return true;
+    }
+
+    const Stats& stats() const { return stats_; }
+    void resetStats() { memset(&stats_, 0, sizeof(stats_)); }
+
+private:
+    uint8_t* memory_;
+    uint32_t size_;
+    uint32_t sectorSize_;
+    Stats stats_;
+};
+
+#endif
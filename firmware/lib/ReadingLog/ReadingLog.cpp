@@ -0,0 +1,356 @@
+#include "ReadingLog.h"
+
+#include <string.h>
+
+namespace {
+
+const uint32_t kSectorMagic = 0x52474C32;  // "RGL2"
+const uint32_t kMaxSkipsPerRead = 64;
+
+bool isErased(const void* data, size_t length) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < length; i++) {
+        if (p[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint16_t recordChecksum(const LogRecord& record) {
+    return ReadingLog::checksum(&record, offsetof(LogRecord, check));
+}
+
+uint16_t summaryChecksum(const SegmentSummary& summary) {
+    return ReadingLog::checksum(&summary, offsetof(SegmentSummary, check));
+}
+
+}  // namespace
+
+void SegmentSummary::clear() {
+    memset(this, 0, sizeof(*this));
+    firstMs = INT64_MAX;
+    lastMs = INT64_MIN;
+    temperatureMin = INT16_MAX;
+    temperatureMax = INT16_MIN;
+    humidityMin = UINT16_MAX;
+    humidityMax = 0;
+}
+
+void SegmentSummary::add(const LogRecord& record) {
+    if ((record.flags & LogRecord::kTimeSynced) == 0) {
+        return;
+    }
+    count++;
+    temperatureSum += record.temperatureCenti;
+    humiditySum += record.humidityCenti;
+    if (record.timestampMs < firstMs) firstMs = record.timestampMs;
+    if (record.timestampMs > lastMs) lastMs = record.timestampMs;
+    if (record.temperatureCenti < temperatureMin) temperatureMin = record.temperatureCenti;
+    if (record.temperatureCenti > temperatureMax) temperatureMax = record.temperatureCenti;
+    if (record.humidityCenti < humidityMin) humidityMin = record.humidityCenti;
+    if (record.humidityCenti > humidityMax) humidityMax = record.humidityCenti;
+}
+
+ReadingLog::ReadingLog(FlashDevice& flash)
+    : flash_(flash),
+      sectorCount_(0),
+      perSector_(0),
+      physicalOffset_(0),
+      firstSeq_(0),
+      nextSeq_(0),
+      headerWritten_(false) {
+    open_.clear();
+}
+
+uint16_t ReadingLog::checksum(const void* data, size_t length) {
+    // Fletcher-16
+    const uint8_t* p = (const uint8_t*)data;
+    uint16_t a = 0, b = 0;
+    for (size_t i = 0; i < length; i++) {
+        a = (a + p[i]) % 255;
+        b = (b + a) % 255;
+    }
+    return (uint16_t)((b << 8) | a);
+}
+
+uint32_t ReadingLog::sectorAddress(uint32_t sectorSeq) const {
+    return ((sectorSeq + physicalOffset_) % sectorCount_) * flash_.sectorSize();
+}
+
+uint32_t ReadingLog::recordAddress(uint32_t seq) const {
+    return sectorAddress(seq / perSector_) + sizeof(SectorHeader) + (seq % perSector_) * sizeof(LogRecord);
+}
+
+bool ReadingLog::readHeader(uint32_t index, SectorHeader* header) {
+    return flash_.read(index * flash_.sectorSize(), header, sizeof(*header)) && header->magic == kSectorMagic;
+}
+
+bool ReadingLog::readSummary(uint32_t sectorSeq, SegmentSummary* out) {
+    if (sectorSeq == nextSeq_ / perSector_) {
+        *out = open_;
+        return true;
+    }
+    return flash_.read(sectorAddress(sectorSeq) + offsetof(SectorHeader, summary), out, sizeof(*out)) &&
+           out->check == summaryChecksum(*out);
+}
+
+bool ReadingLog::scanSector(uint32_t sectorSeq, SegmentSummary* out, uint32_t* used) {
+    // Records are written in order, so the first erased slot ends the sector
+    out->clear();
+    uint32_t base = sectorAddress(sectorSeq) + sizeof(SectorHeader);
+    uint32_t slot = 0;
+    for (; slot < perSector_; slot++) {
+        LogRecord record;
+        if (!flash_.read(base + slot * sizeof(LogRecord), &record, sizeof(record))) {
+            return false;
+        }
+        if (isErased(&record, sizeof(record))) {
+            break;
+        }
+        if (record.check == recordChecksum(record)) {
+            out->add(record);
+        }
+    }
+    *used = slot;
+    return true;
+}
+
+bool ReadingLog::seal(uint32_t sectorSeq, SegmentSummary summary) {
+    // Programming over an existing summary would corrupt it, so only once
+    uint32_t address = sectorAddress(sectorSeq) + offsetof(SectorHeader, summary);
+    SegmentSummary current;
+    if (!flash_.read(address, &current, sizeof(current))) {
+        return false;
+    }
+    if (!isErased(&current, sizeof(current))) {
+        return true;
+    }
+    summary.check = summaryChecksum(summary);
+    return flash_.write(address, &summary, sizeof(summary));
+}
+
+bool ReadingLog::begin() {
+    static_assert(sizeof(SectorHeader) % sizeof(LogRecord) == 0, "header must fill whole record slots");
+    sectorCount_ = flash_.size() / flash_.sectorSize();
+    perSector_ = (flash_.sectorSize() - sizeof(SectorHeader)) / sizeof(LogRecord);
+    if (sectorCount_ < 2) {
+        return false;
+    }
+
+    bool found = false;
+    uint32_t newestSeq = 0, newestIndex = 0, oldestSeq = 0;
+    for (uint32_t i = 0; i < sectorCount_; i++) {
+        SectorHeader header;
+        if (!readHeader(i, &header)) {
+            continue;
+        }
+        if (!found || header.sectorSeq > newestSeq) {
+            newestSeq = header.sectorSeq;
+            newestIndex = i;
+        }
+        if (!found || header.sectorSeq < oldestSeq) {
+            oldestSeq = header.sectorSeq;
+        }
+        found = true;
+    }
+
+    open_.clear();
+    if (!found) {
+        physicalOffset_ = 0;
+        firstSeq_ = nextSeq_ = 0;
+        headerWritten_ = false;
+        return true;
+    }
+
+    physicalOffset_ = (newestIndex + sectorCount_ - newestSeq % sectorCount_) % sectorCount_;
+    firstSeq_ = oldestSeq * perSector_;
+    headerWritten_ = true;
+
+    uint32_t used;
+    if (!scanSector(newestSeq, &open_, &used)) {
+        return false;
+    }
+    nextSeq_ = newestSeq * perSector_ + used;
+    if (used == perSector_) {
+        seal(newestSeq, open_);
+        open_.clear();
+    }
+
+    // A power cut between filling a sector and sealing it leaves it without
+    // a summary; rebuild those from their records
+    for (uint32_t sectorSeq = oldestSeq; sectorSeq < newestSeq; sectorSeq++) {
+        SectorHeader header;
+        uint32_t index = (sectorSeq + physicalOffset_) % sectorCount_;
+        if (!readHeader(index, &header) || header.sectorSeq != sectorSeq) {
+            continue;
+        }
+        SegmentSummary rebuilt;
+        if (isErased(&header.summary, sizeof(header.summary)) && scanSector(sectorSeq, &rebuilt, &used)) {
+            seal(sectorSeq, rebuilt);
+        }
+    }
+    return true;
+}
+
+bool ReadingLog::startSector(uint32_t sectorSeq) {
+    if (headerWritten_ && sectorSeq > 0 && !seal(sectorSeq - 1, open_)) {
+        return false;
+    }
+    open_.clear();
+
+    uint32_t address = sectorAddress(sectorSeq);
+    if (!flash_.eraseSector(address)) {
+        return false;
+    }
+    // The erased sector may have held the oldest data
+    uint32_t lost = (sectorSeq + 1 > sectorCount_) ? (sectorSeq + 1 - sectorCount_) * perSector_ : 0;
+    if (firstSeq_ < lost) {
+        firstSeq_ = lost;
+    }
+    uint32_t start[2] = {kSectorMagic, sectorSeq};
+    return flash_.write(address, start, sizeof(start));
+}
+
+bool ReadingLog::append(LogRecord record) {
+    if (sectorCount_ == 0) {
+        return false;
+    }
+    uint32_t sectorSeq = nextSeq_ / perSector_;
+    uint32_t slot = nextSeq_ % perSector_;
+    if (slot == 0 || !headerWritten_) {
+        if (!startSector(sectorSeq)) {
+            return false;
+        }
+        headerWritten_ = true;
+    }
+    record.check = recordChecksum(record);
+    if (!flash_.write(recordAddress(nextSeq_), &record, sizeof(record))) {
+        return false;
+    }
+    open_.add(record);
+    nextSeq_++;
+    return true;
+}
+
+bool ReadingLog::read(uint32_t seq, LogRecord* record) {
+    if (seq < firstSeq_ || seq >= nextSeq_) {
+        return false;
+    }
+    return flash_.read(recordAddress(seq), record, sizeof(*record)) && record->check == recordChecksum(*record);
+}
+
+bool ReadingLog::summary(uint32_t seq, SegmentSummary* out) {
+    if (seq < firstSeq_ || seq >= nextSeq_) {
+        return false;
+    }
+    return readSummary(seq / perSector_, out);
+}
+
+uint32_t ReadingLog::seek(int64_t fromMs) {
+    if (nextSeq_ == firstSeq_) {
+        return firstSeq_;
+    }
+    uint32_t low = firstSeq_ / perSector_;
+    uint32_t high = (nextSeq_ - 1) / perSector_;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        SegmentSummary summary;
+        if (readSummary(middle, &summary) && summary.count > 0 && summary.lastMs < fromMs) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    uint32_t cursor = low * perSector_;
+    return cursor > firstSeq_ ? cursor : firstSeq_;
+}
+
+size_t ReadingLog::readRange(uint32_t* cursor, uint32_t endSeq, int64_t fromMs, int64_t toMs, LogRecord* out,
+                             size_t max) {
+    if (*cursor < firstSeq_) {
+        *cursor = firstSeq_;
+    }
+    if (endSeq > nextSeq_) {
+        endSeq = nextSeq_;
+    }
+
+    // Skip whole sectors the index says hold nothing in range. A summary that
+    // fails its check is not trusted and the sector is scanned.
+    for (uint32_t skips = 0; *cursor < endSeq && skips < kMaxSkipsPerRead; skips++) {
+        SegmentSummary summary;
+        if (!readSummary(*cursor / perSector_, &summary) || summary.overlaps(fromMs, toMs)) {
+            break;
+        }
+        if (summary.count > 0 && summary.firstMs >= toMs) {
+            *cursor = endSeq;
+            break;
+        }
+        *cursor = (*cursor / perSector_ + 1) * perSector_;
+    }
+    if (*cursor > endSeq) {
+        *cursor = endSeq;
+    }
+
+    size_t copied = 0;
+    uint32_t sectorEnd = (*cursor / perSector_ + 1) * perSector_;
+    while (copied < max && *cursor < endSeq && *cursor < sectorEnd) {
+        LogRecord record;
+        bool ok = read(*cursor, &record);
+        (*cursor)++;
+        if (ok && (record.flags & LogRecord::kTimeSynced) && record.timestampMs >= fromMs &&
+            record.timestampMs < toMs) {
+            out[copied++] = record;
+        }
+    }
+    return copied;
+}
+
+void ReadingLog::aggregate(int64_t fromMs, int64_t toMs, RangeAggregate* out) {
+    SegmentSummary total;
+    total.clear();
+    out->count = 0;
+    out->temperatureSum = 0;
+    out->humiditySum = 0;
+
+    for (uint32_t sectorSeq = seek(fromMs) / perSector_; sectorSeq * perSector_ < nextSeq_; sectorSeq++) {
+        SegmentSummary summary;
+        bool indexed = readSummary(sectorSeq, &summary);
+        if (indexed && summary.count > 0 && summary.firstMs >= toMs) {
+            break;
+        }
+        if (indexed && !summary.overlaps(fromMs, toMs)) {
+            continue;
+        }
+        if (!indexed || !summary.within(fromMs, toMs)) {
+            // Straddles an end of the range: look at the records themselves
+            summary.clear();
+            uint32_t end = (sectorSeq + 1) * perSector_;
+            for (uint32_t seq = sectorSeq * perSector_; seq < end && seq < nextSeq_; seq++) {
+                LogRecord record;
+                if (read(seq, &record) && record.timestampMs >= fromMs && record.timestampMs < toMs) {
+                    summary.add(record);
+                }
+            }
+            if (summary.count == 0) {
+                continue;
+            }
+        }
+        out->count += summary.count;
+        out->temperatureSum += summary.temperatureSum;
+        out->humiditySum += summary.humiditySum;
+        if (summary.firstMs < total.firstMs) total.firstMs = summary.firstMs;
+        if (summary.lastMs > total.lastMs) total.lastMs = summary.lastMs;
+        if (summary.temperatureMin < total.temperatureMin) total.temperatureMin = summary.temperatureMin;
+        if (summary.temperatureMax > total.temperatureMax) total.temperatureMax = summary.temperatureMax;
+        if (summary.humidityMin < total.humidityMin) total.humidityMin = summary.humidityMin;
+        if (summary.humidityMax > total.humidityMax) total.humidityMax = summary.humidityMax;
+    }
+
+    out->firstMs = total.firstMs;
+    out->lastMs = total.lastMs;
+    out->temperatureMin = total.temperatureMin;
+    out->temperatureMax = total.temperatureMax;
+    out->humidityMin = total.humidityMin;
+    out->humidityMax = total.humidityMax;
+}
@@ -0,0 +1,140 @@
+#ifndef READING_LOG_H
+#define READING_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FlashDevice.h"
+
+// One stored reading, 16 bytes so a 4 KB sector holds a header plus 253.
+struct LogRecord {
+    int64_t timestampMs;
+    int16_t temperatureCenti;   // °C * 100
+    uint16_t humidityCenti;     // %RH * 100
+    int8_t rssi;
+    uint8_t flags;
+    uint16_t check;             // detects records torn by a power cut
+
+    static const uint8_t kTimeSynced = 0x01;
+};
+
+// Sparse index entry: what one sector holds, counting time-synced readings
+// only. firstMs/lastMs are the smallest and largest timestamps.
+struct SegmentSummary {
+    int64_t firstMs;
+    int64_t lastMs;
+    int32_t temperatureSum;
+    int32_t humiditySum;
+    uint16_t count;
+    int16_t temperatureMin;
+    int16_t temperatureMax;
+    uint16_t humidityMin;
+    uint16_t humidityMax;
+    uint16_t check;
+    uint32_t reserved;
+
+    void clear();
+    void add(const LogRecord& record);
+    bool overlaps(int64_t fromMs, int64_t toMs) const {
+        return count > 0 && firstMs < toMs && lastMs >= fromMs;
+    }
+    bool within(int64_t fromMs, int64_t toMs) const {
+        return count > 0 && firstMs >= fromMs && lastMs < toMs;
+    }
+};
+
+// Result of ReadingLog::aggregate()
+struct RangeAggregate {
+    uint32_t count;
+    int64_t firstMs;
+    int64_t lastMs;
+    int64_t temperatureSum;
+    int64_t humiditySum;
+    int16_t temperatureMin;
+    int16_t temperatureMax;
+    uint16_t humidityMin;
+    uint16_t humidityMax;
+};
+
+// Append-only circular log of readings on a FlashDevice.
+//
+// Sectors are filled in turn; each starts with a header carrying a sector
+// sequence number, and when the log wraps the oldest sector is erased. Every
+// record therefore has a stable global sequence number (sector sequence *
+// records per sector + slot) that is used as a resumable cursor: it keeps
+// pointing at the same reading until that reading is overwritten.
+//
+// When a sector fills up its SegmentSummary is programmed into the erased
+// tail of its header, so the index costs no extra flash page or erase and
+// disappears together with the data it describes. The open sector's summary
+// lives in RAM. Range queries and aggregates read the 48-byte headers and
+// only touch records in sectors that straddle the range.
+class ReadingLog {
+public:
+    explicit ReadingLog(FlashDevice& flash);
+
+    // Scans sector headers to find the oldest and newest data, and seals
+    // sectors a power cut left without a summary.
+    bool begin();
+
+    bool append(LogRecord record);
+
+    // Oldest readable sequence number and the one the next append gets.
+    uint32_t firstSeq() const { return firstSeq_; }
+    uint32_t nextSeq() const { return nextSeq_; }
+    uint32_t recordsPerSector() const { return perSector_; }
+
+    bool read(uint32_t seq, LogRecord* record);
+
+    // Summary of the sector holding seq; false if that sector is gone.
+    bool summary(uint32_t seq, SegmentSummary* out);
+
+    // Cursor of the first sector that may hold readings at or after fromMs,
+    // by binary search over the summaries. Relies on synced timestamps only
+    // moving forward (EpochClock never steps back); sectors without synced
+    // readings are treated as a possible match, so it never skips data.
+    uint32_t seek(int64_t fromMs);
+
+    // Copies up to max records with fromMs <= timestamp < toMs, from *cursor
+    // up to endSeq, and advances *cursor past everything it looked at.
+    // Records taken before the first time sync are skipped since their
+    // timestamps are not wall-clock. Sectors outside the range are skipped
+    // on their summary alone, and a sector that starts after toMs ends the
+    // range (same time-order assumption as seek()); at most one sector's
+    // worth of records is read per call, so callers in loop() stay
+    // responsive. Returns the number of records copied.
+    size_t readRange(uint32_t* cursor, uint32_t endSeq, int64_t fromMs, int64_t toMs, LogRecord* out, size_t max);
+
+    // Count, sums and extremes over fromMs <= timestamp < toMs. Sectors fully
+    // inside the range are answered from their summaries; only the ones at
+    // either end are read record by record.
+    void aggregate(int64_t fromMs, int64_t toMs, RangeAggregate* out);
+
+    static uint16_t checksum(const void* data, size_t length);
+
+private:
+    struct SectorHeader {
+        uint32_t magic;
+        uint32_t sectorSeq;
+        SegmentSummary summary;     // erased until the sector is sealed
+    };
+
+    uint32_t sectorAddress(uint32_t sectorSeq) const;
+    uint32_t recordAddress(uint32_t seq) const;
+    bool readHeader(uint32_t index, SectorHeader* header);
+    bool readSummary(uint32_t sectorSeq, SegmentSummary* out);
+    bool scanSector(uint32_t sectorSeq, SegmentSummary* out, uint32_t* used);
+    bool seal(uint32_t sectorSeq, SegmentSummary summary);
+    bool startSector(uint32_t sectorSeq);
+
+    FlashDevice& flash_;
+    uint32_t sectorCount_;
+    uint32_t perSector_;
+    uint32_t physicalOffset_;   // physical index of sector sequence 0, mod count
+    uint32_t firstSeq_;
+    uint32_t nextSeq_;
+    bool headerWritten_;
+    SegmentSummary open_;       // summary of the sector being appended to
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include "RuntimeConfig.h"
+
+#include <string.h>
+
+namespace {
+
+const uint32_t kMagic = 0x43464731;  // "CFG1"
+
+struct StoredHeader {
+    uint32_t magic;
+    uint16_t schema;
+    uint16_t size;          // sizeof(DeviceConfig) when it was written
+    uint32_t revision;
+    uint32_t crc;           // over the config bytes that follow
+};
+
+enum FieldType : uint8_t { kU32, kU8, kF32 };
+
+struct Field {
+    const char* name;
+    uint16_t offset;
+    FieldType type;
+    float min;
+    float max;
+};
+
+#define CONFIG_FIELD(name, member, type, min, max) \
+    { name, (uint16_t)offsetof(DeviceConfig, member), type, min, max }
+
+const Field fields[] = {
+    CONFIG_FIELD("sample_min_ms", sampleMinMs, kU32, 2000, 3600000),
+    CONFIG_FIELD("sample_max_ms", sampleMaxMs, kU32, 2000, 86400000),
+    CONFIG_FIELD("temp_rate_enter", tempRateEnter, kF32, 0.0f, 10.0f),
+    CONFIG_FIELD("temp_rate_exit", tempRateExit, kF32, 0.0f, 10.0f),
+    CONFIG_FIELD("hum_rate_enter", humRateEnter, kF32, 0.0f, 50.0f),
+    CONFIG_FIELD("hum_rate_exit", humRateExit, kF32, 0.0f, 50.0f),
+    CONFIG_FIELD("alert_temp_min", alertTempMin, kF32, -40.0f, 80.0f),
+    CONFIG_FIELD("alert_temp_max", alertTempMax, kF32, -40.0f, 80.0f),
+    CONFIG_FIELD("alert_hum_min", alertHumMin, kF32, 0.0f, 100.0f),
+    CONFIG_FIELD("alert_hum_max", alertHumMax, kF32, 0.0f, 100.0f),
+    CONFIG_FIELD("alert_z_enter", alertZEnter, kF32, 1.0f, 20.0f),
+    CONFIG_FIELD("inflight_window", inflightWindow, kU8, 1, 32),
+    CONFIG_FIELD("log_level", logLevel, kU8, 0, 3),
+    CONFIG_FIELD("backlog_points", backlogPoints, kU32, 10, 100000),
+    CONFIG_FIELD("backlog_method", backlogMethod, kU8, 0, 2),
+};
+
+const size_t fieldCount = sizeof(fields) / sizeof(fields[0]);
+
+// double holds every uint32_t exactly, so one accessor serves all types
+double readField(const DeviceConfig& config, const Field& f) {
+    const uint8_t* p = (const uint8_t*)&config + f.offset;
+    switch (f.type) {
+        case kU32: { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+        case kU8: return *p;
+        case kF32: { float v; memcpy(&v, p, sizeof(v)); return v; }
+    }
+    return 0.0;
+}
+
+}  // namespace
+
+uint32_t crc32(const void* data, size_t length, uint32_t crc) {
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    while (length--) {
+        crc ^= *p++;
+        for (uint8_t k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+#if defined(ESP32) || defined(VIRTUAL_ESP32)
+size_t NvsConfigStore::read(void* buffer, size_t capacity) {
+    if (!preferences_.begin(namespace_, true)) {
+        return 0;
+    }
+    size_t length = preferences_.getBytesLength("block");
+    if (length > capacity) {
+        length = 0;
+    } else if (length > 0) {
+        length = preferences_.getBytes("block", buffer, capacity);
+    }
+    preferences_.end();
+    return length;
+}
+
+bool NvsConfigStore::write(const void* data, size_t length) {
+    if (!preferences_.begin(namespace_, false)) {
+        return false;
+    }
+    bool ok = preferences_.putBytes("block", data, length) == length;
+    preferences_.end();
+    return ok;
+}
+
+bool NvsConfigStore::erase() {
+    if (!preferences_.begin(namespace_, false)) {
+        return false;
+    }
+    bool ok = preferences_.clear();
+    preferences_.end();
+    return ok;
+}
+#endif
+
+RuntimeConfig::RuntimeConfig(ConfigStore& store, const DeviceConfig& defaults)
+    : store_(store), defaults_(defaults), current_(defaults), revision_(0), apply_(nullptr) {}
+
+bool RuntimeConfig::load() {
+    uint8_t buffer[sizeof(StoredHeader) + sizeof(DeviceConfig) + 64];
+    size_t length = store_.read(buffer, sizeof(buffer));
+    if (length < sizeof(StoredHeader)) {
+        return false;
+    }
+
+    StoredHeader header;
+    memcpy(&header, buffer, sizeof(header));
+    const uint8_t* body = buffer + sizeof(header);
+    if (header.magic != kMagic || header.schema > kSchema || sizeof(header) + header.size > length ||
+        crc32(body, header.size) != header.crc) {
+        return false;
+    }
+
+    // Older, shorter blocks keep the defaults for the fields they lack
+    DeviceConfig loaded = defaults_;
+    memcpy(&loaded, body, header.size < sizeof(loaded) ? header.size : sizeof(loaded));
+    const char* error;
+    if (!validate(loaded, &error)) {
+        return false;
+    }
+    current_ = loaded;
+    revision_ = header.revision;
+    if (apply_ != nullptr) {
+        apply_(current_);
+    }
+    return true;
+}
+
+bool RuntimeConfig::validate(const DeviceConfig& config, const char** error) const {
+    for (size_t i = 0; i < fieldCount; i++) {
+        double v = readField(config, fields[i]);
+        if (!(v >= fields[i].min && v <= fields[i].max)) {
+            *error = fields[i].name;
+            return false;
+        }
+    }
+    if (config.sampleMaxMs < config.sampleMinMs) {
+        *error = "sample_max_ms < sample_min_ms";
+        return false;
+    }
+    if (config.tempRateExit > config.tempRateEnter || config.humRateExit > config.humRateEnter) {
+        *error = "rate exit limit above enter limit";
+        return false;
+    }
+    if (config.alertTempMin >= config.alertTempMax || config.alertHumMin >= config.alertHumMax) {
+        *error = "alert min not below max";
+        return false;
+    }
+    return true;
+}
+
+bool RuntimeConfig::commit(const DeviceConfig& config) {
+    uint8_t buffer[sizeof(StoredHeader) + sizeof(DeviceConfig)];
+    StoredHeader header = {kMagic, kSchema, (uint16_t)sizeof(DeviceConfig), revision_ + 1,
+                           crc32(&config, sizeof(config))};
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), &config, sizeof(config));
+    if (!store_.write(buffer, sizeof(buffer))) {
+        return false;
+    }
+    current_ = config;
+    revision_++;
+    if (apply_ != nullptr) {
+        apply_(current_);
+    }
+    return true;
+}
+
+bool RuntimeConfig::update(JsonObjectConst patch, JsonObject response) {
+    DeviceConfig next = current_;
+    uint8_t changed = 0;
+
+    for (JsonPairConst kv : patch) {
+        const Field* field = nullptr;
+        for (size_t i = 0; i < fieldCount; i++) {
+            if (strcmp(fields[i].name, kv.key().c_str()) == 0) {
+                field = &fields[i];
+                break;
+            }
+        }
+        if (field == nullptr || !kv.value().is<float>()) {
+            response["error"] = field == nullptr ? "unknown field" : "not a number";
+            response["field"] = kv.key().c_str();
+            return false;
+        }
+        uint8_t* p = (uint8_t*)&next + field->offset;
+        double v = kv.value().as<double>();
+        // Range-check before narrowing so out-of-range integers can't wrap
+        if (!(v >= field->min && v <= field->max)) {
+            response["error"] = "out of range";
+            response["field"] = field->name;
+            return false;
+        }
+        switch (field->type) {
+            case kU32: { uint32_t u = kv.value().as<uint32_t>(); memcpy(p, &u, sizeof(u)); break; }
+            case kU8: *p = kv.value().as<uint8_t>(); break;
+            case kF32: { float f = (float)v; memcpy(p, &f, sizeof(f)); break; }
+        }
+        changed++;
+    }
+
+    const char* error;
+    if (!validate(next, &error)) {
+        response["error"] = error;
+        return false;
+    }
+    if (changed > 0 && !commit(next)) {
+        response["error"] = "storage write failed";
+        return false;
+    }
+    response["revision"] = revision_;
+    response["changed"] = changed;
+    return true;
+}
+
+bool RuntimeConfig::reset() {
+    if (!store_.erase()) {
+        return false;
+    }
+    current_ = defaults_;
+    revision_ = 0;
+    if (apply_ != nullptr) {
+        apply_(current_);
+    }
+    return true;
+}
+
+void RuntimeConfig::toJson(JsonObject out) const {
+    out["schema"] = kSchema;
+    out["revision"] = revision_;
+    JsonObject values = out.createNestedObject("config");
+    for (size_t i = 0; i < fieldCount; i++) {
+        const Field& f = fields[i];
+        if (f.type == kF32) {
+            values[f.name] = (float)readField(current_, f);
+        } else {
+            values[f.name] = (uint32_t)readField(current_, f);
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Tunables that can be changed over /commands without reflashing. Fields are
+// only ever appended: a block saved by older firmware loads with the new
+// fields at their defaults.
+struct DeviceConfig {
+    uint32_t sampleMinMs;
+    uint32_t sampleMaxMs;
+    float tempRateEnter;
+    float tempRateExit;
+    float humRateEnter;
+    float humRateExit;
+    float alertTempMin;
+    float alertTempMax;
+    float alertHumMin;
+    float alertHumMax;
+    float alertZEnter;
+    uint8_t inflightWindow;
+    uint8_t logLevel;       // 0 silent, 1 errors, 2 info, 3 every reading
+    uint8_t reserved[2];
+    uint32_t backlogPoints;     // points sent for the readings missed while offline
+    uint8_t backlogMethod;      // downsampling for those: 0 none, 1 LTTB, 2 min/max
+    uint8_t reserved2[3];
+};
+
+enum LogLevel : uint8_t {
+    kLogSilent = 0,
+    kLogError = 1,
+    kLogInfo = 2,
+    kLogDebug = 3,
+};
+
+// Persistent backing for the configuration blob.
+class ConfigStore {
+public:
+    virtual ~ConfigStore() {}
+    // Returns the stored length, 0 if nothing is stored.
+    virtual size_t read(void* buffer, size_t capacity) = 0;
+    // Must replace the previous blob atomically.
+    virtual bool write(const void* data, size_t length) = 0;
+    virtual bool erase() = 0;
+};
+
+#if defined(ESP32) || defined(VIRTUAL_ESP32)
+#include <Preferences.h>
+
+// One NVS blob; NVS commits an entry atomically, so a power cut mid-write
+// leaves either the old or the new block, never a mix.
+class NvsConfigStore : public ConfigStore {
+public:
+    explicit NvsConfigStore(const char* ns) : namespace_(ns) {}
+
+    size_t read(void* buffer, size_t capacity) override;
+    bool write(const void* data, size_t length) override;
+    bool erase() override;
+
+private:
+    const char* namespace_;
+    Preferences preferences_;
+};
+#endif
+
+// Versioned configuration with an in-RAM copy. get() never touches flash;
+// update() validates the merged result before persisting it and swapping it
+// in, so readers only ever see a complete, valid block.
+class RuntimeConfig {
+public:
+    typedef void (*ApplyCallback)(const DeviceConfig& config);
+
+    RuntimeConfig(ConfigStore& store, const DeviceConfig& defaults);
+
+    // Loads the stored block, or keeps the defaults if it is missing/corrupt.
+    bool load();
+    void setApplyCallback(ApplyCallback apply) { apply_ = apply; }
+
+    const DeviceConfig& get() const { return current_; }
+    uint32_t revision() const { return revision_; }
+
+    // Merges patch over the current values. On success the new block is
+    // stored and applied; on failure response gets "error" and nothing changes.
+    bool update(JsonObjectConst patch, JsonObject response);
+    bool reset();
+    void toJson(JsonObject out) const;
+
+    static constexpr uint16_t kSchema = 1;
+
+private:
+    bool validate(const DeviceConfig& config, const char** error) const;
+    bool commit(const DeviceConfig& config);
+
+    ConfigStore& store_;
+    DeviceConfig defaults_;
+    DeviceConfig current_;
+    uint32_t revision_;
+    ApplyCallback apply_;
+};
+
+uint32_t crc32(const void* data, size_t length, uint32_t crc = 0);
+
+#endif
@@ -0,0 +1,170 @@
+#include "SntpClient.h"
+
+namespace {
+
+const uint8_t kPacketSize = 48;
+const uint32_t kResponseTimeoutMs = 2000;
+// Seconds between the NTP era (1900) and the Unix epoch (1970)
+const uint32_t kNtpToUnix = 2208988800UL;
+
+uint32_t read32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void write32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+int64_t ntpToEpochMs(const uint8_t* p) {
+    uint32_t seconds = read32(p);
+    uint32_t fraction = read32(p + 4);
+    return (int64_t)(seconds - kNtpToUnix) * 1000 + (int64_t)(((uint64_t)fraction * 1000) >> 32);
+}
+
+void epochMsToNtp(int64_t epochMs, uint8_t* p) {
+    write32(p, (uint32_t)(epochMs / 1000) + kNtpToUnix);
+    write32(p + 4, (uint32_t)(((uint64_t)(epochMs % 1000) << 32) / 1000));
+}
+
+}  // namespace
+
+SntpClient::SntpClient(EpochClock& clock, uint64_t (*monoMs)())
+    : clock_(clock),
+      monoMs_(monoMs),
+      server_(nullptr),
+      port_(123),
+      lookup_(kLookupIdle),
+      address_(0),
+      pending_(false),
+      sentMono_(0),
+      sentEpoch_(0),
+      nextRequestMono_(0),
+      syncIntervalMs_(3600000),
+      retryIntervalMs_(10000),
+      lastRttMs_(0),
+      failures_(0) {}
+
+void SntpClient::begin(const char* server, uint16_t port) {
+    server_ = server;
+    port_ = port;
+    udp_.begin(0);
+    nextRequestMono_ = 0;
+}
+
+void SntpClient::setIntervals(uint32_t syncIntervalMs, uint32_t retryIntervalMs) {
+    syncIntervalMs_ = syncIntervalMs;
+    retryIntervalMs_ = retryIntervalMs;
+}
+
+void SntpClient::poll() {
+    if (server_ == nullptr) {
+        return;
+    }
+    uint64_t now = monoMs_();
+
+    if (pending_) {
+        if (receive()) {
+            pending_ = false;
+            nextRequestMono_ = now + syncIntervalMs_;
+        } else if (now - sentMono_ > kResponseTimeoutMs) {
+            pending_ = false;
+            failures_++;
+            nextRequestMono_ = now + retryIntervalMs_;
+        }
+        return;
+    }
+
+    if (now < nextRequestMono_ || lookup_ == kLookupPending) {
+        return;
+    }
+    if (lookup_ == kLookupIdle && !resolve()) {
+        return;
+    }
+    // Each query asks the resolver again, so a changed record is picked up
+    // once lwIP's cached copy expires
+    bool resolvedOk = lookup_ == kLookupDone;
+    lookup_ = kLookupIdle;
+    if (resolvedOk && request()) {
+        pending_ = true;
+    } else {
+        failures_++;
+        nextRequestMono_ = now + retryIntervalMs_;
+    }
+}
+
+bool SntpClient::resolve() {
+    ip_addr_t address;
+    lookup_ = kLookupPending;
+    err_t err = dns_gethostbyname(server_, &address, resolved, this);
+    if (err == ERR_OK) {
+        address_ = ip_addr_get_ip4_u32(&address);
+        lookup_ = kLookupDone;
+    } else if (err != ERR_INPROGRESS) {
+        lookup_ = kLookupFailed;
+    }
+    return lookup_ != kLookupPending;
+}
+
+void SntpClient::resolved(const char*, const ip_addr_t* address, void* arg) {
+    SntpClient* self = static_cast<SntpClient*>(arg);
+    if (address != nullptr) {
+        self->address_ = ip_addr_get_ip4_u32(address);
+        self->lookup_ = kLookupDone;
+    } else {
+        self->lookup_ = kLookupFailed;
+    }
+}
+
+bool SntpClient::request() {
+    uint8_t packet[kPacketSize] = {0};
+    packet[0] = 0x23;  // LI 0, version 4, mode 3 (client)
+
+    sentMono_ = monoMs_();
+    sentEpoch_ = clock_.now(sentMono_);
+    // Origin timestamp, echoed back by the server so stale answers are ignored
+    epochMsToNtp(sentEpoch_, packet + 40);
+
+    if (!udp_.beginPacket(IPAddress(address_), port_)) {
+        return false;
+    }
+    udp_.write(packet, kPacketSize);
+    return udp_.endPacket();
+}
+
+bool SntpClient::receive() {
+    int size = udp_.parsePacket();
+    if (size < kPacketSize) {
+        if (size > 0) {
+            udp_.flush();
+        }
+        return false;
+    }
+
+    uint8_t packet[kPacketSize];
+    udp_.read(packet, kPacketSize);
+    udp_.flush();
+    uint64_t receivedMono = monoMs_();
+
+    // Ignore kiss-of-death packets, non-server replies and late answers to an
+    // earlier query
+    uint8_t origin[8];
+    epochMsToNtp(sentEpoch_, origin);
+    uint8_t mode = packet[0] & 0x07;
+    uint8_t stratum = packet[1];
+    if (mode != 4 || stratum == 0 || memcmp(origin, packet + 24, 8) != 0) {
+        return false;
+    }
+
+    int64_t serverReceive = ntpToEpochMs(packet + 32);
+    int64_t serverTransmit = ntpToEpochMs(packet + 40);
+    uint32_t roundTrip = (uint32_t)(receivedMono - sentMono_);
+    int64_t serverHold = serverTransmit - serverReceive;
+    int64_t networkDelay = (int64_t)roundTrip - (serverHold > 0 ? serverHold : 0);
+    lastRttMs_ = roundTrip;
+
+    clock_.sync(serverTransmit + networkDelay / 2, receivedMono);
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef SNTP_CLIENT_H
+#define SNTP_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include <EpochClock.h>
+#include <lwip/dns.h>
+
+// Minimal non-blocking SNTP (RFC 4330) client that feeds an EpochClock.
+// request() sends one query; poll() must be called from loop() and hands the
+// answer to the clock once it arrives, using the four NTP timestamps to
+// remove half the round trip. Nothing here blocks, so a slow or missing
+// server never delays sampling: the server's name goes to lwIP's resolver,
+// which answers from its cache (kept for the record's TTL) or calls back
+// later, instead of the synchronous lookup beginPacket(host) would do.
+class SntpClient {
+public:
+    SntpClient(EpochClock& clock, uint64_t (*monoMs)());
+
+    void begin(const char* server, uint16_t port = 123);
+
+    // Call every loop(); sends queries on schedule and processes answers.
+    void poll();
+
+    void setIntervals(uint32_t syncIntervalMs, uint32_t retryIntervalMs);
+
+    uint32_t lastRoundTripMs() const { return lastRttMs_; }
+    uint32_t failures() const { return failures_; }
+
+private:
+    enum Lookup : uint8_t { kLookupIdle, kLookupPending, kLookupDone, kLookupFailed };
+
+    bool resolve();
+    bool request();
+    bool receive();
+    // From lwIP's task, with null once the lookup has failed or timed out
+    static void resolved(const char* name, const ip_addr_t* address, void* arg);
+
+    EpochClock& clock_;
+    uint64_t (*monoMs_)();
+    WiFiUDP udp_;
+    const char* server_;
+    uint16_t port_;
+    volatile uint8_t lookup_;   // written by resolved()
+    uint32_t address_;          // IPv4 in lwIP's byte order, once kLookupDone
+    bool pending_;
+    uint64_t sentMono_;
+    int64_t sentEpoch_;
+    uint64_t nextRequestMono_;
+    uint32_t syncIntervalMs_;
+    uint32_t retryIntervalMs_;
+    uint32_t lastRttMs_;
+    uint32_t failures_;
+};
+
+#endif
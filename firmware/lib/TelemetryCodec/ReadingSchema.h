@@ -0,0 +1,59 @@
+#ifndef READING_SCHEMA_H
+#define READING_SCHEMA_H
+
+#include "TelemetryCodec.h"
+
+// The reading the device publishes on …/telemetry and, trimmed, on …/state.
+// These schemas are the format: the firmware encodes with them and the host
+// tools decode with them.
+namespace telemetry {
+
+struct Reading {
+    const char* deviceId;
+    int64_t timestampMs;
+    bool timeSynced;
+    float temperature;
+    float humidity;
+    float heatIndex;
+    int rssi;
+    // For tracing a reading to the database: readings published since boot,
+    // gaps meaning lost ones, and the time between the sample and handing the
+    // payload to MQTT, on the device's own clock
+    uint32_t seq;
+    uint16_t publishDelayMs;
+};
+
+constexpr uint8_t kDeviceIdMaxLength = 24;
+
+// Hundredths of °C and %RH, as ReadingLog stores them; the DHT22 resolves 0.1
+constexpr auto kReadingSchema = codec::schema<Reading>(
+    2,
+    codec::text("device_id", &Reading::deviceId, kDeviceIdMaxLength),
+    codec::integer("timestamp", "ms", &Reading::timestampMs, codec::Wire::I64),
+    codec::flag("time_synced", &Reading::timeSynced),
+    codec::fixed("temperature", "°C", &Reading::temperature, 2, codec::Wire::I16),
+    codec::fixed("humidity", "%RH", &Reading::humidity, 2, codec::Wire::I16),
+    codec::fixed("heat_index", "°C", &Reading::heatIndex, 2, codec::Wire::I16),
+    codec::integer("wifi_rssi", "dBm", &Reading::rssi, codec::Wire::I8),
+    codec::integer("seq", "", &Reading::seq, codec::Wire::I32),
+    codec::integer("publish_delay", "ms", &Reading::publishDelayMs, codec::Wire::U16));
+
+// The retained last known values
+constexpr auto kStateSchema = codec::schema<Reading>(
+    1,
+    codec::text("device_id", &Reading::deviceId, kDeviceIdMaxLength),
+    codec::integer("timestamp", "ms", &Reading::timestampMs, codec::Wire::I64),
+    codec::flag("time_synced", &Reading::timeSynced),
+    codec::fixed("temperature", "°C", &Reading::temperature, 2, codec::Wire::I16),
+    codec::fixed("humidity", "%RH", &Reading::humidity, 2, codec::Wire::I16));
+
+static_assert(codec::valid(kReadingSchema), "reading schema");
+static_assert(codec::valid(kStateSchema), "state schema");
+
+constexpr size_t kReadingJsonMax = codec::maxJsonSize(kReadingSchema);
+constexpr size_t kReadingBinaryMax = codec::maxBinarySize(kReadingSchema);
+constexpr size_t kStateJsonMax = codec::maxJsonSize(kStateSchema);
+
+}  // namespace telemetry
+
+#endif
@@ -0,0 +1,828 @@
+#ifndef TELEMETRY_CODEC_H
+#define TELEMETRY_CODEC_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <tuple>
+#include <type_traits>
+
+// Schema-driven codec for flat telemetry records, header only so the firmware
+// and the host tools compile the same code. A schema lists a record's fields
+// once, at compile time:
+//
+//   constexpr auto kSchema = codec::schema<Reading>(1,
+//       codec::text("device_id", &Reading::deviceId, 24),
+//       codec::fixed("temperature", "°C", &Reading::temperature, 2, codec::Wire::I16));
+//
+// and the templates below turn it into a JSON encoder/decoder and a binary
+// encoder/decoder. Nothing allocates: encoders write into a caller buffer,
+// decoders fill a caller record and point its text fields into the input.
+//
+// Field kinds, by member type:
+//   const char*   text, at most maxLength bytes, no control characters
+//   integral      integer, range checked against its wire width
+//   bool          true/false
+//   float         fixed point with `decimals` digits: the wire carries
+//                 round(value * 10^decimals); NaN travels as JSON null and as
+//                 the wire type's lowest value
+//
+// Binary layout, little-endian: u8 schema version, then each field in schema
+// order at its wire width; text is its bytes and a NUL.
+namespace codec {
+
+enum class Wire : uint8_t { I8, U8, I16, U16, I32, I64, Bool, Text };
+
+template <typename Record, typename T>
+struct Field {
+    const char* key;
+    const char* unit;       // documentation only, "" if none
+    T Record::*member;
+    Wire wire;
+    uint8_t decimals;       // fixed point fields
+    uint8_t maxLength;      // text fields, without the NUL
+};
+
+template <typename Record>
+constexpr Field<Record, const char*> text(const char* key, const char* Record::*member, uint8_t maxLength) {
+    return {key, "", member, Wire::Text, 0, maxLength};
+}
+
+template <typename Record, typename T>
+constexpr Field<Record, T> integer(const char* key, const char* unit, T Record::*member, Wire wire) {
+    static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value, "integer() needs an integer member");
+    return {key, unit, member, wire, 0, 0};
+}
+
+template <typename Record>
+constexpr Field<Record, bool> flag(const char* key, bool Record::*member) {
+    return {key, "", member, Wire::Bool, 0, 0};
+}
+
+template <typename Record>
+constexpr Field<Record, float> fixed(const char* key, const char* unit, float Record::*member, uint8_t decimals,
+                                     Wire wire) {
+    return {key, unit, member, wire, decimals, 0};
+}
+
+template <typename Record, typename... Fields>
+struct Schema {
+    uint8_t version;
+    std::tuple<Fields...> fields;
+
+    static constexpr size_t size() { return sizeof...(Fields); }
+};
+
+template <typename Record, typename... Fields>
+constexpr Schema<Record, Fields...> schema(uint8_t version, Fields... fields) {
+    return {version, std::tuple<Fields...>(fields...)};
+}
+
+namespace detail {
+
+constexpr size_t length(const char* s) {
+    size_t n = 0;
+    while (s[n] != '\0') {
+        n++;
+    }
+    return n;
+}
+
+constexpr bool sameKey(const char* a, const char* b) {
+    size_t i = 0;
+    while (a[i] != '\0' && a[i] == b[i]) {
+        i++;
+    }
+    return a[i] == b[i];
+}
+
+constexpr size_t wireSize(Wire wire) {
+    return wire == Wire::I8 || wire == Wire::U8 || wire == Wire::Bool ? 1
+           : wire == Wire::I16 || wire == Wire::U16                   ? 2
+           : wire == Wire::I32                                        ? 4
+           : wire == Wire::I64                                        ? 8
+                                                                      : 0;
+}
+
+constexpr int64_t wireMin(Wire wire) {
+    return wire == Wire::I8    ? -128
+           : wire == Wire::I16 ? -32768
+           : wire == Wire::I32 ? -2147483647LL - 1
+           : wire == Wire::I64 ? -9223372036854775807LL - 1
+                               : 0;
+}
+
+constexpr int64_t wireMax(Wire wire) {
+    return wire == Wire::I8    ? 127
+           : wire == Wire::U8  ? 255
+           : wire == Wire::I16 ? 32767
+           : wire == Wire::U16 ? 65535
+           : wire == Wire::I32 ? 2147483647LL
+           : wire == Wire::I64 ? 9223372036854775807LL
+                               : 1;
+}
+
+// Characters of the longest integer the wire type can carry
+constexpr size_t wireDigits(Wire wire) {
+    return wire == Wire::I8 ? 4 : wire == Wire::U8 ? 3 : wire == Wire::I16 ? 6 : wire == Wire::U16 ? 5
+         : wire == Wire::I32 ? 11 : 20;
+}
+
+constexpr int64_t pow10(uint8_t exponent) {
+    int64_t value = 1;
+    for (uint8_t i = 0; i < exponent; i++) {
+        value *= 10;
+    }
+    return value;
+}
+
+template <typename Record, typename T>
+constexpr size_t maxJsonValue(const Field<Record, T>& field) {
+    return field.wire == Wire::Text   ? 2 + 2 * (size_t)field.maxLength   // quotes, every byte escaped
+           : field.wire == Wire::Bool ? 5
+           : field.decimals > 0       ? wireDigits(field.wire) + 1
+                                      : wireDigits(field.wire);
+}
+
+template <typename Record, typename T>
+constexpr size_t maxBinaryValue(const Field<Record, T>& field) {
+    return field.wire == Wire::Text ? (size_t)field.maxLength + 1 : wireSize(field.wire);
+}
+
+template <typename Record, typename T>
+constexpr bool validField(const Field<Record, T>& field) {
+    return field.key != nullptr && length(field.key) > 0 && field.member != nullptr && field.decimals <= 6 &&
+           (std::is_same<T, const char*>::value == (field.wire == Wire::Text)) &&
+           (std::is_same<T, bool>::value == (field.wire == Wire::Bool)) &&
+           (std::is_same<T, float>::value || field.decimals == 0) &&
+           (!std::is_same<T, float>::value || wireMin(field.wire) < 0) &&   // NaN needs the signed minimum
+           (field.wire != Wire::Text || field.maxLength > 0);
+}
+
+// --- JSON output ---------------------------------------------------------
+
+struct Writer {
+    char* p;
+    char* end;
+    bool ok;
+
+    void put(char c) {
+        if (p < end) {
+            *p++ = c;
+        } else {
+            ok = false;
+        }
+    }
+    void put(const char* s, size_t n) {
+        if ((size_t)(end - p) >= n) {
+            memcpy(p, s, n);
+            p += n;
+        } else {
+            ok = false;
+        }
+    }
+};
+
+inline void putUnsigned(Writer& out, uint64_t value, uint8_t minDigits = 1) {
+    char digits[20];
+    uint8_t n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0 || n < minDigits);
+    while (n > 0) {
+        out.put(digits[--n]);
+    }
+}
+
+inline void putInteger(Writer& out, int64_t value) {
+    if (value < 0) {
+        out.put('-');
+        putUnsigned(out, 0 - (uint64_t)value);
+    } else {
+        putUnsigned(out, (uint64_t)value);
+    }
+}
+
+// 2450 with 2 decimals is "24.5"; trailing zeros go, as ArduinoJson does
+inline void putFixed(Writer& out, int64_t value, uint8_t decimals) {
+    if (value < 0) {
+        out.put('-');
+    }
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    uint64_t scale = (uint64_t)pow10(decimals);
+    putUnsigned(out, magnitude / scale);
+    uint64_t fraction = magnitude % scale;
+    if (fraction == 0) {
+        return;
+    }
+    while (fraction % 10 == 0) {
+        fraction /= 10;
+        decimals--;
+    }
+    out.put('.');
+    putUnsigned(out, fraction, decimals);
+}
+
+inline bool toFixed(float value, uint8_t decimals, Wire wire, int64_t* out) {
+    float scaled = roundf(value * (float)pow10(decimals));
+    if (!(scaled >= (float)wireMin(wire) && scaled <= (float)wireMax(wire))) {
+        return false;
+    }
+    *out = (int64_t)scaled;
+    return true;
+}
+
+template <typename Record>
+void putValue(Writer& out, const Field<Record, const char*>& field, const Record& record) {
+    const char* s = record.*field.member;
+    size_t n = s != nullptr ? strlen(s) : 0;
+    if (s == nullptr || n > field.maxLength) {
+        out.ok = false;
+        return;
+    }
+    out.put('"');
+    for (size_t i = 0; i < n; i++) {
+        char c = s[i];
+        if ((uint8_t)c < 0x20) {
+            out.ok = false;
+            return;
+        }
+        if (c == '"' || c == '\\') {
+            out.put('\\');
+        }
+        out.put(c);
+    }
+    out.put('"');
+}
+
+template <typename Record>
+void putValue(Writer& out, const Field<Record, bool>& field, const Record& record) {
+    if (record.*field.member) {
+        out.put("true", 4);
+    } else {
+        out.put("false", 5);
+    }
+}
+
+template <typename Record>
+void putValue(Writer& out, const Field<Record, float>& field, const Record& record) {
+    float value = record.*field.member;
+    int64_t scaled;
+    if (isnan(value)) {
+        out.put("null", 4);
+    } else if (toFixed(value, field.decimals, field.wire, &scaled)) {
+        putFixed(out, scaled, field.decimals);
+    } else {
+        out.ok = false;
+    }
+}
+
+template <typename Record, typename T>
+void putValue(Writer& out, const Field<Record, T>& field, const Record& record) {
+    int64_t value = (int64_t)(record.*field.member);
+    if (value < wireMin(field.wire) || value > wireMax(field.wire)) {
+        out.ok = false;
+        return;
+    }
+    putInteger(out, value);
+}
+
+template <typename Record, typename T>
+void putMember(Writer& out, const Field<Record, T>& field, const Record& record, bool& first) {
+    if (!first) {
+        out.put(',');
+    }
+    first = false;
+    out.put('"');
+    out.put(field.key, strlen(field.key));
+    out.put("\":", 2);
+    putValue(out, field, record);
+}
+
+// --- JSON input ----------------------------------------------------------
+
+struct Reader {
+    char* p;
+    char* end;
+
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+    }
+    bool take(char c) {
+        skipSpace();
+        if (p < end && *p == c) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+    bool literal(const char* word, size_t n) {
+        if ((size_t)(end - p) >= n && memcmp(p, word, n) == 0) {
+            p += n;
+            return true;
+        }
+        return false;
+    }
+};
+
+inline int hexDigit(char c) {
+    return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+// Unescapes a string in place; on return [*start, *start + *length) holds it
+inline bool readString(Reader& in, char** start, size_t* length) {
+    if (!in.take('"')) {
+        return false;
+    }
+    char* write = in.p;
+    *start = in.p;
+    while (in.p < in.end) {
+        char c = *in.p++;
+        if (c == '"') {
+            *length = (size_t)(write - *start);
+            return true;
+        }
+        if ((uint8_t)c < 0x20) {
+            return false;
+        }
+        if (c == '\\') {
+            if (in.p == in.end) {
+                return false;
+            }
+            c = *in.p++;
+            switch (c) {
+                case '"': case '\\': case '/': break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': {
+                    // Only ASCII: the schemas carry identifiers, not prose
+                    int code = 0;
+                    for (int i = 0; i < 4; i++) {
+                        int digit = in.p < in.end ? hexDigit(*in.p++) : -1;
+                        if (digit < 0) {
+                            return false;
+                        }
+                        code = code * 16 + digit;
+                    }
+                    if (code >= 0x80) {
+                        return false;
+                    }
+                    c = (char)code;
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        *write++ = c;
+    }
+    return false;
+}
+
+// A JSON number as mantissa * 10^exponent, without going through a float
+inline bool readDecimal(Reader& in, int64_t* mantissa, int* exponent) {
+    in.skipSpace();
+    bool negative = in.p < in.end && *in.p == '-';
+    if (negative) {
+        in.p++;
+    }
+    uint64_t digits = 0;
+    int scale = 0;
+    bool any = false;
+    bool point = false;
+    for (; in.p < in.end; in.p++) {
+        char c = *in.p;
+        if (c >= '0' && c <= '9') {
+            any = true;
+            if (digits < 100000000000000000ULL) {
+                digits = digits * 10 + (uint64_t)(c - '0');
+                scale -= point ? 1 : 0;
+            } else if (!point) {
+                scale++;    // beyond 17 significant digits, keep the magnitude
+            }
+        } else if (c == '.' && !point) {
+            point = true;
+        } else {
+            break;
+        }
+    }
+    if (!any) {
+        return false;
+    }
+    if (in.p < in.end && (*in.p == 'e' || *in.p == 'E')) {
+        in.p++;
+        bool negativeExponent = in.p < in.end && *in.p == '-';
+        if (in.p < in.end && (*in.p == '-' || *in.p == '+')) {
+            in.p++;
+        }
+        int value = 0;
+        bool exponentDigits = false;
+        while (in.p < in.end && *in.p >= '0' && *in.p <= '9') {
+            value = value < 1000 ? value * 10 + (*in.p - '0') : value;
+            in.p++;
+            exponentDigits = true;
+        }
+        if (!exponentDigits) {
+            return false;
+        }
+        scale += negativeExponent ? -value : value;
+    }
+    *mantissa = negative ? -(int64_t)digits : (int64_t)digits;
+    *exponent = scale;
+    return true;
+}
+
+// mantissa * 10^(exponent + decimals), rounded half away from zero
+inline bool scaleDecimal(int64_t mantissa, int exponent, uint8_t decimals, Wire wire, int64_t* out) {
+    int shift = exponent + decimals;
+    int64_t value = mantissa;
+    if (shift > 0) {
+        for (int i = 0; i < shift; i++) {
+            if (value > wireMax(Wire::I64) / 10 || value < wireMin(Wire::I64) / 10) {
+                return false;
+            }
+            value *= 10;
+        }
+    } else if (shift < 0) {
+        if (shift < -18) {
+            value = 0;
+        } else {
+            int64_t divisor = pow10((uint8_t)-shift);
+            int64_t quotient = value / divisor;
+            int64_t remainder = value % divisor;
+            if (remainder * 2 >= divisor) {
+                quotient++;
+            } else if (remainder * 2 <= -divisor) {
+                quotient--;
+            }
+            value = quotient;
+        }
+    }
+    if (value < wireMin(wire) || value > wireMax(wire)) {
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+template <typename Record>
+bool readValue(Reader& in, const Field<Record, const char*>& field, Record& record) {
+    char* start;
+    size_t length;
+    if (!readString(in, &start, &length) || length > field.maxLength) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if ((uint8_t)start[i] < 0x20) {
+            return false;
+        }
+    }
+    start[length] = '\0';   // over the closing quote or escape slack
+    record.*field.member = start;
+    return true;
+}
+
+template <typename Record>
+bool readValue(Reader& in, const Field<Record, bool>& field, Record& record) {
+    in.skipSpace();
+    if (in.literal("true", 4)) {
+        record.*field.member = true;
+    } else if (in.literal("false", 5)) {
+        record.*field.member = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+template <typename Record>
+bool readValue(Reader& in, const Field<Record, float>& field, Record& record) {
+    in.skipSpace();
+    if (in.literal("null", 4)) {
+        record.*field.member = NAN;
+        return true;
+    }
+    int64_t mantissa;
+    int exponent;
+    int64_t value;
+    if (!readDecimal(in, &mantissa, &exponent) ||
+        !scaleDecimal(mantissa, exponent, field.decimals, field.wire, &value)) {
+        return false;
+    }
+    record.*field.member = (float)value / (float)pow10(field.decimals);
+    return true;
+}
+
+template <typename Record, typename T>
+bool readValue(Reader& in, const Field<Record, T>& field, Record& record) {
+    int64_t mantissa;
+    int exponent;
+    int64_t value;
+    if (!readDecimal(in, &mantissa, &exponent) || !scaleDecimal(mantissa, exponent, 0, field.wire, &value)) {
+        return false;
+    }
+    record.*field.member = (T)value;
+    return true;
+}
+
+// Skips a value of a key the schema doesn't know
+inline bool skipValue(Reader& in) {
+    in.skipSpace();
+    if (in.p == in.end) {
+        return false;
+    }
+    char c = *in.p;
+    if (c == '"') {
+        char* start;
+        size_t length;
+        return readString(in, &start, &length);
+    }
+    if (c == '{' || c == '[') {
+        int depth = 0;
+        while (in.p < in.end) {
+            c = *in.p;
+            if (c == '"') {
+                char* start;
+                size_t length;
+                if (!readString(in, &start, &length)) {
+                    return false;
+                }
+                continue;
+            }
+            in.p++;
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if ((c == '}' || c == ']') && --depth == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (in.literal("true", 4) || in.literal("false", 5) || in.literal("null", 4)) {
+        return true;
+    }
+    int64_t mantissa;
+    int exponent;
+    return readDecimal(in, &mantissa, &exponent);
+}
+
+template <typename Record, typename T>
+bool matchField(Reader& in, const Field<Record, T>& field, size_t index, const char* key, size_t keyLength,
+                Record& record, uint32_t& seen, bool& ok) {
+    if (strlen(field.key) != keyLength || memcmp(field.key, key, keyLength) != 0) {
+        return false;
+    }
+    ok = readValue(in, field, record);
+    seen |= 1UL << index;
+    return true;
+}
+
+template <typename Record, typename Tuple, size_t... I>
+bool readField(Reader& in, const Tuple& fields, std::index_sequence<I...>, const char* key, size_t keyLength,
+               Record& record, uint32_t& seen) {
+    bool ok = true;
+    bool known = (matchField(in, std::get<I>(fields), I, key, keyLength, record, seen, ok) || ...);
+    return known ? ok : skipValue(in);
+}
+
+// --- Binary --------------------------------------------------------------
+
+inline void putLittle(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+inline int64_t getLittle(const uint8_t* in, Wire wire) {
+    size_t bytes = wireSize(wire);
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    // Sign extend the signed widths
+    if (wireMin(wire) < 0 && bytes < 8 && (value >> (8 * bytes - 1)) != 0) {
+        value |= ~0ULL << (8 * bytes);
+    }
+    return (int64_t)value;
+}
+
+template <typename Record>
+size_t putBinary(uint8_t* out, const Field<Record, const char*>& field, const Record& record) {
+    const char* s = record.*field.member;
+    size_t n = s != nullptr ? strlen(s) : 0;
+    if (s == nullptr || n > field.maxLength) {
+        return 0;
+    }
+    memcpy(out, s, n + 1);
+    return n + 1;
+}
+
+template <typename Record>
+size_t putBinary(uint8_t* out, const Field<Record, bool>& field, const Record& record) {
+    out[0] = record.*field.member ? 1 : 0;
+    return 1;
+}
+
+template <typename Record>
+size_t putBinary(uint8_t* out, const Field<Record, float>& field, const Record& record) {
+    float value = record.*field.member;
+    int64_t scaled = wireMin(field.wire);
+    if (!isnan(value) && (!toFixed(value, field.decimals, field.wire, &scaled) || scaled == wireMin(field.wire))) {
+        return 0;
+    }
+    putLittle(out, (uint64_t)scaled, wireSize(field.wire));
+    return wireSize(field.wire);
+}
+
+template <typename Record, typename T>
+size_t putBinary(uint8_t* out, const Field<Record, T>& field, const Record& record) {
+    int64_t value = (int64_t)(record.*field.member);
+    if (value < wireMin(field.wire) || value > wireMax(field.wire)) {
+        return 0;
+    }
+    putLittle(out, (uint64_t)value, wireSize(field.wire));
+    return wireSize(field.wire);
+}
+
+template <typename Record>
+size_t getBinary(const uint8_t* in, size_t available, const Field<Record, const char*>& field, Record& record) {
+    size_t limit = available < (size_t)field.maxLength + 1 ? available : (size_t)field.maxLength + 1;
+    const void* nul = memchr(in, 0, limit);
+    if (nul == nullptr) {
+        return 0;
+    }
+    record.*field.member = (const char*)in;
+    return (size_t)((const uint8_t*)nul - in) + 1;
+}
+
+template <typename Record>
+size_t getBinary(const uint8_t* in, size_t available, const Field<Record, bool>& field, Record& record) {
+    if (available < 1 || in[0] > 1) {
+        return 0;
+    }
+    record.*field.member = in[0] == 1;
+    return 1;
+}
+
+template <typename Record>
+size_t getBinary(const uint8_t* in, size_t available, const Field<Record, float>& field, Record& record) {
+    if (available < wireSize(field.wire)) {
+        return 0;
+    }
+    int64_t value = getLittle(in, field.wire);
+    record.*field.member = value == wireMin(field.wire) ? NAN : (float)value / (float)pow10(field.decimals);
+    return wireSize(field.wire);
+}
+
+template <typename Record, typename T>
+size_t getBinary(const uint8_t* in, size_t available, const Field<Record, T>& field, Record& record) {
+    if (available < wireSize(field.wire)) {
+        return 0;
+    }
+    record.*field.member = (T)getLittle(in, field.wire);
+    return wireSize(field.wire);
+}
+
+}  // namespace detail
+
+// --- Compile-time properties ----------------------------------------------
+
+template <typename Record, typename... Fields>
+constexpr bool valid(const Schema<Record, Fields...>& s) {
+    bool ok = sizeof...(Fields) > 0 && sizeof...(Fields) <= 32;
+    std::apply([&](const auto&... field) { ok = ok && (detail::validField(field) && ...); }, s.fields);
+    // Keys must be unique for the decoder to be unambiguous
+    const char* keys[sizeof...(Fields)] = {};
+    size_t n = 0;
+    std::apply([&](const auto&... field) { ((keys[n++] = field.key), ...); }, s.fields);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            ok = ok && !detail::sameKey(keys[i], keys[j]);
+        }
+    }
+    return ok;
+}
+
+// Longest JSON the encoder can produce, NUL included
+template <typename Record, typename... Fields>
+constexpr size_t maxJsonSize(const Schema<Record, Fields...>& s) {
+    size_t size = 2 + 1;    // braces, NUL
+    std::apply([&](const auto&... field) {
+        ((size += detail::length(field.key) + 4 + detail::maxJsonValue(field)), ...);
+    }, s.fields);
+    return size;
+}
+
+template <typename Record, typename... Fields>
+constexpr size_t maxBinarySize(const Schema<Record, Fields...>& s) {
+    size_t size = 1;    // version
+    std::apply([&](const auto&... field) { ((size += detail::maxBinaryValue(field)), ...); }, s.fields);
+    return size;
+}
+
+// --- Encoders and decoders -------------------------------------------------
+
+// Writes the record as a JSON object and a NUL. Returns the length without
+// the NUL, or 0 if it doesn't fit or a value is out of its field's range.
+template <typename Record, typename... Fields>
+size_t encodeJson(const Schema<Record, Fields...>& s, const Record& record, char* out, size_t size) {
+    if (out == nullptr || size == 0) {
+        return 0;
+    }
+    detail::Writer writer = {out, out + size - 1, true};
+    bool first = true;
+    writer.put('{');
+    std::apply([&](const auto&... field) { (detail::putMember(writer, field, record, first), ...); }, s.fields);
+    writer.put('}');
+    if (!writer.ok) {
+        return 0;
+    }
+    *writer.p = '\0';
+    return (size_t)(writer.p - out);
+}
+
+// Parses one JSON object in place (strings are unescaped inside `in`, and text
+// fields point there). Unknown keys are skipped; fields absent from the input
+// keep their value. Returns how many schema fields were read, or -1 if the
+// input is malformed or a value does not fit its field.
+template <typename Record, typename... Fields>
+int decodeJson(const Schema<Record, Fields...>& s, char* in, size_t length, Record& record) {
+    detail::Reader reader = {in, in + length};
+    uint32_t seen = 0;
+    if (!reader.take('{')) {
+        return -1;
+    }
+    if (!reader.take('}')) {
+        do {
+            reader.skipSpace();
+            char* key;
+            size_t keyLength;
+            if (!detail::readString(reader, &key, &keyLength) || !reader.take(':') ||
+                !detail::readField(reader, s.fields, std::index_sequence_for<Fields...>(), key, keyLength, record,
+                                   seen)) {
+                return -1;
+            }
+        } while (reader.take(','));
+        if (!reader.take('}')) {
+            return -1;
+        }
+    }
+    int count = 0;
+    for (; seen != 0; seen &= seen - 1) {
+        count++;
+    }
+    return count;
+}
+
+// Returns the encoded length, or 0 if it doesn't fit (maxBinarySize() always
+// does) or a value is out of its field's range.
+template <typename Record, typename... Fields>
+size_t encodeBinary(const Schema<Record, Fields...>& s, const Record& record, uint8_t* out, size_t size) {
+    if (out == nullptr || size < maxBinarySize(s)) {
+        return 0;
+    }
+    out[0] = s.version;
+    size_t n = 1;
+    bool ok = true;
+    std::apply([&](const auto&... field) {
+        ((ok = ok && [&] {
+             size_t written = detail::putBinary(out + n, field, record);
+             n += written;
+             return written > 0;
+         }()),
+         ...);
+    }, s.fields);
+    return ok ? n : 0;
+}
+
+// Decodes one record; text fields point into `in`. Returns the bytes
+// consumed, so records can be read back to back, or 0 if malformed.
+template <typename Record, typename... Fields>
+size_t decodeBinary(const Schema<Record, Fields...>& s, const uint8_t* in, size_t length, Record& record) {
+    if (in == nullptr || length < 1 || in[0] != s.version) {
+        return 0;
+    }
+    size_t n = 1;
+    bool ok = true;
+    std::apply([&](const auto&... field) {
+        ((ok = ok && [&] {
+             size_t read = detail::getBinary(in + n, length - n, field, record);
+             n += read;
+             return read > 0;
+         }()),
+         ...);
+    }, s.fields);
+    return ok ? n : 0;
+}
+
+}  // namespace codec
+
+#endif
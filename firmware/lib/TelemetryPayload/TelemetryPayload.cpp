@@ -0,0 +1,68 @@
+#include "TelemetryPayload.h"
+
+#include <ArduinoJson.h>
+#include <math.h>
+
+namespace telemetry {
+
+const char kWill[] = "{\"online\":false,\"reason\":\"lost\"}";
+const size_t kWillLength = sizeof(kWill) - 1;
+
+namespace {
+
+// serializeJson() truncates silently; a cut payload is worse than none
+size_t finish(const JsonDocument& doc, char* out, size_t size) {
+    if (out == nullptr || measureJson(doc) >= size) {
+        return 0;
+    }
+    return serializeJson(doc, out, size);
+}
+
+}  // namespace
+
+size_t writeAlert(const Alert& alert, char* out, size_t size) {
+    StaticJsonDocument<256> doc;
+    doc["device_id"] = alert.deviceId;
+    doc["timestamp"] = alert.timestampMs;
+    doc["time_synced"] = alert.timeSynced;
+    doc["channel"] = alert.channel;
+    doc["kind"] = alert.kind;
+    doc["value"] = alert.value;
+    doc["mean"] = alert.mean;
+    doc["z"] = alert.z;
+    return finish(doc, out, size);
+}
+
+size_t writePresence(bool online, int64_t timestampMs, bool timeSynced, char* out, size_t size) {
+    StaticJsonDocument<96> doc;
+    doc["online"] = online;
+    if (online) {
+        doc["timestamp"] = timestampMs;
+        doc["time_synced"] = timeSynced;
+    } else {
+        doc["reason"] = "reboot";
+    }
+    return finish(doc, out, size);
+}
+
+StateFilter::StateFilter(float temperatureDelta, float humidityDelta)
+    : temperatureDelta_(temperatureDelta),
+      humidityDelta_(humidityDelta),
+      primed_(false),
+      temperature_(0),
+      humidity_(0),
+      updates_(0) {}
+
+bool StateFilter::changed(float temperature, float humidity) const {
+    return !primed_ || fabsf(temperature - temperature_) >= temperatureDelta_ ||
+           fabsf(humidity - humidity_) >= humidityDelta_;
+}
+
+void StateFilter::accept(float temperature, float humidity) {
+    primed_ = true;
+    temperature_ = temperature;
+    humidity_ = humidity;
+    updates_++;
+}
+
+}  // namespace telemetry
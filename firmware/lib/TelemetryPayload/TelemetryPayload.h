@@ -0,0 +1,66 @@
+#ifndef TELEMETRY_PAYLOAD_H
+#define TELEMETRY_PAYLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ReadingSchema.h>
+
+// JSON payloads the device publishes, shared by the firmware and the host
+// tools (tools/fleet_sim) so simulated traffic is byte for byte what the
+// fleet sends. Each writer fills a caller buffer and returns the length, or
+// 0 if the payload does not fit; nothing is allocated. Readings and state
+// follow the schemas in ReadingSchema.h.
+namespace telemetry {
+
+struct Alert {
+    const char* deviceId;
+    int64_t timestampMs;
+    bool timeSynced;
+    const char* channel;
+    const char* kind;
+    float value;
+    float mean;
+    float z;
+};
+
+// …/telemetry: every reading, at most kReadingJsonMax with the NUL
+inline size_t writeReading(const Reading& reading, char* out, size_t size) {
+    return codec::encodeJson(kReadingSchema, reading, out, size);
+}
+// …/state: the retained last known values, at most kStateJsonMax
+inline size_t writeState(const Reading& reading, char* out, size_t size) {
+    return codec::encodeJson(kStateSchema, reading, out, size);
+}
+// …/alerts
+size_t writeAlert(const Alert& alert, char* out, size_t size);
+// …/status: birth message when online, a requested disconnect otherwise
+size_t writePresence(bool online, int64_t timestampMs, bool timeSynced, char* out, size_t size);
+
+// Last Will registered at connect, published by the broker on a lost link
+extern const char kWill[];
+extern const size_t kWillLength;
+
+// Decides when the retained state is worth rewriting: on the first reading
+// and whenever a value has moved by its delta since the last one accepted.
+class StateFilter {
+public:
+    StateFilter(float temperatureDelta, float humidityDelta);
+
+    bool changed(float temperature, float humidity) const;
+    // Call once the state message was accepted for delivery
+    void accept(float temperature, float humidity);
+    uint32_t updates() const { return updates_; }
+
+private:
+    float temperatureDelta_;
+    float humidityDelta_;
+    bool primed_;
+    float temperature_;
+    float humidity_;
+    uint32_t updates_;
+};
+
+}  // namespace telemetry
+
+#endif
@@ -0,0 +1,82 @@
+#include "TopicScheme.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+// In TopicScheme::Topic order. levels is how much of tenant/site/device
+// prefixes the kind: 3 for the device's topics, 2 for its site's, 1 for the
+// tenant's.
+struct Kind {
+    uint8_t levels;
+    const char* name;
+};
+
+const Kind kKinds[] = {
+    {3, "telemetry"}, {3, "alerts"},          {3, "state"},    {3, "status"}, {3, "responses"},
+    {3, "history"},   {3, "history/backlog"}, {3, "commands"}, {2, "commands"}, {1, "commands"},
+};
+
+// Length of the topic without its terminator
+size_t topic_length(const Kind& kind, const size_t* levelLengths) {
+    size_t length = strlen(kind.name);
+    for (uint8_t i = 0; i < kind.levels; i++) {
+        length += levelLengths[i] + 1;
+    }
+    return length;
+}
+
+}  // namespace
+
+TopicScheme::TopicScheme() {
+    for (uint8_t i = 0; i < kTopicCount; i++) {
+        topics_[i] = "";
+    }
+}
+
+bool TopicScheme::validLevel(const char* level) {
+    return level != nullptr && level[0] != '\0' && strpbrk(level, "/+#") == nullptr;
+}
+
+size_t TopicScheme::storageSize(const char* tenant, const char* site, const char* device) {
+    static_assert(sizeof(kKinds) / sizeof(kKinds[0]) == kTopicCount, "one kind per topic");
+    if (!validLevel(tenant) || !validLevel(site) || !validLevel(device)) {
+        return 0;
+    }
+    const size_t levelLengths[3] = {strlen(tenant), strlen(site), strlen(device)};
+    size_t size = 0;
+    for (uint8_t i = 0; i < kTopicCount; i++) {
+        size_t length = topic_length(kKinds[i], levelLengths);
+        if (length >= TOPIC_MAX_LENGTH) {
+            return 0;
+        }
+        size += length + 1;
+    }
+    return size;
+}
+
+bool TopicScheme::build(const char* tenant, const char* site, const char* device, char* storage, size_t size) {
+    // Measured first, so a failure leaves storage and the old topics intact
+    size_t needed = storageSize(tenant, site, device);
+    if (needed == 0 || storage == nullptr || size < needed) {
+        return false;
+    }
+    const char* levels[3] = {tenant, site, device};
+    char* out = storage;
+    for (uint8_t i = 0; i < kTopicCount; i++) {
+        const Kind& kind = kKinds[i];
+        char* topic = out;
+        for (uint8_t level = 0; level < kind.levels; level++) {
+            size_t length = strlen(levels[level]);
+            memcpy(out, levels[level], length);
+            out += length;
+            *out++ = '/';
+        }
+        size_t length = strlen(kind.name);
+        memcpy(out, kind.name, length + 1);
+        out += length + 1;
+        topics_[i] = topic;
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef TOPIC_SCHEME_H
+#define TOPIC_SCHEME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef TOPIC_MAX_LENGTH
+#define TOPIC_MAX_LENGTH 128
+#endif
+
+// Per-device topic namespace, <tenant>/<site>/<device>/<kind>, built once at
+// boot so publishing never formats a topic. The device id is a level of its
+// own, so consumers and the broker pick devices or sites with wildcards
+// (<tenant>/<site>/+/telemetry) instead of decoding payloads.
+//
+// Commands arrive on three levels: the device's own topic, its site's
+// (<tenant>/<site>/commands) and the tenant's (<tenant>/commands).
+//
+// The topics are packed back to back into storage the caller provides,
+// storageSize() bytes of it (the firmware reserves them from the message
+// arena), and must outlive the scheme. Until build() succeeds every topic is
+// empty.
+class TopicScheme {
+public:
+    TopicScheme();
+
+    // Bytes build() needs for these levels; 0 if a level is invalid or a
+    // topic would not fit TOPIC_MAX_LENGTH.
+    static size_t storageSize(const char* tenant, const char* site, const char* device);
+
+    // False if a level is empty, holds '/', '+' or '#', a topic would not
+    // fit TOPIC_MAX_LENGTH or the storage is too small; nothing is written
+    // and the previous topics are kept then.
+    bool build(const char* tenant, const char* site, const char* device, char* storage, size_t size);
+
+    const char* telemetry() const { return topics_[kTelemetry]; }
+    const char* alerts() const { return topics_[kAlerts]; }
+    const char* state() const { return topics_[kState]; }           // retained last known reading
+    const char* status() const { return topics_[kStatus]; }         // retained online/offline
+    const char* responses() const { return topics_[kResponses]; }
+    const char* history() const { return topics_[kHistory]; }       // prefix for streams
+    const char* backlog() const { return topics_[kBacklog]; }
+    const char* commands() const { return topics_[kCommands]; }
+    const char* siteCommands() const { return topics_[kSiteCommands]; }
+    const char* tenantCommands() const { return topics_[kTenantCommands]; }
+
+    static bool validLevel(const char* level);
+
+private:
+    enum Topic : uint8_t {
+        kTelemetry,
+        kAlerts,
+        kState,
+        kStatus,
+        kResponses,
+        kHistory,
+        kBacklog,
+        kCommands,
+        kSiteCommands,
+        kTenantCommands,
+        kTopicCount
+    };
+
+    const char* topics_[kTopicCount];
+};
+
+#endif
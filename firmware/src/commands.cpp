@@ -0,0 +1,470 @@
+#include <Arduino.h>
+#include <CommandDispatcher.h>
+#include <config_defaults.h>
+
+#include "commands.h"
+#include "device.h"
+#include "history.h"
+#include "memory.h"
+#include "ota.h"
+
+namespace {
+
+uint32_t repliesDropped = 0;    // no room in the arena, or neither sent nor queued
+
+uint32_t micros_now(){
+    return micros();
+}
+
+// Shorthand for set-config on the two sampling fields, so it persists too
+bool cmd_set_interval(JsonObjectConst request, JsonObject response){
+    StaticJsonDocument<64> patch;
+    patch["sample_min_ms"] = request["min_ms"] | runtimeConfig.get().sampleMinMs;
+    patch["sample_max_ms"] = request["max_ms"] | runtimeConfig.get().sampleMaxMs;
+    if (!runtimeConfig.update(patch.as<JsonObjectConst>(), response)) {
+        return false;
+    }
+    response["min_ms"] = runtimeConfig.get().sampleMinMs;
+    response["max_ms"] = runtimeConfig.get().sampleMaxMs;
+    return true;
+}
+
+bool cmd_get_config(JsonObjectConst, JsonObject response){
+    runtimeConfig.toJson(response);
+    return true;
+}
+
+bool cmd_set_config(JsonObjectConst request, JsonObject response){
+    return runtimeConfig.update(request, response);
+}
+
+bool cmd_reset_config(JsonObjectConst, JsonObject response){
+    if (!runtimeConfig.reset()) {
+        response["error"] = "storage erase failed";
+        return false;
+    }
+    response["revision"] = runtimeConfig.revision();
+    return true;
+}
+
+bool cmd_read_now(JsonObjectConst, JsonObject){
+    request_sample_now();
+    return true;
+}
+
+bool cmd_flush_buffer(JsonObjectConst, JsonObject response){
+    client.flush();
+    MqttOutbox::Stats stats = client.stats();
+    response["queued"] = stats.depth;
+    response["in_flight"] = stats.inflight;
+    return true;
+}
+
+// get-stats sections, each filling its own nested object
+void stats_sampling(JsonObject sampling){
+    AdaptiveSampler::Stats samplerStats = sampler.stats();
+    sampling["samples"] = samplerStats.samplesTaken;
+    sampling["fixed_schedule_samples"] = samplerStats.fixedScheduleSamples;
+    sampling["interval_ms"] = sampler.intervalMs();
+}
+
+void stats_clock(JsonObject clock){
+    clock["synced"] = epochClock.synced();
+    clock["offset_ms"] = epochClock.lastOffsetMs();
+    clock["drift_ppm"] = epochClock.driftPpm();
+}
+
+void stats_memory(JsonObject memory){
+    MemoryStats memoryStats = memory_stats();
+    memory["free"] = memoryStats.freeHeap;
+    memory["min_free"] = memoryStats.minFreeHeap;
+    memory["largest_block"] = memoryStats.largestBlock;
+    memory["min_largest_block"] = memoryStats.minLargestBlock;
+    memory["fragmentation"] = memoryStats.fragmentation;
+    memory["low_events"] = memoryStats.lowMemoryEvents;
+    memory["arena_reserved"] = memoryStats.arena.reserved;
+    memory["arena_high_water"] = memoryStats.arena.highWater;
+    memory["arena_failures"] = memoryStats.arena.failures;
+}
+
+void stats_mqtt(JsonObject mqtt){
+    MqttOutbox::Stats mqttStats = client.stats();
+    mqtt["delivered"] = mqttStats.delivered;
+    mqtt["retransmitted"] = mqttStats.retransmitted;
+    mqtt["expired"] = mqttStats.expired;
+    mqtt["queued"] = mqttStats.depth;
+    mqtt["publish_call_max_us"] = publishCallMaxUs;
+    mqtt["bytes_in"] = client.bytesIn();
+    mqtt["publishes_in"] = client.publishesIn();
+    mqtt["bytes_in_last_cycle"] = inboundBytesLastCycle;
+    mqtt["bytes_in_max_cycle"] = inboundBytesMaxCycle;
+    mqtt["bytes_out"] = client.bytesOut();
+    mqtt["protocol"] = client.protocol();
+    mqtt["topic_aliases"] = client.topicAliasesInUse();
+    mqtt["state_updates"] = stateFilter.updates();
+    mqtt["replies_dropped"] = repliesDropped;
+}
+
+void stats_ota(JsonObject ota){
+    OtaStats otaStats = ota_stats();
+    ota["state"] = ota_state_name(otaStats.state);
+    if (otaStats.error != nullptr) {
+        ota["error"] = otaStats.error;
+    }
+    ota["patch_bytes"] = otaStats.patchBytes;
+    ota["patch_size"] = otaStats.patchSize;
+    ota["written"] = otaStats.written;
+    ota["image_size"] = otaStats.imageSize;
+    ota["duration_ms"] = otaStats.durationMs;
+    ota["rolled_back"] = otaStats.rolledBack;
+}
+
+#if MQTT_TLS
+void stats_tls(JsonObject tls){
+    TlsTransport::Stats tlsStats = mqttTls.stats();
+    tls["full"] = tlsStats.fullHandshakes;
+    tls["resumed"] = tlsStats.resumedHandshakes;
+    tls["failed"] = tlsStats.failedHandshakes;
+    tls["last_error"] = tlsStats.lastError;
+    tls["last_resumed"] = tlsStats.lastResumed;
+    tls["last_ms"] = tlsStats.lastHandshakeMs;
+    tls["last_cpu_ms"] = tlsStats.lastHandshakeCpuMs;
+    tls["full_cpu_ms_max"] = tlsStats.fullCpuMsMax;
+    tls["resumed_cpu_ms_max"] = tlsStats.resumedCpuMsMax;
+    tls["setup_heap"] = tlsStats.setupHeap;
+    tls["handshake_heap_max"] = tlsStats.handshakeHeapMax;
+    tls["session_bytes"] = tlsStats.sessionBytes;
+    tls["session_in_rtc"] = tlsStats.sessionInRtc;
+}
+#endif
+
+void stats_alerts(JsonObject alerts){
+    alerts["published"] = alertsPublished;
+    alerts["queued"] = alertsQueued;
+    alerts["lost"] = alertsLost;
+    alerts["latency_max_us"] = alertLatencyMaxUs;
+}
+
+void stats_history(JsonObject history){
+    HistoryStats historyStats = history_stats();
+    history["stored"] = historyStats.stored;
+    history["streams"] = historyStats.streams;
+    history["records_per_s"] = historyStats.recordsPerSecond;
+    history["bytes_per_s"] = historyStats.bytesPerSecond;
+    history["chunk_bytes_max"] = historyStats.chunkBytesMax;
+    history["heap_min_free"] = historyStats.heapMinFree;
+    history["stack_min_free"] = historyStats.stackMinFree;
+    history["downsample_in"] = historyStats.readingsIn;
+    history["downsample_out"] = historyStats.pointsOut;
+    history["downsample_max_us"] = historyStats.downsampleMaxUs;
+}
+
+// members is what the section writes at most; it sizes the reply document.
+// onRequest sections are only sent when asked for by name, which keeps the
+// default reply within the message arena.
+struct StatsSection {
+    const char* name;
+    size_t members;
+    void (*fill)(JsonObject section);
+    bool onRequest;
+};
+
+constexpr StatsSection statsSections[] = {
+    {"sampling", 3, stats_sampling, false},
+    {"clock", 3, stats_clock, false},
+    {"memory", 9, stats_memory, false},
+    {"mqtt", 14, stats_mqtt, false},
+    {"ota", 8, stats_ota, true},
+#if MQTT_TLS
+    {"tls", 13, stats_tls, true},
+#endif
+    {"alerts", 4, stats_alerts, false},
+    {"history", 10, stats_history, false},
+};
+
+constexpr size_t stats_members(size_t i = 0){
+    return i < sizeof(statsSections) / sizeof(statsSections[0])
+               ? 1 + statsSections[i].members + stats_members(i + 1)
+               : 0;
+}
+
+// "section" picks one; without it the reply carries all but the onRequest ones
+bool cmd_get_stats(JsonObjectConst request, JsonObject response){
+    const char* wanted = request["section"];
+    bool found = false;
+    for (const StatsSection& section : statsSections) {
+        if (wanted == nullptr ? !section.onRequest : strcmp(wanted, section.name) == 0) {
+            section.fill(response.createNestedObject(section.name));
+            found = true;
+        }
+    }
+    if (!found) {
+        response["error"] = "unknown section";
+        return false;
+    }
+    response["uptime_ms"] = mono_ms();
+    return true;
+}
+
+// Time range shared by the history commands: from_ms/to_ms, or the last
+// "hours" (1 by default) up to now
+void history_range(JsonObjectConst request, int64_t* fromMs, int64_t* toMs){
+    *toMs = request["to_ms"] | epochClock.now(mono_ms());
+    *fromMs = request["from_ms"] | (*toMs - (int64_t)(request["hours"] | 1) * 3600000);
+}
+
+// Streams stored readings as binary chunks on their own topic; see history.h
+bool cmd_get_history(JsonObjectConst request, JsonObject response){
+    static uint32_t streamCount = 0;
+    int64_t fromMs, toMs;
+    history_range(request, &fromMs, &toMs);
+    uint16_t chunk = request["chunk"] | HISTORY_CHUNK_RECORDS;
+    if (fromMs >= toMs || chunk == 0 || chunk > HISTORY_CHUNK_MAX_RECORDS) {
+        response["error"] = "invalid range or chunk size";
+        return false;
+    }
+    downsample::Method method;
+    if (!downsample::parseMethod(request["downsample"] | "none", &method)) {
+        response["error"] = "unknown downsample method";
+        return false;
+    }
+    const char* channel = request["channel"] | "temperature";
+
+    char topic[TOPIC_MAX_LENGTH];
+    const char* requestedTopic = request["topic"];
+    if (requestedTopic != nullptr) {
+        strlcpy(topic, requestedTopic, sizeof(topic));
+    } else {
+        snprintf(topic, sizeof(topic), "%s/%lu", topics.history(), (unsigned long)++streamCount);
+    }
+    HistoryRequest stream = {
+        topic,
+        fromMs,
+        toMs,
+        request["cursor"] | (uint32_t)0,
+        chunk,
+        method,
+        request["points"] | (uint32_t)HISTORY_BACKLOG_POINTS,
+        (uint8_t)(strcmp(channel, "humidity") == 0 ? 1 : 0),
+    };
+    HistoryStreamInfo info;
+    if (!history_start(stream, &info)) {
+        response["error"] = "history unavailable";
+        return false;
+    }
+    response["topic"] = topic;
+    response["cursor"] = info.startCursor;
+    response["end_cursor"] = info.endCursor;
+    response["chunk"] = chunk;
+    response["ratio"] = info.ratio;
+    return true;
+}
+
+bool cmd_get_summary(JsonObjectConst request, JsonObject response){
+    int64_t fromMs, toMs;
+    history_range(request, &fromMs, &toMs);
+    RangeAggregate aggregate;
+    if (fromMs >= toMs || !history_aggregate(fromMs, toMs, &aggregate)) {
+        response["error"] = fromMs >= toMs ? "invalid range" : "history unavailable";
+        return false;
+    }
+    response["count"] = aggregate.count;
+    if (aggregate.count > 0) {
+        response["first_ms"] = aggregate.firstMs;
+        response["last_ms"] = aggregate.lastMs;
+        response["temperature_min"] = aggregate.temperatureMin / 100.0f;
+        response["temperature_max"] = aggregate.temperatureMax / 100.0f;
+        response["temperature_mean"] = aggregate.temperatureSum / 100.0f / aggregate.count;
+        response["humidity_min"] = aggregate.humidityMin / 100.0f;
+        response["humidity_max"] = aggregate.humidityMax / 100.0f;
+        response["humidity_mean"] = aggregate.humiditySum / 100.0f / aggregate.count;
+    }
+    return true;
+}
+
+bool parse_sha256(const char* hex, uint8_t out[32]){
+    if (hex == nullptr || strlen(hex) != 64) {
+        return false;
+    }
+    for (int i = 0; i < 32; i++) {
+        char pair[3] = {hex[2 * i], hex[2 * i + 1], '\0'};
+        char* end;
+        out[i] = (uint8_t)strtoul(pair, &end, 16);
+        if (end != pair + 2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Delta update: url of a DeltaPatch made against the running image, sha256
+// of the image it produces
+bool cmd_ota_update(JsonObjectConst request, JsonObject response){
+    const char* url = request["url"];
+    uint8_t sha256[32];
+    if (url == nullptr || !parse_sha256(request["sha256"], sha256)) {
+        response["error"] = "url and sha256 (64 hex digits) are required";
+        return false;
+    }
+    const char* error = nullptr;
+    if (!ota_start(url, sha256, &error)) {
+        response["error"] = error;
+        return false;
+    }
+    response["state"] = ota_state_name(ota_stats().state);
+    return true;
+}
+
+// Times the reading codec on this CPU with a typical reading. Blocks loop()
+// for the run, a few ms per thousand iterations.
+bool cmd_bench_codec(JsonObjectConst request, JsonObject response){
+    uint32_t iterations = request["iterations"] | 1000;
+    if (iterations == 0 || iterations > 10000) {
+        response["error"] = "iterations must be 1-10000";
+        return false;
+    }
+    const telemetry::Reading sample = {
+        "ESP32-A1:B2:C3:D4:E5:F6", 1757689200123LL, true, 24.5f, 65.2f, 24.63f, -61, 86400, 12,
+    };
+    MessageArena::Scope scratch(messageArena);
+    char* json = scratch.chars(telemetry::kReadingJsonMax);
+    char* parse = scratch.chars(telemetry::kReadingJsonMax);
+    uint8_t* binary = scratch.bytes(telemetry::kReadingBinaryMax);
+    if (json == nullptr || parse == nullptr || binary == nullptr) {
+        response["error"] = "no scratch memory";
+        return false;
+    }
+    size_t jsonLength = 0;
+    size_t binaryLength = 0;
+    telemetry::Reading decoded = {};
+    uint32_t failures = 0;
+
+    uint32_t startUs = micros();
+    for (uint32_t i = 0; i < iterations; i++) {
+        jsonLength = codec::encodeJson(telemetry::kReadingSchema, sample, json, telemetry::kReadingJsonMax);
+    }
+    uint32_t jsonEncodeUs = micros() - startUs;
+
+    // Parsing is in place, so each pass starts from a fresh copy
+    startUs = micros();
+    for (uint32_t i = 0; i < iterations; i++) {
+        memcpy(parse, json, jsonLength);
+        failures += codec::decodeJson(telemetry::kReadingSchema, parse, jsonLength, decoded) < 0;
+    }
+    uint32_t jsonDecodeUs = micros() - startUs;
+
+    startUs = micros();
+    for (uint32_t i = 0; i < iterations; i++) {
+        binaryLength = codec::encodeBinary(telemetry::kReadingSchema, sample, binary, telemetry::kReadingBinaryMax);
+    }
+    uint32_t binaryEncodeUs = micros() - startUs;
+
+    startUs = micros();
+    for (uint32_t i = 0; i < iterations; i++) {
+        failures += codec::decodeBinary(telemetry::kReadingSchema, binary, binaryLength, decoded) == 0;
+    }
+    uint32_t binaryDecodeUs = micros() - startUs;
+
+    response["iterations"] = iterations;
+    response["json_bytes"] = jsonLength;
+    response["binary_bytes"] = binaryLength;
+    response["json_encode_ns"] = (uint64_t)jsonEncodeUs * 1000 / iterations;
+    response["json_decode_ns"] = (uint64_t)jsonDecodeUs * 1000 / iterations;
+    response["binary_encode_ns"] = (uint64_t)binaryEncodeUs * 1000 / iterations;
+    response["binary_decode_ns"] = (uint64_t)binaryDecodeUs * 1000 / iterations;
+    response["failures"] = failures;
+    return failures == 0;
+}
+
+bool cmd_reboot(JsonObjectConst, JsonObject response){
+    schedule_reboot(1000);
+    response["reboot_in_ms"] = 1000;
+    return true;
+}
+
+constexpr command::Entry commandTable[] = {
+    COMMAND_ENTRY("set-interval", cmd_set_interval),
+    COMMAND_ENTRY("read-now", cmd_read_now),
+    COMMAND_ENTRY("flush-buffer", cmd_flush_buffer),
+    COMMAND_ENTRY("get-stats", cmd_get_stats),
+    COMMAND_ENTRY("reboot", cmd_reboot),
+    COMMAND_ENTRY("ota-update", cmd_ota_update),
+    COMMAND_ENTRY("get-config", cmd_get_config),
+    COMMAND_ENTRY("set-config", cmd_set_config),
+    COMMAND_ENTRY("reset-config", cmd_reset_config),
+    COMMAND_ENTRY("get-history", cmd_get_history),
+    COMMAND_ENTRY("get-summary", cmd_get_summary),
+    COMMAND_ENTRY("bench-codec", cmd_bench_codec),
+};
+
+CommandDispatcher dispatcher(commandTable, sizeof(commandTable) / sizeof(commandTable[0]), micros_now);
+
+// Room for every get-stats section at once, uptime_ms and the members
+// every reply has (id, action, ok, error, dispatch_us). Strings are not
+// copied into the document, they point at literals or the request payload.
+// Every other reply fits the 512 bytes this used to be.
+constexpr size_t kReplyCapacity = JSON_OBJECT_SIZE(stats_members() + 6) > 512
+                                      ? JSON_OBJECT_SIZE(stats_members() + 6)
+                                      : 512;
+
+}  // namespace
+
+void handle_command(uint8_t* payload, size_t length){
+    StaticJsonDocument<256> request;
+    StaticJsonDocument<kReplyCapacity> response;
+    CommandDispatcher::Result result = dispatcher.dispatch(payload, length, request, response);
+
+    // Time spent parsing and running this command
+    response["dispatch_us"] = dispatcher.stats().lastUs;
+    // ArduinoJson drops whatever does not fit; answer with the error instead
+    if (response.overflowed()) {
+        response.clear();
+        response["id"] = request["id"].as<const char*>();
+        response["action"] = request["action"].as<const char*>();
+        response["ok"] = false;
+        response["error"] = "reply too large";
+        result = CommandDispatcher::kFailed;
+    }
+    const char* replyTo = request["reply_to"] | topics.responses();
+
+    MessageArena::Scope scratch(messageArena);
+    size_t size = measureJson(response) + 1;
+    char* buffer = scratch.chars(size);
+    if (buffer == nullptr) {
+        // Counted in the arena's failures too; better no reply than a cut one
+        repliesDropped++;
+        Serial.print("Command reply dropped: ");
+        Serial.print(size);
+        Serial.println(" bytes do not fit in the message arena");
+        return;
+    }
+    size_t written = serializeJson(response, buffer, size);
+    // An outbox slot holds MQTT_OUTBOX_SLOT_DATA bytes of topic and payload,
+    // less than a full get-stats reply, so the fallback can refuse it
+    if (!client.publish(replyTo, (const uint8_t*)buffer, written, false) &&
+        !client.enqueue(replyTo, (const uint8_t*)buffer, written, false)) {
+        repliesDropped++;
+        Serial.print("Command reply dropped: ");
+        Serial.print(written);
+        Serial.println(" bytes could not be sent and do not fit an outbox slot");
+        return;
+    }
+
+    Serial.print("Command ");
+    Serial.print(CommandDispatcher::resultName(result));
+    Serial.print(": ");
+    Serial.println(buffer);
+}
+
+void print_command_stats(){
+    const CommandDispatcher::Stats& stats = dispatcher.stats();
+    Serial.print("Commands: ");
+    Serial.print(stats.dispatched);
+    Serial.print(" dispatched, ");
+    Serial.print(stats.rejected);
+    Serial.print(" rejected, dispatch avg ");
+    Serial.print(stats.dispatched + stats.rejected > 0 ? stats.totalUs / (stats.dispatched + stats.rejected) : 0);
+    Serial.print(" us, max ");
+    Serial.print(stats.maxUs);
+    Serial.println(" us");
+}
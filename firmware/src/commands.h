@@ -0,0 +1,14 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Parses and runs one /commands message, then publishes the response.
+// The payload buffer is parsed in place and modified.
+void handle_command(uint8_t* payload, size_t length);
+
+// Adds the dispatcher's counters to the serial stats dump
+void print_command_stats();
+
+#endif
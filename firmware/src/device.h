@@ -0,0 +1,48 @@
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <ArduinoJson.h>
+#include <config_defaults.h>
+#include <AdaptiveSampler.h>
+#include <AnomalyDetector.h>
+#include <EpochClock.h>
+#include <MqttClient.h>
+#include <AsyncTcpTransport.h>
+#include <MessageArena.h>
+#include <TlsTransport.h>
+#include <RuntimeConfig.h>
+#include <SntpClient.h>
+#include <TelemetryPayload.h>
+#include <TopicScheme.h>
+
+// Objects and hooks owned by main.cpp that the command handlers act on
+extern MqttClient client;
+extern AsyncTcpTransport mqttTransport;
+#if MQTT_TLS
+extern TlsTransport mqttTls;
+#endif
+extern AdaptiveSampler sampler;
+extern AnomalyDetector detector;
+extern EpochClock epochClock;
+extern SntpClient sntp;
+extern RuntimeConfig runtimeConfig;
+extern TopicScheme topics;
+extern MessageArena messageArena;
+extern uint32_t alertsPublished;
+extern uint32_t alertsQueued;
+extern uint32_t alertsLost;
+extern telemetry::StateFilter stateFilter;
+extern uint32_t alertLatencyMaxUs;
+extern uint32_t publishCallMaxUs;
+extern uint32_t inboundBytesLastCycle;
+extern uint32_t inboundBytesMaxCycle;
+
+uint64_t mono_ms();
+
+// Takes a reading on the next loop() pass regardless of the schedule
+void request_sample_now();
+
+// Restarts once delayMs has passed, so the acknowledgement can go out first
+void schedule_reboot(uint32_t delayMs);
+
+#endif
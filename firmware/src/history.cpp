@@ -0,0 +1,287 @@
+#include <Arduino.h>
+#include <HistoryCodec.h>
+#include <ReadingLog.h>
+#include <config_defaults.h>
+
+#include "device.h"
+#include "history.h"
+
+namespace {
+
+PartitionFlash historyFlash(HISTORY_PARTITION);
+ReadingLog readingLog(historyFlash);
+bool logReady = false;
+
+// One stream at a time, with fixed buffers so streaming never allocates
+struct Stream {
+    bool active;
+    char* topic;                // TOPIC_MAX_LENGTH, from the message arena
+    int64_t fromMs;
+    int64_t toMs;
+    uint32_t cursor;
+    uint32_t endCursor;
+    uint16_t chunkRecords;
+    downsample::Method method;
+    uint8_t channel;
+    uint32_t ratio;
+    uint16_t windowSize;
+    uint16_t windowFill;
+    uint32_t windowReadings;    // readings the window stands for
+    uint16_t pending;       // records in chunkRecords waiting to be sent
+    uint32_t startMs;
+    uint32_t records;
+    uint32_t bytes;
+};
+Stream stream = {};
+LogRecord chunkRecords[HISTORY_CHUNK_MAX_RECORDS];
+const size_t kChunkBufferSize = history::kHeaderSize + HISTORY_CHUNK_MAX_RECORDS * history::kMaxRecordSize;
+uint8_t* chunkBuffer = nullptr;     // from the message arena
+LogRecord window[HISTORY_DOWNSAMPLE_WINDOW];
+downsample::Point windowPoints[HISTORY_DOWNSAMPLE_WINDOW];
+uint16_t windowSelected[HISTORY_DOWNSAMPLE_WINDOW];
+downsample::GroupExtremes<LogRecord> windowGroups;
+HistoryStats stats = {};
+
+int16_t to_centi(float value){
+    return (int16_t)lroundf(value * 100.0f);
+}
+
+void track_memory(){
+    uint32_t heapFree = ESP.getMinFreeHeap();
+    uint32_t stackFree = uxTaskGetStackHighWaterMark(NULL) * sizeof(StackType_t);
+    if (stats.heapMinFree == 0 || heapFree < stats.heapMinFree) {
+        stats.heapMinFree = heapFree;
+    }
+    if (stats.stackMinFree == 0 || stackFree < stats.stackMinFree) {
+        stats.stackMinFree = stackFree;
+    }
+}
+
+float channel_value(const LogRecord& record){
+    return stream.channel == 0 ? record.temperatureCenti : record.humidityCenti;
+}
+
+// Reads the next window of readings and keeps the kernel's pick of them in
+// chunkRecords. The window covers ratio readings per point and at most one
+// chunk's worth of points, so every window goes out as a single chunk whose
+// cursor resumes after it. When that is more readings than the window holds,
+// they go in as the min and max of each group (see GroupExtremes). Returns
+// false while the window is still filling.
+bool downsample_window(){
+    uint32_t group = windowGroups.size();
+    uint32_t room = stream.windowSize - stream.windowFill;
+    uint32_t wanted = group == 1 ? room : room / 2 * group - windowGroups.count();
+    // chunkRecords is free while nothing is pending, so it doubles as scratch
+    size_t read = readingLog.readRange(&stream.cursor, stream.endCursor, stream.fromMs, stream.toMs, chunkRecords,
+                                       min<uint32_t>(wanted, HISTORY_CHUNK_MAX_RECORDS));
+    for (size_t i = 0; i < read; i++) {
+        if (windowGroups.add(chunkRecords[i], channel_value(chunkRecords[i]))) {
+            stream.windowFill += windowGroups.take(window + stream.windowFill);
+        }
+    }
+    stream.windowReadings += read;
+    bool finished = stream.cursor >= stream.endCursor;
+    if (finished) {
+        stream.windowFill += windowGroups.take(window + stream.windowFill);
+    }
+    bool full = group == 1 ? stream.windowFill >= stream.windowSize : stream.windowFill + 2 > stream.windowSize;
+    if (!full && !finished) {
+        return false;
+    }
+
+    uint32_t startUs = micros();
+    int64_t baseMs = stream.windowFill > 0 ? window[0].timestampMs : 0;
+    for (uint16_t i = 0; i < stream.windowFill; i++) {
+        windowPoints[i].x = (window[i].timestampMs - baseMs) / 1000.0f;
+        windowPoints[i].y = channel_value(window[i]);
+    }
+    size_t target = max<size_t>(stream.windowReadings / stream.ratio, 3);
+    size_t kept = downsample::run(stream.method, windowPoints, stream.windowFill,
+                                  min<size_t>(target, stream.chunkRecords), windowSelected);
+    uint32_t elapsedUs = micros() - startUs;
+    if (elapsedUs > stats.downsampleMaxUs) {
+        stats.downsampleMaxUs = elapsedUs;
+    }
+
+    kept = min<size_t>(kept, stream.chunkRecords);
+    for (size_t i = 0; i < kept; i++) {
+        chunkRecords[i] = window[windowSelected[i]];
+    }
+    stats.readingsIn += stream.windowReadings;
+    stats.pointsOut += kept;
+    stream.pending = kept;
+    stream.windowFill = 0;
+    stream.windowReadings = 0;
+    return true;
+}
+
+void finish_stream(){
+    uint32_t elapsedMs = millis() - stream.startMs;
+    if (elapsedMs == 0) {
+        elapsedMs = 1;
+    }
+    stream.active = false;
+    stats.streams++;
+    stats.recordsPerSecond = (uint32_t)((uint64_t)stream.records * 1000 / elapsedMs);
+    stats.bytesPerSecond = (uint32_t)((uint64_t)stream.bytes * 1000 / elapsedMs);
+
+    Serial.print("History stream done: ");
+    Serial.print(stream.records);
+    Serial.print(" readings, ");
+    Serial.print(stream.bytes);
+    Serial.print(" bytes in ");
+    Serial.print(elapsedMs);
+    Serial.println(" ms");
+}
+
+}  // namespace
+
+bool history_begin(){
+    logReady = historyFlash.valid() && readingLog.begin();
+    // Stream buffers are only reserved when there is a log to stream from
+    if (logReady && chunkBuffer == nullptr) {
+        stream.topic = (char*)messageArena.reserve(TOPIC_MAX_LENGTH);
+        chunkBuffer = (uint8_t*)messageArena.reserve(kChunkBufferSize);
+        logReady = stream.topic != nullptr && chunkBuffer != nullptr;
+    }
+    return logReady;
+}
+
+void history_record(int64_t epochMs, bool timeSynced, float temperature, float humidity, int rssi){
+    if (!logReady) {
+        return;
+    }
+    LogRecord record = {};
+    record.timestampMs = epochMs;
+    record.temperatureCenti = to_centi(temperature);
+    record.humidityCenti = (uint16_t)to_centi(humidity);
+    record.rssi = (int8_t)constrain(rssi, -128, 0);
+    record.flags = timeSynced ? LogRecord::kTimeSynced : 0;
+    readingLog.append(record);
+}
+
+bool history_start(const HistoryRequest& request, HistoryStreamInfo* info){
+    if (!logReady || strlen(request.topic) >= TOPIC_MAX_LENGTH) {
+        return false;
+    }
+    strcpy(stream.topic, request.topic);
+    stream.fromMs = request.fromMs;
+    stream.toMs = request.toMs;
+    stream.cursor = max(request.cursor, readingLog.seek(request.fromMs));
+    // Readings stored while streaming are not included, so the stream ends
+    stream.endCursor = readingLog.nextSeq();
+    stream.chunkRecords = constrain(request.chunkRecords, 1, HISTORY_CHUNK_MAX_RECORDS);
+    stream.method = request.method;
+    stream.channel = request.channel;
+    stream.ratio = 1;
+    if (stream.method != downsample::kNone && request.points > 0) {
+        // The index gives the reading count without touching the readings
+        RangeAggregate aggregate;
+        readingLog.aggregate(request.fromMs, request.toMs, &aggregate);
+        stream.ratio = max<uint32_t>((aggregate.count + request.points - 1) / request.points, 1);
+    }
+    if (stream.ratio == 1) {
+        stream.method = downsample::kNone;
+    } else {
+        stream.chunkRecords = max<uint16_t>(stream.chunkRecords, 3);  // LTTB keeps both ends plus one
+    }
+    uint32_t covered = stream.ratio * stream.chunkRecords;
+    stream.windowSize = min<uint32_t>(covered, HISTORY_DOWNSAMPLE_WINDOW);
+    windowGroups.reset(covered <= HISTORY_DOWNSAMPLE_WINDOW ? 1 : (2 * covered + HISTORY_DOWNSAMPLE_WINDOW - 1) /
+                                                                        HISTORY_DOWNSAMPLE_WINDOW);
+    stream.windowFill = 0;
+    stream.windowReadings = 0;
+    stream.pending = 0;
+    stream.startMs = millis();
+    stream.records = 0;
+    stream.bytes = 0;
+    stream.active = true;
+    info->startCursor = stream.cursor;
+    info->endCursor = stream.endCursor;
+    info->ratio = stream.ratio;
+    return true;
+}
+
+bool history_streaming(){
+    return stream.active;
+}
+
+bool history_aggregate(int64_t fromMs, int64_t toMs, RangeAggregate* aggregate){
+    if (!logReady) {
+        return false;
+    }
+    readingLog.aggregate(fromMs, toMs, aggregate);
+    return true;
+}
+
+void history_poll(){
+    if (!stream.active || !client.connected() || client.congested()) {
+        return;
+    }
+    // Leave at least half the transport buffer to telemetry and alerts
+    size_t worstCase = history::maxChunkSize(stream.chunkRecords) + strlen(stream.topic) + 8;
+    if (mqttTransport.txQueued() + worstCase > mqttTransport.txCapacity() / 2) {
+        return;
+    }
+
+    // A chunk stays in chunkRecords until it is published, so a full
+    // transport only delays it to a later pass
+    if (stream.pending == 0) {
+        if (stream.method != downsample::kNone) {
+            if (!downsample_window()) {
+                return;
+            }
+        } else {
+            stream.pending = readingLog.readRange(&stream.cursor, stream.endCursor, stream.fromMs, stream.toMs,
+                                                  chunkRecords, stream.chunkRecords);
+        }
+    }
+    bool last = stream.cursor >= stream.endCursor;
+    if (stream.pending == 0 && !last) {
+        return;  // Nothing in range in this stretch, keep scanning next pass
+    }
+
+    size_t length = history::encodeChunk(chunkBuffer, kChunkBufferSize, chunkRecords, stream.pending,
+                                         stream.cursor, last);
+    if (!client.publish(stream.topic, chunkBuffer, length, false)) {
+        return;
+    }
+    stream.records += stream.pending;
+    stream.pending = 0;
+    stream.bytes += length;
+    if (length > stats.chunkBytesMax) {
+        stats.chunkBytesMax = length;
+    }
+    track_memory();
+    if (last) {
+        finish_stream();
+    }
+}
+
+HistoryStats history_stats(){
+    stats.stored = logReady ? readingLog.nextSeq() - readingLog.firstSeq() : 0;
+    return stats;
+}
+
+void print_history_stats(){
+    HistoryStats current = history_stats();
+    Serial.print("History: ");
+    Serial.print(current.stored);
+    Serial.print(" readings stored, ");
+    Serial.print(current.streams);
+    Serial.print(" streams, last ");
+    Serial.print(current.recordsPerSecond);
+    Serial.print(" readings/s (");
+    Serial.print(current.bytesPerSecond);
+    Serial.print(" B/s), min free heap ");
+    Serial.print(current.heapMinFree);
+    Serial.print(" B, min free stack ");
+    Serial.print(current.stackMinFree);
+    Serial.print(" B, downsampled ");
+    Serial.print(current.readingsIn);
+    Serial.print(" -> ");
+    Serial.print(current.pointsOut);
+    Serial.print(" points, kernel max ");
+    Serial.print(current.downsampleMaxUs);
+    Serial.println(" us");
+}
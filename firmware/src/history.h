@@ -0,0 +1,60 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Downsample.h>
+#include <ReadingLog.h>
+
+// Opens the history partition; false if it is missing from the partition table.
+bool history_begin();
+
+// Stores one reading in the on-flash log.
+void history_record(int64_t epochMs, bool timeSynced, float temperature, float humidity, int rssi);
+
+struct HistoryRequest {
+    const char* topic;
+    int64_t fromMs;             // readings with fromMs <= timestamp < toMs
+    int64_t toMs;
+    uint32_t cursor;            // resume point, 0 for the start of the range
+    uint16_t chunkRecords;
+    downsample::Method method;  // kNone sends every reading
+    uint32_t points;            // downsampling target for the whole range
+    uint8_t channel;            // 0 temperature, 1 humidity: what the kernel looks at
+};
+
+struct HistoryStreamInfo {
+    uint32_t startCursor;
+    uint32_t endCursor;         // where the stream will stop
+    uint32_t ratio;             // readings per point sent, 1 when not downsampling
+};
+
+// Starts streaming to request.topic, replacing any stream in progress.
+bool history_start(const HistoryRequest& request, HistoryStreamInfo* info);
+bool history_streaming();
+
+// Count, sums and extremes of the stored readings in [fromMs, toMs),
+// answered mostly from the per-sector index.
+bool history_aggregate(int64_t fromMs, int64_t toMs, RangeAggregate* aggregate);
+
+// Sends at most one chunk, and only while the link has spare room; call
+// every loop() pass.
+void history_poll();
+
+struct HistoryStats {
+    uint32_t stored;            // readings currently in the log
+    uint32_t streams;           // streams finished
+    uint32_t recordsPerSecond;  // of the last finished stream
+    uint32_t bytesPerSecond;
+    size_t chunkBytesMax;       // largest chunk sent
+    uint32_t heapMinFree;       // lowest free heap seen while streaming
+    uint32_t stackMinFree;      // lowest free loop() stack seen while streaming
+    uint32_t readingsIn;        // read from flash while downsampling
+    uint32_t pointsOut;         // kept by the downsampling kernels
+    uint32_t downsampleMaxUs;   // slowest kernel run over one window
+};
+HistoryStats history_stats();
+
+void print_history_stats();
+
+#endif
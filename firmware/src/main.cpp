@@ -1,18 +1,318 @@
 #include <WiFi.h>
-#include <PubSubClient.h>
+#include <MqttClient.h>
+#include <AsyncTcpTransport.h>
 #include <ArduinoJson.h>
 #include <DHT.h>
-#include <config.h>
+#include <config_defaults.h>
+#include <AdaptiveSampler.h>
+#include <AnomalyDetector.h>
+#include <EpochClock.h>
+#include <SntpClient.h>
+#include <CommandDispatcher.h>
+#include <RuntimeConfig.h>
+#include <TopicScheme.h>
+#include <MessageArena.h>
+#include <TelemetryPayload.h>
+#include <esp_timer.h>
+
+#include "commands.h"
+#include "device.h"
+#include "history.h"
+#include "memory.h"
+#include "ota.h"
 
 // prototype functions
 void setup_wifi();
 void reconnect();
+void on_mqtt_connected();
 void callback(char* topic, byte* payload, unsigned int length);
 
-WiFiClient espClient;
-PubSubClient client(espClient);
+uint32_t now_ms(){
+    return millis();
+}
+
+AsyncTcpTransport mqttTransport;
+MqttOutbox::Slot outboxSlots[MQTT_OUTBOX_CAPACITY];
+MqttOutbox outbox(outboxSlots, MQTT_OUTBOX_CAPACITY, MQTT_INFLIGHT_WINDOW, MQTT_MESSAGE_MAX_AGE);
+#if MQTT_TLS
+TlsTransport mqttTls(mqttTransport);
+MqttClient client(mqttTls, outbox, now_ms);
+#else
+MqttClient client(mqttTransport, outbox, now_ms);
+#endif
+bool connectAttemptPending = false;
+bool connectAttempted = false;
+uint32_t lastConnectAttemptMs = 0;
+uint32_t publishCallMaxUs = 0;
+uint32_t readingSeq = 0;        // readings published since boot, in each payload
+TopicScheme topics;
+TopicMatcher commandTopics[3];
+alignas(4) uint8_t messageArenaStorage[MESSAGE_ARENA_SIZE];
+MessageArena messageArena(messageArenaStorage, sizeof(messageArenaStorage));
+const size_t kDeviceIdLength = 24;     // "ESP32-" and a MAC, either form
+char* clientId = nullptr;       // ESP32-AABBCCDDEEFF, also the topic level
+char* deviceId = nullptr;       // ESP32-AA:BB:CC:DD:EE:FF, in payloads
+bool rebootScheduled = false;
+uint32_t rebootAtMs = 0;
+telemetry::StateFilter stateFilter(STATE_TEMP_DELTA, STATE_HUM_DELTA);
 DHT dht(DHTPIN, DHTTYPE);
 
+// 64-bit monotonic milliseconds; unlike millis() it does not wrap after 49 days
+uint64_t mono_ms(){
+    return (uint64_t)(esp_timer_get_time() / 1000);
+}
+
+EpochClock epochClock({NTP_MAX_SLEW_PPM, 200, NTP_STEP_THRESHOLD});
+SntpClient sntp(epochClock, mono_ms);
+
+// Channel 0 is temperature, channel 1 is humidity
+const AdaptiveSampler::Config samplerConfig = {
+    SAMPLE_INTERVAL_MIN,
+    SAMPLE_INTERVAL_MAX,
+    PUBLISH_INTERVAL,
+    60000,  // tauMs
+    1.5f,   // growFactor
+    SAMPLE_CALM_SAMPLES,
+    2,
+    {
+        {SAMPLE_TEMP_RATE_ENTER, SAMPLE_TEMP_RATE_EXIT, SAMPLE_TEMP_STDDEV_ENTER, SAMPLE_TEMP_STDDEV_EXIT},
+        {SAMPLE_HUM_RATE_ENTER, SAMPLE_HUM_RATE_EXIT, SAMPLE_HUM_STDDEV_ENTER, SAMPLE_HUM_STDDEV_EXIT},
+    },
+};
+AdaptiveSampler sampler(samplerConfig);
+
+const AnomalyDetector::Config detectorConfig = {
+    0.05f,  // alpha, slow baseline so a sudden change stands out
+    ALERT_Z_ENTER,
+    ALERT_Z_CLEAR,
+    0.2f,   // minStddev, about twice the DHT22 resolution
+    ALERT_WARMUP_SAMPLES,
+    2,
+    {
+        {ALERT_TEMP_MIN, ALERT_TEMP_MAX, 0.5f},
+        {ALERT_HUM_MIN, ALERT_HUM_MAX, 2.0f},
+    },
+};
+AnomalyDetector detector(detectorConfig);
+
+const DeviceConfig defaultDeviceConfig = {
+    SAMPLE_INTERVAL_MIN,
+    SAMPLE_INTERVAL_MAX,
+    SAMPLE_TEMP_RATE_ENTER,
+    SAMPLE_TEMP_RATE_EXIT,
+    SAMPLE_HUM_RATE_ENTER,
+    SAMPLE_HUM_RATE_EXIT,
+    ALERT_TEMP_MIN,
+    ALERT_TEMP_MAX,
+    ALERT_HUM_MIN,
+    ALERT_HUM_MAX,
+    ALERT_Z_ENTER,
+    MQTT_INFLIGHT_WINDOW,
+    LOG_LEVEL,
+    {0, 0},
+    HISTORY_BACKLOG_POINTS,
+    HISTORY_BACKLOG_METHOD,
+    {0, 0, 0},
+};
+NvsConfigStore configStore("devcfg");
+RuntimeConfig runtimeConfig(configStore, defaultDeviceConfig);
+const char* const channelNames[2] = {"temperature", "humidity"};
+uint32_t alertsPublished = 0;
+uint32_t alertsQueued = 0;      // immediate publish failed, sent through the outbox
+uint32_t alertsLost = 0;        // neither went out nor fit the outbox
+uint32_t alertLatencyMaxUs = 0;
+uint32_t lastSampleMs = 0;
+uint32_t nextSampleDelayMs = 0;
+bool brokerWasConnected = false;
+int64_t brokerLostAtMs = 0;     // epoch ms the broker link dropped, 0 while up
+uint32_t bytesInAtLastSample = 0;
+uint32_t inboundBytesLastCycle = 0;
+uint32_t inboundBytesMaxCycle = 0;
+
+// Retained presence on the status topic. Going offline without this (power
+// loss, crash, WiFi) is covered by the Last Will the broker holds.
+void publish_presence(bool online){
+    MessageArena::Scope scratch(messageArena);
+    char* buffer = scratch.chars(128);
+    size_t length = telemetry::writePresence(online, epochClock.now(mono_ms()), epochClock.synced(), buffer, 128);
+    if (length > 0 && !client.publish(topics.status(), (const uint8_t*)buffer, length, true) && online) {
+        client.enqueue(topics.status(), (const uint8_t*)buffer, length, true);
+    }
+}
+
+// Retained last known reading, so a new subscriber gets every device's state
+// at once. Only refreshed when a value moves by STATE_*_DELTA, so the broker
+// rewrites its retained store now and then instead of on every reading.
+void publish_state(int64_t epochMs, bool timeSynced, float temperature, float humidity){
+    if (!stateFilter.changed(temperature, humidity)) {
+        return;
+    }
+    // kStateSchema writes none of heat index, RSSI, seq or publish delay
+    telemetry::Reading reading = {deviceId, epochMs, timeSynced, temperature, humidity, 0, 0, 0, 0};
+    MessageArena::Scope scratch(messageArena);
+    char* buffer = scratch.chars(telemetry::kStateJsonMax);
+    size_t length = telemetry::writeState(reading, buffer, telemetry::kStateJsonMax);
+    // The outbox keeps retained messages until delivered, replacing a queued
+    // one with the newer, so what it accepts is what the broker will hold.
+    // It only refuses one too large for a slot; that retries next reading.
+    if (length > 0 && client.enqueue(topics.state(), (const uint8_t*)buffer, length, true)) {
+        stateFilter.accept(temperature, humidity);
+    }
+}
+
+// Publishes straight away on the alerts topic, before the regular reading
+void publish_alert(const AnomalyDetector::Event& event, uint32_t detectedUs){
+    telemetry::Alert alert = {
+        deviceId,
+        epochClock.now(mono_ms()),
+        epochClock.synced(),
+        channelNames[event.channel],
+        AnomalyDetector::kindName(event.kind),
+        event.value,
+        event.mean,
+        event.z,
+    };
+    MessageArena::Scope scratch(messageArena);
+    char* alertBuffer = scratch.chars(256);
+    size_t alertLength = telemetry::writeAlert(alert, alertBuffer, 256);
+    bool published = alertLength > 0 &&
+                     client.publish(topics.alerts(), (const uint8_t*)alertBuffer, alertLength, false);
+    uint32_t latencyUs = micros() - detectedUs;
+
+    const char* outcome = "⚠ Alert published: ";
+    if (published) {
+        alertsPublished++;
+        if (latencyUs > alertLatencyMaxUs) {
+            alertLatencyMaxUs = latencyUs;
+        }
+    } else if (alertLength > 0 &&
+               client.enqueue(topics.alerts(), (const uint8_t*)alertBuffer, alertLength, false)) {
+        // The detector stays latched until the channel recovers, so this is
+        // the only chance; QoS 1 carries it across the outage
+        alertsQueued++;
+        outcome = "⚠ Alert queued for QoS 1: ";
+    } else {
+        alertsLost++;
+        outcome = "✗ Alert lost: ";
+    }
+    Serial.print(outcome);
+    Serial.print(alertBuffer);
+    Serial.print(" (detection to publish ");
+    Serial.print(latencyUs);
+    Serial.print(" us, max ");
+    Serial.print(alertLatencyMaxUs);
+    Serial.println(" us)");
+}
+
+void print_stats(){
+    AdaptiveSampler::Stats stats = sampler.stats();
+    Serial.print("Sampler: ");
+    Serial.print(stats.samplesTaken);
+    Serial.print(" samples taken vs ");
+    Serial.print(stats.fixedScheduleSamples);
+    Serial.print(" on a fixed schedule, interval=");
+    Serial.print(sampler.intervalMs());
+    Serial.print(" ms, ");
+    Serial.println(sampler.isActive() ? "active" : "calm");
+
+    Serial.print("Clock: ");
+    Serial.print(epochClock.synced() ? "synced" : "not synced");
+    Serial.print(", last offset ");
+    Serial.print((long)epochClock.lastOffsetMs());
+    Serial.print(" ms, drift ");
+    Serial.print(epochClock.driftPpm());
+    Serial.print(" ppm, rtt ");
+    Serial.print(sntp.lastRoundTripMs());
+    Serial.println(" ms");
+
+    MqttOutbox::Stats mqttStats = client.stats();
+    Serial.print("MQTT QoS1: ");
+    Serial.print(mqttStats.delivered);
+    Serial.print(" delivered, ");
+    Serial.print(mqttStats.retransmitted);
+    Serial.print(" retransmitted, ");
+    Serial.print(mqttStats.expired);
+    Serial.print(" expired, ");
+    Serial.print(mqttStats.inflight);
+    Serial.print(" in flight, ");
+    Serial.print(mqttStats.depth);
+    Serial.print(" queued, ");
+    Serial.print(mqttTransport.txQueued());
+    Serial.print(" bytes buffered, publish call max ");
+    Serial.print(publishCallMaxUs);
+    Serial.println(" us");
+
+    Serial.print("MQTT inbound: ");
+    Serial.print(client.bytesIn());
+    Serial.print(" bytes in ");
+    Serial.print(client.publishesIn());
+    Serial.print(" messages, last cycle ");
+    Serial.print(inboundBytesLastCycle);
+    Serial.print(" bytes, max ");
+    Serial.print(inboundBytesMaxCycle);
+    Serial.println(" bytes");
+
+    Serial.print("MQTT outbound: ");
+    Serial.print(client.bytesOut());
+    Serial.print(" bytes, protocol ");
+    Serial.print(client.protocol() == 5 ? "5" : "3.1.1");
+    Serial.print(", ");
+    Serial.print(client.topicAliasesInUse());
+    Serial.print(" topic aliases, ");
+    Serial.print(stateFilter.updates());
+    Serial.println(" retained state updates");
+
+#if MQTT_TLS
+    TlsTransport::Stats tlsStats = mqttTls.stats();
+    Serial.print("TLS: ");
+    Serial.print(tlsStats.fullHandshakes);
+    Serial.print(" full (cpu max ");
+    Serial.print(tlsStats.fullCpuMsMax);
+    Serial.print(" ms), ");
+    Serial.print(tlsStats.resumedHandshakes);
+    Serial.print(" resumed (cpu max ");
+    Serial.print(tlsStats.resumedCpuMsMax);
+    Serial.print(" ms), ");
+    Serial.print(tlsStats.failedHandshakes);
+    Serial.print(" failed, last ");
+    Serial.print(tlsStats.lastResumed ? "resumed " : "full ");
+    Serial.print(tlsStats.lastHandshakeMs);
+    Serial.print(" ms, heap ");
+    Serial.print(tlsStats.setupHeap);
+    Serial.print(" + ");
+    Serial.print(tlsStats.handshakeHeapMax);
+    Serial.print(" bytes, session ");
+    Serial.print(tlsStats.sessionBytes);
+    Serial.println(tlsStats.sessionInRtc ? " bytes in RTC" : " bytes in RAM");
+#endif
+
+    print_memory_stats();
+    print_command_stats();
+    print_history_stats();
+    print_ota_stats();
+}
+
+// Pushes a new configuration into the live objects; flash is not touched here
+void apply_config(const DeviceConfig& config){
+    sampler.setIntervals(config.sampleMinMs, config.sampleMaxMs);
+    sampler.setRateLimits(0, config.tempRateEnter, config.tempRateExit);
+    sampler.setRateLimits(1, config.humRateEnter, config.humRateExit);
+    detector.setBand(0, config.alertTempMin, config.alertTempMax);
+    detector.setBand(1, config.alertHumMin, config.alertHumMax);
+    detector.setZEnter(config.alertZEnter);
+    outbox.setWindow(config.inflightWindow);
+}
+
+void request_sample_now(){
+    sampler.forceFast();
+    nextSampleDelayMs = 0;
+}
+
+void schedule_reboot(uint32_t delayMs){
+    rebootScheduled = true;
+    rebootAtMs = millis() + delayMs;
+}
+
 void setup_wifi(){
     Serial.print("Connecting to WiFi: ");
     Serial.println(WIFI_SSID);
@@ -33,56 +333,95 @@ void setup_wifi(){
     Serial.println(" dBm");
 }
 
+// Starts a connection attempt when due; never waits on the network
 void reconnect(){
-    while (!client.connected()){
-        Serial.print("Attempting MQTT connection...");
-        // Create unique client ID using MAC address
-        String clientId = "ESP32-" + WiFi.macAddress();
-        clientId.replace(":", "");
-        Serial.print("Client ID: ");
-        Serial.println(clientId);
-        
-        if (client.connect(clientId.c_str())){
-            Serial.println(" connected!");
-            Serial.println("Connected to MQTT broker");
-            client.subscribe("5a728254-5316-45c6-bf3c-de194f1afa53/sensor_data");
-            client.subscribe("5a728254-5316-45c6-bf3c-de194f1afa53/commands");  // For future remote commands
-            Serial.println("Subscribed to topics");
-        } else {
-            Serial.print(" failed, rc=");
-            Serial.print(client.state());
-            Serial.println(" retrying in 10 seconds...");
-            delay(10000);  // Increased delay to avoid rate limiting
-        }
+    if (client.connected() || client.connecting()){
+        return;
+    }
+    if (connectAttemptPending){
+        connectAttemptPending = false;
+        Serial.print("MQTT connection failed, rc=");
+        Serial.print(client.state());
+        Serial.println(" retrying in 10 seconds...");
+    }
+    uint32_t now = millis();
+    if (connectAttempted && now - lastConnectAttemptMs < RECONNECT_DELAY){
+        return;  // Keep the delay to avoid rate limiting
+    }
+    connectAttempted = true;
+    lastConnectAttemptMs = now;
+
+    Serial.print("Attempting MQTT connection...");
+    Serial.print("Client ID: ");
+    Serial.println(clientId);
+    connectAttemptPending = client.connect(clientId);
+    if (!connectAttemptPending){
+        Serial.print(" failed to start, rc=");
+        Serial.println(client.state());
+    }
+}
+
+// Readings older than what the outbox holds never reached the broker during
+// an outage; send the whole gap from the history log, downsampled per the
+// configured policy, unless a requested stream is already running
+void drain_backlog(){
+    int64_t nowMs = epochClock.now(mono_ms());
+    if (brokerLostAtMs == 0 || nowMs - brokerLostAtMs < HISTORY_BACKLOG_MIN_GAP || history_streaming()) {
+        return;
+    }
+    const DeviceConfig& config = runtimeConfig.get();
+    HistoryRequest request = {
+        topics.backlog(),
+        brokerLostAtMs,
+        nowMs,
+        0,
+        HISTORY_CHUNK_RECORDS,
+        (downsample::Method)config.backlogMethod,
+        config.backlogPoints,
+        0,
+    };
+    HistoryStreamInfo info;
+    if (history_start(request, &info)) {
+        Serial.print("Sending ");
+        Serial.print((long)((nowMs - brokerLostAtMs) / 1000));
+        Serial.print(" s of missed readings, 1 point per ");
+        Serial.print(info.ratio);
+        Serial.println(" readings");
     }
 }
 
+void on_mqtt_connected(){
+    connectAttemptPending = false;
+    Serial.println("Connected to MQTT broker");
+    // Only command topics: the device never subscribes to what it publishes,
+    // so none of its own readings come back to it
+    for (const TopicMatcher& matcher : commandTopics) {
+        client.subscribe(matcher.topic());
+        Serial.print("Subscribed to ");
+        Serial.println(matcher.topic());
+    }
+    publish_presence(true);
+    drain_backlog();
+    brokerLostAtMs = 0;
+}
+
 void callback(char* topic, byte* payload, unsigned int length){
+    size_t topicLength = strlen(topic);
+    for (const TopicMatcher& matcher : commandTopics) {
+        if (matcher.matches(topic, topicLength)) {
+            handle_command(payload, length);
+            return;
+        }
+    }
+    if (runtimeConfig.get().logLevel < kLogDebug) {
+        return;
+    }
+
     Serial.print("Message received on topic: ");
     Serial.println(topic);
-    
-    String message;
-    for (unsigned int i = 0; i < length; i++){
-        message += (char)payload[i];
-    }
-    
     Serial.print("Message content: ");
-    Serial.println(message);
-    
-    // Parse JSON if it's a command
-    if (String(topic).endsWith("/commands")) {
-        StaticJsonDocument<100> cmdDoc;
-        DeserializationError error = deserializeJson(cmdDoc, message);
-        
-        if (!error) {
-            if (cmdDoc.containsKey("action")) {
-                String action = cmdDoc["action"];
-                Serial.print("Command received: ");
-                Serial.println(action);
-                // Add command handling here in the future
-            }
-        }
-    }
+    Serial.write(payload, length);
+    Serial.println();
 }
 
 void setup(){
@@ -90,9 +429,61 @@ void setup(){
     Serial.println();
     Serial.println("=== ESP32 IoT Temperature Tracker ===");
     Serial.println("Starting system initialization...");
+    ota_begin();
     
+    runtimeConfig.setApplyCallback(apply_config);
+    if (runtimeConfig.load()) {
+        Serial.print("Loaded configuration revision ");
+        Serial.println(runtimeConfig.revision());
+    } else {
+        Serial.println("Using default configuration");
+    }
+
     setup_wifi();  
+
+    // Unique client ID from the MAC address; it is also the device level of
+    // every topic. Built once into buffers reserved from the message arena.
+    clientId = (char*)messageArena.reserve(kDeviceIdLength);
+    deviceId = (char*)messageArena.reserve(kDeviceIdLength);
+    if (clientId == nullptr || deviceId == nullptr) {
+        Serial.println("ERROR: MESSAGE_ARENA_SIZE too small, restarting");
+        ESP.restart();
+    }
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    snprintf(clientId, kDeviceIdLength, "ESP32-%02X%02X%02X%02X%02X%02X", mac[0], mac[1], mac[2], mac[3], mac[4],
+             mac[5]);
+    snprintf(deviceId, kDeviceIdLength, "ESP32-%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3],
+             mac[4], mac[5]);
+    size_t topicBytes = TopicScheme::storageSize(TOPIC_BASE, DEVICE_SITE, clientId);
+    if (topicBytes == 0) {
+        Serial.println("ERROR: TOPIC_BASE or DEVICE_SITE is not a valid topic level");
+    } else {
+        char* topicStorage = (char*)messageArena.reserve(topicBytes);
+        if (topicStorage == nullptr) {
+            Serial.println("ERROR: MESSAGE_ARENA_SIZE too small, restarting");
+            ESP.restart();
+        }
+        topics.build(TOPIC_BASE, DEVICE_SITE, clientId, topicStorage, topicBytes);
+        Serial.print("Topics: ");
+        Serial.print(topicBytes);
+        Serial.println(" bytes reserved from the message arena");
+    }
+    Serial.print("Publishing telemetry to ");
+    Serial.println(topics.telemetry());
+    client.setWill(topics.status(), (const uint8_t*)telemetry::kWill, telemetry::kWillLength, true);
+
+    Serial.print("Syncing time with SNTP server: ");
+    Serial.println(NTP_SERVER);
+    sntp.setIntervals(NTP_SYNC_INTERVAL, NTP_RETRY_INTERVAL);
+    sntp.begin(NTP_SERVER, NTP_PORT);
     
+    if (history_begin()) {
+        Serial.println("Reading history ready");
+    } else {
+        Serial.println("WARNING: no history partition, readings will not be stored");
+    }
+
     Serial.println("Initializing DHT sensor...");
     dht.begin();
     delay(2000); // Give sensor time to stabilize
@@ -101,34 +492,140 @@ void setup(){
     Serial.print("Connecting to MQTT broker: ");
     Serial.println(MQTT_BROKER);
     client.setServer(MQTT_BROKER, MQTT_PORT);
+#if MQTT_TLS
+    if (!mqttTls.begin(MQTT_TLS_CA_CERT, MQTT_TLS_ECDSA, MQTT_TLS_RESUME)) {
+        Serial.print("ERROR: TLS setup failed, mbedTLS error ");
+        Serial.println(mqttTls.stats().lastError);
+    }
+#endif
+    client.setProtocol(MQTT_PROTOCOL_VERSION);
+    commandTopics[0].set(topics.commands());
+    commandTopics[1].set(topics.siteCommands());
+    commandTopics[2].set(topics.tenantCommands());
     client.setCallback(callback);
+    client.setConnectedCallback(on_mqtt_connected);
+    client.setTransportCapacity(mqttTransport.txCapacity());
     
     Serial.println("System initialization complete!");
     Serial.println("================================");
 }
 
 void loop(){
-    if (!client.connected()){
-        reconnect();
+    if (rebootScheduled && (int32_t)(millis() - rebootAtMs) >= 0) {
+        Serial.println("Rebooting on request...");
+        // A clean DISCONNECT makes the broker discard the Last Will
+        publish_presence(false);
+        client.disconnect();
+        delay(100);
+        ESP.restart();
     }
 
+    reconnect();
     client.loop();
+    if (brokerWasConnected && !client.connected() && epochClock.synced()) {
+        brokerLostAtMs = epochClock.now(mono_ms());
+    }
+    brokerWasConnected = client.connected();
+    ota_poll(client.connected());
+    memory_poll();
+    sntp.poll();
+    history_poll();
 
-    Serial.println("Reading sensor data...");
+    uint32_t now = millis();
+    if (lastSampleMs != 0 && now - lastSampleMs < nextSampleDelayMs) {
+        delay(10);
+        return;
+    }
+    lastSampleMs = now;
+    uint8_t logLevel = runtimeConfig.get().logLevel;
+
+    // Everything the broker sent since the previous reading
+    inboundBytesLastCycle = client.bytesIn() - bytesInAtLastSample;
+    bytesInAtLastSample = client.bytesIn();
+    if (inboundBytesLastCycle > inboundBytesMaxCycle) {
+        inboundBytesMaxCycle = inboundBytesLastCycle;
+    }
+
+    if (logLevel >= kLogDebug) {
+        Serial.println("Reading sensor data...");
+    }
     
+    uint64_t sampleMonoMs = mono_ms();
+    int64_t sampleEpochMs = epochClock.now(sampleMonoMs);
+    bool timeSynced = epochClock.synced();
     float temperature = dht.readTemperature();
     float humidity = dht.readHumidity();
     
     // Check if readings are valid
     if (isnan(temperature) || isnan(humidity)) {
-        Serial.println("ERROR: Failed to read from DHT sensor!");
-        Serial.println("Using default values for testing...");
+        if (logLevel >= kLogError) {
+            Serial.println("ERROR: Failed to read from DHT sensor!");
+            Serial.println("Using default values for testing...");
+        }
         temperature = 25.0;  // Default temperature
         humidity = 60.0;     // Default humidity
+        nextSampleDelayMs = runtimeConfig.get().sampleMinMs;  // Retry soon, keep defaults out of the sampler
+    } else {
+        float channels[2] = {temperature, humidity};
+
+        AnomalyDetector::Event events[AnomalyDetector::kMaxChannels];
+        uint8_t eventCount = detector.update(channels, events);
+        uint32_t detectedUs = micros();
+        for (uint8_t i = 0; i < eventCount; i++) {
+            publish_alert(events[i], detectedUs);
+        }
+        if (eventCount > 0) {
+            sampler.forceFast();
+        }
+
+        history_record(sampleEpochMs, timeSynced, temperature, humidity, WiFi.RSSI());
+        publish_state(sampleEpochMs, timeSynced, temperature, humidity);
+
+        nextSampleDelayMs = sampler.update(channels, now);
+        if (client.congested()) {
+            // Backpressure: produce less while the link drains the queue
+            nextSampleDelayMs = min<uint32_t>(nextSampleDelayMs * 2, runtimeConfig.get().sampleMaxMs);
+            if (logLevel >= kLogInfo) {
+                Serial.println("MQTT congested, slowing down sampling");
+            }
+        }
+        if (logLevel >= kLogInfo && sampler.stats().samplesTaken % SAMPLE_STATS_EVERY == 0) {
+            print_stats();
+        }
     }
     
     float heatIndex = dht.computeHeatIndex(temperature, humidity);
 
+    // Serialize into scratch from the message arena; the outbox keeps its own
+    // copy. The sequence number advances even if the queue refuses the reading,
+    // so the host sees the loss as a gap.
+    uint64_t publishDelayMs = mono_ms() - sampleMonoMs;
+    telemetry::Reading reading = {
+        deviceId, sampleEpochMs, timeSynced, temperature, humidity, heatIndex, WiFi.RSSI(),
+        readingSeq++, (uint16_t)min<uint64_t>(publishDelayMs, UINT16_MAX),
+    };
+    MessageArena::Scope scratch(messageArena);
+    char* jsonString = scratch.chars(telemetry::kReadingJsonMax);
+    size_t jsonLength = telemetry::writeReading(reading, jsonString, telemetry::kReadingJsonMax);
+    
+    // Queue for QoS 1 delivery on this device's telemetry topic; loop()
+    // sends it once there is room in the in-flight window. Not retained: the
+    // state topic holds the last known values.
+    uint32_t publishStartUs = micros();
+    bool queued = jsonLength > 0 &&
+                  client.enqueue(topics.telemetry(), (const uint8_t*)jsonString, jsonLength, false);
+    uint32_t publishCallUs = micros() - publishStartUs;
+    if (publishCallUs > publishCallMaxUs) {
+        publishCallMaxUs = publishCallUs;
+    }
+
+    if (!queued && logLevel >= kLogError) {
+        Serial.println("✗ Error queueing JSON data");
+    }
+    if (logLevel < kLogDebug) {
+        return;
+    }
+
     Serial.print("Temperature: ");
     Serial.print(temperature);
     Serial.println(" °C");
@@ -141,34 +638,14 @@ void loop(){
     Serial.print(heatIndex);
     Serial.println(" °C");
 
-    // Publish data to MQTT
-    Serial.println("Publishing data to MQTT...");
-    
-    // Create JSON document
-    StaticJsonDocument<200> jsonDoc;
-    jsonDoc["device_id"] = "ESP32-" + WiFi.macAddress();
-    jsonDoc["timestamp"] = millis();
-    jsonDoc["temperature"] = temperature;
-    jsonDoc["humidity"] = humidity;
-    jsonDoc["heat_index"] = heatIndex;
-    jsonDoc["wifi_rssi"] = WiFi.RSSI();
-    
-    // Convert JSON to string
-    String jsonString;
-    serializeJson(jsonDoc, jsonString);
-    
     Serial.print("JSON payload: ");
-    Serial.println(jsonString);
-    
-    // Publish to single topic
-    bool published = client.publish("5a728254-5316-45c6-bf3c-de194f1afa53/sensor_data", jsonString.c_str(), true);
-
-    if (published) {
-        Serial.println("✓ JSON data published successfully!");
-    } else {
-        Serial.println("✗ Error publishing JSON data");
+    Serial.println(jsonLength > 0 ? jsonString : "");
+    if (queued) {
+        Serial.println("✓ JSON data queued for delivery!");
     }
 
+    Serial.print("Next reading in ");
+    Serial.print(nextSampleDelayMs);
+    Serial.println(" ms");
     Serial.println("-----");
-    delay(5000); // wait 5 seconds before next reading
 }
@@ -0,0 +1,81 @@
+#include <Arduino.h>
+#include <config_defaults.h>
+#include <esp_heap_caps.h>
+
+#include "device.h"
+#include "memory.h"
+
+namespace {
+
+MemoryStats stats = {};
+uint32_t lastSampleMs = 0;
+bool sampled = false;
+
+}  // namespace
+
+void memory_poll(){
+    uint32_t now = millis();
+    if (sampled && now - lastSampleMs < MEMORY_SAMPLE_INTERVAL) {
+        return;
+    }
+    sampled = true;
+    lastSampleMs = now;
+
+    // The largest block walks the free list, hence sampled rather than per pass
+    stats.freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    stats.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    stats.minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    if (stats.minLargestBlock == 0 || stats.largestBlock < stats.minLargestBlock) {
+        stats.minLargestBlock = stats.largestBlock;
+    }
+    stats.fragmentation = stats.freeHeap > 0 ? 100 - (uint64_t)stats.largestBlock * 100 / stats.freeHeap : 0;
+    if (stats.fragmentation > stats.fragmentationMax) {
+        stats.fragmentationMax = stats.fragmentation;
+    }
+
+    bool low = stats.freeHeap < MEMORY_FREE_WARN || stats.largestBlock < MEMORY_BLOCK_WARN;
+    if (low && !stats.low) {
+        stats.lowMemoryEvents++;
+        Serial.print("WARNING: low memory, free heap ");
+        Serial.print(stats.freeHeap);
+        Serial.print(" bytes, largest block ");
+        Serial.print(stats.largestBlock);
+        Serial.println(" bytes");
+    }
+    stats.low = low;
+}
+
+MemoryStats memory_stats(){
+    MemoryStats current = stats;
+    current.arena = messageArena.stats();
+    return current;
+}
+
+void print_memory_stats(){
+    MemoryStats current = memory_stats();
+    Serial.print("Memory: free heap ");
+    Serial.print(current.freeHeap);
+    Serial.print(" bytes (min ");
+    Serial.print(current.minFreeHeap);
+    Serial.print("), largest block ");
+    Serial.print(current.largestBlock);
+    Serial.print(" bytes (min ");
+    Serial.print(current.minLargestBlock);
+    Serial.print("), fragmentation ");
+    Serial.print(current.fragmentation);
+    Serial.print("% (max ");
+    Serial.print(current.fragmentationMax);
+    Serial.print("%), ");
+    Serial.print(current.lowMemoryEvents);
+    Serial.println(" low memory events");
+
+    Serial.print("Message arena: ");
+    Serial.print(current.arena.reserved);
+    Serial.print(" reserved, high water ");
+    Serial.print(current.arena.highWater);
+    Serial.print(" of ");
+    Serial.print(current.arena.capacity);
+    Serial.print(" bytes, ");
+    Serial.print(current.arena.failures);
+    Serial.println(" failures");
+}
@@ -0,0 +1,29 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdint.h>
+
+#include <MessageArena.h>
+
+struct MemoryStats {
+    uint32_t freeHeap;
+    uint32_t largestBlock;      // biggest single allocation that would succeed now
+    uint32_t minFreeHeap;       // lowest free heap since boot, from the allocator
+    uint32_t minLargestBlock;   // lowest largest block seen by memory_poll()
+    uint8_t fragmentation;      // % of free heap outside the largest block
+    uint8_t fragmentationMax;
+    uint32_t lowMemoryEvents;   // times a threshold below was crossed
+    bool low;                   // below a threshold right now
+    MessageArena::Stats arena;
+};
+
+// Samples the heap every MEMORY_SAMPLE_INTERVAL and warns once on serial each
+// time the free heap or the largest block drops below its threshold, which
+// comes well before an allocation inside WiFi, TLS or the TCP stack fails.
+// Call every loop() pass.
+void memory_poll();
+
+MemoryStats memory_stats();
+void print_memory_stats();
+
+#endif
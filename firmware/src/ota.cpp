@@ -0,0 +1,326 @@
+#include <Arduino.h>
+#include <DeltaPatch.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <config_defaults.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+
+#include "device.h"
+#include "ota.h"
+
+// Keeps the core from confirming the image on its own when the bootloader
+// has rollback enabled; ota_poll() confirms it once the broker is reached
+extern "C" bool verifyRollbackLater(){
+    return true;
+}
+
+namespace {
+
+// Flash reads of the running image, the base the patch was made against
+class PartitionImage : public delta::ImageReader {
+public:
+    void set(const esp_partition_t* partition){ partition_ = partition; }
+    bool read(uint32_t offset, uint8_t* data, size_t length) override {
+        return esp_partition_read(partition_, offset, data, length) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t* partition_ = nullptr;
+};
+
+// Sequential writes into the inactive slot; esp_ota_write erases as it goes
+class OtaImage : public delta::ImageWriter {
+public:
+    esp_ota_handle_t handle = 0;
+    bool write(const uint8_t* data, size_t length) override {
+        return esp_ota_write(handle, data, length) == ESP_OK;
+    }
+};
+
+struct Job {
+    char url[256];
+    uint8_t sha256[Sha256::kDigestSize];
+    const esp_partition_t* running;
+    const esp_partition_t* target;
+};
+
+Job job;
+PartitionImage oldImage;
+OtaImage newImage;
+// Static rather than on the task stack: the LZSS window and buffers are ~5 KB
+delta::Applier applier(oldImage, newImage);
+uint8_t downloadBuffer[512];
+
+// Written by the task, read by loop(); each field is a single aligned word
+volatile OtaState state = kOtaIdle;
+volatile const char* lastError = nullptr;
+volatile uint32_t patchBytes = 0;
+volatile uint32_t patchSize = 0;
+volatile uint32_t durationMs = 0;
+uint32_t bootAttempts = 0;
+bool rolledBack = false;
+bool rebootRequested = false;
+esp_timer_handle_t probationTimer = nullptr;
+
+Preferences prefs;
+
+void finish(OtaState result, const char* error){
+    lastError = error;
+    state = result;
+}
+
+// Points the bootloader back at the previous image and restarts into it
+void roll_back(){
+    prefs.begin("ota", false);
+    char previous[17] = "";
+    prefs.getString("previous", previous, sizeof(previous));
+    prefs.putBool("pending", false);
+    prefs.putBool("rolled_back", true);
+    prefs.end();
+    const esp_partition_t* partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, previous);
+    if (partition != nullptr) {
+        esp_ota_set_boot_partition(partition);
+    }
+    esp_restart();
+}
+
+void probation_expired(void*){
+    Serial.println("OTA: update did not reach the broker in time, rolling back");
+    roll_back();
+}
+
+void ota_task(void*){
+    uint32_t startMs = millis();
+    HTTPClient http;
+    http.setTimeout(OTA_HTTP_TIMEOUT);
+    if (!http.begin(job.url)) {
+        finish(kOtaFailed, "bad url");
+        vTaskDelete(NULL);
+        return;
+    }
+    int code = http.GET();
+    if (code != HTTP_CODE_OK) {
+        http.end();
+        finish(kOtaFailed, code < 0 ? "connection failed" : "http error");
+        vTaskDelete(NULL);
+        return;
+    }
+    patchSize = http.getSize() > 0 ? http.getSize() : 0;
+    WiFiClient* stream = http.getStreamPtr();
+
+    oldImage.set(job.running);
+    applier.reset();
+    bool begun = false;
+    uint32_t lastDataMs = millis();
+    const char* error = nullptr;
+
+    while (applier.status() == delta::kNeedMore && error == nullptr) {
+        size_t available = stream->available();
+        if (available == 0) {
+            if (!stream->connected()) {
+                error = "download truncated";
+            } else if (millis() - lastDataMs > OTA_HTTP_TIMEOUT) {
+                error = "download stalled";
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+        // The header alone first, so the slot is only erased for a patch
+        // that targets this image and a hash the command asked for
+        size_t want = !applier.headerReady() ? delta::kHeaderSize - applier.consumed() : sizeof(downloadBuffer);
+        size_t n = stream->readBytes(downloadBuffer, available < want ? available : want);
+        lastDataMs = millis();
+        patchBytes = patchBytes + n;
+        applier.feed(downloadBuffer, n);
+
+        if (!begun && applier.headerReady() && applier.status() == delta::kNeedMore) {
+            const delta::Header& header = applier.header();
+            if (memcmp(header.newHash, job.sha256, sizeof(job.sha256)) != 0) {
+                error = "patch is for another image";
+            } else if (header.newSize > job.target->size) {
+                error = "image too large";
+            } else if (esp_ota_begin(job.target, header.newSize, &newImage.handle) != ESP_OK) {
+                error = "ota begin failed";
+            }
+            begun = error == nullptr;
+        }
+    }
+    http.end();
+
+    if (error == nullptr && applier.status() != delta::kDone) {
+        error = delta::statusName(applier.status());
+    }
+    // esp_ota_end() also checks the image format and its own checksum
+    if (error == nullptr && esp_ota_end(newImage.handle) != ESP_OK) {
+        error = "image invalid";
+        begun = false;
+    }
+    if (error == nullptr && esp_ota_set_boot_partition(job.target) != ESP_OK) {
+        error = "set boot failed";
+    }
+    if (error != nullptr) {
+        if (begun) {
+            esp_ota_abort(newImage.handle);
+        }
+        durationMs = millis() - startMs;
+        finish(kOtaFailed, error);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    prefs.begin("ota", false);
+    prefs.putBool("pending", true);
+    prefs.putUInt("attempts", 0);
+    prefs.putString("previous", job.running->label);
+    prefs.putBool("rolled_back", false);
+    prefs.end();
+    durationMs = millis() - startMs;
+    finish(kOtaReady, nullptr);
+    vTaskDelete(NULL);
+}
+
+}  // namespace
+
+void ota_begin(){
+    prefs.begin("ota", false);
+    rolledBack = prefs.getBool("rolled_back", false);
+    if (prefs.getBool("pending", false)) {
+        const esp_partition_t* running = esp_ota_get_running_partition();
+        char previous[17] = "";
+        prefs.getString("previous", previous, sizeof(previous));
+        if (strcmp(previous, running->label) == 0) {
+            // The bootloader already went back (the new image never started)
+            prefs.putBool("pending", false);
+            prefs.putBool("rolled_back", true);
+            rolledBack = true;
+        } else {
+            bootAttempts = prefs.getUInt("attempts", 0) + 1;
+            prefs.putUInt("attempts", bootAttempts);
+            state = kOtaProbation;
+        }
+    }
+    prefs.end();
+
+    if (state != kOtaProbation) {
+        return;
+    }
+    Serial.print("OTA: new image on probation, boot ");
+    Serial.println(bootAttempts);
+    if (bootAttempts > OTA_MAX_BOOT_ATTEMPTS) {
+        Serial.println("OTA: too many boots without reaching the broker, rolling back");
+        roll_back();
+    }
+    // A timer rather than a loop() check, so a setup() that never returns
+    // (e.g. WiFi never connecting) still rolls back
+    esp_timer_create_args_t args = {};
+    args.callback = probation_expired;
+    args.name = "ota_probation";
+    if (esp_timer_create(&args, &probationTimer) == ESP_OK) {
+        esp_timer_start_once(probationTimer, (uint64_t)OTA_VALIDATE_TIMEOUT * 1000);
+    }
+}
+
+bool ota_start(const char* url, const uint8_t sha256[32], const char** error){
+    if (state == kOtaDownloading || state == kOtaReady) {
+        *error = "update in progress";
+        return false;
+    }
+    if (state == kOtaProbation) {
+        *error = "current image not confirmed yet";
+        return false;
+    }
+    job.running = esp_ota_get_running_partition();
+    job.target = esp_ota_get_next_update_partition(NULL);
+    if (job.target == nullptr || job.running == nullptr) {
+        *error = "no ota partition";
+        return false;
+    }
+    if (strlcpy(job.url, url, sizeof(job.url)) >= sizeof(job.url)) {
+        *error = "url too long";
+        return false;
+    }
+    memcpy(job.sha256, sha256, sizeof(job.sha256));
+    patchBytes = 0;
+    patchSize = 0;
+    lastError = nullptr;
+    state = kOtaDownloading;
+    if (xTaskCreate(ota_task, "ota", OTA_TASK_STACK, NULL, 1, NULL) != pdPASS) {
+        finish(kOtaFailed, "no memory for task");
+        *error = "no memory for task";
+        return false;
+    }
+    return true;
+}
+
+void ota_poll(bool brokerConnected){
+    if (state == kOtaProbation && brokerConnected) {
+        esp_timer_stop(probationTimer);
+        esp_ota_mark_app_valid_cancel_rollback();
+        prefs.begin("ota", false);
+        prefs.putBool("pending", false);
+        prefs.end();
+        state = kOtaIdle;
+        Serial.println("OTA: new image confirmed");
+    }
+    if (state == kOtaReady && !rebootRequested) {
+        rebootRequested = true;
+        Serial.println("OTA: update verified, rebooting into it");
+        schedule_reboot(2000);
+    }
+}
+
+OtaStats ota_stats(){
+    OtaStats stats;
+    stats.state = state;
+    stats.error = (const char*)lastError;
+    stats.patchBytes = patchBytes;
+    stats.patchSize = patchSize;
+    stats.written = applier.written();
+    stats.imageSize = applier.headerReady() ? applier.header().newSize : 0;
+    stats.durationMs = durationMs;
+    stats.bootAttempts = bootAttempts;
+    stats.rolledBack = rolledBack;
+    return stats;
+}
+
+const char* ota_state_name(OtaState value){
+    switch (value) {
+        case kOtaIdle: return "idle";
+        case kOtaDownloading: return "downloading";
+        case kOtaReady: return "ready";
+        case kOtaFailed: return "failed";
+        case kOtaProbation: return "probation";
+    }
+    return "?";
+}
+
+void print_ota_stats(){
+    OtaStats current = ota_stats();
+    if (current.state == kOtaIdle && current.patchBytes == 0 && !current.rolledBack) {
+        return;
+    }
+    Serial.print("OTA: ");
+    Serial.print(ota_state_name(current.state));
+    if (current.error != nullptr) {
+        Serial.print(" (");
+        Serial.print(current.error);
+        Serial.print(")");
+    }
+    Serial.print(", patch ");
+    Serial.print(current.patchBytes);
+    Serial.print("/");
+    Serial.print(current.patchSize);
+    Serial.print(" B, image ");
+    Serial.print(current.written);
+    Serial.print("/");
+    Serial.print(current.imageSize);
+    Serial.print(" B, ");
+    Serial.print(current.durationMs);
+    Serial.print(" ms");
+    if (current.rolledBack) {
+        Serial.print(", last update rolled back");
+    }
+    Serial.println();
+}
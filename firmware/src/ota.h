@@ -0,0 +1,45 @@
+#ifndef OTA_H
+#define OTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Checks whether this boot is a freshly updated image still on probation and
+// arms the rollback if so. Call first thing in setup().
+void ota_begin();
+
+// Downloads a DeltaPatch from url in a background task and applies it against
+// the running image into the inactive OTA slot. sha256 is the expected hash
+// of the new image, from the command rather than the download. False if an
+// update is already running or there is no slot to write to.
+bool ota_start(const char* url, const uint8_t sha256[32], const char** error);
+
+// Call every loop() pass: confirms the new image once the broker is reached
+// and schedules the reboot when an update is ready.
+void ota_poll(bool brokerConnected);
+
+enum OtaState : uint8_t {
+    kOtaIdle,
+    kOtaDownloading,
+    kOtaReady,          // written and verified, rebooting into it
+    kOtaFailed,
+    kOtaProbation,      // running an update that has not reached the broker yet
+};
+
+struct OtaStats {
+    OtaState state;
+    const char* error;          // why the last update failed, or null
+    uint32_t patchBytes;        // downloaded so far
+    uint32_t patchSize;         // from Content-Length, 0 if unknown
+    uint32_t written;           // new image bytes written
+    uint32_t imageSize;
+    uint32_t durationMs;        // of the last finished download and apply
+    uint32_t bootAttempts;      // boots of the image on probation
+    bool rolledBack;            // the last update was rolled back
+};
+OtaStats ota_stats();
+
+const char* ota_state_name(OtaState state);
+void print_ota_stats();
+
+#endif
@@ -0,0 +1,662 @@
+#include "BatchDecoder.h"
+
+#include <TelemetryCodec.h>
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_DECODER_X86 1
+#endif
+
+namespace ingest {
+
+namespace {
+
+// Stage one works on windows this large, restarting at a record boundary so
+// the index stays small and in cache
+const size_t kWindow = 256 * 1024;
+
+struct Masks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;        // { } [ ] : , \n
+    uint64_t newline;
+};
+
+// --- Classification kernels --------------------------------------------
+
+Masks classifyScalar(const uint8_t* block) {
+    Masks m = {0, 0, 0, 0};
+    for (int i = 0; i < 64; i++) {
+        uint8_t c = block[i];
+        uint64_t bit = 1ULL << i;
+        if (c == '"') {
+            m.quote |= bit;
+        } else if (c == '\\') {
+            m.backslash |= bit;
+        } else if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') {
+            m.op |= bit;
+        } else if (c == '\n') {
+            m.op |= bit;
+            m.newline |= bit;
+        }
+    }
+    return m;
+}
+
+#if BATCH_DECODER_X86
+
+// { [ and } ] differ from each other only in bit 5, so OR 0x20 folds four
+// compares into two
+__attribute__((target("sse2"))) Masks classifySse2(const uint8_t* block) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i fold = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    Masks m = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + 16 * i));
+        __m128i folded = _mm_or_si128(v, fold);
+        __m128i lines = _mm_cmpeq_epi8(v, newline);
+        __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+                                  _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)),
+                                               lines));
+        m.newline |= (uint64_t)(uint16_t)_mm_movemask_epi8(lines) << (16 * i);
+        m.quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << (16 * i);
+        m.backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << (16 * i);
+        m.op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << (16 * i);
+    }
+    return m;
+}
+
+__attribute__((target("avx2"))) Masks classifyAvx2(const uint8_t* block) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i fold = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    Masks m = {0, 0, 0, 0};
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + 32 * i));
+        __m256i folded = _mm256_or_si256(v, fold);
+        __m256i lines = _mm256_cmpeq_epi8(v, newline);
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)), lines));
+        m.newline |= (uint64_t)(uint32_t)_mm256_movemask_epi8(lines) << (32 * i);
+        m.quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << (32 * i);
+        m.backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << (32 * i);
+        m.op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << (32 * i);
+    }
+    return m;
+}
+
+#endif
+
+// --- Bit tricks shared by every kernel ------------------------------------
+
+// Characters preceded by an odd run of backslashes, i.e. escaped. A run can
+// cross blocks; carry says the previous block ended inside an odd one.
+uint64_t escapedBits(uint64_t backslash, uint64_t& carry) {
+    const uint64_t even = 0x5555555555555555ULL;
+    uint64_t starts = backslash & ~(backslash << 1);
+    uint64_t evenStartMask = even ^ carry;
+    uint64_t evenStarts = starts & evenStartMask;
+    uint64_t oddStarts = starts & ~evenStartMask;
+    uint64_t evenCarries = backslash + evenStarts;
+    uint64_t oddCarries;
+    bool endsOdd = __builtin_add_overflow(backslash, oddStarts, &oddCarries);
+    oddCarries |= carry;
+    carry = endsOdd ? 1 : 0;
+    uint64_t evenCarryEnds = evenCarries & ~backslash;
+    uint64_t oddCarryEnds = oddCarries & ~backslash;
+    return (evenCarryEnds & ~even) | (oddCarryEnds & even);
+}
+
+// Bit i set when an odd number of quotes are at or before i: inside a string
+uint64_t prefixXor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+template <Masks (*Classify)(const uint8_t*)>
+size_t indexWith(const uint8_t* data, size_t length, uint32_t* out) {
+    uint64_t escapeCarry = 0;
+    uint64_t inString = 0;
+    size_t count = 0;
+    uint8_t tail[64];
+    for (size_t base = 0; base < length; base += 64) {
+        const uint8_t* block = data + base;
+        if (length - base < 64) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, length - base);
+            block = tail;
+        }
+        Masks m = Classify(block);
+        uint64_t quotes = m.quote & ~escapedBits(m.backslash, escapeCarry);
+        uint64_t strings = prefixXor(quotes) ^ inString;
+        // A raw newline can't be inside a valid string: a line cut off in
+        // the middle of one must not swallow the lines after it
+        for (uint64_t open = m.newline & strings; open != 0; open = m.newline & strings) {
+            strings ^= ~0ULL << __builtin_ctzll(open);
+        }
+        inString = (uint64_t)((int64_t)strings >> 63);
+        uint64_t structural = (m.op & ~strings) | quotes;
+        while (structural != 0) {
+            out[count++] = (uint32_t)(base + __builtin_ctzll(structural));
+            structural &= structural - 1;
+        }
+    }
+    return count;
+}
+
+// --- Values ---------------------------------------------------------------
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Only whitespace may sit between two structurals outside a value
+bool blank(const char* data, uint32_t from, uint32_t to) {
+    for (uint32_t p = from; p < to; p++) {
+        if (!isSpace(data[p])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The generic path, for anything the fast ones don't take (exponents, long
+// mantissas); the same rules as the codec's decoder
+bool slowNumber(const char* begin, const char* end, uint8_t decimals, codec::Wire wire, int64_t* out) {
+    char copy[64];
+    size_t length = (size_t)(end - begin);
+    if (length >= sizeof(copy)) {
+        return false;
+    }
+    memcpy(copy, begin, length);
+    codec::detail::Reader reader = {copy, copy + length};
+    int64_t mantissa;
+    int exponent;
+    return codec::detail::readDecimal(reader, &mantissa, &exponent) && reader.p == reader.end &&
+           codec::detail::scaleDecimal(mantissa, exponent, decimals, wire, out);
+}
+
+bool parseInteger(const char* begin, const char* end, codec::Wire wire, int64_t* out) {
+    const char* p = begin;
+    bool negative = p < end && *p == '-';
+    p += negative ? 1 : 0;
+    if (p == end || end - p > 18) {
+        return slowNumber(begin, end, 0, wire, out);
+    }
+    int64_t value = 0;
+    for (; p < end; p++) {
+        unsigned digit = (unsigned)(*p - '0');
+        if (digit > 9) {
+            return slowNumber(begin, end, 0, wire, out);
+        }
+        value = value * 10 + digit;
+    }
+    value = negative ? -value : value;
+    if (value < codec::detail::wireMin(wire) || value > codec::detail::wireMax(wire)) {
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+// "24.5" -> 2450, rounding half away from zero on the third decimal
+bool parseCenti(const char* begin, const char* end, int16_t* out) {
+    if (end - begin == 4 && memcmp(begin, "null", 4) == 0) {
+        *out = kNull;
+        return true;
+    }
+    const char* p = begin;
+    bool negative = p < end && *p == '-';
+    p += negative ? 1 : 0;
+    int32_t whole = 0;
+    int digits = 0;
+    while (p < end && (unsigned)(*p - '0') <= 9 && digits < 6) {
+        whole = whole * 10 + (*p++ - '0');
+        digits++;
+    }
+    int32_t fraction = 0;
+    int fractionDigits = 0;
+    bool roundUp = false;
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && (unsigned)(*p - '0') <= 9) {
+            if (fractionDigits < 2) {
+                fraction = fraction * 10 + (*p - '0');
+            } else if (fractionDigits == 2) {
+                roundUp = *p >= '5';
+            }
+            fractionDigits++;
+            p++;
+        }
+        if (fractionDigits == 0) {
+            return false;
+        }
+    }
+    if (digits == 0 || p != end) {
+        int64_t value;
+        if (!slowNumber(begin, end, 2, codec::Wire::I16, &value) || value == kNull) {
+            return false;
+        }
+        *out = (int16_t)value;
+        return true;
+    }
+    fraction *= fractionDigits == 0 ? 100 : fractionDigits == 1 ? 10 : 1;
+    int32_t value = whole * 100 + fraction + (roundUp ? 1 : 0);
+    value = negative ? -value : value;
+    if (value <= kNull || value > INT16_MAX) {
+        return false;
+    }
+    *out = (int16_t)value;
+    return true;
+}
+
+// Eight bytes per step; ids are around 24 bytes, so three multiplies
+uint32_t hashBytes(const char* data, size_t length) {
+    uint64_t hash = length * 0x9E3779B97F4A7C15ULL;
+    while (length > 0) {
+        uint64_t word = 0;
+        size_t n = length < 8 ? length : 8;
+        memcpy(&word, data, n);
+        hash = (hash ^ word) * 0xBF58476D1CE4E5B9ULL;
+        hash ^= hash >> 31;
+        data += n;
+        length -= n;
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// Field keys of the payload, matched by length then bytes
+enum Key : uint8_t {
+    kDeviceId, kTimestamp, kTimeSynced, kTemperature, kHumidity, kHeatIndex, kRssi, kSeq, kPublishDelay, kUnknown
+};
+
+Key keyOf(const char* key, size_t length) {
+    switch (length) {
+        case 3:
+            return memcmp(key, "seq", 3) == 0 ? kSeq : kUnknown;
+        case 8:
+            return memcmp(key, "humidity", 8) == 0 ? kHumidity : kUnknown;
+        case 9:
+            return memcmp(key, "device_id", 9) == 0   ? kDeviceId
+                   : memcmp(key, "timestamp", 9) == 0 ? kTimestamp
+                   : memcmp(key, "wifi_rssi", 9) == 0 ? kRssi
+                                                      : kUnknown;
+        case 10:
+            return memcmp(key, "heat_index", 10) == 0 ? kHeatIndex : kUnknown;
+        case 11:
+            return memcmp(key, "temperature", 11) == 0   ? kTemperature
+                   : memcmp(key, "time_synced", 11) == 0 ? kTimeSynced
+                                                         : kUnknown;
+        case 13:
+            return memcmp(key, "publish_delay", 13) == 0 ? kPublishDelay : kUnknown;
+        default:
+            return kUnknown;
+    }
+}
+
+const uint32_t kRequired = (1u << kDeviceId) | (1u << kTimestamp) | (1u << kTemperature) | (1u << kHumidity);
+
+}  // namespace
+
+void Columns::reserve(size_t rows) {
+    device.reserve(rows);
+    timestampMs.reserve(rows);
+    timeSynced.reserve(rows);
+    temperatureCenti.reserve(rows);
+    humidityCenti.reserve(rows);
+    heatIndexCenti.reserve(rows);
+    rssi.reserve(rows);
+    seq.reserve(rows);
+    publishDelayMs.reserve(rows);
+}
+
+void Columns::clear() {
+    device.clear();
+    timestampMs.clear();
+    timeSynced.clear();
+    temperatureCenti.clear();
+    humidityCenti.clear();
+    heatIndexCenti.clear();
+    rssi.clear();
+    seq.clear();
+    publishDelayMs.clear();
+}
+
+BatchDecoder::BatchDecoder(Kernel kernel)
+    : kernel_(kernel == kAuto ? best() : kernel), stats_{0, 0, 0}, deviceOwner_(nullptr) {
+#if !BATCH_DECODER_X86
+    kernel_ = kScalar;
+#endif
+    structurals_.resize(kWindow + 64);
+}
+
+BatchDecoder::Kernel BatchDecoder::best() {
+#if BATCH_DECODER_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? kAvx2 : kSse2;
+#else
+    return kScalar;
+#endif
+}
+
+const char* BatchDecoder::kernelName(Kernel kernel) {
+    switch (kernel) {
+        case kScalar: return "scalar";
+        case kSse2: return "sse2";
+        case kAvx2: return "avx2";
+        default: return "auto";
+    }
+}
+
+size_t BatchDecoder::index(const uint8_t* data, size_t length) {
+    switch (kernel_) {
+#if BATCH_DECODER_X86
+        case kAvx2: return indexWith<classifyAvx2>(data, length, structurals_.data());
+        case kSse2: return indexWith<classifySse2>(data, length, structurals_.data());
+#endif
+        default: return indexWith<classifyScalar>(data, length, structurals_.data());
+    }
+}
+
+size_t BatchDecoder::decode(const char* data, size_t length, Columns& out) {
+    size_t before = out.size();
+    size_t offset = 0;
+    while (offset < length) {
+        size_t window = length - offset < kWindow ? length - offset : kWindow;
+        bool final = offset + window == length;
+        size_t count = index((const uint8_t*)data + offset, window);
+        size_t consumed = records(data + offset, window, count, final, out);
+        if (consumed == 0) {
+            // One line longer than the window: not a payload of ours
+            const char* newline = (const char*)memchr(data + offset + window, '\n', length - offset - window);
+            consumed = newline != nullptr ? (size_t)(newline - (data + offset)) + 1 : length - offset;
+            stats_.rejected++;
+        }
+        offset += consumed;
+    }
+    stats_.bytes += length;
+    stats_.rows += out.size() - before;
+    return out.size() - before;
+}
+
+size_t BatchDecoder::records(const char* data, size_t length, size_t count, bool final, Columns& out) {
+    const uint32_t* at = structurals_.data();
+    size_t i = 0;
+    while (i < count) {
+        if (data[at[i]] == '\n') {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        bool ok = data[at[i]] == '{';
+        bool complete = true;
+        uint32_t seen = 0;
+        const char* deviceId = nullptr;
+        size_t deviceIdLength = 0;
+        bool deviceIdEscaped = false;
+        int64_t timestamp = 0;
+        bool synced = false;
+        int16_t temperature = kNull;
+        int16_t humidity = kNull;
+        int16_t heatIndex = kNull;
+        int8_t rssi = kNullRssi;
+        int64_t seq = kNoSeq;
+        int32_t publishDelay = kNoDelay;
+        i++;
+
+        // Members: "key" : value , ... } — each quote is a structural
+        while (ok) {
+            if (i + 3 > count) {
+                complete = false;
+                break;
+            }
+            if (data[at[i]] != '"' || data[at[i + 1]] != '"' || data[at[i + 2]] != ':' ||
+                !blank(data, at[i - 1] + 1, at[i]) || !blank(data, at[i + 1] + 1, at[i + 2])) {
+                ok = false;
+                break;
+            }
+            const char* key = data + at[i] + 1;
+            Key field = keyOf(key, at[i + 1] - at[i] - 1);
+            uint32_t colon = at[i + 2];
+            i += 3;
+            if (i >= count) {
+                complete = false;
+                break;
+            }
+
+            char c = data[at[i]];
+            const char* valueBegin = data + colon + 1;
+            const char* valueEnd;
+            bool isString = false;
+            if (c == '"') {
+                if (i + 2 > count) {
+                    complete = false;
+                    break;
+                }
+                valueBegin = data + at[i] + 1;
+                valueEnd = data + at[i + 1];
+                isString = true;
+                ok = data[at[i + 1]] == '"' && blank(data, colon + 1, at[i]) &&
+                     (i + 2 == count || blank(data, at[i + 1] + 1, at[i + 2]));
+                i += 2;
+            } else if (c == '{' || c == '[') {
+                // A nested value for a key we don't know; skip it whole
+                uint32_t open = at[i];
+                int depth = 0;
+                for (; i < count; i++) {
+                    char s = data[at[i]];
+                    if (s == '{' || s == '[') {
+                        depth++;
+                    } else if ((s == '}' || s == ']') && --depth == 0) {
+                        break;
+                    } else if (s == '\n') {
+                        ok = false;
+                        break;
+                    }
+                }
+                if (i == count) {
+                    complete = false;
+                    break;
+                }
+                ok = ok && field == kUnknown && blank(data, colon + 1, open);
+                i++;
+                valueEnd = valueBegin;
+            } else {
+                valueEnd = data + at[i];
+            }
+            if (!ok) {
+                break;
+            }
+            if (i >= count) {
+                complete = false;
+                break;
+            }
+            if (!isString && c != '{' && c != '[') {
+                while (valueBegin < valueEnd && isSpace(*valueBegin)) {
+                    valueBegin++;
+                }
+                while (valueEnd > valueBegin && isSpace(valueEnd[-1])) {
+                    valueEnd--;
+                }
+                ok = valueBegin < valueEnd;
+            }
+
+            int64_t number = 0;
+            switch (field) {
+                case kDeviceId:
+                    deviceId = valueBegin;
+                    deviceIdLength = (size_t)(valueEnd - valueBegin);
+                    deviceIdEscaped = memchr(valueBegin, '\\', deviceIdLength) != nullptr;
+                    ok = isString && deviceIdLength <= 255;
+                    break;
+                case kTimestamp:
+                    ok = !isString && parseInteger(valueBegin, valueEnd, codec::Wire::I64, &number);
+                    timestamp = number;
+                    break;
+                case kTimeSynced:
+                    synced = valueEnd - valueBegin == 4 && memcmp(valueBegin, "true", 4) == 0;
+                    ok = !isString && (synced || (valueEnd - valueBegin == 5 && memcmp(valueBegin, "false", 5) == 0));
+                    break;
+                case kTemperature:
+                    ok = !isString && parseCenti(valueBegin, valueEnd, &temperature);
+                    break;
+                case kHumidity:
+                    ok = !isString && parseCenti(valueBegin, valueEnd, &humidity);
+                    break;
+                case kHeatIndex:
+                    ok = !isString && parseCenti(valueBegin, valueEnd, &heatIndex);
+                    break;
+                case kRssi:
+                    if (valueEnd - valueBegin == 4 && memcmp(valueBegin, "null", 4) == 0) {
+                        rssi = kNullRssi;
+                    } else {
+                        ok = !isString && parseInteger(valueBegin, valueEnd, codec::Wire::I8, &number);
+                        rssi = (int8_t)number;
+                    }
+                    break;
+                case kSeq:
+                    ok = !isString && parseInteger(valueBegin, valueEnd, codec::Wire::I32, &number) && number >= 0;
+                    seq = number;
+                    break;
+                case kPublishDelay:
+                    ok = !isString && parseInteger(valueBegin, valueEnd, codec::Wire::U16, &number);
+                    publishDelay = (int32_t)number;
+                    break;
+                default:
+                    break;
+            }
+            if (field != kUnknown) {
+                seen |= 1u << field;
+            }
+
+            char next = data[at[i]];
+            i++;
+            if (next == '}') {
+                break;
+            }
+            ok = ok && next == ',';
+        }
+
+        if (!complete && !final) {
+            return at[start];   // the window ends inside this record
+        }
+        // The rest of the line must be blank
+        if (ok && complete) {
+            size_t lineEnd = i < count ? at[i] : length;
+            for (size_t p = at[i - 1] + 1; ok && p < lineEnd; p++) {
+                ok = isSpace(data[p]);
+            }
+            ok = ok && (i == count || data[at[i]] == '\n');
+        }
+        if (!ok || !complete || (seen & kRequired) != kRequired) {
+            // From the start: a failed member may already have stepped past
+            // the newline that ends this line
+            for (i = start + 1; i < count && data[at[i]] != '\n';) {
+                i++;
+            }
+            if (i == count && !final) {
+                return at[start];   // see the whole line before rejecting it
+            }
+            stats_.rejected++;
+            continue;
+        }
+
+        char unescaped[256];
+        if (deviceIdEscaped) {
+            // Rare; unescape a copy with the codec's string reader
+            char quoted[258];
+            quoted[0] = '"';
+            memcpy(quoted + 1, deviceId, deviceIdLength);
+            quoted[deviceIdLength + 1] = '"';
+            codec::detail::Reader reader = {quoted, quoted + deviceIdLength + 2};
+            char* text;
+            if (!codec::detail::readString(reader, &text, &deviceIdLength)) {
+                stats_.rejected++;
+                continue;
+            }
+            memcpy(unescaped, text, deviceIdLength);
+            deviceId = unescaped;
+        }
+        out.device.push_back(deviceIndex(deviceId, deviceIdLength, out));
+        out.timestampMs.push_back(timestamp);
+        out.timeSynced.push_back(synced ? 1 : 0);
+        out.temperatureCenti.push_back(temperature);
+        out.humidityCenti.push_back(humidity);
+        out.heatIndexCenti.push_back(heatIndex);
+        out.rssi.push_back(rssi);
+        out.seq.push_back(seq);
+        out.publishDelayMs.push_back(publishDelay);
+    }
+    return length;
+}
+
+uint32_t BatchDecoder::deviceIndex(const char* id, size_t length, Columns& out) {
+    // The table indexes one Columns' dictionary; rebuild it if that changed
+    if (deviceOwner_ != &out || deviceHashes_.size() != out.deviceIds.size()) {
+        deviceOwner_ = &out;
+        size_t slots = 64;
+        while (slots < out.deviceIds.size() * 2 + 2) {
+            slots *= 2;
+        }
+        deviceSlots_.assign(slots, 0);
+        deviceHashes_.clear();
+        for (uint32_t k = 0; k < out.deviceIds.size(); k++) {
+            deviceHashes_.push_back(hashBytes(out.deviceIds[k].data(), out.deviceIds[k].size()));
+            size_t s = deviceHashes_[k] & (slots - 1);
+            while (deviceSlots_[s] != 0) {
+                s = (s + 1) & (slots - 1);
+            }
+            deviceSlots_[s] = k + 1;
+        }
+    }
+    uint32_t hash = hashBytes(id, length);
+    size_t mask = deviceSlots_.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        uint32_t entry = deviceSlots_[slot];
+        if (entry == 0) {
+            uint32_t index = (uint32_t)out.deviceIds.size();
+            out.deviceIds.emplace_back(id, length);
+            deviceHashes_.push_back(hash);
+            deviceSlots_[slot] = index + 1;
+            // Keep the table at most half full
+            if (out.deviceIds.size() * 2 > deviceSlots_.size()) {
+                std::vector<uint32_t> grown(deviceSlots_.size() * 2, 0);
+                size_t grownMask = grown.size() - 1;
+                for (uint32_t k = 0; k < out.deviceIds.size(); k++) {
+                    size_t s = deviceHashes_[k] & grownMask;
+                    while (grown[s] != 0) {
+                        s = (s + 1) & grownMask;
+                    }
+                    grown[s] = k + 1;
+                }
+                deviceSlots_.swap(grown);
+            }
+            return index;
+        }
+        const std::string& known = out.deviceIds[entry - 1];
+        if (deviceHashes_[entry - 1] == hash && known.size() == length && memcmp(known.data(), id, length) == 0) {
+            return entry - 1;
+        }
+    }
+}
+
+}  // namespace ingest
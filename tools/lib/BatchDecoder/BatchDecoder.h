@@ -0,0 +1,92 @@
+#ifndef BATCH_DECODER_H
+#define BATCH_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Batch decoder for captures of telemetry payloads, one JSON object per line
+// (the firmware's reading or state, see ReadingSchema.h), into columns.
+//
+// It works the way simdjson does, specialised to this flat shape. Stage one
+// classifies 64 bytes at a time into bitmasks (quotes, backslashes, the
+// characters { } [ ] : , and newline), drops escaped quotes and everything
+// inside strings, and writes the positions of what is left. Stage two walks
+// those positions record by record, so keys and values are located without
+// looking at the bytes in between; only the values are parsed. Stage one has
+// AVX2, SSE2 and scalar kernels, chosen at run time.
+//
+// Values are kept in the schema's fixed point: hundredths of °C and %RH, with
+// kNull where the payload had null or no such field, and kNoSeq/kNoDelay for
+// payloads without seq/publish_delay. Device ids go into a dictionary and each
+// row holds its index.
+namespace ingest {
+
+const int16_t kNull = INT16_MIN;
+const int8_t kNullRssi = INT8_MIN;
+// seq and publish_delay of payloads from before they existed
+const int64_t kNoSeq = -1;
+const int32_t kNoDelay = -1;
+
+struct Columns {
+    std::vector<uint32_t> device;           // index into deviceIds
+    std::vector<int64_t> timestampMs;
+    std::vector<uint8_t> timeSynced;
+    std::vector<int16_t> temperatureCenti;
+    std::vector<int16_t> humidityCenti;
+    std::vector<int16_t> heatIndexCenti;
+    std::vector<int8_t> rssi;
+    std::vector<int64_t> seq;
+    std::vector<int32_t> publishDelayMs;
+    std::vector<std::string> deviceIds;
+
+    size_t size() const { return timestampMs.size(); }
+    void reserve(size_t rows);
+    // Drops the rows; the device dictionary stays
+    void clear();
+};
+
+class BatchDecoder {
+public:
+    enum Kernel : uint8_t { kAuto, kScalar, kSse2, kAvx2 };
+
+    struct Stats {
+        uint64_t rows;
+        uint64_t rejected;      // malformed lines, or missing device_id/timestamp/temperature/humidity
+        uint64_t bytes;
+    };
+
+    explicit BatchDecoder(Kernel kernel = kAuto);
+
+    // Appends one row per valid line of [data, data + length). A last line
+    // without its newline is decoded too. Returns the rows appended.
+    size_t decode(const char* data, size_t length, Columns& out);
+
+    Kernel kernel() const { return kernel_; }
+    const Stats& stats() const { return stats_; }
+
+    static Kernel best();
+    static const char* kernelName(Kernel kernel);
+
+private:
+    // Positions of structural characters in [data, data + length)
+    size_t index(const uint8_t* data, size_t length);
+    // Decodes the records in the current window; returns where the first
+    // incomplete one starts, or length if none is
+    size_t records(const char* data, size_t length, size_t count, bool final, Columns& out);
+    uint32_t deviceIndex(const char* id, size_t length, Columns& out);
+
+    Kernel kernel_;
+    Stats stats_;
+    std::vector<uint32_t> structurals_;
+    // Open addressing over Columns::deviceIds, slot = index + 1
+    std::vector<uint32_t> deviceSlots_;
+    std::vector<uint32_t> deviceHashes_;
+    const Columns* deviceOwner_;
+};
+
+}  // namespace ingest
+
+#endif
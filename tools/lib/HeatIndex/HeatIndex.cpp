@@ -0,0 +1,22 @@
+#include "HeatIndex.h"
+
+#include <math.h>
+
+float heat_index_fahrenheit(float t, float humidity) {
+    float hi = 0.5f * (t + 61.0f + ((t - 68.0f) * 1.2f) + (humidity * 0.094f));
+    if (hi > 79) {
+        hi = -42.379f + 2.04901523f * t + 10.14333127f * humidity - 0.22475541f * t * humidity -
+             0.00683783f * t * t - 0.05481717f * humidity * humidity + 0.00122874f * t * t * humidity +
+             0.00085282f * t * humidity * humidity - 0.00000199f * t * t * humidity * humidity;
+        if (humidity < 13 && t >= 80 && t <= 112) {
+            hi -= ((13 - humidity) * 0.25f) * sqrtf((17 - fabsf(t - 95)) * 0.05882f);
+        } else if (humidity > 85 && t >= 80 && t <= 87) {
+            hi += ((humidity - 85) * 0.1f) * ((87 - t) * 0.2f);
+        }
+    }
+    return hi;
+}
+
+float heat_index(float celsius, float humidity) {
+    return (heat_index_fahrenheit(celsius * 1.8f + 32, humidity) - 32) * 0.55555f;
+}
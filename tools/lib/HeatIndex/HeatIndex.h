@@ -0,0 +1,13 @@
+#ifndef HEAT_INDEX_H
+#define HEAT_INDEX_H
+
+// Adafruit DHT computeHeatIndex(): Steadman's simple formula, or the
+// Rothfusz regression with its two corrections once that comes out above
+// 79 °F. One copy for the host tools that make up readings and for the
+// virtual DHT22, so they agree with the firmware to the last bit.
+float heat_index_fahrenheit(float fahrenheit, float humidity);
+
+// In Celsius, as the firmware calls it
+float heat_index(float celsius, float humidity);
+
+#endif
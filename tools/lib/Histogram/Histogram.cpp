@@ -0,0 +1,27 @@
+#include "Histogram.h"
+
+#include <algorithm>
+
+void Histogram::add(int64_t ms) {
+    buckets[std::min<int64_t>(std::max<int64_t>(ms, 0), buckets.size() - 1)]++;
+    count++;
+    max = std::max(max, ms);
+}
+
+uint32_t Histogram::percentile(double p) const {
+    uint64_t rank = (uint64_t)(p * count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++) {
+        seen += buckets[i];
+        if (seen > rank) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+void Histogram::clear() {
+    std::fill(buckets.begin(), buckets.end(), 0);
+    count = 0;
+    max = 0;
+}
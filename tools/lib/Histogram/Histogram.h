@@ -0,0 +1,24 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#include <vector>
+
+// Latency histogram for the host tools: millisecond buckets up to a minute,
+// the last one catching everything above, so percentiles cost a walk over
+// 60001 counters and adding one is an increment. max keeps the exact largest
+// value, above the last bucket too.
+struct Histogram {
+    std::vector<uint64_t> buckets = std::vector<uint64_t>(60001, 0);
+    uint64_t count = 0;
+    int64_t max = 0;
+
+    // Negative values count as 0 ms
+    void add(int64_t ms);
+    // Smallest bucket holding more than p of the values, 0 when empty
+    uint32_t percentile(double p) const;
+    void clear();
+};
+
+#endif
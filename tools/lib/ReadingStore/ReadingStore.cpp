@@ -0,0 +1,494 @@
+#include "ReadingStore.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace store {
+
+namespace {
+
+const char kFileMagic[8] = {'R', 'D', 'G', 'S', 'T', 'O', 'R', 'E'};
+const uint32_t kVersion = 1;
+const size_t kFileHeader = 16;
+const uint32_t kBlockMagic = 0x4B4C4252;    // "RBLK"
+
+// --- Integer columns -----------------------------------------------------
+
+uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+uint64_t gcd(uint64_t a, uint64_t b) {
+    while (b != 0) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Column layout: order (1 differences, 2 differences of differences), bit
+// width, first value, first difference (order 2 only) and divisor as
+// varints, then rows - order packed values, least significant bit first
+void encodeColumn(const std::vector<int64_t>& values, int order, std::vector<uint64_t>& scratch,
+                  std::string& out) {
+    size_t n = values.size();
+    if (n < 2) {
+        order = 1;
+    }
+    // Differences wrap, so any int64 round-trips
+    scratch.clear();
+    uint64_t previous = n > 1 ? (uint64_t)values[1] - (uint64_t)values[0] : 0;
+    for (size_t i = order; i < n; i++) {
+        uint64_t difference = (uint64_t)values[i] - (uint64_t)values[i - 1];
+        scratch.push_back(order == 2 ? difference - previous : difference);
+        previous = difference;
+    }
+    uint64_t divisor = 0;
+    for (uint64_t d : scratch) {
+        int64_t s = (int64_t)d;
+        divisor = gcd(divisor, s < 0 ? 0 - d : d);
+    }
+    if (divisor == 0) {
+        divisor = 1;
+    }
+    uint64_t widest = 0;
+    for (uint64_t& d : scratch) {
+        d = zigzag(divisor == 1 ? (int64_t)d : (int64_t)d / (int64_t)divisor);
+        widest |= d;
+    }
+    int width = widest == 0 ? 0 : 64 - __builtin_clzll(widest);
+
+    out.push_back((char)order);
+    out.push_back((char)width);
+    putVarint(out, zigzag(values[0]));
+    if (order == 2) {
+        putVarint(out, zigzag((int64_t)((uint64_t)values[1] - (uint64_t)values[0])));
+    }
+    putVarint(out, divisor);
+
+    uint64_t word = 0;
+    int used = 0;
+    for (uint64_t d : scratch) {
+        word |= d << used;
+        if (used + width >= 64) {
+            out.append((const char*)&word, 8);
+            word = used == 0 ? 0 : d >> (64 - used);
+            used = used + width - 64;
+        } else {
+            used += width;
+        }
+    }
+    out.append((const char*)&word, (used + 7) / 8);
+}
+
+// Bits [bit, bit + width) of the packed area
+uint64_t unpack(const uint8_t* packed, const uint8_t* end, uint64_t bit, int width) {
+    const uint8_t* p = packed + (bit >> 3);
+    int shift = bit & 7;
+    uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+    if (p + 8 <= end && shift + width <= 64) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        return (word >> shift) & mask;
+    }
+    // Tail of the column, or a width above 56 straddling nine bytes
+    uint64_t value = 0;
+    for (int got = 0; got < width; got += 8 - shift, shift = 0) {
+        uint64_t byte = p < end ? *p : 0;
+        p++;
+        value |= (byte >> shift) << got;
+    }
+    return value & mask;
+}
+
+template <typename T>
+bool decodeColumn(const uint8_t* p, const uint8_t* end, size_t rows, std::vector<T>& out) {
+    if (end - p < 2 || rows == 0) {
+        return false;
+    }
+    int order = p[0];
+    int width = p[1];
+    p += 2;
+    uint64_t first;
+    uint64_t firstDifference = 0;
+    uint64_t divisor;
+    if ((order != 1 && order != 2) || width > 64 || !getVarint(p, end, &first) ||
+        (order == 2 && !getVarint(p, end, &firstDifference)) || !getVarint(p, end, &divisor)) {
+        return false;
+    }
+    size_t packedCount = rows > (size_t)order ? rows - order : 0;
+    if ((uint64_t)(end - p) * 8 < (uint64_t)packedCount * width) {
+        return false;
+    }
+
+    size_t at = out.size();
+    out.resize(at + rows);
+    T* values = out.data() + at;
+    uint64_t value = (uint64_t)unzigzag(first);
+    values[0] = (T)value;
+    uint64_t difference = (uint64_t)unzigzag(firstDifference);
+    if (order == 2 && rows > 1) {
+        value += difference;
+        values[1] = (T)value;
+    }
+    uint64_t bit = 0;
+    for (size_t i = order; i < rows; i++, bit += width) {
+        uint64_t d = (uint64_t)unzigzag(unpack(p, end, bit, width)) * divisor;
+        if (order == 2) {
+            difference += d;
+            value += difference;
+        } else {
+            value += d;
+        }
+        values[i] = (T)value;
+    }
+    return true;
+}
+
+bool blockValid(const BlockHeader& header, size_t remaining) {
+    if (header.magic != kBlockMagic || header.bytes < sizeof(BlockHeader) || header.bytes > remaining ||
+        header.bytes % 8 != 0 || header.rows == 0) {
+        return false;
+    }
+    uint32_t previous = sizeof(BlockHeader) + header.deviceLength;
+    for (int c = 0; c < kColumns; c++) {
+        if (header.columnOffset[c] < previous || header.columnOffset[c] > header.bytes) {
+            return false;
+        }
+        previous = header.columnOffset[c];
+    }
+    return true;
+}
+
+int64_t floorDiv(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+void range(const std::vector<int64_t>& values, int64_t null, int16_t* low, int16_t* high) {
+    int64_t lo = INT64_MAX;
+    int64_t hi = INT64_MIN;
+    for (int64_t v : values) {
+        if (v != null) {
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        }
+    }
+    *low = lo == INT64_MAX ? INT16_MAX : (int16_t)lo;
+    *high = hi == INT64_MIN ? INT16_MIN : (int16_t)hi;
+}
+
+}  // namespace
+
+// --- Writer --------------------------------------------------------------
+
+const Writer::Config Writer::kDefaultConfig = {3600000, 4096};
+
+Writer::Writer(const Config& config) : config_(config), fd_(-1), stats_{0, 0, 0}, owner_(nullptr) {
+    if (config_.chunkMs <= 0) {
+        config_.chunkMs = kDefaultConfig.chunkMs;
+    }
+    if (config_.blockRows == 0 || config_.blockRows > UINT16_MAX) {
+        config_.blockRows = UINT16_MAX;
+    }
+}
+
+Writer::~Writer() {
+    close();
+}
+
+bool Writer::open(const char* path) {
+    close();
+    fd_ = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        return false;
+    }
+    uint8_t header[kFileHeader];
+    if (st.st_size == 0) {
+        memset(header, 0, sizeof(header));
+        memcpy(header, kFileMagic, sizeof(kFileMagic));
+        memcpy(header + 8, &kVersion, sizeof(kVersion));
+        return pwrite(fd_, header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+               lseek(fd_, 0, SEEK_END) == (off_t)sizeof(header);
+    }
+    if (pread(fd_, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header, kFileMagic, sizeof(kFileMagic)) != 0) {
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    // Walk the block headers to the end of the last whole block
+    size_t size = st.st_size;
+    size_t offset = kFileHeader;
+    BlockHeader block;
+    while (size - offset >= sizeof(block) && pread(fd_, &block, sizeof(block), offset) == (ssize_t)sizeof(block) &&
+           blockValid(block, size - offset)) {
+        offset += block.bytes;
+    }
+    if (offset != size && ftruncate(fd_, offset) != 0) {
+        return false;
+    }
+    return lseek(fd_, 0, SEEK_END) == (off_t)offset;
+}
+
+Writer::Pending& Writer::pendingFor(const ingest::Columns& columns, uint32_t device) {
+    if (owner_ != &columns || ownerMap_.size() > columns.deviceIds.size()) {
+        owner_ = &columns;
+        ownerMap_.clear();
+    }
+    while (ownerMap_.size() <= device) {
+        const std::string& id = columns.deviceIds[ownerMap_.size()];
+        auto found = byDevice_.find(id);
+        if (found == byDevice_.end()) {
+            found = byDevice_.emplace(id, pending_.size()).first;
+            pending_.emplace_back();
+            pending_.back().device = id;
+        }
+        ownerMap_.push_back(found->second);
+    }
+    return pending_[ownerMap_[device]];
+}
+
+bool Writer::append(const ingest::Columns& columns) {
+    if (fd_ < 0) {
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < columns.size(); i++) {
+        Pending& p = pendingFor(columns, columns.device[i]);
+        int64_t chunk = floorDiv(columns.timestampMs[i], config_.chunkMs);
+        if (!p.timestampMs.empty() && (chunk != p.chunk || p.timestampMs.size() >= config_.blockRows)) {
+            ok = write(p) && ok;
+        }
+        p.chunk = chunk;
+        p.timestampMs.push_back(columns.timestampMs[i]);
+        p.timeSynced.push_back(columns.timeSynced[i]);
+        p.temperatureCenti.push_back(columns.temperatureCenti[i]);
+        p.humidityCenti.push_back(columns.humidityCenti[i]);
+        p.heatIndexCenti.push_back(columns.heatIndexCenti[i]);
+        p.rssi.push_back(columns.rssi[i]);
+    }
+    return ok;
+}
+
+bool Writer::flushBefore(int64_t ms) {
+    bool ok = true;
+    for (Pending& p : pending_) {
+        if (!p.timestampMs.empty() && (p.chunk + 1) * config_.chunkMs <= ms) {
+            ok = write(p) && ok;
+        }
+    }
+    return ok;
+}
+
+bool Writer::flush() {
+    bool ok = true;
+    for (Pending& p : pending_) {
+        if (!p.timestampMs.empty()) {
+            ok = write(p) && ok;
+        }
+    }
+    return ok;
+}
+
+bool Writer::close() {
+    if (fd_ < 0) {
+        return true;
+    }
+    bool ok = flush();
+    ok = ::close(fd_) == 0 && ok;
+    fd_ = -1;
+    return ok;
+}
+
+bool Writer::write(Pending& p) {
+    size_t rows = p.timestampMs.size();
+    BlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kBlockMagic;
+    header.rows = rows;
+    header.deviceLength = p.device.size() < UINT16_MAX ? p.device.size() : UINT16_MAX;
+    header.firstMs = INT64_MAX;
+    header.lastMs = INT64_MIN;
+    for (size_t i = 0; i < rows; i++) {
+        header.firstMs = p.timestampMs[i] < header.firstMs ? p.timestampMs[i] : header.firstMs;
+        header.lastMs = p.timestampMs[i] > header.lastMs ? p.timestampMs[i] : header.lastMs;
+        header.syncedRows += p.timeSynced[i] ? 1 : 0;
+    }
+    range(p.temperatureCenti, ingest::kNull, &header.minTemperature, &header.maxTemperature);
+    range(p.humidityCenti, ingest::kNull, &header.minHumidity, &header.maxHumidity);
+    range(p.heatIndexCenti, ingest::kNull, &header.minHeatIndex, &header.maxHeatIndex);
+    int16_t low;
+    int16_t high;
+    range(p.rssi, ingest::kNullRssi, &low, &high);
+    header.minRssi = low > INT8_MAX ? INT8_MAX : (int8_t)low;
+    header.maxRssi = high < INT8_MIN ? INT8_MIN : (int8_t)high;
+
+    block_.assign(sizeof(header), '\0');
+    block_.append(p.device, 0, header.deviceLength);
+    const std::vector<int64_t>* columns[kColumns] = {&p.timestampMs,    &p.timeSynced,     &p.temperatureCenti,
+                                                     &p.humidityCenti, &p.heatIndexCenti, &p.rssi};
+    std::vector<uint64_t> scratch;
+    for (int c = 0; c < kColumns; c++) {
+        header.columnOffset[c] = block_.size();
+        encodeColumn(*columns[c], c == kTimestamp ? 2 : 1, scratch, block_);
+    }
+    block_.resize((block_.size() + 7) & ~(size_t)7, '\0');
+    header.bytes = block_.size();
+    memcpy(&block_[0], &header, sizeof(header));
+
+    for (std::vector<int64_t>* column : {&p.timestampMs, &p.timeSynced, &p.temperatureCenti, &p.humidityCenti,
+                                         &p.heatIndexCenti, &p.rssi}) {
+        column->clear();
+    }
+    size_t written = 0;
+    while (written < block_.size()) {
+        ssize_t n = ::write(fd_, block_.data() + written, block_.size() - written);
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    stats_.rows += rows;
+    stats_.blocks++;
+    stats_.bytes += block_.size();
+    return true;
+}
+
+// --- Reader --------------------------------------------------------------
+
+Reader::Reader() : data_(nullptr), length_(0), torn_(0), rows_(0) {}
+
+Reader::~Reader() {
+    close();
+}
+
+bool Reader::open(const char* path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < kFileHeader) {
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    data_ = (const uint8_t*)mapped;
+    length_ = st.st_size;
+    if (memcmp(data_, kFileMagic, sizeof(kFileMagic)) != 0) {
+        close();
+        return false;
+    }
+    madvise(mapped, length_, MADV_SEQUENTIAL);
+
+    std::unordered_map<std::string, uint32_t> byDevice;
+    size_t offset = kFileHeader;
+    while (length_ - offset >= sizeof(BlockHeader)) {
+        const BlockHeader* header = (const BlockHeader*)(data_ + offset);
+        if (!blockValid(*header, length_ - offset)) {
+            break;
+        }
+        std::string device((const char*)(header + 1), header->deviceLength);
+        auto found = byDevice.find(device);
+        if (found == byDevice.end()) {
+            found = byDevice.emplace(device, devices_.size()).first;
+            devices_.push_back(device);
+        }
+        blocks_.push_back({header, found->second});
+        rows_ += header->rows;
+        offset += header->bytes;
+    }
+    torn_ = length_ - offset;
+    return true;
+}
+
+void Reader::close() {
+    if (data_ != nullptr) {
+        munmap((void*)data_, length_);
+    }
+    data_ = nullptr;
+    length_ = 0;
+    torn_ = 0;
+    rows_ = 0;
+    blocks_.clear();
+    devices_.clear();
+}
+
+bool Reader::decode(const Block& block, ingest::Columns& out) const {
+    const BlockHeader& h = *block.header;
+    const uint8_t* base = (const uint8_t*)block.header;
+    if (out.deviceIds.size() < devices_.size()) {
+        out.deviceIds = devices_;
+    }
+    size_t at = out.size();
+    auto column = [&](int c, auto& values) {
+        const uint8_t* end = base + (c + 1 < kColumns ? h.columnOffset[c + 1] : h.bytes);
+        return decodeColumn(base + h.columnOffset[c], end, h.rows, values);
+    };
+    bool ok = column(kTimestamp, out.timestampMs) && column(kSynced, out.timeSynced) &&
+              column(kTemperature, out.temperatureCenti) && column(kHumidity, out.humidityCenti) &&
+              column(kHeatIndex, out.heatIndexCenti) && column(kRssi, out.rssi);
+    if (!ok) {
+        // Leave out as it was
+        out.timestampMs.resize(at);
+        out.timeSynced.resize(at);
+        out.temperatureCenti.resize(at);
+        out.humidityCenti.resize(at);
+        out.heatIndexCenti.resize(at);
+        out.rssi.resize(at);
+        return false;
+    }
+    out.device.insert(out.device.end(), h.rows, block.device);
+    out.seq.insert(out.seq.end(), h.rows, ingest::kNoSeq);
+    out.publishDelayMs.insert(out.publishDelayMs.end(), h.rows, ingest::kNoDelay);
+    return true;
+}
+
+bool Reader::decode(const Block& block, Column column, std::vector<int64_t>& values) const {
+    const BlockHeader& h = *block.header;
+    const uint8_t* base = (const uint8_t*)block.header;
+    const uint8_t* end = base + (column + 1 < kColumns ? h.columnOffset[column + 1] : h.bytes);
+    values.clear();
+    return column < kColumns && decodeColumn(base + h.columnOffset[column], end, h.rows, values);
+}
+
+}  // namespace store
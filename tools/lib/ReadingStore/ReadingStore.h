@@ -0,0 +1,156 @@
+#ifndef READING_STORE_H
+#define READING_STORE_H
+
+#include <BatchDecoder.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Columnar file of readings for captures and archives, written by appending
+// and read through mmap.
+//
+// A file is a 16-byte header followed by blocks. A block holds one device's
+// readings within one time chunk (an hour by default), column by column:
+// timestamp, time_synced, temperature, humidity, heat index and RSSI, the
+// values in the schema's fixed point (see BatchDecoder.h). Each column is a
+// first value plus the differences between neighbours (differences of the
+// differences for timestamps), divided by their greatest common divisor -
+// DHT22 values move in tenths, so by 10 - zigzag-mapped and bit-packed at the
+// width of the block's largest one. The block header carries the row count,
+// first/last timestamp and min/max of every value column, so a reader skips
+// blocks by device, time or value without touching their columns.
+//
+// Blocks are only appended. A block cut short by a crash is ignored by the
+// reader and dropped by the next writer that opens the file.
+namespace store {
+
+const int kColumns = 6;
+
+enum Column : uint8_t { kTimestamp, kSynced, kTemperature, kHumidity, kHeatIndex, kRssi };
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t bytes;             // whole block, header included, a multiple of 8
+    uint32_t rows;
+    uint16_t deviceLength;      // device id follows the header
+    uint16_t syncedRows;
+    int64_t firstMs;            // smallest timestamp
+    int64_t lastMs;             // largest timestamp
+    // Ranges skip kNull; min > max when every value is null
+    int16_t minTemperature;
+    int16_t maxTemperature;
+    int16_t minHumidity;
+    int16_t maxHumidity;
+    int16_t minHeatIndex;
+    int16_t maxHeatIndex;
+    int8_t minRssi;
+    int8_t maxRssi;
+    uint16_t reserved;
+    uint32_t columnOffset[kColumns];    // from the start of the block
+};
+static_assert(sizeof(BlockHeader) == 72, "BlockHeader is written as is");
+
+class Writer {
+public:
+    struct Config {
+        int64_t chunkMs;        // blocks never span a multiple of this
+        uint32_t blockRows;     // and hold at most this many rows
+    };
+
+    struct Stats {
+        uint64_t rows;
+        uint64_t blocks;
+        uint64_t bytes;         // written by this writer, headers included
+    };
+
+    static const Config kDefaultConfig;
+
+    explicit Writer(const Config& config = kDefaultConfig);
+    ~Writer();
+
+    // Opens path for appending, creating it if needed; drops a torn last block
+    bool open(const char* path);
+    // Buffers every row of columns under its device; a device's block is
+    // written once it is full or a row falls in another chunk. The
+    // dictionary of columns may only grow between calls.
+    bool append(const ingest::Columns& columns);
+    // Writes the blocks of chunks that end at or before ms, i.e. the ones no
+    // more rows are expected for
+    bool flushBefore(int64_t ms);
+    // Writes every buffered block
+    bool flush();
+    // flush() and close the file
+    bool close();
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct Pending {
+        std::string device;
+        int64_t chunk;
+        std::vector<int64_t> timestampMs;
+        std::vector<int64_t> timeSynced;
+        std::vector<int64_t> temperatureCenti;
+        std::vector<int64_t> humidityCenti;
+        std::vector<int64_t> heatIndexCenti;
+        std::vector<int64_t> rssi;
+    };
+
+    bool write(Pending& pending);
+    Pending& pendingFor(const ingest::Columns& columns, uint32_t device);
+
+    Config config_;
+    int fd_;
+    Stats stats_;
+    std::vector<Pending> pending_;
+    std::unordered_map<std::string, uint32_t> byDevice_;
+    // Columns::device index to pending_ index for the last columns appended
+    const ingest::Columns* owner_;
+    std::vector<uint32_t> ownerMap_;
+    std::string block_;
+};
+
+class Reader {
+public:
+    struct Block {
+        const BlockHeader* header;
+        uint32_t device;        // index into devices()
+    };
+
+    Reader();
+    ~Reader();
+
+    // Maps path and indexes its blocks
+    bool open(const char* path);
+    void close();
+
+    const std::vector<Block>& blocks() const { return blocks_; }
+    const std::vector<std::string>& devices() const { return devices_; }
+    size_t rows() const { return rows_; }
+    size_t fileBytes() const { return length_; }
+    // Bytes after the last whole block
+    size_t tornBytes() const { return torn_; }
+
+    // Appends the rows of a block to out. out.device indexes devices(), so
+    // out must be empty or only ever filled by this reader. seq and
+    // publishDelayMs are not stored and come back as kNoSeq and kNoDelay.
+    bool decode(const Block& block, ingest::Columns& out) const;
+    // Only one column of a block, into values (replacing what they held)
+    bool decode(const Block& block, Column column, std::vector<int64_t>& values) const;
+
+private:
+    const uint8_t* data_;
+    size_t length_;
+    size_t torn_;
+    size_t rows_;
+    std::vector<Block> blocks_;
+    std::vector<std::string> devices_;
+};
+
+}  // namespace store
+
+#endif
@@ -0,0 +1,100 @@
+#include "TcpTransport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+TcpTransport::TcpTransport(size_t capacity) : fd_(-1), buffer_(capacity), start_(0), end_(0) {}
+
+TcpTransport::~TcpTransport() {
+    stop();
+}
+
+bool TcpTransport::connect(const char* host, uint16_t port) {
+    stop();
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host, service, &hints, &result) != 0) {
+        return false;
+    }
+    for (addrinfo* at = result; at != nullptr && fd_ < 0; at = at->ai_next) {
+        fd_ = socket(at->ai_family, at->ai_socktype, at->ai_protocol);
+        if (fd_ >= 0 && ::connect(fd_, at->ai_addr, at->ai_addrlen) < 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+    freeaddrinfo(result);
+    if (fd_ < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+size_t TcpTransport::write(const uint8_t* data, size_t length) {
+    if (length > writable()) {
+        return 0;
+    }
+    if (buffer_.size() - end_ < length) {
+        memmove(buffer_.data(), buffer_.data() + start_, end_ - start_);
+        end_ -= start_;
+        start_ = 0;
+    }
+    memcpy(buffer_.data() + end_, data, length);
+    end_ += length;
+    if (end_ - start_ >= buffer_.size() / 2) {
+        flush();
+    }
+    return length;
+}
+
+size_t TcpTransport::read(uint8_t* data, size_t length) {
+    if (fd_ < 0) {
+        return 0;
+    }
+    ssize_t n = recv(fd_, data, length, 0);
+    if (n > 0) {
+        return n;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+        stop();
+    }
+    return 0;
+}
+
+void TcpTransport::stop() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = -1;
+    start_ = end_ = 0;
+}
+
+void TcpTransport::flush() {
+    while (fd_ >= 0 && end_ > start_) {
+        ssize_t n = send(fd_, buffer_.data() + start_, end_ - start_, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                stop();
+            }
+            return;
+        }
+        start_ += n;
+    }
+    if (start_ == end_) {
+        start_ = end_ = 0;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef TCP_TRANSPORT_H
+#define TCP_TRANSPORT_H
+
+#include <MqttTransport.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// MqttTransport over one non-blocking POSIX socket, for host tools that hold
+// a single broker connection. Writes are buffered, so writable() has an
+// honest answer as with AsyncTcpTransport, and go out when poll() runs -
+// MqttClient::loop() calls it - or once half the buffer is taken, so a burst
+// of publishes leaves in few syscalls.
+class TcpTransport : public MqttTransport {
+public:
+    explicit TcpTransport(size_t capacity = 4096);
+    ~TcpTransport() override;
+
+    // Blocking connect, then non-blocking I/O
+    bool connect(const char* host, uint16_t port) override;
+    bool connected() override { return fd_ >= 0; }
+    size_t writable() override { return fd_ >= 0 ? buffer_.size() - (end_ - start_) : 0; }
+    size_t write(const uint8_t* data, size_t length) override;
+    size_t read(uint8_t* data, size_t length) override;
+    void stop() override;
+    void poll() override { flush(); }
+
+    // For poll(2): the socket, and whether there is output waiting for it
+    int fd() const { return fd_; }
+    bool wantsWrite() const { return end_ > start_; }
+
+private:
+    void flush();
+
+    int fd_;
+    std::vector<uint8_t> buffer_;
+    size_t start_;
+    size_t end_;
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include "TrafficCapture.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace capture {
+
+namespace {
+
+const char kMagic[8] = {'T', 'T', 'C', 'A', 'P', 'T', 'R', '1'};
+const size_t kHeaderBytes = 16;
+
+}  // namespace
+
+// --- Writer ---
+
+Writer::Writer() : file_(nullptr), lastUs_(0), messages_(0), bytes_(0) {}
+
+Writer::~Writer() {
+    close();
+}
+
+bool Writer::open(const char* path, int64_t startMs) {
+    close();
+    file_ = fopen(path, "wb");
+    if (file_ == nullptr) {
+        return false;
+    }
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+    uint8_t header[kHeaderBytes];
+    memcpy(header, kMagic, sizeof(kMagic));
+    memcpy(header + 8, &startMs, sizeof(startMs));
+    lastUs_ = messages_ = 0;
+    bytes_ = sizeof(header);
+    topics_.clear();
+    return fwrite(header, sizeof(header), 1, file_) == 1;
+}
+
+void Writer::put(uint64_t value) {
+    while (value >= 0x80) {
+        record_.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    record_.push_back((char)value);
+}
+
+bool Writer::add(uint64_t atUs, const char* topic, const uint8_t* payload, size_t length) {
+    if (file_ == nullptr) {
+        return false;
+    }
+    record_.clear();
+    put(atUs > lastUs_ ? atUs - lastUs_ : 0);
+    lastUs_ = atUs > lastUs_ ? atUs : lastUs_;
+    auto found = topics_.emplace(topic, (uint32_t)topics_.size());
+    put(found.first->second);
+    if (found.second) {
+        put(found.first->first.size());
+        record_ += found.first->first;
+    }
+    put(length);
+    bool ok = fwrite(record_.data(), record_.size(), 1, file_) == 1 &&
+              (length == 0 || fwrite(payload, length, 1, file_) == 1);
+    messages_++;
+    bytes_ += record_.size() + length;
+    return ok;
+}
+
+bool Writer::close() {
+    if (file_ == nullptr) {
+        return true;
+    }
+    bool ok = fclose(file_) == 0;
+    file_ = nullptr;
+    return ok;
+}
+
+// --- Reader ---
+
+Reader::Reader() : data_(nullptr), length_(0), at_(0), done_(false), startMs_(0), atUs_(0) {}
+
+Reader::~Reader() {
+    close();
+}
+
+bool Reader::open(const char* path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < kHeaderBytes) {
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    data_ = (const uint8_t*)mapped;
+    length_ = st.st_size;
+    if (memcmp(data_, kMagic, sizeof(kMagic)) != 0) {
+        close();
+        return false;
+    }
+    madvise(mapped, length_, MADV_SEQUENTIAL);
+    memcpy(&startMs_, data_ + 8, sizeof(startMs_));
+    rewind();
+    return true;
+}
+
+void Reader::close() {
+    if (data_ != nullptr) {
+        munmap((void*)data_, length_);
+    }
+    data_ = nullptr;
+    length_ = at_ = 0;
+    done_ = false;
+    topics_.clear();
+}
+
+void Reader::rewind() {
+    at_ = kHeaderBytes;
+    atUs_ = 0;
+    done_ = false;
+    // Rebuilt in the same order, so indices from an earlier pass still hold
+    topics_.clear();
+}
+
+bool Reader::get(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && at_ < length_; shift += 7) {
+        uint8_t byte = data_[at_++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Reader::next(Message& message) {
+    if (done_ || data_ == nullptr) {
+        return false;
+    }
+    size_t start = at_;
+    uint64_t gap, topic, topicLength = 0, length;
+    size_t topicAt = 0;
+    bool ok = get(gap) && get(topic) && topic <= topics_.size();
+    if (ok && topic == topics_.size()) {
+        ok = get(topicLength) && topicLength <= length_ - at_;
+        topicAt = at_;
+        at_ += ok ? topicLength : 0;
+    }
+    ok = ok && get(length) && length <= length_ - at_;
+    if (!ok) {
+        at_ = start;
+        done_ = true;
+        return false;
+    }
+    if (topic == topics_.size()) {
+        topics_.emplace_back((const char*)data_ + topicAt, topicLength);
+    }
+    atUs_ += gap;
+    message.atUs = atUs_;
+    message.topic = (uint32_t)topic;
+    message.payload = data_ + at_;
+    message.length = length;
+    at_ += length;
+    return true;
+}
+
+}  // namespace capture
@@ -0,0 +1,99 @@
+#ifndef TRAFFIC_CAPTURE_H
+#define TRAFFIC_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// File of MQTT messages as a broker delivered them, in arrival order, for
+// replaying a fleet's traffic.
+//
+// A file is a 16-byte header - "TTCAPTR1" and the wall clock in ms when the
+// recording started - followed by one record per message:
+//
+//   varint  gap           µs since the previous message (the start, for the first)
+//   varint  topic         index into the file's topics, in order of first use;
+//                         the next unused index introduces a new topic:
+//   [varint length, bytes]
+//   varint  length        of the payload
+//   bytes   payload
+//
+// A fleet has a few topics per device and a message every few seconds on
+// each, so the gap and topic take two to four bytes and the payload is most of
+// the file. A record cut short by a crash ends the file for the reader.
+namespace capture {
+
+struct Message {
+    uint64_t atUs;              // since the start of the recording
+    uint32_t topic;             // index into Reader::topics()
+    const uint8_t* payload;
+    size_t length;
+};
+
+class Writer {
+public:
+    Writer();
+    ~Writer();
+
+    // Creates path, replacing it; startMs is the wall clock at atUs == 0
+    bool open(const char* path, int64_t startMs);
+    // atUs must not go backwards
+    bool add(uint64_t atUs, const char* topic, const uint8_t* payload, size_t length);
+    bool close();
+
+    uint64_t messages() const { return messages_; }
+    uint64_t bytes() const { return bytes_; }
+    size_t topics() const { return topics_.size(); }
+
+private:
+    void put(uint64_t value);
+
+    FILE* file_;
+    uint64_t lastUs_;
+    uint64_t messages_;
+    uint64_t bytes_;
+    std::unordered_map<std::string, uint32_t> topics_;
+    std::string record_;
+};
+
+class Reader {
+public:
+    Reader();
+    ~Reader();
+
+    // Maps path and checks its header
+    bool open(const char* path);
+    void close();
+
+    int64_t startMs() const { return startMs_; }
+    size_t fileBytes() const { return length_; }
+    // Topics met so far by next(); all of them once it returned false
+    const std::vector<std::string>& topics() const { return topics_; }
+    // Bytes after the last whole record, known once next() returned false
+    size_t tornBytes() const { return done_ ? length_ - at_ : 0; }
+
+    // The following message, false at the end. message.payload points into
+    // the mapping and stays valid until close().
+    bool next(Message& message);
+    // Back to the first message; topics() fills up again as next() goes
+    void rewind();
+
+private:
+    bool get(uint64_t& value);
+
+    const uint8_t* data_;
+    size_t length_;
+    size_t at_;
+    bool done_;
+    int64_t startMs_;
+    uint64_t atUs_;
+    std::vector<std::string> topics_;
+};
+
+}  // namespace capture
+
+#endif
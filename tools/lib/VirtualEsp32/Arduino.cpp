@@ -0,0 +1,195 @@
+#include "Arduino.h"
+
+#include "esp_ota_ops.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace sim {
+
+namespace {
+
+FILE* serialOut = nullptr;
+
+}  // namespace
+
+void setSerial(FILE* out) {
+    serialOut = out;
+}
+
+FILE* serial() {
+    return serialOut;
+}
+
+}  // namespace sim
+
+uint32_t millis() {
+    return (uint32_t)(sim::deviceUs() / 1000);
+}
+
+uint32_t micros() {
+    return (uint32_t)sim::deviceUs();
+}
+
+void delay(uint32_t ms) {
+    sim::advance(sim::toTrueUs((uint64_t)ms * 1000));
+}
+
+#if defined(__GLIBC__) && __GLIBC__ == 2 && __GLIBC_MINOR__ < 38
+size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t length = strlen(src);
+    if (size > 0) {
+        size_t n = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return length;
+}
+#endif
+
+// --- Print ---
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (n < size && write(buffer[n])) {
+        n++;
+    }
+    return n;
+}
+
+size_t Print::print(const char* value) {
+    return discarding() ? 0 : write(value);
+}
+
+size_t Print::print(char value) {
+    return discarding() ? 0 : write((uint8_t)value);
+}
+
+size_t Print::print(unsigned char value, int base) {
+    return printUnsigned(value, base);
+}
+
+size_t Print::print(int value, int base) {
+    return printSigned(value, base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+    return printUnsigned(value, base);
+}
+
+size_t Print::print(long value, int base) {
+    return printSigned(value, base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+    return printUnsigned(value, base);
+}
+
+size_t Print::print(long long value, int base) {
+    return printSigned(value, base);
+}
+
+size_t Print::print(unsigned long long value, int base) {
+    return printUnsigned(value, base);
+}
+
+size_t Print::print(double value, int digits) {
+    if (discarding()) {
+        return 0;
+    }
+    // Arduino prints these spelled out rather than as printf does
+    if (isnan(value)) {
+        return write("nan");
+    }
+    if (isinf(value)) {
+        return write("inf");
+    }
+    char text[48];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return write(text);
+}
+
+size_t Print::println() {
+    return discarding() ? 0 : write("\r\n");
+}
+
+size_t Print::printSigned(long long value, int base) {
+    if (discarding()) {
+        return 0;
+    }
+    if (base == 10) {
+        char text[24];
+        snprintf(text, sizeof(text), "%lld", value);
+        return write(text);
+    }
+    return printUnsigned((unsigned long long)value, base);
+}
+
+size_t Print::printUnsigned(unsigned long long value, int base) {
+    if (discarding()) {
+        return 0;
+    }
+    char text[24];
+    snprintf(text, sizeof(text), base == 16 ? "%llX" : "%llu", value);
+    return write(text);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    FILE* out = sim::serial();
+    if (out == nullptr) {
+        return size;
+    }
+    for (size_t i = 0; i < size; i++) {
+        if (buffer[i] == '\r') {
+            continue;
+        }
+        if (lineStart_) {
+            uint64_t ms = sim::deviceUs() / 1000;
+            fprintf(out, "[%llud %02u:%02u:%02u.%03u] ", (unsigned long long)(ms / 86400000),
+                    (unsigned)(ms / 3600000 % 24), (unsigned)(ms / 60000 % 60), (unsigned)(ms / 1000 % 60),
+                    (unsigned)(ms % 1000));
+            lineStart_ = false;
+        }
+        fputc(buffer[i], out);
+        lineStart_ = buffer[i] == '\n';
+    }
+    return size;
+}
+
+// --- ESP ---
+
+void EspClass::restart() {
+    esp_restart();
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return sim::heap().stats().free;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    return sim::heap().stats().minFree;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    return sim::heap().largestFree();
+}
+
+// --- FreeRTOS ---
+
+BaseType_t xTaskCreate(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*) {
+    return pdFAIL;
+}
+
+void vTaskDelete(TaskHandle_t) {}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks);
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) {
+    return 8192;    // ARDUINO_LOOP_STACK_SIZE
+}
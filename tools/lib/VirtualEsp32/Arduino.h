@@ -0,0 +1,133 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// The parts of the Arduino ESP32 core the firmware uses, on VirtualEsp32's
+// clock. Types and overloads follow core 2.x so the same code compiles.
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "VirtualEsp32.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+using std::isinf;
+using std::isnan;
+using std::max;
+using std::min;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define DEC 10
+#define HEX 16
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+inline void yield() {}
+
+// In the ESP32 newlib; glibc only has it from 2.38
+#if defined(__GLIBC__) && __GLIBC__ == 2 && __GLIBC_MINOR__ < 38
+size_t strlcpy(char* dst, const char* src, size_t size);
+#endif
+
+// --- Print ---
+
+class Print;
+
+class Printable {
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* str) { return str != nullptr ? write((const uint8_t*)str, strlen(str)) : 0; }
+
+    size_t print(const char* value);
+    size_t print(char value);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(long long value, int base = DEC);
+    size_t print(unsigned long long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+    size_t print(const Printable& value) { return value.printTo(*this); }
+
+    template <typename T>
+    size_t println(const T& value) {
+        return print(value) + println();
+    }
+    size_t println(unsigned char value, int base) { return print(value, base) + println(); }
+    size_t println(double value, int digits) { return print(value, digits) + println(); }
+    size_t println();
+
+    // Cheap check before formatting anything
+    virtual bool discarding() const { return false; }
+
+private:
+    size_t printSigned(long long value, int base);
+    size_t printUnsigned(unsigned long long value, int base);
+};
+
+// Serial port, written to sim::serial() with the uptime at the start of each line
+class HardwareSerial : public Print {
+public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    bool discarding() const override { return sim::serial() == nullptr; }
+    using Print::write;
+
+private:
+    bool lineStart_ = true;
+};
+
+extern HardwareSerial Serial;
+
+// --- ESP ---
+
+class EspClass {
+public:
+    [[noreturn]] void restart();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+};
+
+extern EspClass ESP;
+
+// --- FreeRTOS, as much as the firmware touches ---
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;        // ESP-IDF counts stack in bytes
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// There is no second task on the host: creating one fails
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stackDepth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+// Stack use is not measured; reports the loop task's whole stack as free
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+#endif
@@ -0,0 +1,285 @@
+#include "AsyncTCP.h"
+
+#include <algorithm>
+#include <deque>
+
+namespace sim {
+
+namespace {
+
+// lwIP as the Arduino ESP32 core configures it
+const size_t kSendBuffer = 5744;            // TCP_SND_BUF, 4 × MSS
+const uint32_t kPcbBytes = 196;             // struct tcp_pcb
+const uint32_t kPbufBytes = 16;             // struct pbuf, ahead of the payload
+const uint32_t kHeaderBytes = 54;           // TCP, IP and link headers reserved in a TX pbuf
+const uint32_t kSegBytes = 20;              // struct tcp_seg
+const uint64_t kSynTimeoutUs = 20000000;    // SYN retransmissions before ERR_ABRT
+const uint64_t kRxRetryUs = 100000;         // a dropped segment comes back after this
+
+// lwIP error codes AsyncTCP passes on
+const int8_t kErrAbort = -13;
+const int8_t kErrReset = -14;
+
+Server* server = nullptr;
+std::deque<Socket> sockets;
+
+}  // namespace
+
+void setServer(Server* far) {
+    server = far;
+}
+
+void Socket::send(const uint8_t* data, size_t length) {
+    if (serverOpen_ && length > 0) {
+        AsyncClient::transmit({this, false, AsyncClient::kData, std::vector<uint8_t>(data, data + length)});
+    }
+}
+
+void Socket::close() {
+    if (serverOpen_) {
+        serverOpen_ = false;
+        AsyncClient::transmit({this, false, AsyncClient::kFin, {}});
+    }
+}
+
+}  // namespace sim
+
+std::deque<AsyncClient::Packet> AsyncClient::held_;
+
+void AsyncClient::transmit(Packet packet) {
+    if (!sim::wifiConnected()) {
+        hold(std::move(packet));
+        return;
+    }
+    sim::at(sim::nowUs() + (uint64_t)sim::latencyMs() * 1000, [packet]() mutable { arrive(packet); });
+}
+
+void AsyncClient::hold(Packet packet) {
+    if (packet.kind == kSyn || packet.kind == kSynAck) {
+        return;
+    }
+    held_.push_back(std::move(packet));
+    if (held_.size() == 1) {
+        sim::whenConnected([]() {
+            std::deque<Packet> ready;
+            ready.swap(held_);
+            for (Packet& waiting : ready) {
+                transmit(std::move(waiting));
+            }
+        });
+    }
+}
+
+void AsyncClient::arrive(Packet& packet) {
+    if (!sim::wifiConnected()) {
+        // Lost on the way; TCP sends it again once the link is back
+        hold(std::move(packet));
+        return;
+    }
+    sim::Socket* socket = packet.socket;
+    AsyncClient* client = static_cast<AsyncClient*>(socket->client_);
+    if (packet.toServer) {
+        switch (packet.kind) {
+        case kSyn:
+            if (!socket->deviceOpen_) {
+                break;
+            }
+            if (sim::server != nullptr && sim::server->accept(socket)) {
+                socket->serverOpen_ = true;
+                transmit({socket, false, kSynAck, {}});
+            } else {
+                transmit({socket, false, kReset, {}});
+            }
+            break;
+        case kData:
+            if (!socket->serverOpen_) {
+                break;
+            }
+            sim::server->receive(socket, packet.data.data(), packet.data.size());
+            // The ACK back; one per segment, in order
+            sim::at(sim::nowUs() + (uint64_t)sim::latencyMs() * 1000, [socket]() {
+                AsyncClient* sender = static_cast<AsyncClient*>(socket->client_);
+                if (sender != nullptr) {
+                    sender->acked(socket);
+                }
+            });
+            break;
+        case kReset:
+        case kFin:
+            if (socket->serverOpen_) {
+                socket->serverOpen_ = false;
+                sim::server->closed(socket);
+            }
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+
+    if (client == nullptr) {
+        return;
+    }
+    switch (packet.kind) {
+    case kSynAck:
+        if (client->state_ == kConnecting) {
+            client->connected(socket);
+        }
+        break;
+    case kReset:
+        client->drop(client->state_ == kConnecting ? sim::kErrReset : sim::kErrAbort);
+        break;
+    case kData:
+        client->received(socket, packet.data);
+        break;
+    case kFin:
+        client->release();
+        if (client->onDisconnect_) {
+            client->onDisconnect_(client->disconnectArg_, client);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+bool AsyncClient::connect(const char*, uint16_t) {
+    if (state_ != kClosed || !sim::wifiConnected()) {
+        return false;
+    }
+    pcb_ = sim::heap().alloc(sim::kPcbBytes);
+    if (pcb_ < 0) {
+        return false;
+    }
+    sim::sockets.emplace_back();
+    sim::Socket* socket = &sim::sockets.back();
+    socket->id_ = (uint32_t)sim::sockets.size();
+    socket->deviceOpen_ = true;
+    socket->client_ = this;
+    socket_ = socket;
+    state_ = kConnecting;
+    unacked_ = 0;
+    transmit({socket, true, kSyn, {}});
+    sim::at(sim::nowUs() + sim::kSynTimeoutUs, [this, socket]() {
+        if (socket_ == socket && state_ == kConnecting) {
+            drop(sim::kErrAbort);
+        }
+    });
+    return true;
+}
+
+void AsyncClient::close(bool) {
+    if (state_ == kClosed) {
+        return;
+    }
+    sim::Socket* socket = socket_;
+    // Whatever had not reached the broker yet goes with the connection
+    held_.erase(std::remove_if(held_.begin(), held_.end(),
+                              [socket](const Packet& p) { return p.socket == socket && p.toServer; }),
+               held_.end());
+    transmit({socket, true, kReset, {}});
+    release();
+    if (onDisconnect_) {
+        onDisconnect_(disconnectArg_, this);
+    }
+}
+
+size_t AsyncClient::space() const {
+    return state_ == kConnected ? sim::kSendBuffer - unacked_ : 0;
+}
+
+size_t AsyncClient::add(const char* data, size_t size, uint8_t) {
+    size_t n = std::min(size, space());
+    if (n == 0) {
+        return 0;
+    }
+    int64_t pbuf = sim::heap().alloc((uint32_t)n + sim::kPbufBytes + sim::kHeaderBytes);
+    int64_t seg = sim::heap().alloc(sim::kSegBytes);
+    if (pbuf < 0 || seg < 0) {
+        // ERR_MEM: AsyncTcpTransport keeps the bytes and tries again
+        sim::heap().free(pbuf);
+        sim::heap().free(seg);
+        return 0;
+    }
+    unsent_.push_back({std::vector<uint8_t>(data, data + n), pbuf, seg});
+    unacked_ += n;
+    return n;
+}
+
+bool AsyncClient::send() {
+    if (state_ != kConnected) {
+        return false;
+    }
+    while (!unsent_.empty()) {
+        Segment segment = std::move(unsent_.front());
+        unsent_.pop_front();
+        transmit({socket_, true, kData, segment.data});
+        inflight_.push_back(std::move(segment));
+    }
+    return true;
+}
+
+size_t AsyncClient::ack(size_t length) {
+    return length;
+}
+
+void AsyncClient::connected(sim::Socket*) {
+    state_ = kConnected;
+    if (onConnect_) {
+        onConnect_(connectArg_, this);
+    }
+}
+
+void AsyncClient::received(sim::Socket* socket, const std::vector<uint8_t>& data) {
+    int64_t pbuf = sim::heap().alloc((uint32_t)data.size() + sim::kPbufBytes);
+    if (pbuf < 0) {
+        // Dropped for want of a pbuf; the broker retransmits
+        sim::at(sim::nowUs() + sim::kRxRetryUs, [this, socket, data]() {
+            if (socket_ == socket) {
+                received(socket, data);
+            }
+        });
+        return;
+    }
+    if (onData_) {
+        onData_(dataArg_, this, (void*)data.data(), data.size());
+    }
+    sim::heap().free(pbuf);
+}
+
+void AsyncClient::acked(sim::Socket* socket) {
+    if (socket != socket_ || inflight_.empty()) {
+        return;
+    }
+    Segment& segment = inflight_.front();
+    unacked_ -= segment.data.size();
+    sim::heap().free(segment.pbuf);
+    sim::heap().free(segment.seg);
+    inflight_.pop_front();
+}
+
+void AsyncClient::release() {
+    for (std::deque<Segment>* queue : {&unsent_, &inflight_}) {
+        for (Segment& segment : *queue) {
+            sim::heap().free(segment.pbuf);
+            sim::heap().free(segment.seg);
+        }
+        queue->clear();
+    }
+    sim::heap().free(pcb_);
+    pcb_ = -1;
+    if (socket_ != nullptr) {
+        socket_->deviceOpen_ = false;
+        socket_->client_ = nullptr;
+        socket_ = nullptr;
+    }
+    state_ = kClosed;
+    unacked_ = 0;
+}
+
+void AsyncClient::drop(int8_t error) {
+    release();
+    if (onError_) {
+        onError_(errorArg_, this, error);
+    }
+}
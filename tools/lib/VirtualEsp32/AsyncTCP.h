@@ -0,0 +1,92 @@
+#ifndef ASYNC_TCP_H
+#define ASYNC_TCP_H
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "VirtualEsp32.h"
+
+#define ASYNC_WRITE_FLAG_COPY 0x01
+
+class AsyncClient;
+
+typedef std::function<void(void*, AsyncClient*)> AcConnectHandler;
+typedef std::function<void(void*, AsyncClient*, void* data, size_t length)> AcDataHandler;
+typedef std::function<void(void*, AsyncClient*, int8_t error)> AcErrorHandler;
+
+// AsyncTCP's client on sim's link. Like lwIP underneath it, connect() fails at
+// once without WiFi (no DNS), add() copies into a heap pbuf that is freed when
+// the broker acknowledges it, and space() is what is left of TCP_SND_BUF.
+// Callbacks run from events, as they would from the AsyncTCP task.
+class AsyncClient {
+public:
+    AsyncClient() {}
+    AsyncClient(const AsyncClient&) = delete;
+    AsyncClient& operator=(const AsyncClient&) = delete;
+
+    void onConnect(AcConnectHandler handler, void* arg) { onConnect_ = handler, connectArg_ = arg; }
+    void onDisconnect(AcConnectHandler handler, void* arg) { onDisconnect_ = handler, disconnectArg_ = arg; }
+    void onData(AcDataHandler handler, void* arg) { onData_ = handler, dataArg_ = arg; }
+    void onError(AcErrorHandler handler, void* arg) { onError_ = handler, errorArg_ = arg; }
+
+    bool connect(const char* host, uint16_t port);
+    bool connected() const { return state_ == kConnected; }
+    bool connecting() const { return state_ == kConnecting; }
+    void close(bool now = false);
+    size_t space() const;
+    size_t add(const char* data, size_t size, uint8_t flags = ASYNC_WRITE_FLAG_COPY);
+    bool send();
+    size_t ack(size_t length);
+    void ackLater() {}
+    void setNoDelay(bool) {}
+
+private:
+    friend class sim::Socket;
+
+    enum State : uint8_t { kClosed, kConnecting, kConnected };
+    struct Segment {
+        std::vector<uint8_t> data;
+        int64_t pbuf;           // heap blocks until acknowledged
+        int64_t seg;
+    };
+    enum Kind : uint8_t { kSyn, kSynAck, kReset, kData, kFin };
+    struct Packet {
+        sim::Socket* socket;
+        bool toServer;
+        Kind kind;
+        std::vector<uint8_t> data;
+    };
+
+    // Both directions of every connection go through here: after the link
+    // latency while WiFi is up, held and re-sent in order once it is back
+    // otherwise (handshakes are simply lost)
+    static void transmit(Packet packet);
+    static void arrive(Packet& packet);
+    static void hold(Packet packet);
+    static std::deque<Packet> held_;    // waiting for the link, in send order
+
+    void connected(sim::Socket* socket);
+    void received(sim::Socket* socket, const std::vector<uint8_t>& data);
+    void acked(sim::Socket* socket);
+    void release();
+    void drop(int8_t error);
+
+    State state_ = kClosed;
+    sim::Socket* socket_ = nullptr;
+    int64_t pcb_ = -1;
+    size_t unacked_ = 0;        // added and not acknowledged yet
+    std::deque<Segment> unsent_;
+    std::deque<Segment> inflight_;
+
+    AcConnectHandler onConnect_;
+    AcConnectHandler onDisconnect_;
+    AcDataHandler onData_;
+    AcErrorHandler onError_;
+    void* connectArg_ = nullptr;
+    void* disconnectArg_ = nullptr;
+    void* dataArg_ = nullptr;
+    void* errorArg_ = nullptr;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "DHT.h"
+
+#include <HeatIndex.h>
+
+namespace sim {
+
+namespace {
+
+const uint64_t kReadUs = 5000;              // start pulse plus 40 bits
+const uint64_t kMinIntervalUs = 2000000;    // the driver's cache
+
+SensorModel sensor;
+std::vector<uint64_t> reads;
+
+}  // namespace
+
+void setSensor(SensorModel model) {
+    sensor = model;
+}
+
+const std::vector<uint64_t>& sensorReads() {
+    return reads;
+}
+
+}  // namespace sim
+
+bool DHT::read(bool force) {
+    uint64_t now = sim::deviceUs();
+    if (!force && haveRead_ && now - lastReadUs_ < sim::kMinIntervalUs) {
+        return lastOk_;
+    }
+    haveRead_ = true;
+    lastReadUs_ = now;
+    sim::advance(sim::toTrueUs(sim::kReadUs));
+    float temperature = NAN;
+    float humidity = NAN;
+    lastOk_ = sim::sensor && sim::sensor(&temperature, &humidity);
+    temperature_ = lastOk_ ? temperature : NAN;
+    humidity_ = lastOk_ ? humidity : NAN;
+    return lastOk_;
+}
+
+float DHT::readTemperature(bool fahrenheit, bool force) {
+    sim::reads.push_back(sim::nowUs());
+    if (!read(force)) {
+        return NAN;
+    }
+    return fahrenheit ? temperature_ * 1.8f + 32 : temperature_;
+}
+
+float DHT::readHumidity(bool force) {
+    return read(force) ? humidity_ : NAN;
+}
+
+float DHT::computeHeatIndex(float temperature, float humidity, bool isFahrenheit) {
+    return isFahrenheit ? heat_index_fahrenheit(temperature, humidity) : heat_index(temperature, humidity);
+}
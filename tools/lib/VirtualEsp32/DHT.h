@@ -0,0 +1,32 @@
+#ifndef DHT_H
+#define DHT_H
+
+#include "Arduino.h"
+
+#define DHT11 11
+#define DHT22 22
+
+// DHT sensor on sim's sensor model. As with the Adafruit driver a read takes
+// a few milliseconds and is reused for two seconds, so temperature and
+// humidity read back to back come from the same measurement.
+class DHT {
+public:
+    DHT(uint8_t pin, uint8_t type, uint8_t count = 6) { (void)pin, (void)type, (void)count; }
+
+    void begin(uint8_t usec = 55) { (void)usec; }
+    float readTemperature(bool fahrenheit = false, bool force = false);
+    float readHumidity(bool force = false);
+    // Adafruit's formula, Fahrenheit unless told otherwise
+    float computeHeatIndex(float temperature, float humidity, bool isFahrenheit = true);
+
+private:
+    bool read(bool force);
+
+    bool haveRead_ = false;
+    uint64_t lastReadUs_ = 0;
+    bool lastOk_ = false;
+    float temperature_ = NAN;
+    float humidity_ = NAN;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include "WiFi.h"
+
+#define HTTP_CODE_OK 200
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+
+// OTA downloads are not simulated: every request fails to connect
+class HTTPClient {
+public:
+    void setTimeout(uint16_t) {}
+    bool begin(const char*) { return true; }
+    int GET() { return HTTPC_ERROR_CONNECTION_REFUSED; }
+    int getSize() { return -1; }
+    WiFiClient* getStreamPtr() { return &stream_; }
+    void end() {}
+
+private:
+    WiFiClient stream_;
+};
+
+#endif
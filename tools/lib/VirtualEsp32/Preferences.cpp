@@ -0,0 +1,149 @@
+#include "Preferences.h"
+
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "VirtualEsp32.h"
+
+namespace sim {
+
+namespace {
+
+typedef std::map<std::string, std::vector<uint8_t>> Namespace;
+
+std::map<std::string, Namespace> nvs;
+NvsStats stats = {};
+
+}  // namespace
+
+NvsStats nvsStats() {
+    return stats;
+}
+
+}  // namespace sim
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    // The real NVS limits namespace names to 15 characters
+    if (name == nullptr || strlen(name) > 15) {
+        return false;
+    }
+    namespace_ = &sim::nvs[name];
+    readOnly_ = readOnly;
+    return true;
+}
+
+void Preferences::end() {
+    namespace_ = nullptr;
+}
+
+bool Preferences::clear() {
+    if (namespace_ == nullptr || readOnly_) {
+        return false;
+    }
+    sim::Namespace* entries = static_cast<sim::Namespace*>(namespace_);
+    if (!entries->empty()) {
+        entries->clear();
+        sim::stats.writes++;
+    }
+    return true;
+}
+
+bool Preferences::remove(const char* key) {
+    if (namespace_ == nullptr || readOnly_) {
+        return false;
+    }
+    if (static_cast<sim::Namespace*>(namespace_)->erase(key) > 0) {
+        sim::stats.writes++;
+    }
+    return true;
+}
+
+size_t Preferences::put(const char* key, const void* value, size_t length) {
+    if (namespace_ == nullptr || readOnly_ || key == nullptr) {
+        return 0;
+    }
+    std::vector<uint8_t> bytes((const uint8_t*)value, (const uint8_t*)value + length);
+    std::vector<uint8_t>& stored = (*static_cast<sim::Namespace*>(namespace_))[key];
+    // NVS compares before writing, so an unchanged value costs no flash
+    if (stored != bytes) {
+        stored.swap(bytes);
+        sim::stats.writes++;
+        sim::stats.bytesWritten += length;
+    }
+    return length;
+}
+
+const void* Preferences::get(const char* key, size_t* length) {
+    if (namespace_ == nullptr || key == nullptr) {
+        return nullptr;
+    }
+    sim::Namespace* entries = static_cast<sim::Namespace*>(namespace_);
+    auto found = entries->find(key);
+    if (found == entries->end()) {
+        return nullptr;
+    }
+    *length = found->second.size();
+    return found->second.data();
+}
+
+size_t Preferences::putBool(const char* key, bool value) {
+    uint8_t byte = value ? 1 : 0;
+    return put(key, &byte, 1);
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+    return put(key, &value, sizeof(value));
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+    return put(key, value, strlen(value) + 1);
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+    return put(key, value, length);
+}
+
+bool Preferences::getBool(const char* key, bool defaultValue) {
+    size_t length = 0;
+    const void* value = get(key, &length);
+    return value != nullptr && length == 1 ? *(const uint8_t*)value != 0 : defaultValue;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+    size_t length = 0;
+    const void* value = get(key, &length);
+    if (value == nullptr || length != sizeof(uint32_t)) {
+        return defaultValue;
+    }
+    uint32_t result;
+    memcpy(&result, value, sizeof(result));
+    return result;
+}
+
+size_t Preferences::getString(const char* key, char* value, size_t maxLength) {
+    size_t length = 0;
+    const void* stored = get(key, &length);
+    if (stored == nullptr || value == nullptr || length > maxLength) {
+        return 0;
+    }
+    memcpy(value, stored, length);
+    return length;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    size_t length = 0;
+    return get(key, &length) != nullptr ? length : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLength) {
+    size_t length = 0;
+    const void* stored = get(key, &length);
+    if (stored == nullptr || buffer == nullptr || length > maxLength) {
+        return 0;
+    }
+    memcpy(buffer, stored, length);
+    return length;
+}
@@ -0,0 +1,35 @@
+#ifndef PREFERENCES_H
+#define PREFERENCES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// NVS namespaces kept in memory for the whole run; writes are counted for
+// sim::nvsStats()
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+    bool clear();
+    bool remove(const char* key);
+
+    size_t putBool(const char* key, bool value);
+    size_t putUInt(const char* key, uint32_t value);
+    size_t putString(const char* key, const char* value);
+    size_t putBytes(const char* key, const void* value, size_t length);
+
+    bool getBool(const char* key, bool defaultValue = false);
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+    size_t getString(const char* key, char* value, size_t maxLength);
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buffer, size_t maxLength);
+
+private:
+    size_t put(const char* key, const void* value, size_t length);
+    const void* get(const char* key, size_t* length);
+
+    void* namespace_ = nullptr;
+    bool readOnly_ = false;
+};
+
+#endif
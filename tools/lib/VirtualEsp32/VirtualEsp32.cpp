@@ -0,0 +1,400 @@
+#include "VirtualEsp32.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+
+#include "esp_heap_caps.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+
+namespace sim {
+
+namespace {
+
+// --- Clock and events ---
+
+uint64_t trueNow = 0;
+double driftPpm = 0;
+uint64_t driftTrueBase = 0;
+double driftDeviceBase = 0;
+
+// Keyed by (time, id), so equal times run in scheduling order
+std::map<std::pair<uint64_t, uint64_t>, Action> events;
+std::unordered_map<uint64_t, uint64_t> eventTimes;
+uint64_t nextEventId = 1;
+uint64_t eventCount = 0;
+
+double deviceAt(uint64_t trueUs) {
+    return driftDeviceBase + (double)(trueUs - driftTrueBase) * (1.0 + driftPpm * 1e-6);
+}
+
+// --- Flash ---
+
+struct PartitionStore {
+    esp_partition_t info;
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> sectorErases;
+    FlashStats stats;
+};
+
+void add_partition(std::deque<PartitionStore>& table, const char* label, uint8_t subtype, uint32_t size) {
+    table.emplace_back();
+    PartitionStore& store = table.back();
+    store.info.type = ESP_PARTITION_TYPE_DATA;
+    store.info.subtype = (esp_partition_subtype_t)subtype;
+    store.info.address = 0;
+    store.info.size = size;
+    strncpy(store.info.label, label, sizeof(store.info.label) - 1);
+    store.info.label[sizeof(store.info.label) - 1] = '\0';
+    store.info.encrypted = false;
+    store.data.assign(size, 0xFF);
+    store.sectorErases.assign(size / SPI_FLASH_SEC_SIZE, 0);
+    store.stats = FlashStats();
+}
+
+// The data partitions of firmware/partitions.csv, erased. Built on first use,
+// since the firmware looks them up from its static constructors.
+std::deque<PartitionStore>& partitions() {
+    static std::deque<PartitionStore> table;
+    if (table.empty()) {
+        add_partition(table, "nvs", ESP_PARTITION_SUBTYPE_DATA_NVS, 0x5000);
+        add_partition(table, "otadata", 0x00, 0x2000);
+        add_partition(table, "history", 0x40, 0x160000);
+        add_partition(table, "coredump", 0x03, 0x10000);
+    }
+    return table;
+}
+
+PartitionStore* store_of(const esp_partition_t* partition) {
+    for (PartitionStore& store : partitions()) {
+        if (&store.info == partition) {
+            return &store;
+        }
+    }
+    return nullptr;
+}
+
+// The image the device runs from; only its label is ever read
+const esp_partition_t runningApp = {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, 0x140000,
+                                    "app0", false};
+
+Heap deviceHeap;
+
+}  // namespace
+
+uint64_t nowUs() {
+    return trueNow;
+}
+
+uint64_t deviceUs() {
+    return (uint64_t)deviceAt(trueNow);
+}
+
+void setDriftPpm(double ppm) {
+    driftDeviceBase = deviceAt(trueNow);
+    driftTrueBase = trueNow;
+    driftPpm = ppm;
+}
+
+uint64_t toTrueUs(uint64_t deviceSpanUs) {
+    return (uint64_t)llround((double)deviceSpanUs / (1.0 + driftPpm * 1e-6));
+}
+
+uint64_t at(uint64_t atUs, Action action) {
+    uint64_t id = nextEventId++;
+    uint64_t when = std::max(atUs, trueNow);
+    events.emplace(std::make_pair(when, id), std::move(action));
+    eventTimes.emplace(id, when);
+    return id;
+}
+
+void cancel(uint64_t id) {
+    auto found = eventTimes.find(id);
+    if (found != eventTimes.end()) {
+        events.erase(std::make_pair(found->second, id));
+        eventTimes.erase(found);
+    }
+}
+
+void advance(uint64_t us) {
+    uint64_t target = trueNow + us;
+    while (!events.empty() && events.begin()->first.first <= target) {
+        auto next = events.begin();
+        trueNow = std::max(trueNow, next->first.first);
+        Action action = std::move(next->second);
+        eventTimes.erase(next->first.second);
+        events.erase(next);
+        eventCount++;
+        // May run firmware code that waits, and so advance the clock itself
+        action();
+    }
+    trueNow = std::max(trueNow, target);
+}
+
+uint64_t eventsRun() {
+    return eventCount;
+}
+
+// --- Heap ---
+
+namespace {
+
+const uint32_t kBlockHeader = 8;
+const uint32_t kMinSplit = 16;
+
+}  // namespace
+
+void Heap::reset(uint32_t size) {
+    size_ = size;
+    free_ = size;
+    minFree_ = size;
+    allocations_ = 0;
+    failures_ = 0;
+    freeBlocks_.clear();
+    usedBlocks_.clear();
+    if (size > 0) {
+        freeBlocks_[0] = size;
+    }
+}
+
+int64_t Heap::alloc(uint32_t bytes) {
+    uint32_t need = ((bytes + 3) & ~3u) + kBlockHeader;
+    for (auto it = freeBlocks_.begin(); it != freeBlocks_.end(); ++it) {
+        if (it->second < need) {
+            continue;
+        }
+        uint32_t offset = it->first;
+        uint32_t taken = it->second;
+        freeBlocks_.erase(it);
+        if (taken - need >= kMinSplit) {
+            freeBlocks_[offset + need] = taken - need;
+            taken = need;
+        }
+        usedBlocks_[offset] = taken;
+        free_ -= taken;
+        minFree_ = std::min(minFree_, free_);
+        allocations_++;
+        return offset;
+    }
+    failures_++;
+    return -1;
+}
+
+void Heap::free(int64_t block) {
+    auto used = usedBlocks_.find((uint32_t)block);
+    if (block < 0 || used == usedBlocks_.end()) {
+        return;
+    }
+    uint32_t offset = used->first;
+    uint32_t size = used->second;
+    usedBlocks_.erase(used);
+    free_ += size;
+
+    auto next = freeBlocks_.lower_bound(offset);
+    if (next != freeBlocks_.end() && offset + size == next->first) {
+        size += next->second;
+        next = freeBlocks_.erase(next);
+    }
+    if (next != freeBlocks_.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+    freeBlocks_[offset] = size;
+}
+
+uint32_t Heap::largestFree() const {
+    uint32_t largest = 0;
+    for (const auto& block : freeBlocks_) {
+        largest = std::max(largest, block.second);
+    }
+    return largest > kBlockHeader ? largest - kBlockHeader : 0;
+}
+
+HeapStats Heap::stats() const {
+    HeapStats stats;
+    stats.size = size_;
+    stats.free = free_;
+    stats.minFree = minFree_;
+    stats.largestFree = largestFree();
+    stats.allocations = allocations_;
+    stats.failures = failures_;
+    stats.liveBlocks = usedBlocks_.size();
+    return stats;
+}
+
+Heap& heap() {
+    return deviceHeap;
+}
+
+// --- Flash ---
+
+FlashStats flashStats(const char* label) {
+    for (const PartitionStore& store : partitions()) {
+        if (strcmp(store.info.label, label) == 0) {
+            return store.stats;
+        }
+    }
+    return FlashStats();
+}
+
+}  // namespace sim
+
+// --- ESP-IDF ---
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+    for (sim::PartitionStore& store : sim::partitions()) {
+        if (store.info.type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || store.info.subtype == subtype) &&
+            (label == nullptr || strcmp(store.info.label, label) == 0)) {
+            return &store.info;
+        }
+    }
+    if (type == ESP_PARTITION_TYPE_APP && (label == nullptr || strcmp(label, sim::runningApp.label) == 0)) {
+        return &sim::runningApp;
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* data, size_t size) {
+    sim::PartitionStore* store = sim::store_of(partition);
+    if (store == nullptr || offset + size > store->data.size()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(data, store->data.data() + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* data, size_t size) {
+    sim::PartitionStore* store = sim::store_of(partition);
+    if (store == nullptr || offset + size > store->data.size()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        store->data[offset + i] &= bytes[i];
+    }
+    store->stats.writes++;
+    store->stats.bytesWritten += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    sim::PartitionStore* store = sim::store_of(partition);
+    if (store == nullptr || offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0 ||
+        offset + size > store->data.size()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(store->data.data() + offset, 0xFF, size);
+    for (size_t sector = offset / SPI_FLASH_SEC_SIZE; sector < (offset + size) / SPI_FLASH_SEC_SIZE; sector++) {
+        uint32_t erases = ++store->sectorErases[sector];
+        store->stats.erases++;
+        store->stats.maxSectorErases = std::max(store->stats.maxSectorErases, erases);
+    }
+    return ESP_OK;
+}
+
+const esp_partition_t* esp_ota_get_running_partition() {
+    return &sim::runningApp;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t*) {
+    return nullptr;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t*, size_t, esp_ota_handle_t*) {
+    return ESP_FAIL;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t, const void*, size_t) {
+    return ESP_FAIL;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t) {
+    return ESP_FAIL;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t*) {
+    return ESP_FAIL;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback() {
+    return ESP_OK;
+}
+
+void esp_restart() {
+    throw sim::Restart();
+}
+
+// The timer's event id while armed, 0 otherwise
+struct esp_timer {
+    esp_timer_create_args_t args;
+    uint64_t event;
+};
+
+int64_t esp_timer_get_time() {
+    return (int64_t)sim::deviceUs();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    if (args == nullptr || args->callback == nullptr || handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *handle = new esp_timer{*args, 0};
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+    if (timer == nullptr || timer->event != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    timer->event = sim::at(sim::nowUs() + sim::toTrueUs(timeoutUs), [timer]() {
+        timer->event = 0;
+        timer->args.callback(timer->args.arg);
+    });
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (timer == nullptr || timer->event == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sim::cancel(timer->event);
+    timer->event = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->event != 0) {
+        sim::cancel(timer->event);
+    }
+    delete timer;
+    return ESP_OK;
+}
+
+size_t heap_caps_get_free_size(uint32_t) {
+    return sim::heap().stats().free;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t) {
+    return sim::heap().largestFree();
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t) {
+    return sim::heap().stats().minFree;
+}
@@ -0,0 +1,210 @@
+#ifndef VIRTUAL_ESP32_H
+#define VIRTUAL_ESP32_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class AsyncClient;
+
+// A virtual ESP32 for running the firmware's own sources on the host under a
+// discrete-event clock. The headers next to this one stand in for the Arduino
+// core, ESP-IDF and the libraries the firmware builds on (AsyncTCP, DHT,
+// Preferences, HTTPClient); all of them are backed by the state here, which a
+// driver program sets up and changes as its scenario unfolds. Built with
+// VIRTUAL_ESP32 defined, the firmware libraries compile their ESP32-only
+// classes (AsyncTcpTransport, PartitionFlash, NvsConfigStore) against it.
+//
+// Time only moves when the firmware spends it: delay(), a DHT read and each
+// loop() pass advance the clock, and every event due by then runs in order -
+// packets arriving, timers firing, scenario changes. Nothing reads the host's
+// clock, so a run is repeatable and a week of device time costs only the
+// firmware's own work.
+//
+// What is modelled: WiFi association, one-way latency and packet loss while
+// the link is down (TCP data waits and is retransmitted once it is back, as
+// long as neither end has given up on the connection); lwIP's send buffer and
+// its heap use per connection and per segment, on a first-fit allocator that
+// heap_caps_* reports from; NOR flash partitions with erase counts; NVS; the
+// crystal's error on millis(). Not modelled: TLS, OTA downloads (there is no
+// second app slot), other FreeRTOS tasks, stack use.
+namespace sim {
+
+// Thrown by ESP.restart() and esp_restart(). The firmware's globals cannot be
+// reset in place, so a restart ends the run.
+struct Restart {};
+
+// --- Clock and events ---
+
+// True time, µs since the start of the run
+uint64_t nowUs();
+// Device clock (millis(), micros(), esp_timer): true time with the crystal's error
+uint64_t deviceUs();
+// Positive runs the device clock fast; takes effect from now on
+void setDriftPpm(double ppm);
+// True µs for a span measured on the device clock
+uint64_t toTrueUs(uint64_t deviceSpanUs);
+
+typedef std::function<void()> Action;
+// Runs action at true time atUs, or now if that has passed. Events due at the
+// same time run in the order they were scheduled. Returns an id for cancel().
+uint64_t at(uint64_t atUs, Action action);
+void cancel(uint64_t id);
+// Runs every event due within the next us, then leaves the clock there
+void advance(uint64_t us);
+// Events run so far, for the driver's report
+uint64_t eventsRun();
+
+// --- WiFi ---
+
+struct WifiStats {
+    uint32_t drops;             // times the link went down
+    uint32_t joins;             // associations, the first one included
+    uint64_t downUs;            // time not associated since the first join
+};
+
+// The radio link as the scenario sets it; association follows joinMs after
+// it comes up (and after WiFi.begin())
+void setLink(bool up);
+bool linkUp();
+void setJoinMs(uint32_t ms);
+void setLatencyMs(uint32_t ms);     // one way, device to broker or NTP server
+uint32_t latencyMs();
+void setRssi(int8_t rssi);
+int8_t rssi();
+void setMac(const uint8_t mac[6]);
+const uint8_t* mac();
+// WiFi.begin() was called
+void wifiBegin();
+bool wifiConnected();
+// Runs action once WiFi is associated, right away if it is
+void whenConnected(Action action);
+WifiStats wifiStats();
+
+// --- TCP ---
+
+class Socket;
+
+// The far end of every TCP connection the device opens, whatever host and
+// port it asks for. Its callbacks run in events, outside the firmware.
+class Server {
+public:
+    virtual ~Server() {}
+    // A SYN arrived; false answers with a reset
+    virtual bool accept(Socket* socket) = 0;
+    virtual void receive(Socket* socket, const uint8_t* data, size_t length) = 0;
+    // The device closed or reset the connection; socket is closed already
+    virtual void closed(Socket* socket) = 0;
+};
+
+void setServer(Server* server);
+
+// One TCP connection as the server sees it. Sockets live until the end of
+// the run, so a pointer stays valid after close.
+class Socket {
+public:
+    uint32_t id() const { return id_; }
+    bool open() const { return serverOpen_; }
+    // To the device, after the link latency (or once the link is back)
+    void send(const uint8_t* data, size_t length);
+    // Closes from the server side; the device sees it like any other packet
+    void close();
+
+    void* session = nullptr;    // for the server
+
+private:
+    friend class ::AsyncClient;
+    uint32_t id_ = 0;
+    bool serverOpen_ = false;
+    bool deviceOpen_ = false;
+    void* client_ = nullptr;    // AsyncClient, while the device side is open
+};
+
+// --- UDP ---
+
+// Datagrams the device sends, to any host and port; a non-empty reply goes
+// back to the sending WiFiUDP after the link latency
+typedef std::function<void(const uint8_t* data, size_t length, std::vector<uint8_t>* reply)> DatagramHandler;
+void setDatagramHandler(DatagramHandler handler);
+
+// --- Heap ---
+
+struct HeapStats {
+    uint32_t size;
+    uint32_t free;
+    uint32_t minFree;
+    uint32_t largestFree;
+    uint32_t allocations;
+    uint32_t failures;
+    uint32_t liveBlocks;
+};
+
+// First fit over an address-ordered free list, with an 8-byte header per
+// block and 4-byte alignment, roughly what ESP-IDF's multi_heap does. Only
+// bookkeeping: blocks are offsets, not memory.
+class Heap {
+public:
+    explicit Heap(uint32_t size = 0) { reset(size); }
+
+    void reset(uint32_t size);
+    // Offset of the block, -1 if no free block is large enough
+    int64_t alloc(uint32_t bytes);
+    void free(int64_t block);
+    uint32_t largestFree() const;
+    HeapStats stats() const;
+
+private:
+    uint32_t size_;
+    uint32_t free_;
+    uint32_t minFree_;
+    uint32_t allocations_;
+    uint32_t failures_;
+    std::map<uint32_t, uint32_t> freeBlocks_;   // offset -> size
+    std::map<uint32_t, uint32_t> usedBlocks_;
+};
+
+Heap& heap();
+
+// --- Flash and NVS ---
+
+struct FlashStats {
+    uint64_t bytesWritten;
+    uint32_t writes;
+    uint32_t erases;
+    uint32_t maxSectorErases;   // of the most erased sector
+};
+
+// The data partitions of firmware/partitions.csv, in RAM and erased at start
+FlashStats flashStats(const char* label);
+
+struct NvsStats {
+    uint32_t writes;            // put* calls that changed a value
+    uint32_t bytesWritten;
+};
+NvsStats nvsStats();
+
+// --- Sensor ---
+
+// Called for each DHT read: fills temperature and humidity, or returns false
+// for a failed read (the DHT returns NaN)
+typedef std::function<bool(float* temperature, float* humidity)> SensorModel;
+void setSensor(SensorModel model);
+// True time of each readTemperature() since boot. The firmware takes one
+// reading per call, so entry n is the sample behind the reading with seq n.
+const std::vector<uint64_t>& sensorReads();
+
+// --- Serial ---
+
+// Where Serial output goes, each line prefixed with the device's uptime;
+// null (the default) discards it without formatting
+void setSerial(FILE* out);
+FILE* serial();
+
+}  // namespace sim
+
+#endif
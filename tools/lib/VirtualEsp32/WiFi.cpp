@@ -0,0 +1,243 @@
+#include "WiFi.h"
+
+#include "WiFiUdp.h"
+#include "lwip/dns.h"
+
+WiFiClass WiFi;
+
+namespace sim {
+
+namespace {
+
+bool link = true;
+bool begun = false;
+bool associated = false;
+uint32_t joinDelayMs = 2000;
+uint32_t oneWayMs = 20;
+int8_t rssiDbm = -60;
+uint8_t macBytes[6] = {0x24, 0x6F, 0x28, 0xA1, 0xB2, 0xC3};
+uint64_t joinEvent = 0;
+std::vector<Action> waiting;
+WifiStats stats = {};
+bool everJoined = false;
+uint64_t lostAtUs = 0;
+DatagramHandler datagrams;
+const uint64_t kDnsTtlUs = 300000000;       // how long lwIP keeps a record here
+uint64_t dnsCachedUntilUs = 0;
+
+void schedule_join() {
+    if (!link || !begun || associated || joinEvent != 0) {
+        return;
+    }
+    joinEvent = at(nowUs() + (uint64_t)joinDelayMs * 1000, []() {
+        joinEvent = 0;
+        associated = true;
+        stats.joins++;
+        if (everJoined) {
+            stats.downUs += nowUs() - lostAtUs;
+        }
+        everJoined = true;
+        std::vector<Action> ready;
+        ready.swap(waiting);
+        for (Action& action : ready) {
+            action();
+        }
+    });
+}
+
+}  // namespace
+
+void setLink(bool up) {
+    if (up == link) {
+        return;
+    }
+    link = up;
+    if (up) {
+        schedule_join();
+        return;
+    }
+    if (joinEvent != 0) {
+        cancel(joinEvent);
+        joinEvent = 0;
+    }
+    if (associated) {
+        associated = false;
+        stats.drops++;
+        lostAtUs = nowUs();
+    }
+}
+
+bool linkUp() {
+    return link;
+}
+
+void setJoinMs(uint32_t ms) {
+    joinDelayMs = ms;
+}
+
+void setLatencyMs(uint32_t ms) {
+    oneWayMs = ms;
+}
+
+uint32_t latencyMs() {
+    return oneWayMs;
+}
+
+void setRssi(int8_t rssi) {
+    rssiDbm = rssi;
+}
+
+int8_t rssi() {
+    return rssiDbm;
+}
+
+void setMac(const uint8_t mac[6]) {
+    memcpy(macBytes, mac, sizeof(macBytes));
+}
+
+const uint8_t* mac() {
+    return macBytes;
+}
+
+void wifiBegin() {
+    begun = true;
+    schedule_join();
+}
+
+bool wifiConnected() {
+    return associated;
+}
+
+void whenConnected(Action action) {
+    if (associated) {
+        action();
+    } else {
+        waiting.push_back(std::move(action));
+    }
+}
+
+WifiStats wifiStats() {
+    WifiStats current = stats;
+    if (everJoined && !associated) {
+        current.downUs += nowUs() - lostAtUs;
+    }
+    return current;
+}
+
+void setDatagramHandler(DatagramHandler handler) {
+    datagrams = handler;
+}
+
+}  // namespace sim
+
+size_t IPAddress::printTo(Print& p) const {
+    size_t n = 0;
+    for (int i = 0; i < 4; i++) {
+        if (i > 0) {
+            n += p.print('.');
+        }
+        n += p.print(bytes_[i], DEC);
+    }
+    return n;
+}
+
+wl_status_t WiFiClass::begin(const char*, const char*) {
+    sim::wifiBegin();
+    return status();
+}
+
+wl_status_t WiFiClass::status() {
+    return sim::wifiConnected() ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+    memcpy(mac, sim::mac(), 6);
+    return mac;
+}
+
+int WiFiUDP::beginPacket(const char*, uint16_t) {
+    out_.clear();
+    // Without WiFi the host name does not even resolve
+    return sim::wifiConnected() ? 1 : 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress, uint16_t) {
+    out_.clear();
+    return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t* data, size_t length) {
+    out_.insert(out_.end(), data, data + length);
+    return length;
+}
+
+int WiFiUDP::endPacket() {
+    if (!sim::wifiConnected()) {
+        return 0;
+    }
+    uint64_t oneWayUs = (uint64_t)sim::latencyMs() * 1000;
+    std::vector<uint8_t> datagram;
+    datagram.swap(out_);
+    sim::at(sim::nowUs() + oneWayUs, [this, datagram, oneWayUs]() {
+        if (!sim::wifiConnected() || !sim::datagrams) {
+            return;
+        }
+        std::vector<uint8_t> reply;
+        sim::datagrams(datagram.data(), datagram.size(), &reply);
+        if (reply.empty()) {
+            return;
+        }
+        sim::at(sim::nowUs() + oneWayUs, [this, reply]() {
+            if (sim::wifiConnected()) {
+                in_.push_back(reply);
+            }
+        });
+    });
+    return 1;
+}
+
+int WiFiUDP::parsePacket() {
+    if (parsed_ && !in_.empty()) {
+        in_.pop_front();
+    }
+    parsed_ = !in_.empty();
+    return parsed_ ? (int)in_.front().size() : 0;
+}
+
+int WiFiUDP::read(uint8_t* data, size_t length) {
+    if (!parsed_ || in_.empty()) {
+        return 0;
+    }
+    std::vector<uint8_t>& datagram = in_.front();
+    size_t n = std::min(length, datagram.size());
+    memcpy(data, datagram.data(), n);
+    datagram.erase(datagram.begin(), datagram.begin() + n);
+    return (int)n;
+}
+
+void WiFiUDP::flush() {
+    if (parsed_ && !in_.empty()) {
+        in_.pop_front();
+    }
+    parsed_ = false;
+}
+
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg) {
+    const ip_addr_t server = {0x7b0200c0};     // 192.0.2.123
+    if (!sim::wifiConnected()) {
+        return ERR_VAL;
+    }
+    if (sim::nowUs() < sim::dnsCachedUntilUs) {
+        *addr = server;
+        return ERR_OK;
+    }
+    sim::at(sim::nowUs() + 2 * (uint64_t)sim::latencyMs() * 1000, [hostname, server, found, callback_arg]() {
+        if (!sim::wifiConnected()) {
+            found(hostname, nullptr, callback_arg);
+            return;
+        }
+        sim::dnsCachedUntilUs = sim::nowUs() + sim::kDnsTtlUs;
+        found(hostname, &server, callback_arg);
+    });
+    return ERR_INPROGRESS;
+}
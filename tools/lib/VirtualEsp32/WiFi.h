@@ -0,0 +1,48 @@
+#ifndef WIFI_H
+#define WIFI_H
+
+#include "Arduino.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+class IPAddress : public Printable {
+public:
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes_{a, b, c, d} {}
+    // lwIP's u32, bytes in network order
+    explicit IPAddress(uint32_t address) { memcpy(bytes_, &address, 4); }
+    size_t printTo(Print& p) const override;
+
+private:
+    uint8_t bytes_[4];
+};
+
+// Station interface on sim's link: associated while the scenario has the
+// link up, a join delay after it comes back
+class WiFiClass {
+public:
+    wl_status_t begin(const char* ssid, const char* password);
+    wl_status_t status();
+    IPAddress localIP() { return IPAddress(192, 168, 1, 50); }
+    int8_t RSSI() { return sim::wifiConnected() ? sim::rssi() : 0; }
+    uint8_t* macAddress(uint8_t* mac);
+};
+
+extern WiFiClass WiFi;
+
+// Only what HTTPClient hands out; never connected on the host
+class WiFiClient {
+public:
+    int available() { return 0; }
+    uint8_t connected() { return 0; }
+    size_t readBytes(uint8_t*, size_t) { return 0; }
+};
+
+#endif
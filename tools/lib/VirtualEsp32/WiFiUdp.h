@@ -0,0 +1,30 @@
+#ifndef WIFI_UDP_H
+#define WIFI_UDP_H
+
+#include <deque>
+#include <vector>
+
+#include "Arduino.h"
+#include "WiFi.h"
+
+// UDP socket whose datagrams go to sim's datagram handler and whose replies
+// come back after the link latency. Lost while WiFi is not associated.
+class WiFiUDP {
+public:
+    uint8_t begin(uint16_t port) { (void)port; return 1; }
+    int beginPacket(const char* host, uint16_t port);
+    int beginPacket(IPAddress address, uint16_t port);
+    size_t write(const uint8_t* data, size_t length);
+    int endPacket();
+    // Size of the next received datagram, 0 if none
+    int parsePacket();
+    int read(uint8_t* data, size_t length);
+    void flush();
+
+private:
+    std::vector<uint8_t> out_;
+    std::deque<std::vector<uint8_t>> in_;
+    bool parsed_ = false;
+};
+
+#endif
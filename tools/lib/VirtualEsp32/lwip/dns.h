@@ -0,0 +1,26 @@
+#ifndef LWIP_DNS_H
+#define LWIP_DNS_H
+
+#include <stdint.h>
+
+// lwIP's asynchronous resolver as SntpClient uses it. Names resolve to one
+// fixed address over sim's link: the first lookup, and the first after the
+// cached record's TTL, answers through the callback after a round trip;
+// the others come from the cache at once. Without WiFi the lookup fails.
+typedef int8_t err_t;
+
+const err_t ERR_OK = 0;
+const err_t ERR_INPROGRESS = -5;
+const err_t ERR_VAL = -6;
+
+struct ip_addr_t {
+    uint32_t addr;      // IPv4, network byte order in memory
+};
+
+#define ip_addr_get_ip4_u32(ipaddr) ((ipaddr)->addr)
+
+typedef void (*dns_found_callback)(const char* name, const ip_addr_t* ipaddr, void* callback_arg);
+
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg);
+
+#endif
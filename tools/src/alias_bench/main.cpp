@@ -0,0 +1,276 @@
+// Bytes on the wire per telemetry PUBLISH with MQTT 3.1.1, MQTT 5 without
+// aliases and MQTT 5 with topic aliases. MqttClient talks through an
+// in-memory link to a broker stand-in that resolves aliases and checks every
+// topic it reconstructs, so a wrong alias shows up as an error, not a saving.
+#include <MqttClient.h>
+
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int kPublishes = 1000;
+const char* kTopic = "5a728254-5316-45c6-bf3c-de194f1afa53/default/ESP32-A1B2C3D4E5F6/telemetry";
+const char* kJsonPayload =
+    "{\"device_id\":\"ESP32-A1:B2:C3:D4:E5:F6\",\"timestamp\":1760000000000,\"time_synced\":true,"
+    "\"temperature\":23.4,\"humidity\":45.6,\"heat_index\":23.1,\"wifi_rssi\":-61}";
+const size_t kCompactPayload = 16;  // one LogRecord
+
+uint32_t nowMs = 0;
+uint32_t now_ms() { return nowMs; }
+
+// Both directions of a TCP connection as byte queues
+class LoopbackTransport : public MqttTransport {
+public:
+    std::deque<uint8_t> toBroker;
+    std::deque<uint8_t> toClient;
+    bool open = false;
+
+    bool connect(const char*, uint16_t) override {
+        toBroker.clear();
+        toClient.clear();
+        open = true;
+        return true;
+    }
+    bool connected() override { return open; }
+    size_t writable() override { return open ? 16384 : 0; }
+    size_t write(const uint8_t* data, size_t length) override {
+        toBroker.insert(toBroker.end(), data, data + length);
+        return length;
+    }
+    size_t read(uint8_t* data, size_t length) override {
+        size_t n = 0;
+        while (n < length && !toClient.empty()) {
+            data[n++] = toClient.front();
+            toClient.pop_front();
+        }
+        return n;
+    }
+    void stop() override { open = false; }
+};
+
+// Just enough of a broker: CONNACK with the alias and receive maximums,
+// PUBACK, SUBACK, PINGRESP. A 3.1.1-only broker refuses level 5 with
+// return code 1 and closes, as Mosquitto 1.x does.
+class BrokerStandIn {
+public:
+    BrokerStandIn(bool speaksV5, uint16_t aliasMaximum)
+        : speaksV5_(speaksV5), aliasMaximum_(aliasMaximum), reader_(buffer_, sizeof(buffer_)) {}
+
+    int publishes = 0;
+    size_t publishBytes = 0;
+    size_t payloadBytes = 0;
+    int aliasedPublishes = 0;
+    int topicErrors = 0;
+
+    void pump(LoopbackTransport& link) {
+        while (link.open && !link.toBroker.empty()) {
+            uint8_t b = link.toBroker.front();
+            link.toBroker.pop_front();
+            packetBytes_++;
+            reader_.feed(&b, 1);
+            if (reader_.ready()) {
+                handle(link);
+                reader_.reset();
+                packetBytes_ = 0;
+            }
+        }
+    }
+
+private:
+    void send(LoopbackTransport& link, std::initializer_list<uint8_t> bytes) {
+        link.toClient.insert(link.toClient.end(), bytes);
+    }
+
+    void handle(LoopbackTransport& link) {
+        const uint8_t* body = reader_.body();
+        size_t length = reader_.bodyLength();
+        switch (reader_.type()) {
+            case mqtt::kConnect:
+                level_ = body[6];
+                aliases_.clear();
+                if (level_ == mqtt::kProtocol5 && !speaksV5_) {
+                    send(link, {0x20, 2, 0, 1});
+                    link.open = false;
+                } else if (level_ == mqtt::kProtocol5) {
+                    send(link, {0x20, 9, 0, 0, 6, 0x22, (uint8_t)(aliasMaximum_ >> 8), (uint8_t)aliasMaximum_,
+                                0x21, 0, 20});
+                } else {
+                    send(link, {0x20, 2, 0, 0});
+                }
+                break;
+
+            case mqtt::kPublish: {
+                uint8_t qos = (reader_.flags() >> 1) & 0x03;
+                size_t topicLength = mqtt::read16(body);
+                std::string topic((const char*)body + 2, topicLength);
+                size_t offset = 2 + topicLength;
+                uint16_t packetId = 0;
+                if (qos > 0) {
+                    packetId = mqtt::read16(body + offset);
+                    offset += 2;
+                }
+                uint16_t alias = 0;
+                if (level_ == mqtt::kProtocol5) {
+                    uint32_t propertiesLength;
+                    offset += mqtt::readVarint(body + offset, length - offset, &propertiesLength);
+                    size_t end = offset + propertiesLength;
+                    while (offset < end) {
+                        uint8_t id = body[offset++];
+                        if (id == 0x23) {
+                            alias = mqtt::read16(body + offset);
+                            offset += 2;
+                        } else {
+                            topicErrors++;  // the client sends no other property
+                            offset = end;
+                        }
+                    }
+                }
+                if (alias > 0) {
+                    if (alias > aliasMaximum_) {
+                        topicErrors++;
+                    } else if (topicLength > 0) {
+                        aliases_[alias] = topic;
+                    } else {
+                        topic = aliases_.count(alias) ? aliases_[alias] : std::string();
+                        aliasedPublishes++;
+                    }
+                }
+                if (topic != kTopic) {
+                    topicErrors++;
+                }
+                publishes++;
+                publishBytes += packetBytes_;
+                payloadBytes += length - offset;
+                if (qos == 1) {
+                    send(link, {0x40, 2, (uint8_t)(packetId >> 8), (uint8_t)packetId});
+                }
+                break;
+            }
+
+            case mqtt::kSubscribe:
+                if (level_ == mqtt::kProtocol5) {
+                    send(link, {0x90, 4, body[0], body[1], 0, 0});
+                } else {
+                    send(link, {0x90, 3, body[0], body[1], 0});
+                }
+                break;
+
+            case mqtt::kPingreq:
+                send(link, {0xD0, 0});
+                break;
+
+            case mqtt::kDisconnect:
+                link.open = false;
+                break;
+        }
+    }
+
+    bool speaksV5_;
+    uint16_t aliasMaximum_;
+    uint8_t level_ = 0;
+    std::map<uint16_t, std::string> aliases_;
+    uint8_t buffer_[4096];
+    mqtt::PacketReader reader_;
+    size_t packetBytes_ = 0;
+};
+
+struct Result {
+    uint8_t protocol;
+    int connectAttempts;
+    int aliasedPublishes;
+    double bytesPerPublish;
+    double overheadPerPublish;
+    uint32_t bytesOut;
+    int topicErrors;
+};
+
+Result run(uint8_t clientProtocol, bool brokerV5, uint16_t aliasMaximum,
+           const uint8_t* payload, size_t payloadLength) {
+    static MqttOutbox::Slot slots[32];
+    LoopbackTransport link;
+    MqttOutbox outbox(slots, 32, 8, 3600000);
+    MqttClient client(link, outbox, now_ms);
+    BrokerStandIn broker(brokerV5, aliasMaximum);
+    client.setServer("broker", 1883);
+    client.setProtocol(clientProtocol);
+
+    Result result = {};
+    for (int attempt = 0; attempt < 3 && !client.connected(); attempt++) {
+        result.connectAttempts++;
+        client.connect("ESP32-A1B2C3D4E5F6");
+        for (int i = 0; i < 4; i++) {
+            broker.pump(link);
+            client.loop();
+        }
+    }
+    client.subscribe("5a728254-5316-45c6-bf3c-de194f1afa53/default/ESP32-A1B2C3D4E5F6/commands", 1);
+
+    for (int i = 0; i < kPublishes; i++) {
+        nowMs += 5000;
+        client.enqueue(kTopic, payload, payloadLength, true);
+        broker.pump(link);
+        client.loop();
+    }
+    broker.pump(link);
+    client.loop();
+
+    result.protocol = client.protocol();
+    result.aliasedPublishes = broker.aliasedPublishes;
+    result.bytesPerPublish = broker.publishes > 0 ? (double)broker.publishBytes / broker.publishes : 0;
+    result.overheadPerPublish =
+        broker.publishes > 0 ? (double)(broker.publishBytes - broker.payloadBytes) / broker.publishes : 0;
+    result.bytesOut = client.bytesOut();
+    result.topicErrors = broker.topicErrors + (broker.publishes == kPublishes ? 0 : 1);
+    return result;
+}
+
+}  // namespace
+
+int main() {
+    std::vector<uint8_t> compact(kCompactPayload, 0x5A);
+    struct Payload {
+        const char* name;
+        const uint8_t* data;
+        size_t length;
+    } payloads[] = {
+        {"json", (const uint8_t*)kJsonPayload, strlen(kJsonPayload)},
+        {"compact", compact.data(), compact.size()},
+    };
+    struct Case {
+        const char* name;
+        uint8_t clientProtocol;
+        bool brokerV5;
+        uint16_t aliasMaximum;
+    } cases[] = {
+        {"3.1.1", mqtt::kProtocol311, false, 0},
+        {"5, no aliases", mqtt::kProtocol5, true, 0},
+        {"5, aliases", mqtt::kProtocol5, true, 10},
+        {"5 -> 3.1.1 broker", mqtt::kProtocol5, false, 0},
+    };
+
+    printf("%d QoS 1 publishes on a %zu-byte topic\n\n", kPublishes, strlen(kTopic));
+    printf("%-8s %-18s %5s %8s %8s %10s %10s %10s %7s\n", "payload", "case", "proto", "connects",
+           "aliased", "B/publish", "overhead", "bytes out", "errors");
+    int errors = 0;
+    for (const Payload& payload : payloads) {
+        double baseline = 0;
+        for (const Case& c : cases) {
+            Result r = run(c.clientProtocol, c.brokerV5, c.aliasMaximum, payload.data, payload.length);
+            if (baseline == 0) {
+                baseline = r.bytesPerPublish;
+            }
+            printf("%-8s %-18s %5s %8d %8d %10.1f %10.1f %10u %7d  (%+.0f%%)\n", payload.name, c.name,
+                   r.protocol == mqtt::kProtocol5 ? "5" : "3.1.1", r.connectAttempts, r.aliasedPublishes,
+                   r.bytesPerPublish, r.overheadPerPublish, r.bytesOut, r.topicErrors,
+                   100.0 * (r.bytesPerPublish - baseline) / baseline);
+            errors += r.topicErrors;
+        }
+    }
+    return errors == 0 ? 0 : 1;
+}
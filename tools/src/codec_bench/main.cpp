@@ -0,0 +1,236 @@
+// Round-trip checks and throughput of the reading codec (lib/TelemetryCodec)
+// in both flavours, on the same schema the firmware encodes with. The device
+// side runs the same loops through the bench-codec command.
+#include <ReadingSchema.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t kRecords = 200000;
+const int kRounds = 5;
+
+struct Check {
+    const char* name;
+    bool passed;
+};
+
+// Fixed-point view of a reading, what the wire actually carries
+struct Wire {
+    std::string deviceId;
+    int64_t timestampMs;
+    bool timeSynced;
+    long temperature;
+    long humidity;
+    long heatIndex;
+    int rssi;
+
+    bool operator==(const Wire& other) const {
+        return deviceId == other.deviceId && timestampMs == other.timestampMs && timeSynced == other.timeSynced &&
+               temperature == other.temperature && humidity == other.humidity && heatIndex == other.heatIndex &&
+               rssi == other.rssi;
+    }
+};
+
+long centi(float value) {
+    return std::isnan(value) ? -32768 : lroundf(value * 100);
+}
+
+Wire wire(const telemetry::Reading& r) {
+    return {r.deviceId, r.timestampMs, r.timeSynced, centi(r.temperature), centi(r.humidity), centi(r.heatIndex),
+            r.rssi};
+}
+
+uint32_t rng = 12345;
+uint32_t next() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// A fleet's worth of readings, with the awkward values mixed in
+std::vector<telemetry::Reading> make_readings(std::vector<std::string>& ids) {
+    ids.resize(64);
+    for (size_t i = 0; i < ids.size(); i++) {
+        char id[32];
+        snprintf(id, sizeof(id), "ESP32-02:00:00:00:%02X:%02X", (unsigned)(i >> 8), (unsigned)(i & 0xFF));
+        ids[i] = id;
+    }
+    ids[1] = "ESP32-\"quoted\\id\"";
+    std::vector<telemetry::Reading> readings(kRecords);
+    int64_t timestamp = 1757689200123LL;
+    for (size_t i = 0; i < kRecords; i++) {
+        telemetry::Reading& r = readings[i];
+        r.deviceId = ids[i % ids.size()].c_str();
+        r.timestampMs = (timestamp += next() % 10000);
+        r.timeSynced = next() % 16 != 0;
+        r.temperature = (int)(next() % 800 - 200) / 10.0f;     // DHT22: one decimal
+        r.humidity = (int)(next() % 1001) / 10.0f;
+        r.heatIndex = r.temperature + (next() % 100000) / 17000.0f;
+        r.rssi = -(int)(next() % 100);
+    }
+    readings[3].heatIndex = NAN;
+    readings[4].temperature = -0.05f;
+    readings[5].timestampMs = 0;
+    readings[6].humidity = 0;
+    return readings;
+}
+
+template <typename F>
+double best_ns(size_t count, F&& run) {
+    double best = 1e300;
+    for (int round = 0; round < kRounds; round++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, ns / count);
+    }
+    return best;
+}
+
+}  // namespace
+
+int main() {
+    std::vector<std::string> ids;
+    std::vector<telemetry::Reading> readings = make_readings(ids);
+    int failures = 0;
+
+    printf("schema: %zu fields, JSON at most %zu bytes, binary at most %zu bytes\n\n", telemetry::kReadingSchema.size(),
+           telemetry::kReadingJsonMax, telemetry::kReadingBinaryMax);
+
+    // Encode everything once, keeping offsets, for the round trips and decoders
+    std::vector<char> json(kRecords * telemetry::kReadingJsonMax);
+    std::vector<size_t> jsonOffsets(kRecords + 1);
+    std::vector<uint8_t> binary(kRecords * telemetry::kReadingBinaryMax);
+    size_t jsonBytes = 0;
+    size_t binaryBytes = 0;
+    bool encoded = true;
+    for (size_t i = 0; i < kRecords; i++) {
+        jsonOffsets[i] = jsonBytes;
+        size_t n = codec::encodeJson(telemetry::kReadingSchema, readings[i], &json[jsonBytes], telemetry::kReadingJsonMax);
+        size_t b = codec::encodeBinary(telemetry::kReadingSchema, readings[i], &binary[binaryBytes],
+                                       telemetry::kReadingBinaryMax);
+        encoded = encoded && n > 0 && b > 0;
+        jsonBytes += n;
+        binaryBytes += b;
+    }
+    jsonOffsets[kRecords] = jsonBytes;
+
+    std::vector<Check> checks;
+    checks.push_back({"every reading encodes", encoded});
+
+    bool jsonRoundTrip = true;
+    std::vector<char> parse(json.begin(), json.begin() + jsonBytes);
+    for (size_t i = 0; i < kRecords && jsonRoundTrip; i++) {
+        telemetry::Reading decoded = {};
+        int fields = codec::decodeJson(telemetry::kReadingSchema, &parse[jsonOffsets[i]],
+                                       jsonOffsets[i + 1] - jsonOffsets[i], decoded);
+        jsonRoundTrip = fields == (int)telemetry::kReadingSchema.size() && wire(decoded) == wire(readings[i]);
+    }
+    checks.push_back({"JSON round trip", jsonRoundTrip});
+
+    bool binaryRoundTrip = true;
+    size_t offset = 0;
+    for (size_t i = 0; i < kRecords && binaryRoundTrip; i++) {
+        telemetry::Reading decoded = {};
+        size_t n = codec::decodeBinary(telemetry::kReadingSchema, &binary[offset], binaryBytes - offset, decoded);
+        binaryRoundTrip = n > 0 && wire(decoded) == wire(readings[i]);
+        offset += n;
+    }
+    checks.push_back({"binary round trip", binaryRoundTrip && offset == binaryBytes});
+
+    // What ArduinoJson used to print for the same reading
+    char text[] = "{\"device_id\":\"ESP32-A1:B2:C3:D4:E5:F6\",\"timestamp\":1757689200123,\"time_synced\":true,"
+                  "\"temperature\":24.5,\"humidity\":65.2,\"heat_index\":24.634567,\"wifi_rssi\":-61}";
+    telemetry::Reading legacy = {};
+    bool legacyOk = codec::decodeJson(telemetry::kReadingSchema, text, strlen(text), legacy) == 7 &&
+                    centi(legacy.heatIndex) == 2463 && legacy.rssi == -61 &&
+                    !strcmp(legacy.deviceId, "ESP32-A1:B2:C3:D4:E5:F6");
+    checks.push_back({"legacy payload", legacyOk});
+
+    char reordered[] = " { \"wifi_rssi\" : -70 , \"extra\" : {\"a\":[1,\"}\"]}, \"temperature\" : 2.15e1 ,"
+                       " \"humidity\": null } ";
+    telemetry::Reading partial = {};
+    bool partialOk = codec::decodeJson(telemetry::kReadingSchema, reordered, strlen(reordered), partial) == 3 &&
+                     partial.rssi == -70 && centi(partial.temperature) == 2150 && std::isnan(partial.humidity);
+    checks.push_back({"order, unknown keys", partialOk});
+
+    // Every truncation of a payload must be rejected, never read past the end
+    bool truncatedOk = true;
+    size_t firstLength = jsonOffsets[1];
+    for (size_t cut = 0; cut < firstLength; cut++) {
+        std::vector<char> copy(json.begin(), json.begin() + cut);
+        telemetry::Reading r = {};
+        truncatedOk = truncatedOk && codec::decodeJson(telemetry::kReadingSchema, copy.data(), cut, r) < 0;
+    }
+    for (size_t cut = 0; cut < telemetry::kReadingBinaryMax; cut++) {
+        telemetry::Reading r = {};
+        size_t full = codec::decodeBinary(telemetry::kReadingSchema, binary.data(), binaryBytes, r);
+        if (cut < full) {
+            std::vector<uint8_t> copy(binary.begin(), binary.begin() + cut);
+            truncatedOk = truncatedOk && codec::decodeBinary(telemetry::kReadingSchema, copy.data(), cut, r) == 0;
+        }
+    }
+    checks.push_back({"truncated input", truncatedOk});
+
+    telemetry::Reading hot = readings[0];
+    hot.temperature = 400;   // beyond the I16 hundredths
+    char small[16];
+    uint8_t bytes[64];
+    checks.push_back({"out of range, small",
+                      codec::encodeJson(telemetry::kReadingSchema, hot, json.data(), telemetry::kReadingJsonMax) == 0 &&
+                          codec::encodeBinary(telemetry::kReadingSchema, hot, bytes, sizeof(bytes)) == 0 &&
+                          codec::encodeJson(telemetry::kReadingSchema, readings[0], small, sizeof(small)) == 0});
+
+    for (const Check& check : checks) {
+        printf("  %-22s %s\n", check.name, check.passed ? "ok" : "FAILED");
+        failures += check.passed ? 0 : 1;
+    }
+
+    // Throughput over the whole batch, best of kRounds
+    volatile size_t sink = 0;
+    std::vector<char> out(telemetry::kReadingJsonMax);
+    double jsonEncode = best_ns(kRecords, [&] {
+        for (const telemetry::Reading& r : readings) {
+            sink += codec::encodeJson(telemetry::kReadingSchema, r, out.data(), out.size());
+        }
+    });
+    double jsonDecode = best_ns(kRecords, [&] {
+        memcpy(parse.data(), json.data(), jsonBytes);
+        for (size_t i = 0; i < kRecords; i++) {
+            telemetry::Reading r;
+            sink += codec::decodeJson(telemetry::kReadingSchema, &parse[jsonOffsets[i]],
+                                      jsonOffsets[i + 1] - jsonOffsets[i], r);
+        }
+    });
+    std::vector<uint8_t> binaryOut(telemetry::kReadingBinaryMax);
+    double binaryEncode = best_ns(kRecords, [&] {
+        for (const telemetry::Reading& r : readings) {
+            sink += codec::encodeBinary(telemetry::kReadingSchema, r, binaryOut.data(), binaryOut.size());
+        }
+    });
+    double binaryDecode = best_ns(kRecords, [&] {
+        size_t at = 0;
+        for (size_t i = 0; i < kRecords; i++) {
+            telemetry::Reading r;
+            at += codec::decodeBinary(telemetry::kReadingSchema, &binary[at], binaryBytes - at, r);
+        }
+        sink += at;
+    });
+
+    double jsonAverage = (double)jsonBytes / kRecords;
+    double binaryAverage = (double)binaryBytes / kRecords;
+    printf("\n%zu readings, %.1f bytes as JSON, %.1f as binary\n", kRecords, jsonAverage, binaryAverage);
+    printf("%-10s %12s %10s %12s %10s\n", "", "encode ns", "MB/s", "decode ns", "MB/s");
+    printf("%-10s %12.1f %10.0f %12.1f %10.0f\n", "JSON", jsonEncode, jsonAverage * 1e3 / jsonEncode, jsonDecode,
+           jsonAverage * 1e3 / jsonDecode);
+    printf("%-10s %12.1f %10.0f %12.1f %10.0f\n", "binary", binaryEncode, binaryAverage * 1e3 / binaryEncode,
+           binaryDecode, binaryAverage * 1e3 / binaryDecode);
+    return failures == 0 ? 0 : 1;
+}
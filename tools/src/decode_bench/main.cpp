@@ -0,0 +1,274 @@
+// Messages per second per core decoding telemetry captures (one JSON payload
+// per line) into columns: BatchDecoder with each stage-one kernel against a
+// baseline that runs the codec's per-record parser line by line. Every
+// kernel must produce exactly the baseline's columns.
+//
+//   program                 synthetic capture, checks and benchmark
+//   program capture.ndjson  decode a capture with the best kernel
+#include <BatchDecoder.h>
+#include <ReadingSchema.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t kMessages = 2000000;
+const size_t kDevices = 5000;
+const int kRounds = 3;
+
+uint32_t rng = 2463534242u;
+uint32_t next() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// What the fleet publishes, plus a sprinkling of what older firmware,
+// other producers and broken links leave in a capture
+std::string make_capture(size_t messages) {
+    std::vector<std::string> ids(kDevices);
+    for (size_t i = 0; i < kDevices; i++) {
+        char id[32];
+        snprintf(id, sizeof(id), "ESP32-02:00:00:%02X:%02X:%02X", (unsigned)(i >> 16), (unsigned)((i >> 8) & 0xFF),
+                 (unsigned)(i & 0xFF));
+        ids[i] = id;
+    }
+    ids[7] = "ESP32-\"odd\\name";
+    std::string capture;
+    capture.reserve(messages * 160);
+    int64_t timestamp = 1757689200123LL;
+    char line[512];
+    for (size_t i = 0; i < messages; i++) {
+        telemetry::Reading r;
+        r.deviceId = ids[next() % kDevices].c_str();
+        r.timestampMs = (timestamp += next() % 50);
+        r.timeSynced = next() % 32 != 0;
+        r.temperature = (int)(next() % 600 - 100) / 10.0f;
+        r.humidity = (int)(next() % 1001) / 10.0f;
+        r.heatIndex = r.temperature + (next() % 4000) / 1000.0f;
+        r.rssi = -(int)(next() % 95);
+        r.seq = (uint32_t)(i / kDevices);
+        r.publishDelayMs = (uint16_t)(next() % 40);
+        size_t n = codec::encodeJson(telemetry::kReadingSchema, r, line, sizeof(line));
+
+        switch (next() % 1000) {
+            case 0:     // state payload: no heat index or RSSI
+                n = codec::encodeJson(telemetry::kStateSchema, r, line, sizeof(line));
+                break;
+            case 1:     // ArduinoJson's float formatting, keys reordered, spaces
+                n = snprintf(line, sizeof(line),
+                             "{ \"wifi_rssi\": %d, \"heat_index\": %.6f, \"temperature\": %.1f,"
+                             " \"humidity\": %.1f, \"device_id\": \"%s\", \"timestamp\": %lld }",
+                             r.rssi, r.heatIndex, r.temperature, r.humidity, "ESP32-A1B2C3D4E5F6",
+                             (long long)r.timestampMs);
+                break;
+            case 2: {   // an extra nested key from some other producer
+                std::string rest(line + 1, n - 1);
+                n = snprintf(line, sizeof(line), "{\"meta\":{\"fw\":\"1.2\",\"tags\":[\"a\",\"}\"]},%s", rest.c_str());
+                break;
+            }
+            case 3:     // cut off mid-message
+                n /= 2;
+                break;
+            case 4:     // required field missing
+                n = snprintf(line, sizeof(line), "{\"device_id\":\"%s\",\"humidity\":40}", r.deviceId);
+                break;
+            case 5:     // exponent and null
+                n = snprintf(line, sizeof(line),
+                             "{\"device_id\":\"%s\",\"timestamp\":%lld,\"temperature\":2.15e1,\"humidity\":4.5E1,"
+                             "\"heat_index\":null}",
+                             r.deviceId, (long long)r.timestampMs);
+                break;
+            case 6:
+                memcpy(line, "\r", 1);     // blank-ish line
+                n = 1;
+                break;
+        }
+        capture.append(line, n);
+        capture.push_back('\n');
+    }
+    return capture;
+}
+
+// The codec's per-record parser, one line at a time, parsing in place
+size_t baseline(std::string& capture, ingest::Columns& out, size_t* rejected) {
+    const float kAbsent = -1e30f;
+    char* p = &capture[0];
+    char* end = p + capture.size();
+    std::vector<uint32_t> slots(1 << 16, 0);
+    std::vector<uint32_t> hashes;
+    *rejected = 0;
+    while (p < end) {
+        char* newline = (char*)memchr(p, '\n', end - p);
+        char* lineEnd = newline != nullptr ? newline : end;
+        char* first = p;
+        while (first < lineEnd && (*first == ' ' || *first == '\r' || *first == '\t')) {
+            first++;
+        }
+        if (first < lineEnd) {
+            telemetry::Reading r = {nullptr, INT64_MIN, false, kAbsent, kAbsent, NAN, INT8_MIN, UINT32_MAX, 0};
+            int fields = codec::decodeJson(telemetry::kReadingSchema, p, lineEnd - p, r);
+            if (fields < 0 || r.deviceId == nullptr || r.timestampMs == INT64_MIN || r.temperature == kAbsent ||
+                r.humidity == kAbsent) {
+                (*rejected)++;
+            } else {
+                // Same dictionary semantics as the decoder: first seen, first index
+                size_t length = strlen(r.deviceId);
+                uint32_t hash = 2166136261u;
+                for (size_t i = 0; i < length; i++) {
+                    hash = (hash ^ (uint8_t)r.deviceId[i]) * 16777619u;
+                }
+                uint32_t index;
+                for (size_t slot = hash & (slots.size() - 1);; slot = (slot + 1) & (slots.size() - 1)) {
+                    if (slots[slot] == 0) {
+                        index = out.deviceIds.size();
+                        out.deviceIds.emplace_back(r.deviceId, length);
+                        hashes.push_back(hash);
+                        slots[slot] = index + 1;
+                        break;
+                    }
+                    const std::string& known = out.deviceIds[slots[slot] - 1];
+                    if (hashes[slots[slot] - 1] == hash && known.size() == length &&
+                        memcmp(known.data(), r.deviceId, length) == 0) {
+                        index = slots[slot] - 1;
+                        break;
+                    }
+                }
+                out.device.push_back(index);
+                out.timestampMs.push_back(r.timestampMs);
+                out.timeSynced.push_back(r.timeSynced ? 1 : 0);
+                out.temperatureCenti.push_back(std::isnan(r.temperature) ? ingest::kNull : lroundf(r.temperature * 100));
+                out.humidityCenti.push_back(std::isnan(r.humidity) ? ingest::kNull : lroundf(r.humidity * 100));
+                out.heatIndexCenti.push_back(std::isnan(r.heatIndex) ? ingest::kNull : lroundf(r.heatIndex * 100));
+                out.rssi.push_back((int8_t)r.rssi);
+                // The capture has both or neither, so seq tells for the delay too
+                bool traced = r.seq != UINT32_MAX;
+                out.seq.push_back(traced ? (int64_t)r.seq : ingest::kNoSeq);
+                out.publishDelayMs.push_back(traced ? (int32_t)r.publishDelayMs : ingest::kNoDelay);
+            }
+        }
+        p = lineEnd + 1;
+    }
+    return out.size();
+}
+
+bool same(const ingest::Columns& a, const ingest::Columns& b) {
+    return a.deviceIds == b.deviceIds && a.device == b.device && a.timestampMs == b.timestampMs &&
+           a.timeSynced == b.timeSynced && a.temperatureCenti == b.temperatureCenti &&
+           a.humidityCenti == b.humidityCenti && a.heatIndexCenti == b.heatIndexCenti && a.rssi == b.rssi &&
+           a.seq == b.seq && a.publishDelayMs == b.publishDelayMs;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int decode_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        perror(path);
+        return 1;
+    }
+    std::string data;
+    char buffer[1 << 16];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, n);
+    }
+    fclose(file);
+
+    ingest::BatchDecoder decoder;
+    ingest::Columns columns;
+    auto start = std::chrono::steady_clock::now();
+    decoder.decode(data.data(), data.size(), columns);
+    double s = seconds_since(start);
+    printf("%s: %zu rows, %llu rejected, %zu devices, %.1f MB in %.3f s (%s, %.0f messages/s)\n", path,
+           columns.size(), (unsigned long long)decoder.stats().rejected, columns.deviceIds.size(),
+           data.size() / 1048576.0, s, ingest::BatchDecoder::kernelName(decoder.kernel()), columns.size() / s);
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc == 2) {
+        return decode_file(argv[1]);
+    }
+
+    std::string capture = make_capture(kMessages);
+    printf("%zu messages, %.1f MB, %.1f bytes each\n\n", kMessages, capture.size() / 1048576.0,
+           (double)capture.size() / kMessages);
+
+    ingest::Columns reference;
+    size_t referenceRejected = 0;
+    double baselineBest = 1e300;
+    std::string scratch;
+    for (int round = 0; round < kRounds; round++) {
+        scratch = capture;
+        reference = ingest::Columns();
+        reference.reserve(kMessages);
+        auto start = std::chrono::steady_clock::now();
+        baseline(scratch, reference, &referenceRejected);
+        baselineBest = std::min(baselineBest, seconds_since(start));
+    }
+
+    int failures = 0;
+    printf("%-22s %14s %10s %9s %8s %s\n", "", "messages/s", "MB/s", "ns/msg", "speedup", "columns");
+    printf("%-22s %14.0f %10.0f %9.1f %8s %zu rows, %zu rejected\n", "baseline (codec)", kMessages / baselineBest,
+           capture.size() / baselineBest / 1048576.0, baselineBest * 1e9 / kMessages, "1.0x", reference.size(),
+           referenceRejected);
+
+    ingest::BatchDecoder::Kernel kernels[] = {ingest::BatchDecoder::kScalar, ingest::BatchDecoder::kSse2,
+                                              ingest::BatchDecoder::kAvx2};
+    for (ingest::BatchDecoder::Kernel kernel : kernels) {
+        if (kernel == ingest::BatchDecoder::kAvx2 && ingest::BatchDecoder::best() != kernel) {
+            printf("%-22s (not supported on this CPU)\n", "batch avx2");
+            continue;
+        }
+        ingest::Columns columns;
+        double best = 1e300;
+        uint64_t rejected = 0;
+        for (int round = 0; round < kRounds; round++) {
+            ingest::BatchDecoder decoder(kernel);
+            columns = ingest::Columns();
+            columns.reserve(kMessages);
+            auto start = std::chrono::steady_clock::now();
+            decoder.decode(capture.data(), capture.size(), columns);
+            best = std::min(best, seconds_since(start));
+            rejected = decoder.stats().rejected;
+        }
+        bool match = same(columns, reference) && rejected == referenceRejected;
+        failures += match ? 0 : 1;
+        char name[32];
+        snprintf(name, sizeof(name), "batch %s", ingest::BatchDecoder::kernelName(kernel));
+        printf("%-22s %14.0f %10.0f %9.1f %7.1fx %s\n", name, kMessages / best, capture.size() / best / 1048576.0,
+               best * 1e9 / kMessages, baselineBest / best, match ? "match" : "DIFFER");
+    }
+
+    // Windows cut records anywhere: feeding a capture in odd pieces to one
+    // decoder per piece must still find every record that is whole in it
+    ingest::BatchDecoder decoder;
+    ingest::Columns whole;
+    decoder.decode(capture.data(), 300000 * 160, whole);
+    ingest::Columns pieces;
+    ingest::BatchDecoder pieceDecoder;
+    size_t offset = 0;
+    const size_t limit = 300000 * 160;
+    while (offset < limit) {
+        size_t piece = std::min<size_t>(limit - offset, 1 + next() % 700000);
+        const char* cut = (const char*)memrchr(capture.data() + offset, '\n', piece);
+        size_t take = cut != nullptr ? (size_t)(cut - capture.data() - offset) + 1 : piece;
+        pieceDecoder.decode(capture.data() + offset, take, pieces);
+        offset += take;
+    }
+    bool piecesMatch = same(whole, pieces);
+    printf("\nline-aligned pieces     %s\n", piecesMatch ? "match" : "DIFFER");
+    failures += piecesMatch ? 0 : 1;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,551 @@
+// Builds and applies firmware delta patches in the DeltaPatch format.
+//
+//   program diff <old.bin> <new.bin> <patch.bin>   make a patch
+//   program apply <old.bin> <patch.bin> <out.bin>  apply one with the firmware's applier
+//   program [bench]                                 synthetic sample images: sizes, timing
+//                                                   and the applier's failure checks
+//
+// The differ follows bsdiff: extend each match forwards and backwards while
+// at least half the bytes still agree, store those regions as bytewise
+// differences and the rest as literal bytes. Matches are found with a hash
+// index instead of a suffix array, which is plenty for 1-2 MB images.
+#include <DeltaPatch.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+const uint8_t kWindowBits = 11;
+const uint8_t kLengthBits = 8;
+
+// ---------------------------------------------------------------------------
+// Matching
+
+class MatchIndex {
+public:
+    static const size_t kKey = 8;
+
+    explicit MatchIndex(const Bytes& old) : old_(old), head_(1 << kHashBits, -1), prev_(old.size(), -1) {
+        for (size_t i = 0; i + kKey <= old.size(); i++) {
+            uint32_t h = hash(&old[i]);
+            prev_[i] = head_[h];
+            head_[h] = (int32_t)i;
+        }
+    }
+
+    // Longest match for data[0..length) in the old image, trying `hint`
+    // first: after a match the next one is usually at the same offset
+    size_t search(const uint8_t* data, size_t length, int64_t hint, size_t* pos) const {
+        size_t best = 0;
+        if (hint >= 0 && (size_t)hint < old_.size()) {
+            best = extend(data, length, hint);
+            *pos = hint;
+        }
+        if (length < kKey) {
+            return best;
+        }
+        int tries = 0;
+        for (int32_t candidate = head_[hash(data)]; candidate >= 0 && tries < 32 && best < 4096;
+             candidate = prev_[candidate], tries++) {
+            size_t n = extend(data, length, candidate);
+            if (n > best) {
+                best = n;
+                *pos = candidate;
+            }
+        }
+        return best;
+    }
+
+private:
+    static const int kHashBits = 20;
+
+    static uint32_t hash(const uint8_t* p) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return (uint32_t)((v * 0x9E3779B97F4A7C15ull) >> (64 - kHashBits));
+    }
+
+    size_t extend(const uint8_t* data, size_t length, size_t at) const {
+        size_t n = 0;
+        size_t limit = old_.size() - at < length ? old_.size() - at : length;
+        while (n < limit && old_[at + n] == data[n]) {
+            n++;
+        }
+        return n;
+    }
+
+    const Bytes& old_;
+    std::vector<int32_t> head_;
+    std::vector<int32_t> prev_;
+};
+
+void put_varint(Bytes& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(v);
+}
+
+// The uncompressed patch body, bsdiff's main loop with the index above
+Bytes diff_body(const Bytes& old, const Bytes& neu) {
+    MatchIndex index(old);
+    Bytes body;
+    int64_t oldSize = old.size(), newSize = neu.size();
+    int64_t scan = 0, len = 0, pos = 0, lastScan = 0, lastPos = 0, lastOffset = 0;
+
+    while (scan < newSize) {
+        int64_t oldScore = 0;
+        int64_t scsc;
+        for (scsc = scan += len; scan < newSize; scan++) {
+            size_t matchPos = 0;
+            len = index.search(&neu[scan], newSize - scan, scan + lastOffset, &matchPos);
+            pos = matchPos;
+            for (; scsc < scan + len; scsc++) {
+                if (scsc + lastOffset < oldSize && old[scsc + lastOffset] == neu[scsc]) {
+                    oldScore++;
+                }
+            }
+            if ((len == oldScore && len != 0) || len > oldScore + 8) {
+                break;
+            }
+            if (scan + lastOffset < oldSize && old[scan + lastOffset] == neu[scan]) {
+                oldScore--;
+            }
+        }
+        if (len == oldScore && scan != newSize) {
+            continue;
+        }
+
+        // Forwards from the last match and backwards from this one, while
+        // at least half the bytes agree
+        int64_t s = 0, best = 0, lenF = 0;
+        for (int64_t i = 0; lastScan + i < scan && lastPos + i < oldSize;) {
+            if (old[lastPos + i] == neu[lastScan + i]) s++;
+            i++;
+            if (s * 2 - i > best * 2 - lenF) {
+                best = s;
+                lenF = i;
+            }
+        }
+        int64_t lenB = 0;
+        if (scan < newSize) {
+            s = 0;
+            best = 0;
+            for (int64_t i = 1; scan >= lastScan + i && pos >= i; i++) {
+                if (old[pos - i] == neu[scan - i]) s++;
+                if (s * 2 - i > best * 2 - lenB) {
+                    best = s;
+                    lenB = i;
+                }
+            }
+        }
+        if (lastScan + lenF > scan - lenB) {
+            int64_t overlap = (lastScan + lenF) - (scan - lenB);
+            int64_t split = 0;
+            s = 0;
+            best = 0;
+            for (int64_t i = 0; i < overlap; i++) {
+                if (neu[lastScan + lenF - overlap + i] == old[lastPos + lenF - overlap + i]) s++;
+                if (neu[scan - lenB + i] == old[pos - lenB + i]) s--;
+                if (s > best) {
+                    best = s;
+                    split = i + 1;
+                }
+            }
+            lenF += split - overlap;
+            lenB -= split;
+        }
+
+        int64_t extra = (scan - lenB) - (lastScan + lenF);
+        int64_t seek = (pos - lenB) - (lastPos + lenF);
+        put_varint(body, lenF);
+        put_varint(body, extra);
+        put_varint(body, ((uint32_t)seek << 1) ^ (uint32_t)(seek >> 63));
+        for (int64_t i = 0; i < lenF; i++) {
+            body.push_back(neu[lastScan + i] - old[lastPos + i]);
+        }
+        body.insert(body.end(), neu.begin() + lastScan + lenF, neu.begin() + scan - lenB);
+
+        lastScan = scan - lenB;
+        lastPos = pos - lenB;
+        lastOffset = pos - scan;
+    }
+    return body;
+}
+
+// ---------------------------------------------------------------------------
+// LZSS, the bit layout DeltaPatch decodes
+
+class BitWriter {
+public:
+    explicit BitWriter(Bytes& out) : out_(out) {}
+    void put(uint32_t value, int count) {
+        for (int i = count - 1; i >= 0; i--) {
+            current_ = (current_ << 1) | ((value >> i) & 1);
+            if (++used_ == 8) {
+                out_.push_back(current_);
+                current_ = 0;
+                used_ = 0;
+            }
+        }
+    }
+    void finish() {
+        if (used_ > 0) {
+            out_.push_back(current_ << (8 - used_));
+        }
+    }
+
+private:
+    Bytes& out_;
+    uint8_t current_ = 0;
+    int used_ = 0;
+};
+
+void lzss_compress(const Bytes& in, uint8_t windowBits, uint8_t lengthBits, Bytes& out) {
+    const size_t window = (size_t)1 << windowBits;
+    const size_t maxMatch = ((size_t)1 << lengthBits) - 1 + delta::kMinMatch;
+    const int kHashBits = 16;
+    std::vector<int32_t> head(1 << kHashBits, -1);
+    std::vector<int32_t> prev(in.size(), -1);
+    auto hash = [&](size_t i) {
+        return ((in[i] << 16 | in[i + 1] << 8 | in[i + 2]) * 2654435761u) >> (32 - kHashBits);
+    };
+    auto insert = [&](size_t i) {
+        if (i + delta::kMinMatch <= in.size()) {
+            uint32_t h = hash(i);
+            prev[i] = head[h];
+            head[h] = (int32_t)i;
+        }
+    };
+
+    BitWriter bits(out);
+    size_t i = 0;
+    while (i < in.size()) {
+        size_t bestLength = 0, bestDistance = 0;
+        if (i + delta::kMinMatch <= in.size()) {
+            int tries = 0;
+            for (int32_t c = head[hash(i)]; c >= 0 && i - c <= window && tries < 64; c = prev[c], tries++) {
+                size_t n = 0;
+                while (n < maxMatch && i + n < in.size() && in[c + n] == in[i + n]) {
+                    n++;
+                }
+                if (n > bestLength) {
+                    bestLength = n;
+                    bestDistance = i - c;
+                    if (n == maxMatch) {
+                        break;
+                    }
+                }
+            }
+        }
+        if (bestLength >= delta::kMinMatch) {
+            bits.put(0, 1);
+            bits.put(bestDistance - 1, windowBits);
+            bits.put(bestLength - delta::kMinMatch, lengthBits);
+            for (size_t n = 0; n < bestLength; n++) {
+                insert(i++);
+            }
+        } else {
+            bits.put(1, 1);
+            bits.put(in[i], 8);
+            insert(i++);
+        }
+    }
+    bits.finish();
+}
+
+void sha256(const Bytes& data, uint8_t digest[Sha256::kDigestSize]) {
+    Sha256 sha;
+    sha.update(data.data(), data.size());
+    sha.finish(digest);
+}
+
+Bytes make_patch(const Bytes& old, const Bytes& neu, size_t* bodySize = nullptr) {
+    delta::Header header = {};
+    header.version = delta::kVersion;
+    header.windowBits = kWindowBits;
+    header.lengthBits = kLengthBits;
+    header.oldSize = old.size();
+    header.newSize = neu.size();
+    sha256(old, header.oldHash);
+    sha256(neu, header.newHash);
+
+    Bytes patch(delta::kHeaderSize);
+    delta::writeHeader(header, patch.data());
+    Bytes body = diff_body(old, neu);
+    if (bodySize != nullptr) {
+        *bodySize = body.size();
+    }
+    lzss_compress(body, kWindowBits, kLengthBits, patch);
+    return patch;
+}
+
+// ---------------------------------------------------------------------------
+// Applying, through the same interfaces the firmware implements over flash
+
+class BufferReader : public delta::ImageReader {
+public:
+    explicit BufferReader(const Bytes& data) : data_(data) {}
+    bool read(uint32_t offset, uint8_t* out, size_t length) override {
+        if (offset + length > data_.size()) {
+            return false;
+        }
+        memcpy(out, data_.data() + offset, length);
+        reads++;
+        return true;
+    }
+    size_t reads = 0;
+
+private:
+    const Bytes& data_;
+};
+
+class BufferWriter : public delta::ImageWriter {
+public:
+    bool write(const uint8_t* data, size_t length) override {
+        out.insert(out.end(), data, data + length);
+        return true;
+    }
+    Bytes out;
+};
+
+delta::Status apply(const Bytes& old, const Bytes& patch, size_t chunk, Bytes* out, size_t* oldReads = nullptr) {
+    BufferReader reader(old);
+    BufferWriter writer;
+    delta::Applier applier(reader, writer);
+    for (size_t i = 0; i < patch.size() && applier.status() == delta::kNeedMore; i += chunk) {
+        applier.feed(patch.data() + i, patch.size() - i < chunk ? patch.size() - i : chunk);
+    }
+    if (out != nullptr) {
+        *out = writer.out;
+    }
+    if (oldReads != nullptr) {
+        *oldReads = reader.reads;
+    }
+    return applier.status();
+}
+
+bool load(const char* path, Bytes& data) {
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) {
+        perror(path);
+        return false;
+    }
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(f);
+    return true;
+}
+
+bool save(const char* path, const Bytes& data) {
+    FILE* f = fopen(path, "wb");
+    if (f == nullptr || fwrite(data.data(), 1, data.size(), f) != data.size()) {
+        perror(path);
+        return false;
+    }
+    fclose(f);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Synthetic sample images
+
+struct Rng {
+    uint64_t state;
+    uint32_t next() {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return state >> 33;
+    }
+};
+
+const uint32_t kLoadAddress = 0x400D0000;
+
+// Code-like words from a small vocabulary, absolute addresses into the image
+// every few words, a string table and padding, roughly like an ESP32 app
+Bytes make_image(size_t codeWords, uint32_t seed) {
+    Rng rng = {seed};
+    std::vector<uint32_t> vocabulary(512);
+    for (uint32_t& word : vocabulary) {
+        word = rng.next();
+    }
+    Bytes image;
+    auto put32 = [&](uint32_t v) {
+        for (int i = 0; i < 4; i++) image.push_back(v >> (8 * i));
+    };
+    for (size_t i = 0; i < codeWords; i++) {
+        uint32_t r = rng.next();
+        if (r % 7 == 0) {
+            put32(kLoadAddress + (rng.next() % codeWords) * 4);
+        } else if (r % 3 == 0) {
+            put32(rng.next());
+        } else {
+            put32(vocabulary[r % vocabulary.size()]);
+        }
+    }
+    static const char* words[] = {"MQTT ", "temperature ", "humidity ", "error ", "WiFi ", "sensor ",
+                                  "connected ", "history ", "%d ms ", "\n"};
+    for (int i = 0; i < 12000; i++) {
+        const char* w = words[rng.next() % 10];
+        image.insert(image.end(), w, w + strlen(w));
+    }
+    image.resize((image.size() + 4095) & ~(size_t)4095, 0xFF);
+    return image;
+}
+
+// A small source change: code inserted in the middle, so every address past
+// it moves, plus a couple of edited constants and a new string
+Bytes make_update(const Bytes& old, size_t codeWords, size_t insertedWords, uint32_t seed) {
+    Rng rng = {seed};
+    size_t at = (codeWords / 2) * 4;
+    uint32_t shift = insertedWords * 4;
+    Bytes neu;
+    for (size_t i = 0; i < codeWords * 4; i += 4) {
+        if (i == at) {
+            for (size_t k = 0; k < insertedWords; k++) {
+                uint32_t v = rng.next();
+                for (int b = 0; b < 4; b++) neu.push_back(v >> (8 * b));
+            }
+        }
+        uint32_t v = old[i] | old[i + 1] << 8 | old[i + 2] << 16 | (uint32_t)old[i + 3] << 24;
+        if (v >= kLoadAddress + at && v < kLoadAddress + codeWords * 4) {
+            v += shift;
+        }
+        if (rng.next() % 20000 == 0) {
+            v ^= 0x00010000;
+        }
+        for (int b = 0; b < 4; b++) neu.push_back(v >> (8 * b));
+    }
+    neu.insert(neu.end(), old.begin() + codeWords * 4, old.end());
+    const char* added = "MQTT 5 topic alias ";
+    size_t pad = neu.size() - 1;
+    while (pad > 0 && neu[pad] == 0xFF) pad--;
+    neu.insert(neu.begin() + pad + 1, added, added + strlen(added));
+    neu.resize((neu.size() + 4095) & ~(size_t)4095, 0xFF);
+    return neu;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int bench() {
+    const size_t codeWords = 220000;  // ~880 KB of code
+    Bytes old = make_image(codeWords, 1);
+    printf("applier RAM: %zu bytes (window %d KB)\n\n", sizeof(delta::Applier), 1 << (kWindowBits - 10));
+    printf("%-22s %9s %9s %9s %9s %8s %8s %7s\n", "update", "new", "lzss", "body", "patch", "diff s",
+           "apply s", "result");
+
+    struct Case {
+        const char* name;
+        size_t inserted;
+        uint32_t seed;
+    } cases[] = {
+        {"constants only", 0, 2},
+        {"+64 B of code", 16, 3},
+        {"+2 KB of code", 512, 4},
+        {"+20 KB of code", 5000, 5},
+    };
+    int failures = 0;
+    Bytes lastNew, lastPatch;
+    for (const Case& c : cases) {
+        Bytes neu = make_update(old, codeWords, c.inserted, c.seed);
+        Bytes full;
+        lzss_compress(neu, kWindowBits, kLengthBits, full);
+
+        auto start = std::chrono::steady_clock::now();
+        size_t bodySize;
+        Bytes patch = make_patch(old, neu, &bodySize);
+        double diffS = seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        Bytes out;
+        delta::Status status = apply(old, patch, 512, &out);
+        double applyS = seconds_since(start);
+        bool ok = status == delta::kDone && out == neu;
+        failures += ok ? 0 : 1;
+        printf("%-22s %9zu %9zu %9zu %9zu %8.2f %8.2f %7s\n", c.name, neu.size(), full.size(), bodySize,
+               patch.size(), diffS, applyS, ok ? "ok" : delta::statusName(status));
+        lastNew = neu;
+        lastPatch = patch;
+    }
+
+    // Chunking must not matter, and a flipped bit, a wrong base image or a
+    // truncated download must never produce a wrong image marked kDone. A
+    // flip can be harmless (a back-reference into a run of equal bytes),
+    // which is why the output is compared rather than the status alone
+    printf("\nchecks on the last patch:\n");
+    struct Check {
+        const char* name;
+        bool passed;
+    };
+    std::vector<Check> checks;
+    for (size_t chunk : {1, 7, 4096}) {
+        Bytes out;
+        bool passed = apply(old, lastPatch, chunk, &out) == delta::kDone && out == lastNew;
+        checks.push_back({chunk == 1 ? "1-byte chunks" : chunk == 7 ? "7-byte chunks" : "4 KB chunks", passed});
+    }
+    Bytes other = make_image(codeWords, 99);
+    checks.push_back({"wrong old image", apply(other, lastPatch, 512, nullptr) == delta::kOldMismatch});
+    int wrongDone = 0;
+    Rng rng = {7};
+    for (int i = 0; i < 200; i++) {
+        Bytes corrupt = lastPatch;
+        corrupt[delta::kHeaderSize + rng.next() % (corrupt.size() - delta::kHeaderSize)] ^= 1 << (rng.next() % 8);
+        Bytes out;
+        wrongDone += apply(old, corrupt, 512, &out) == delta::kDone && out != lastNew ? 1 : 0;
+    }
+    checks.push_back({"200 flipped bits", wrongDone == 0});
+    Bytes truncated(lastPatch.begin(), lastPatch.begin() + lastPatch.size() / 2);
+    checks.push_back({"truncated", apply(old, truncated, 512, nullptr) == delta::kNeedMore});
+    Bytes badHeader = lastPatch;
+    badHeader[0] = 'X';
+    checks.push_back({"bad magic", apply(old, badHeader, 512, nullptr) == delta::kBadHeader});
+    for (const Check& check : checks) {
+        printf("  %-18s %s\n", check.name, check.passed ? "ok" : "FAILED");
+        failures += check.passed ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc == 5 && strcmp(argv[1], "diff") == 0) {
+        Bytes old, neu;
+        if (!load(argv[2], old) || !load(argv[3], neu)) {
+            return 1;
+        }
+        Bytes patch = make_patch(old, neu);
+        if (!save(argv[4], patch)) {
+            return 1;
+        }
+        printf("%zu -> %zu bytes, patch %zu bytes (%.1f%%)\n", old.size(), neu.size(), patch.size(),
+               100.0 * patch.size() / neu.size());
+        return 0;
+    }
+    if (argc == 5 && strcmp(argv[1], "apply") == 0) {
+        Bytes old, patch, out;
+        if (!load(argv[2], old) || !load(argv[3], patch)) {
+            return 1;
+        }
+        delta::Status status = apply(old, patch, 512, &out);
+        printf("%s, %zu bytes\n", delta::statusName(status), out.size());
+        return status == delta::kDone && save(argv[4], out) ? 0 : 1;
+    }
+    if (argc == 1 || (argc == 2 && strcmp(argv[1], "bench") == 0)) {
+        return bench();
+    }
+    fprintf(stderr, "usage: %s diff <old> <new> <patch> | apply <old> <patch> <out> | bench\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,193 @@
+// Time per command from topic to handler: the dispatcher in
+// lib/CommandDispatcher (topic matched by length and hash, payload parsed in
+// place, action looked up by hash in the compile-time table) against the
+// String-based callback it replaced, for every entry of the firmware's table,
+// a message on a topic that is not a command topic and an unknown action.
+//
+// Both paths run the same handlers, which only answer, so what is timed is
+// the dispatch. The old callback parsed into a 100-byte document, too small
+// for commands with parameters; both use the 256 bytes handle_command() does.
+#include <CommandDispatcher.h>
+#include <TopicScheme.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int kIterations = 20000;
+const int kRounds = 5;
+
+// Arduino's String as the old callback used it: each append reallocates to
+// the exact new length
+class ArduinoString {
+public:
+    ArduinoString() {}
+    explicit ArduinoString(const char* s) { concat(s, strlen(s)); }
+    ArduinoString(const ArduinoString&) = delete;
+    ArduinoString& operator=(const ArduinoString&) = delete;
+    ~ArduinoString() { free(buffer_); }
+
+    void concat(const char* s, size_t n) {
+        buffer_ = (char*)realloc(buffer_, length_ + n + 1);
+        memcpy(buffer_ + length_, s, n);
+        length_ += n;
+        buffer_[length_] = '\0';
+    }
+    ArduinoString& operator+=(char c) {
+        concat(&c, 1);
+        return *this;
+    }
+    bool endsWith(const char* suffix) const {
+        size_t n = strlen(suffix);
+        return n <= length_ && memcmp(buffer_ + length_ - n, suffix, n) == 0;
+    }
+    bool operator==(const char* s) const { return strcmp(c_str(), s) == 0; }
+    const char* c_str() const { return buffer_ != nullptr ? buffer_ : ""; }
+
+private:
+    char* buffer_ = nullptr;
+    size_t length_ = 0;
+};
+
+uint32_t answered = 0;
+
+bool cmd_answer(JsonObjectConst, JsonObject response) {
+    answered++;
+    response["done"] = true;
+    return true;
+}
+
+// The names in src/commands.cpp, in its order
+#define BENCH_COMMANDS(X)                                                                                 \
+    X("set-interval") X("read-now") X("flush-buffer") X("get-stats") X("reboot") X("ota-update")          \
+        X("get-config") X("set-config") X("reset-config") X("get-history") X("get-summary") X("bench-codec")
+
+#define BENCH_ENTRY(name) COMMAND_ENTRY(name, cmd_answer),
+constexpr command::Entry commandTable[] = {BENCH_COMMANDS(BENCH_ENTRY)};
+
+#define BENCH_NAME(name) name,
+const char* const commandNames[] = {BENCH_COMMANDS(BENCH_NAME)};
+
+uint32_t no_clock() {
+    return 0;
+}
+
+CommandDispatcher dispatcher(commandTable, sizeof(commandTable) / sizeof(commandTable[0]), no_clock);
+TopicMatcher commandTopics[3];
+
+// Today's callback and handle_command() up to the handler. The payload is
+// parsed in place, so it works on a copy of what the MQTT buffer would hold.
+bool dispatch_new(const char* topic, const std::string& message, std::vector<uint8_t>& scratch) {
+    size_t topicLength = strlen(topic);
+    for (const TopicMatcher& matcher : commandTopics) {
+        if (matcher.matches(topic, topicLength)) {
+            memcpy(scratch.data(), message.data(), message.size());
+            StaticJsonDocument<256> request;
+            StaticJsonDocument<512> response;
+            return dispatcher.dispatch(scratch.data(), message.size(), request, response) == CommandDispatcher::kOk;
+        }
+    }
+    return false;
+}
+
+// The baseline callback, with the chain of String comparisons it would have
+// needed to reach a handler
+bool dispatch_old(const char* topic, const std::string& message) {
+    const uint8_t* payload = (const uint8_t*)message.data();
+    ArduinoString text;
+    for (size_t i = 0; i < message.size(); i++) {
+        text += (char)payload[i];
+    }
+    if (!ArduinoString(topic).endsWith("/commands")) {
+        return false;
+    }
+    StaticJsonDocument<256> request;
+    if (deserializeJson(request, text.c_str())) {
+        return false;
+    }
+    if (!request.containsKey("action")) {
+        return false;
+    }
+    ArduinoString action(request["action"].as<const char*>());
+    for (const char* name : commandNames) {
+        if (action == name) {
+            StaticJsonDocument<512> response;
+            JsonObject out = response.to<JsonObject>();
+            out["id"] = request["id"].as<const char*>();
+            out["action"] = request["action"].as<const char*>();
+            bool ok = cmd_answer(request["parameters"].as<JsonObjectConst>(), out);
+            out["ok"] = ok;
+            return ok;
+        }
+    }
+    return false;
+}
+
+struct Case {
+    std::string label;
+    const char* topic;
+    std::string message;
+    bool expected;  // reaches a handler
+};
+
+template <typename F>
+double best_ns(F&& run) {
+    double best = 1e300;
+    for (int round = 0; round < kRounds; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kIterations; i++) {
+            run();
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, ns / kIterations);
+    }
+    return best;
+}
+
+}  // namespace
+
+int main() {
+    const char* tenant = "5a728254-5316-45c6-bf3c-de194f1afa53";
+    std::vector<char> topicStorage(TopicScheme::storageSize(tenant, "default", "ESP32-A1B2C3D4E5F6"));
+    TopicScheme topics;
+    topics.build(tenant, "default", "ESP32-A1B2C3D4E5F6", topicStorage.data(), topicStorage.size());
+    commandTopics[0].set(topics.commands());
+    commandTopics[1].set(topics.siteCommands());
+    commandTopics[2].set(topics.tenantCommands());
+
+    std::vector<Case> cases;
+    for (const char* name : commandNames) {
+        cases.push_back({name, topics.commands(),
+                         std::string("{\"id\":\"42\",\"action\":\"") + name +
+                             "\",\"parameters\":{\"min_ms\":2000,\"max_ms\":30000}}",
+                         true});
+    }
+    cases.push_back({"(other topic)", topics.telemetry(), "{\"id\":\"42\",\"action\":\"read-now\"}", false});
+    cases.push_back({"(unknown action)", topics.commands(), "{\"id\":\"42\",\"action\":\"self-destruct\"}", false});
+
+    std::vector<uint8_t> scratch(512);
+    int failures = 0;
+    double newTotal = 0, oldTotal = 0;
+    printf("%-18s %10s %10s %8s\n", "command", "table ns", "String ns", "speedup");
+    for (const Case& c : cases) {
+        bool newOk = dispatch_new(c.topic, c.message, scratch);
+        bool oldOk = dispatch_old(c.topic, c.message);
+        double newNs = best_ns([&] { dispatch_new(c.topic, c.message, scratch); });
+        double oldNs = best_ns([&] { dispatch_old(c.topic, c.message); });
+        newTotal += newNs;
+        oldTotal += oldNs;
+        bool agree = newOk == c.expected && oldOk == c.expected;
+        failures += agree ? 0 : 1;
+        printf("%-18s %10.0f %10.0f %7.1fx%s\n", c.label.c_str(), newNs, oldNs, oldNs / newNs,
+               agree ? "" : "  (wrong handler)");
+    }
+    printf("%-18s %10.0f %10.0f %7.1fx\n", "average", newTotal / cases.size(), oldTotal / cases.size(),
+           oldTotal / newTotal);
+    return failures == 0 && answered > 0 ? 0 : 1;
+}
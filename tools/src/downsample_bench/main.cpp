@@ -0,0 +1,123 @@
+// Reduction ratio, per-point cost and fidelity of the downsampling kernels,
+// run window by window the way the firmware streams history.
+#include <Downsample.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+const size_t kReadings = 7 * 24 * 720;  // a week at 5 s
+const size_t kWindow = 256;             // HISTORY_DOWNSAMPLE_WINDOW
+const size_t kChunk = 32;               // HISTORY_CHUNK_RECORDS
+const int kSpikes = 40;
+
+struct Result {
+    size_t kept;
+    double nsPerPoint;
+    double rmsError;
+    int spikesKept;
+};
+
+// Linear interpolation through the kept points, compared with every reading
+double rms_error(const std::vector<downsample::Point>& series, const std::vector<size_t>& kept) {
+    double sum = 0;
+    for (size_t k = 0; k + 1 < kept.size(); k++) {
+        const downsample::Point& a = series[kept[k]];
+        const downsample::Point& b = series[kept[k + 1]];
+        for (size_t i = kept[k]; i < kept[k + 1]; i++) {
+            double t = b.x > a.x ? (series[i].x - a.x) / (b.x - a.x) : 0;
+            double error = series[i].y - (a.y + t * (b.y - a.y));
+            sum += error * error;
+        }
+    }
+    return sqrt(sum / series.size());
+}
+
+struct Indexed {
+    downsample::Point point;
+    size_t at;
+};
+
+// Same windowing as the firmware: each window yields one chunk of up to
+// kChunk points, with min/max preselection when a window stands for more
+// readings than it holds
+Result run(downsample::Method method, const std::vector<downsample::Point>& series,
+           const std::vector<size_t>& spikes, size_t ratio) {
+    std::vector<size_t> kept;
+    Indexed window[kWindow];
+    downsample::Point points[kWindow];
+    uint16_t selected[kWindow];
+    size_t covered = ratio * kChunk;
+    size_t windowSize = covered < kWindow ? covered : kWindow;
+    downsample::GroupExtremes<Indexed> groups(covered <= kWindow ? 1 : (2 * covered + kWindow - 1) / kWindow);
+    double ns = 0;
+
+    size_t next = 0;
+    while (next < series.size()) {
+        auto begin = std::chrono::steady_clock::now();
+        size_t fill = 0, readings = 0;
+        bool full = false;
+        while (!full && next < series.size()) {
+            if (groups.add({series[next], next}, series[next].y)) {
+                fill += groups.take(window + fill);
+            }
+            next++;
+            readings++;
+            full = groups.size() == 1 ? fill >= windowSize : fill + 2 > windowSize;
+        }
+        fill += groups.take(window + fill);
+        for (size_t i = 0; i < fill; i++) {
+            points[i] = {window[i].point.x - window[0].point.x, window[i].point.y};
+        }
+        size_t target = readings / ratio > 3 ? readings / ratio : 3;
+        size_t n = downsample::run(method, points, fill, target < kChunk ? target : kChunk, selected);
+        ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+        for (size_t i = 0; i < n; i++) {
+            kept.push_back(window[selected[i]].at);
+        }
+    }
+
+    Result result = {kept.size(), ns / series.size(), rms_error(series, kept), 0};
+    size_t k = 0;
+    for (size_t spike : spikes) {
+        while (k < kept.size() && kept[k] < spike) k++;
+        if (k < kept.size() && kept[k] == spike) result.spikesKept++;
+    }
+    return result;
+}
+
+}  // namespace
+
+int main() {
+    srand(7);
+    std::vector<downsample::Point> series(kReadings);
+    for (size_t i = 0; i < kReadings; i++) {
+        double hours = i * 5 / 3600.0;
+        series[i].x = (float)(i * 5);
+        series[i].y = (float)(2200 + 400 * sin(hours / 24 * 2 * M_PI) + rand() % 20);
+    }
+    std::vector<size_t> spikes;
+    for (int s = 0; s < kSpikes; s++) {
+        size_t at = (s + 1) * kReadings / (kSpikes + 1);
+        series[at].y += (s % 2 ? 600 : -600);   // a door left open for one reading
+        spikes.push_back(at);
+    }
+
+    printf("%zu readings, windows of up to %zu, %d one-reading spikes\n\n", kReadings, kWindow, kSpikes);
+    printf("%-7s %6s %8s %8s %10s %12s %8s\n", "method", "ratio", "points", "actual", "ns/point", "rms err °C",
+           "spikes");
+    const size_t ratios[] = {4, 10, 50, 200, 1000};
+    const downsample::Method methods[] = {downsample::kLttb, downsample::kMinMax};
+    for (downsample::Method method : methods) {
+        for (size_t ratio : ratios) {
+            Result r = run(method, series, spikes, ratio);
+            printf("%-7s %5zux %8zu %7.1fx %10.2f %12.3f %5d/%d\n", downsample::methodName(method), ratio, r.kept,
+                   (double)kReadings / r.kept, r.nsPerPoint, r.rmsError / 100, r.spikesKept, kSpikes);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// The firmware's config.h for the simulation. The network is VirtualEsp32's,
+// so the names here are never resolved; everything else keeps the defaults
+// of config_defaults.h, as on a device built from a fresh checkout.
+#define WIFI_SSID "sim"
+#define WIFI_PASSWORD "sim"
+#define MQTT_BROKER "broker.sim"
+#define MQTT_PORT 1883
+#define DHTPIN 4
+#define DHTTYPE DHT22
+
+#endif
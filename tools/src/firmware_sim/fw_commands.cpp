@@ -0,0 +1,2 @@
+// The firmware's own commands.cpp, built unchanged against VirtualEsp32
+#include "../../../firmware/src/commands.cpp"
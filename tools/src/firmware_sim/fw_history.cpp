@@ -0,0 +1,2 @@
+// The firmware's own history.cpp, built unchanged against VirtualEsp32
+#include "../../../firmware/src/history.cpp"
@@ -0,0 +1,2 @@
+// The firmware's own main.cpp, built unchanged against VirtualEsp32
+#include "../../../firmware/src/main.cpp"
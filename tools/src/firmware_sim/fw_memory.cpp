@@ -0,0 +1,2 @@
+// The firmware's own memory.cpp, built unchanged against VirtualEsp32
+#include "../../../firmware/src/memory.cpp"
@@ -0,0 +1,2 @@
+// The firmware's own ota.cpp, built unchanged against VirtualEsp32
+#include "../../../firmware/src/ota.cpp"
@@ -0,0 +1,938 @@
+// Firmware simulation: runs the firmware's own setup() and loop() (the
+// fw_*.cpp files include firmware/src unchanged) on VirtualEsp32's virtual
+// clock, against a broker, an NTP server and a DHT22 modelled here, and plays
+// a scenario of link drops, sensor failures and broker trouble over days of
+// device time. A week takes seconds, and the same scenario and seed always
+// give the same run.
+//
+//   program [scenario.txt] [--days N] [--seed N] [--serial FILE|-]
+//
+// Without a scenario file the built-in one below runs. --days overrides its
+// duration, --serial writes the firmware's serial output with the device's
+// uptime on each line ("-" for stdout). One line per simulated day while it
+// runs, then what the broker received and what the device reports:
+// delivery and latency from sample to broker per reading (each one carries
+// its seq), clock error against true time, the outbox, WiFi, heap and flash.
+//
+// Scenario lines, '#' starting a comment:
+//
+//   duration 7d        drift 40        latency 25ms      rssi -62
+//   heap 160000        join 2s         seed 1
+//   at TIME wifi down [FOR] | wifi up
+//   at TIME sensor fail [FOR] | sensor ok | sensor step +DELTA [FOR]
+//   at TIME broker down [FOR] | broker up
+//   at TIME broker slow DELAY [FOR]    each packet waits DELAY, in turn
+//   at TIME broker stall FOR           nothing processed until FOR is over
+//   at TIME latency MS [FOR]  |  ntp down [FOR] | ntp up  |  rssi DBM
+//   at TIME command JSON               published on the device's commands topic
+//
+// Times and spans combine units: 1d6h30m, 90s, 250ms. drift is the crystal's
+// error in ppm (positive runs millis() fast); heap is what is free to lwIP
+// once WiFi is up, the only heap the model tracks.
+#include <MqttPacket.h>
+#include <ReadingSchema.h>
+#include <Histogram.h>
+#include <HistoryCodec.h>
+#include <VirtualEsp32.h>
+
+#include "../../../firmware/src/device.h"
+#include "../../../firmware/src/history.h"
+#include "../../../firmware/src/memory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+void setup();
+void loop();
+
+namespace {
+
+const int64_t kStartEpochMs = 1767225600000LL;     // 2026-01-01 00:00 UTC
+const uint64_t kDayUs = 86400000000ULL;
+const uint64_t kLoopPassUs = 100;   // a loop() pass that neither waits nor reads the sensor
+const double kFlashCycles = 100000;
+
+const char* kDefaultScenario =
+    "duration 7d\n"
+    "drift 40\n"
+    "latency 25ms\n"
+    "at 6h wifi down 3m\n"
+    "at 1d2h broker slow 400ms 2h\n"
+    "at 1d9h sensor fail 10m\n"
+    "at 2d4h wifi down 2h\n"
+    "at 3d broker down 20m\n"
+    "at 3d12h latency 300ms 6h\n"
+    "at 4d1h ntp down 1d\n"
+    "at 4d18h broker stall 90s\n"
+    "at 5d7h sensor step +8 30m\n"
+    "at 5d20h wifi down 9h\n"
+    "at 6d12h command {\"action\":\"get-stats\",\"id\":\"sim\"}\n";
+
+struct Options {
+    const char* scenario = nullptr;
+    double days = 0;
+    uint64_t seed = 0;
+    bool seedSet = false;
+    const char* serial = nullptr;
+};
+
+Options options;
+
+uint64_t clock_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// "2d 04:00:00.000"
+std::string format_time(uint64_t us) {
+    uint64_t ms = us / 1000;
+    char text[32];
+    snprintf(text, sizeof(text), "%llud %02u:%02u:%02u.%03u", (unsigned long long)(ms / 86400000),
+             (unsigned)(ms / 3600000 % 24), (unsigned)(ms / 60000 % 60), (unsigned)(ms / 1000 % 60),
+             (unsigned)(ms % 1000));
+    return text;
+}
+
+// 1d6h30m, 90s, 250ms; a bare number is seconds
+bool parse_span(const char* text, uint64_t* us) {
+    uint64_t total = 0;
+    const char* p = text;
+    if (*p == '\0') {
+        return false;
+    }
+    while (*p != '\0') {
+        char* end;
+        double value = strtod(p, &end);
+        if (end == p || value < 0) {
+            return false;
+        }
+        p = end;
+        double unitUs = 1e6;
+        if (strncmp(p, "ms", 2) == 0) {
+            unitUs = 1e3;
+            p += 2;
+        } else if (*p == 'd' || *p == 'h' || *p == 'm' || *p == 's') {
+            unitUs = *p == 'd' ? 864e8 : *p == 'h' ? 36e8 : *p == 'm' ? 6e7 : 1e6;
+            p++;
+        } else if (*p != '\0') {
+            return false;
+        }
+        total += (uint64_t)llround(value * unitUs);
+    }
+    *us = total;
+    return true;
+}
+
+// Latency: 25ms or 1s, a bare number being milliseconds
+bool parse_ms(const char* text, uint32_t* ms) {
+    uint64_t us;
+    if (text[0] != '\0' && strspn(text, "0123456789") == strlen(text)) {
+        *ms = (uint32_t)strtoul(text, nullptr, 10);
+        return true;
+    }
+    if (!parse_span(text, &us)) {
+        return false;
+    }
+    *ms = (uint32_t)(us / 1000);
+    return true;
+}
+
+// --- Sensor ---
+
+// Deterministic for a given seed: a daily swing around 21 °C with humidity
+// moving against it, noise, the DHT22's 0.1 resolution
+struct SensorState {
+    uint64_t rng = 1;
+    bool failed = false;
+    float offset = 0;
+    uint32_t failedReads = 0;
+
+    double uniform() {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        return (double)(rng >> 11) / 9007199254740992.0;
+    }
+    double noise() {
+        return (uniform() + uniform() + uniform() - 1.5) * 0.1;
+    }
+};
+
+SensorState sensor;
+
+bool read_sensor(float* temperature, float* humidity) {
+    if (sensor.failed) {
+        sensor.failedReads++;
+        return false;
+    }
+    double dayPhase = (double)(sim::nowUs() % kDayUs) / kDayUs;
+    double swing = sin(2 * M_PI * (dayPhase - 0.375));
+    *temperature = roundf((float)(21 + 3 * swing + sensor.noise()) * 10) / 10 + sensor.offset;
+    *humidity = roundf((float)(50 - 8 * swing + 4 * sensor.noise()) * 10) / 10;
+    return true;
+}
+
+// --- NTP ---
+
+bool ntpDown = false;
+uint32_t ntpAnswered = 0;
+
+void write_ntp(int64_t epochMs, uint8_t* p) {
+    uint32_t seconds = (uint32_t)(epochMs / 1000) + 2208988800UL;
+    uint32_t fraction = (uint32_t)(((uint64_t)(epochMs % 1000) << 32) / 1000);
+    for (int i = 0; i < 4; i++) {
+        p[i] = seconds >> (24 - 8 * i);
+        p[4 + i] = fraction >> (24 - 8 * i);
+    }
+}
+
+int64_t true_epoch_ms() {
+    return kStartEpochMs + (int64_t)(sim::nowUs() / 1000);
+}
+
+void answer_ntp(const uint8_t* data, size_t length, std::vector<uint8_t>* reply) {
+    if (ntpDown || length < 48) {
+        return;
+    }
+    reply->assign(48, 0);
+    uint8_t* packet = reply->data();
+    packet[0] = 0x24;   // LI 0, version 4, mode 4 (server)
+    packet[1] = 2;
+    memcpy(packet + 24, data + 40, 8);
+    write_ntp(true_epoch_ms(), packet + 32);
+    write_ntp(true_epoch_ms(), packet + 40);
+    ntpAnswered++;
+}
+
+// --- Broker ---
+
+struct Results {
+    Histogram latencyMs;        // sample to broker, live telemetry
+    Histogram dayLatencyMs;
+    Histogram clockErrorMs;     // |timestamp - true time of the sample|, synced readings
+    std::vector<bool> seen;     // by seq
+    uint64_t delivered = 0;
+    uint64_t duplicates = 0;
+    uint64_t late = 0;          // over a minute from sample to broker
+    uint64_t undecodable = 0;
+    uint64_t unsynced = 0;
+    uint32_t backlogStreams = 0;
+    uint32_t backlogChunks = 0;
+    uint64_t backlogPoints = 0;
+    uint32_t alerts = 0;
+    uint32_t states = 0;
+    uint32_t presence = 0;
+    uint32_t responses = 0;
+    uint32_t connects = 0;
+    uint32_t wills = 0;
+    uint32_t keepaliveExpiries = 0;
+    uint32_t commandsSent = 0;
+    uint32_t commandsLost = 0;
+};
+
+Results results;
+
+bool ends_with(const std::string& text, const char* suffix) {
+    size_t n = strlen(suffix);
+    return text.size() >= n && text.compare(text.size() - n, n, suffix) == 0;
+}
+
+void record_telemetry(const uint8_t* payload, size_t length) {
+    std::vector<char> text(payload, payload + length);
+    telemetry::Reading reading = {};
+    if (codec::decodeJson(telemetry::kReadingSchema, text.data(), text.size(), reading) < 0) {
+        results.undecodable++;
+        return;
+    }
+    const std::vector<uint64_t>& reads = sim::sensorReads();
+    if (reading.seq >= reads.size()) {
+        results.undecodable++;
+        return;
+    }
+    if (reading.seq >= results.seen.size()) {
+        results.seen.resize(reading.seq + 1, false);
+    }
+    if (results.seen[reading.seq]) {
+        results.duplicates++;
+        return;
+    }
+    results.seen[reading.seq] = true;
+    results.delivered++;
+    uint64_t sampledUs = reads[reading.seq];
+    int64_t latencyMs = (int64_t)((sim::nowUs() - sampledUs) / 1000);
+    results.latencyMs.add(latencyMs);
+    results.dayLatencyMs.add(latencyMs);
+    if (latencyMs >= 60000) {
+        results.late++;
+    }
+    if (reading.timeSynced) {
+        int64_t errorMs = reading.timestampMs - (kStartEpochMs + (int64_t)(sampledUs / 1000));
+        results.clockErrorMs.add(errorMs < 0 ? -errorMs : errorMs);
+    } else {
+        results.unsynced++;
+    }
+}
+
+void record_backlog(const uint8_t* payload, size_t length) {
+    static LogRecord records[HISTORY_CHUNK_MAX_RECORDS];
+    history::ChunkHeader header;
+    int count = history::decodeChunk(payload, length, &header, records, HISTORY_CHUNK_MAX_RECORDS);
+    if (count < 0) {
+        results.undecodable++;
+        return;
+    }
+    results.backlogChunks++;
+    results.backlogPoints += count;
+    if (header.flags & history::kLastChunk) {
+        results.backlogStreams++;
+    }
+}
+
+// One MQTT 3.1.1 or 5 connection, as much broker as the firmware needs:
+// CONNACK (topic aliases and receive maximum under 5), PUBACK, SUBACK,
+// PINGRESP, the keep alive and the Last Will
+struct Session {
+    sim::Socket* socket;
+    uint8_t buffer[8192];
+    mqtt::PacketReader reader;
+    uint8_t level = 0;
+    bool will = false;
+    bool disconnected = false;
+    uint16_t keepAliveS = 0;
+    uint64_t lastSeenUs = 0;
+    std::map<uint16_t, std::string> aliases;
+
+    explicit Session(sim::Socket* s) : socket(s), reader(buffer, sizeof(buffer)) {}
+};
+
+class Broker : public sim::Server {
+public:
+    bool down = false;
+    uint64_t packetDelayUs = 0;
+    uint64_t stalledUntilUs = 0;
+    std::string commandTopic;
+
+    bool accept(sim::Socket* socket) override {
+        if (down) {
+            return false;
+        }
+        sessions_.emplace_back(socket);
+        socket->session = &sessions_.back();
+        return true;
+    }
+
+    // Packets are taken in arrival order, one at a time, each waiting for
+    // the broker to be free: a slow or stalled broker delays all of them
+    void receive(sim::Socket* socket, const uint8_t* data, size_t length) override {
+        uint64_t startUs = std::max(sim::nowUs(), std::max(busyUntilUs_, stalledUntilUs));
+        busyUntilUs_ = startUs + packetDelayUs;
+        std::vector<uint8_t> bytes(data, data + length);
+        sim::at(busyUntilUs_, [this, socket, bytes]() { process(socket, bytes); });
+    }
+
+    void closed(sim::Socket* socket) override {
+        Session* session = static_cast<Session*>(socket->session);
+        if (session != nullptr && session->will && !session->disconnected) {
+            results.wills++;
+        }
+    }
+
+    void setDown(bool isDown) {
+        down = isDown;
+        if (!isDown) {
+            return;
+        }
+        // Whatever was open goes with it; a dead broker publishes no wills
+        for (Session& session : sessions_) {
+            if (session.socket->open()) {
+                session.disconnected = true;
+                session.socket->close();
+            }
+        }
+    }
+
+    // QoS 0 on the commands topic of the device's live connection
+    bool publish(const std::string& topic, const std::string& payload) {
+        Session* session = live();
+        if (session == nullptr || down) {
+            return false;
+        }
+        uint8_t header[512];
+        size_t n = mqtt::encodePublishHeader(header, sizeof(header), topic.c_str(), topic.size(), payload.size(),
+                                             0, false, false, 0, session->level);
+        if (n == 0) {
+            return false;
+        }
+        std::vector<uint8_t> packet(header, header + n);
+        packet.insert(packet.end(), payload.begin(), payload.end());
+        session->socket->send(packet.data(), packet.size());
+        return true;
+    }
+
+private:
+    Session* live() {
+        for (auto it = sessions_.rbegin(); it != sessions_.rend(); ++it) {
+            if (it->socket->open()) {
+                return &*it;
+            }
+        }
+        return nullptr;
+    }
+
+    void send(Session& session, std::initializer_list<uint8_t> bytes) {
+        std::vector<uint8_t> packet(bytes);
+        session.socket->send(packet.data(), packet.size());
+    }
+
+    void process(sim::Socket* socket, const std::vector<uint8_t>& bytes) {
+        Session& session = *static_cast<Session*>(socket->session);
+        size_t offset = 0;
+        while (socket->open() && offset < bytes.size()) {
+            offset += session.reader.feed(bytes.data() + offset, bytes.size() - offset);
+            if (session.reader.ready()) {
+                handle(session);
+                session.reader.reset();
+            }
+        }
+        if (socket->open()) {
+            session.lastSeenUs = sim::nowUs();
+            watch_keepalive(session);
+        }
+    }
+
+    // The broker drops a client silent for 1.5 × its keep alive. Its timers
+    // stop with it: while busy or stalled it looks again once it catches up.
+    void watch_keepalive(Session& session) {
+        if (session.keepAliveS == 0) {
+            return;
+        }
+        check_keepalive(&session, session.lastSeenUs + (uint64_t)session.keepAliveS * 1500000);
+    }
+
+    void check_keepalive(Session* session, uint64_t atUs) {
+        sim::at(atUs, [this, session]() {
+            uint64_t limitUs = (uint64_t)session->keepAliveS * 1500000;
+            uint64_t freeUs = std::max(busyUntilUs_, stalledUntilUs);
+            if (!session->socket->open() || sim::nowUs() - session->lastSeenUs < limitUs) {
+                return;
+            }
+            if (sim::nowUs() < freeUs) {
+                check_keepalive(session, freeUs);
+                return;
+            }
+            results.keepaliveExpiries++;
+            if (session->will) {
+                results.wills++;
+            }
+            session->disconnected = true;
+            session->socket->close();
+        });
+    }
+
+    void handle(Session& session) {
+        const uint8_t* body = session.reader.body();
+        size_t length = session.reader.bodyLength();
+        switch (session.reader.type()) {
+            case mqtt::kConnect:
+                results.connects++;
+                session.level = body[6];
+                session.will = (body[7] & 0x04) != 0;
+                session.keepAliveS = mqtt::read16(body + 8);
+                if (session.level == mqtt::kProtocol5) {
+                    send(session, {0x20, 9, 0, 0, 6, 0x22, 0, 10, 0x21, 0, 20});
+                } else {
+                    send(session, {0x20, 2, 0, 0});
+                }
+                break;
+
+            case mqtt::kPublish: {
+                uint8_t qos = (session.reader.flags() >> 1) & 0x03;
+                size_t topicLength = mqtt::read16(body);
+                std::string topic((const char*)body + 2, topicLength);
+                size_t offset = 2 + topicLength;
+                uint16_t packetId = 0;
+                if (qos > 0) {
+                    packetId = mqtt::read16(body + offset);
+                    offset += 2;
+                }
+                if (session.level == mqtt::kProtocol5) {
+                    uint32_t propertiesLength;
+                    offset += mqtt::readVarint(body + offset, length - offset, &propertiesLength);
+                    size_t end = offset + propertiesLength;
+                    while (offset < end) {
+                        uint8_t id = body[offset++];
+                        if (id != 0x23) {
+                            offset = end;   // the client sends no other property
+                            break;
+                        }
+                        uint16_t alias = mqtt::read16(body + offset);
+                        offset += 2;
+                        if (topicLength > 0) {
+                            session.aliases[alias] = topic;
+                        } else {
+                            topic = session.aliases[alias];
+                        }
+                    }
+                }
+                deliver(topic, body + offset, length - offset);
+                if (qos == 1) {
+                    send(session, {0x40, 2, (uint8_t)(packetId >> 8), (uint8_t)packetId});
+                }
+                break;
+            }
+
+            case mqtt::kSubscribe: {
+                size_t offset = 2;
+                if (session.level == mqtt::kProtocol5) {
+                    uint32_t propertiesLength;
+                    offset += mqtt::readVarint(body + offset, length - offset, &propertiesLength);
+                    offset += propertiesLength;
+                }
+                std::string filter((const char*)body + offset + 2, mqtt::read16(body + offset));
+                // The first one is the device's own commands topic
+                if (commandTopic.empty()) {
+                    commandTopic = filter;
+                }
+                if (session.level == mqtt::kProtocol5) {
+                    send(session, {0x90, 4, body[0], body[1], 0, 0});
+                } else {
+                    send(session, {0x90, 3, body[0], body[1], 0});
+                }
+                break;
+            }
+
+            case mqtt::kPingreq:
+                send(session, {0xD0, 0});
+                break;
+
+            case mqtt::kDisconnect:
+                session.disconnected = true;
+                session.socket->close();
+                break;
+        }
+    }
+
+    void deliver(const std::string& topic, const uint8_t* payload, size_t length) {
+        if (ends_with(topic, "/telemetry")) {
+            record_telemetry(payload, length);
+        } else if (ends_with(topic, "/history/backlog")) {
+            record_backlog(payload, length);
+        } else if (ends_with(topic, "/alerts")) {
+            results.alerts++;
+        } else if (ends_with(topic, "/state")) {
+            results.states++;
+        } else if (ends_with(topic, "/status")) {
+            results.presence++;
+        } else if (ends_with(topic, "/responses")) {
+            results.responses++;
+            printf("%s  response %.*s\n", format_time(sim::nowUs()).c_str(), (int)length, (const char*)payload);
+        }
+    }
+
+    std::deque<Session> sessions_;
+    uint64_t busyUntilUs_ = 0;
+};
+
+Broker broker;
+
+// --- Scenario ---
+
+struct Scenario {
+    uint64_t durationUs = 7 * kDayUs;
+    double driftPpm = 0;
+    uint32_t latencyMs = 20;
+    int8_t rssi = -60;
+    uint32_t heapBytes = 160000;
+    uint32_t joinMs = 2000;
+    uint64_t seed = 1;
+    std::vector<std::pair<uint64_t, std::string>> events;   // true µs, the rest of the line
+};
+
+Scenario scenario;
+
+bool parse_scenario(const std::string& text, const char* name) {
+    size_t start = 0;
+    int line = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string content = text.substr(start, end - start);
+        start = end + 1;
+        line++;
+        for (size_t i = 0; i < content.size(); i++) {
+            if (content[i] == '#' && (i == 0 || content[i - 1] == ' ' || content[i - 1] == '\t')) {
+                content.erase(i);
+                break;
+            }
+        }
+        content.erase(content.find_last_not_of(" \t\r") + 1);
+        char key[16] = "";
+        char value[64] = "";
+        int consumed = 0;
+        if (sscanf(content.c_str(), " %15s%n", key, &consumed) != 1) {
+            continue;
+        }
+        bool ok = true;
+        if (strcmp(key, "at") == 0) {
+            uint64_t atUs;
+            int rest = 0;
+            ok = sscanf(content.c_str() + consumed, " %63s %n", value, &rest) == 1 && parse_span(value, &atUs);
+            if (ok) {
+                scenario.events.push_back(std::make_pair(atUs, content.substr(consumed + rest)));
+            }
+        } else if (sscanf(content.c_str() + consumed, " %63s", value) != 1) {
+            ok = false;
+        } else if (strcmp(key, "duration") == 0) {
+            ok = parse_span(value, &scenario.durationUs);
+        } else if (strcmp(key, "drift") == 0) {
+            scenario.driftPpm = atof(value);
+        } else if (strcmp(key, "latency") == 0) {
+            ok = parse_ms(value, &scenario.latencyMs);
+        } else if (strcmp(key, "rssi") == 0) {
+            scenario.rssi = (int8_t)atoi(value);
+        } else if (strcmp(key, "heap") == 0) {
+            scenario.heapBytes = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(key, "join") == 0) {
+            uint64_t us;
+            ok = parse_span(value, &us);
+            scenario.joinMs = (uint32_t)(us / 1000);
+        } else if (strcmp(key, "seed") == 0) {
+            scenario.seed = strtoull(value, nullptr, 10);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s:%d: cannot parse '%s'\n", name, line, content.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Undoes a change once its FOR span is over, if the line gave one
+void restore_after(const char* span, sim::Action undo) {
+    uint64_t us;
+    if (span != nullptr && parse_span(span, &us)) {
+        sim::at(sim::nowUs() + us, undo);
+    }
+}
+
+// Runs one "at" line; returns false if it is not understood
+bool apply_event(const std::string& line) {
+    char what[16] = "";
+    char arg[64] = "";
+    char span[32] = "";
+    int fields = sscanf(line.c_str(), "%15s %63s %31s", what, arg, span);
+    const char* forSpan = fields >= 3 ? span : nullptr;
+    printf("%s  %s\n", format_time(sim::nowUs()).c_str(), line.c_str());
+
+    if (strcmp(what, "wifi") == 0) {
+        bool up = strcmp(arg, "up") == 0;
+        sim::setLink(up);
+        if (!up) {
+            restore_after(forSpan, []() { sim::setLink(true); });
+        }
+        return up || strcmp(arg, "down") == 0;
+    }
+    if (strcmp(what, "sensor") == 0) {
+        if (strcmp(arg, "fail") == 0) {
+            sensor.failed = true;
+            restore_after(forSpan, []() { sensor.failed = false; });
+        } else if (strcmp(arg, "ok") == 0) {
+            sensor.failed = false;
+        } else if (strcmp(arg, "step") == 0 && fields >= 3) {
+            char step[32] = "";
+            char stepSpan[32] = "";
+            int stepFields = sscanf(line.c_str(), "%*s %*s %31s %31s", step, stepSpan);
+            float delta = (float)atof(step);
+            sensor.offset += delta;
+            restore_after(stepFields >= 2 ? stepSpan : nullptr, [delta]() { sensor.offset -= delta; });
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (strcmp(what, "broker") == 0) {
+        if (strcmp(arg, "down") == 0) {
+            broker.setDown(true);
+            restore_after(forSpan, []() { broker.setDown(false); });
+        } else if (strcmp(arg, "up") == 0) {
+            broker.setDown(false);
+        } else if (strcmp(arg, "slow") == 0 && fields >= 3) {
+            char slowSpan[32] = "";
+            uint64_t delayUs;
+            int slowFields = sscanf(line.c_str(), "%*s %*s %*s %31s", slowSpan);
+            if (!parse_span(span, &delayUs)) {
+                return false;
+            }
+            broker.packetDelayUs = delayUs;
+            restore_after(slowFields >= 1 ? slowSpan : nullptr, []() { broker.packetDelayUs = 0; });
+        } else if (strcmp(arg, "stall") == 0 && fields >= 3) {
+            uint64_t stallUs;
+            if (!parse_span(span, &stallUs)) {
+                return false;
+            }
+            broker.stalledUntilUs = sim::nowUs() + stallUs;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (strcmp(what, "latency") == 0) {
+        uint32_t ms;
+        if (!parse_ms(arg, &ms)) {
+            return false;
+        }
+        uint32_t previous = sim::latencyMs();
+        sim::setLatencyMs(ms);
+        restore_after(forSpan, [previous]() { sim::setLatencyMs(previous); });
+        return true;
+    }
+    if (strcmp(what, "ntp") == 0) {
+        ntpDown = strcmp(arg, "down") == 0;
+        if (ntpDown) {
+            restore_after(forSpan, []() { ntpDown = false; });
+        }
+        return ntpDown || strcmp(arg, "up") == 0;
+    }
+    if (strcmp(what, "rssi") == 0) {
+        sim::setRssi((int8_t)atoi(arg));
+        return true;
+    }
+    if (strcmp(what, "command") == 0) {
+        std::string payload = line.substr(line.find("command") + 7);
+        payload.erase(0, payload.find_first_not_of(' '));
+        results.commandsSent++;
+        if (broker.commandTopic.empty() || !broker.publish(broker.commandTopic, payload)) {
+            results.commandsLost++;
+            printf("%s  command lost: the device is not connected\n", format_time(sim::nowUs()).c_str());
+        }
+        return true;
+    }
+    return false;
+}
+
+// --- Report ---
+
+struct DayMark {
+    uint64_t sampled = 0;
+    uint64_t delivered = 0;
+    uint32_t connects = 0;
+    uint64_t wifiDownUs = 0;
+};
+
+DayMark dayMark;
+
+void print_day(uint32_t day) {
+    sim::WifiStats wifi = sim::wifiStats();
+    sim::HeapStats heap = sim::heap().stats();
+    uint64_t sampled = sim::sensorReads().size();
+    printf("day %-3u %7llu sampled %7llu delivered  latency p50 %5u p99 %6u max %6lld ms  %3u connects  "
+           "WiFi down %5llu s  heap free %6u min %6u\n",
+           day, (unsigned long long)(sampled - dayMark.sampled),
+           (unsigned long long)(results.delivered - dayMark.delivered), results.dayLatencyMs.percentile(0.5),
+           results.dayLatencyMs.percentile(0.99), (long long)results.dayLatencyMs.max,
+           results.connects - dayMark.connects, (unsigned long long)((wifi.downUs - dayMark.wifiDownUs) / 1000000),
+           heap.free, heap.minFree);
+    fflush(stdout);
+    dayMark.sampled = sampled;
+    dayMark.delivered = results.delivered;
+    dayMark.connects = results.connects;
+    dayMark.wifiDownUs = wifi.downUs;
+    results.dayLatencyMs.clear();
+}
+
+void schedule_days(uint32_t day) {
+    sim::at(day * kDayUs, [day]() {
+        print_day(day);
+        schedule_days(day + 1);
+    });
+}
+
+void print_report(uint64_t wallUs, bool restarted) {
+    double simulatedS = sim::nowUs() / 1e6;
+    double wallS = wallUs / 1e6;
+    printf("\n");
+    printf("simulated       %s in %.2f s wall (%.0fx real time, %llu events)%s\n",
+           format_time(sim::nowUs()).c_str(), wallS, wallS > 0 ? simulatedS / wallS : 0,
+           (unsigned long long)sim::eventsRun(), restarted ? ", ended by a restart" : "");
+
+    uint64_t sampled = sim::sensorReads().size();
+    printf("readings        %llu sampled (%u failed reads), %llu delivered live, %llu never live, "
+           "%llu duplicates, %llu undecodable\n",
+           (unsigned long long)sampled, sensor.failedReads, (unsigned long long)results.delivered,
+           (unsigned long long)(sampled - results.delivered), (unsigned long long)results.duplicates,
+           (unsigned long long)results.undecodable);
+    printf("latency         p50 %u ms, p90 %u ms, p99 %u ms, max %lld ms, %llu over a minute\n",
+           results.latencyMs.percentile(0.5), results.latencyMs.percentile(0.9),
+           results.latencyMs.percentile(0.99), (long long)results.latencyMs.max,
+           (unsigned long long)results.late);
+    printf("backlog         %u streams, %u chunks, %llu points\n", results.backlogStreams, results.backlogChunks,
+           (unsigned long long)results.backlogPoints);
+    printf("clock error     p50 %u ms, p99 %u ms, max %lld ms over %llu synced readings (%llu unsynced); "
+           "crystal %.1f ppm, estimated %.1f\n",
+           results.clockErrorMs.percentile(0.5), results.clockErrorMs.percentile(0.99),
+           (long long)results.clockErrorMs.max, (unsigned long long)results.clockErrorMs.count,
+           (unsigned long long)results.unsynced, scenario.driftPpm, -epochClock.driftPpm());
+    printf("NTP             %u answered, %u failures on the device\n", ntpAnswered, sntp.failures());
+
+    MqttOutbox::Stats outboxStats = client.stats();
+    printf("MQTT            %u connects, %u keep alive expiries, %u wills; outbox %u queued, %u delivered, "
+           "%u retransmitted, %u expired, %u left\n",
+           results.connects, results.keepaliveExpiries, results.wills, outboxStats.queued, outboxStats.delivered,
+           outboxStats.retransmitted, outboxStats.expired, outboxStats.depth);
+    printf("other topics    %u alerts, %u state, %u presence, %u responses to %u commands (%u lost)\n",
+           results.alerts, results.states, results.presence, results.responses, results.commandsSent,
+           results.commandsLost);
+
+    sim::WifiStats wifi = sim::wifiStats();
+    printf("WiFi            %u drops, %u joins, down %.1f min in total\n", wifi.drops, wifi.joins,
+           wifi.downUs / 6e7);
+
+    MemoryStats memory = memory_stats();
+    sim::HeapStats heap = sim::heap().stats();
+    printf("heap            %u of %u free, min %u, largest block %u (min %u), fragmentation max %u%%, "
+           "%u low memory events\n",
+           memory.freeHeap, heap.size, memory.minFreeHeap, memory.largestBlock, memory.minLargestBlock,
+           memory.fragmentationMax, memory.lowMemoryEvents);
+    printf("                %u allocations, %u failed, %u live blocks\n", heap.allocations, heap.failures,
+           heap.liveBlocks);
+    printf("message arena   %u of %u bytes at most, %u reserved at boot, %u failures\n", memory.arena.highWater,
+           memory.arena.capacity, memory.arena.reserved, memory.arena.failures);
+
+    sim::FlashStats flash = sim::flashStats(HISTORY_PARTITION);
+    HistoryStats historyStats = history_stats();
+    double days = simulatedS / 86400;
+    printf("history flash   %u readings stored, %.1f KB written, %u erases, most erased sector %u",
+           historyStats.stored, flash.bytesWritten / 1024.0, flash.erases, flash.maxSectorErases);
+    if (flash.maxSectorErases > 0 && days > 0) {
+        printf(" (%.0f years to %.0fk cycles)", kFlashCycles / (flash.maxSectorErases / days) / 365, kFlashCycles / 1000);
+    }
+    printf("\n");
+    sim::NvsStats nvs = sim::nvsStats();
+    printf("NVS             %u writes, %u bytes\n", nvs.writes, nvs.bytesWritten);
+}
+
+void usage(const char* program) {
+    fprintf(stderr, "usage: %s [scenario.txt] [--days N] [--seed N] [--serial FILE|-]\n", program);
+}
+
+bool parse_options(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--days") == 0 && hasValue) {
+            options.days = atof(argv[++i]);
+        } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+            options.seed = strtoull(argv[++i], nullptr, 10);
+            options.seedSet = true;
+        } else if (strcmp(arg, "--serial") == 0 && hasValue) {
+            options.serial = argv[++i];
+        } else if (arg[0] != '-' && options.scenario == nullptr) {
+            options.scenario = arg;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool load_scenario() {
+    if (options.scenario == nullptr) {
+        return parse_scenario(kDefaultScenario, "built-in");
+    }
+    FILE* file = fopen(options.scenario, "r");
+    if (file == nullptr) {
+        perror(options.scenario);
+        return false;
+    }
+    std::string text;
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        text.append(chunk, n);
+    }
+    fclose(file);
+    return parse_scenario(text, options.scenario);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (!parse_options(argc, argv)) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!load_scenario()) {
+        return 2;
+    }
+    if (options.days > 0) {
+        scenario.durationUs = (uint64_t)(options.days * kDayUs);
+    }
+    if (options.seedSet) {
+        scenario.seed = options.seed;
+    }
+
+    FILE* serialOut = nullptr;
+    if (options.serial != nullptr) {
+        serialOut = strcmp(options.serial, "-") == 0 ? stdout : fopen(options.serial, "w");
+        if (serialOut == nullptr) {
+            perror(options.serial);
+            return 1;
+        }
+    }
+    sim::setSerial(serialOut);
+    sim::setDriftPpm(scenario.driftPpm);
+    sim::setLatencyMs(scenario.latencyMs);
+    sim::setRssi(scenario.rssi);
+    sim::setJoinMs(scenario.joinMs);
+    sim::heap().reset(scenario.heapBytes);
+    sensor.rng = scenario.seed * 0x9E3779B97F4A7C15ULL | 1;
+    sim::setSensor(read_sensor);
+    sim::setDatagramHandler(answer_ntp);
+    sim::setServer(&broker);
+
+    for (const auto& event : scenario.events) {
+        std::string line = event.second;
+        sim::at(event.first, [line]() {
+            if (!apply_event(line)) {
+                printf("%s  not understood, ignored\n", format_time(sim::nowUs()).c_str());
+            }
+        });
+    }
+    schedule_days(1);
+    printf("simulating %s of device time, drift %.1f ppm, seed %llu\n", format_time(scenario.durationUs).c_str(),
+           scenario.driftPpm, (unsigned long long)scenario.seed);
+
+    uint64_t startUs = clock_us();
+    bool restarted = false;
+    try {
+        setup();
+        while (sim::nowUs() < scenario.durationUs) {
+            uint64_t before = sim::nowUs();
+            loop();
+            if (sim::nowUs() == before) {
+                sim::advance(kLoopPassUs);
+            }
+        }
+    } catch (const sim::Restart&) {
+        // The firmware's globals cannot start over in place
+        restarted = true;
+    }
+    print_report(clock_us() - startUs, restarted);
+    if (serialOut != nullptr && serialOut != stdout) {
+        fclose(serialOut);
+    }
+    return 0;
+}
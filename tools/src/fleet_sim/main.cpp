@@ -0,0 +1,874 @@
+// Fleet simulator: thousands of virtual ESP32s on one Linux thread, each
+// running the firmware's own logic against a real MQTT broker.
+//
+// Every device has the firmware's MqttClient and MqttOutbox, AdaptiveSampler,
+// AnomalyDetector, TopicScheme, the TelemetryPayload writers and a
+// CommandDispatcher, wired as src/main.cpp wires them: same topics, payloads,
+// retained state and presence, backpressure, reconnect delay and keep alive.
+// Only the DHT22 (a random walk with the odd step change) and WiFi (a fixed
+// RSSI per device) are fake. Devices are state machines driven by one epoll
+// loop and a timer heap; the sockets are non-blocking and each one is a real
+// TCP connection to the broker.
+//
+//   program [--host 127.0.0.1] [--port 1883] [--devices 10000] [--duration 60]
+//           [--ramp 500] [--protocol 5] [--sites 10] [--outbox 8] [--report 5]
+//           [--seed 1]
+//
+// --ramp is devices started per second. Prints publish rate, acks, connect
+// latency and failures every --report seconds, and CPU use at the end.
+#include <AdaptiveSampler.h>
+#include <AnomalyDetector.h>
+#include <CommandDispatcher.h>
+#include <HeatIndex.h>
+#include <MqttClient.h>
+#include <TelemetryPayload.h>
+#include <TopicScheme.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <queue>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Firmware defaults from include/config_defaults.h
+const uint32_t kSampleIntervalMin = 2000;
+const uint32_t kSampleIntervalMax = 60000;
+const uint32_t kPublishInterval = 5000;
+const uint32_t kReconnectDelay = 10000;
+const uint32_t kInflightWindow = 8;
+const uint32_t kMessageMaxAge = 3600000;
+const float kStateTempDelta = 0.5f;
+const float kStateHumDelta = 2.0f;
+const char* kTenant = "5a728254-5316-45c6-bf3c-de194f1afa53";
+
+const AdaptiveSampler::Config kSamplerConfig = {
+    kSampleIntervalMin,
+    kSampleIntervalMax,
+    kPublishInterval,
+    60000,
+    1.5f,
+    3,
+    2,
+    {
+        {0.05f, 0.01f, 0.30f, 0.15f},
+        {0.25f, 0.05f, 1.50f, 0.75f},
+    },
+};
+
+const AnomalyDetector::Config kDetectorConfig = {
+    0.05f,
+    4.0f,
+    2.0f,
+    0.2f,
+    20,
+    2,
+    {
+        {0.0f, 35.0f, 0.5f},
+        {10.0f, 90.0f, 2.0f},
+    },
+};
+
+const char* const kChannelNames[2] = {"temperature", "humidity"};
+
+// Devices wake at least this often so keep alive and timeouts run
+const uint32_t kTickMs = 1000;
+// Time a rebooting device stays away, roughly boot plus WiFi
+const uint32_t kRebootMs = 3000;
+
+struct Options {
+    const char* host = "127.0.0.1";
+    uint16_t port = 1883;
+    uint32_t devices = 10000;
+    uint32_t durationS = 60;
+    uint32_t ramp = 500;
+    uint8_t protocol = mqtt::kProtocol5;
+    uint32_t sites = 10;
+    uint32_t outbox = 8;
+    uint32_t reportS = 5;
+    uint32_t seed = 1;
+};
+
+uint64_t nowUs = 0;
+
+uint64_t clock_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t now_ms() {
+    return (uint32_t)(nowUs / 1000);
+}
+
+// Wall clock, as a synced EpochClock would give it
+int64_t epoch_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint32_t micros_now() {
+    return (uint32_t)clock_us();
+}
+
+struct Rng {
+    uint32_t state;
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+// A room: slow drift, sensor noise, and now and then a step (a door, the
+// heating) that sends the sampler fast and may raise an alert
+struct FakeDht {
+    float temperature;
+    float humidity;
+    float temperatureTarget;
+    float humidityTarget;
+
+    void read(Rng& rng, float* t, float* h) {
+        if (rng.uniform() < 0.003f) {
+            temperatureTarget += (rng.uniform() - 0.5f) * 8;
+            humidityTarget += (rng.uniform() - 0.5f) * 20;
+        }
+        temperature += (temperatureTarget - temperature) * 0.1f + (rng.uniform() - 0.5f) * 0.1f;
+        humidity += (humidityTarget - humidity) * 0.1f + (rng.uniform() - 0.5f) * 0.4f;
+        humidity = std::min(100.0f, std::max(0.0f, humidity));
+        // The DHT22 reports one decimal
+        *t = roundf(temperature * 10) / 10;
+        *h = roundf(humidity * 10) / 10;
+    }
+};
+
+struct Device;
+
+// Non-blocking TCP socket on the shared epoll set. Writes go through a small
+// buffer, like AsyncTcpTransport's, so writable() has an honest answer.
+class SocketTransport : public MqttTransport {
+public:
+    static const size_t kBuffer = 2048;
+
+    void attach(int epoll, Device* owner) {
+        epoll_ = epoll;
+        owner_ = owner;
+    }
+
+    bool connect(const char* host, uint16_t port) override;
+    bool connected() override { return state_ == kOpen; }
+    size_t writable() override { return state_ == kOpen ? kBuffer - (end_ - start_) : 0; }
+    size_t write(const uint8_t* data, size_t length) override {
+        if (length > writable()) {
+            return 0;
+        }
+        if (kBuffer - end_ < length) {
+            memmove(buffer_, buffer_ + start_, end_ - start_);
+            end_ -= start_;
+            start_ = 0;
+        }
+        memcpy(buffer_ + end_, data, length);
+        end_ += length;
+        flush();
+        return length;
+    }
+    size_t read(uint8_t* data, size_t length) override {
+        if (state_ != kOpen) {
+            return 0;
+        }
+        ssize_t n = recv(fd_, data, length, 0);
+        if (n > 0) {
+            return n;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            close();
+        }
+        return 0;
+    }
+    void stop() override { close(); }
+    void poll() override { flush(); }
+
+    // Called by the event loop for this socket
+    void onEvent(uint32_t events) {
+        if (state_ == kConnecting && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error != 0) {
+                close();
+                return;
+            }
+            state_ = kOpen;
+        }
+        if (state_ == kOpen && (events & EPOLLOUT)) {
+            flush();
+        }
+    }
+
+private:
+    enum State : uint8_t { kClosed, kConnecting, kOpen };
+
+    void flush() {
+        while (state_ == kOpen && end_ > start_) {
+            ssize_t n = send(fd_, buffer_ + start_, end_ - start_, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    close();
+                }
+                break;
+            }
+            start_ += n;
+        }
+        if (start_ == end_) {
+            start_ = end_ = 0;
+        }
+        watch(state_ == kConnecting || (state_ == kOpen && end_ > start_));
+    }
+
+    // EPOLLOUT only while there is something to wait for
+    void watch(bool out) {
+        if (fd_ < 0 || out == watchingOut_) {
+            return;
+        }
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP | (out ? EPOLLOUT : 0);
+        event.data.ptr = owner_;
+        epoll_ctl(epoll_, EPOLL_CTL_MOD, fd_, &event);
+        watchingOut_ = out;
+    }
+
+    void close() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+        fd_ = -1;
+        state_ = kClosed;
+        start_ = end_ = 0;
+    }
+
+    int epoll_ = -1;
+    Device* owner_ = nullptr;
+    int fd_ = -1;
+    State state_ = kClosed;
+    bool watchingOut_ = false;
+    uint8_t buffer_[kBuffer];
+    size_t start_ = 0;
+    size_t end_ = 0;
+};
+
+sockaddr_in brokerAddress = {};
+
+bool SocketTransport::connect(const char*, uint16_t) {
+    close();
+    fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd_ < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (::connect(fd_, (sockaddr*)&brokerAddress, sizeof(brokerAddress)) < 0 && errno != EINPROGRESS) {
+        close();
+        return false;
+    }
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    event.data.ptr = owner_;
+    if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd_, &event) < 0) {
+        close();
+        return false;
+    }
+    watchingOut_ = true;
+    state_ = kConnecting;
+    return true;
+}
+
+struct Device {
+    Device(uint32_t index, const Options& options)
+        : index(index),
+          slots(new MqttOutbox::Slot[options.outbox]()),
+          outbox(slots.get(), options.outbox, kInflightWindow, kMessageMaxAge),
+          client(transport, outbox, now_ms),
+          sampler(kSamplerConfig),
+          detector(kDetectorConfig),
+          stateFilter(kStateTempDelta, kStateHumDelta) {
+        // Locally administered MACs, 02:00:00 plus the index
+        uint8_t mac[6] = {0x02, 0x00, 0x00, (uint8_t)(index >> 16), (uint8_t)(index >> 8), (uint8_t)index};
+        snprintf(clientId, sizeof(clientId), "ESP32-%02X%02X%02X%02X%02X%02X", mac[0], mac[1], mac[2], mac[3],
+                 mac[4], mac[5]);
+        snprintf(deviceId, sizeof(deviceId), "ESP32-%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2],
+                 mac[3], mac[4], mac[5]);
+        char site[16];
+        snprintf(site, sizeof(site), "site-%u", index % options.sites);
+        size_t topicBytes = TopicScheme::storageSize(kTenant, site, clientId);
+        topicStorage.reset(new char[topicBytes]);
+        topics.build(kTenant, site, clientId, topicStorage.get(), topicBytes);
+        commandTopics[0].set(topics.commands());
+        commandTopics[1].set(topics.siteCommands());
+        commandTopics[2].set(topics.tenantCommands());
+
+        rng.state = options.seed * 2654435761u + index * 40503u + 1;
+        dht.temperatureTarget = dht.temperature = 19 + rng.uniform() * 6;
+        dht.humidityTarget = dht.humidity = 35 + rng.uniform() * 25;
+        rssi = -40 - (int)(rng.next() % 45);
+        client.setServer(options.host, options.port);
+        client.setProtocol(options.protocol);
+        client.setWill(topics.status(), (const uint8_t*)telemetry::kWill, telemetry::kWillLength, true);
+    }
+
+    uint32_t index;
+    SocketTransport transport;
+    std::unique_ptr<MqttOutbox::Slot[]> slots;
+    MqttOutbox outbox;
+    MqttClient client;
+    AdaptiveSampler sampler;
+    AnomalyDetector detector;
+    telemetry::StateFilter stateFilter;
+    std::unique_ptr<char[]> topicStorage;
+    TopicScheme topics;
+    TopicMatcher commandTopics[3];
+    char clientId[24];
+    char deviceId[24];
+    Rng rng;
+    FakeDht dht;
+    int rssi;
+    uint32_t seq = 0;               // readings since boot, as the firmware counts them
+
+    bool attempted = false;
+    bool attemptPending = false;
+    bool wasConnected = false;
+    uint32_t lastAttemptMs = 0;
+    uint64_t attemptStartUs = 0;
+    uint32_t nextSampleMs = 0;
+    uint32_t rebootAtMs = 0;        // schedule_reboot()
+    uint32_t offlineUntilMs = 0;    // rebooting
+    uint32_t wakeMs = 0;
+};
+
+struct Counters {
+    uint64_t readings = 0;
+    uint64_t queueFailures = 0;
+    uint64_t alerts = 0;
+    uint64_t stateUpdates = 0;
+    uint64_t connectAttempts = 0;
+    uint64_t connects = 0;
+    uint64_t connectFailures = 0;
+    uint64_t disconnects = 0;
+    uint64_t commands = 0;
+    uint64_t reboots = 0;
+};
+
+Options options;
+std::vector<std::unique_ptr<Device>> fleet;
+Counters counters;
+std::vector<uint32_t> connectLatencyUs;
+Device* current = nullptr;      // MqttClient callbacks carry no context
+volatile sig_atomic_t stopRequested = 0;
+
+// --- Commands, as src/commands.cpp handles them where it makes sense here ---
+
+bool cmd_read_now(JsonObjectConst, JsonObject) {
+    current->sampler.forceFast();
+    current->nextSampleMs = now_ms();
+    return true;
+}
+
+bool cmd_set_interval(JsonObjectConst request, JsonObject response) {
+    uint32_t minMs = request["min_ms"] | kSampleIntervalMin;
+    uint32_t maxMs = request["max_ms"] | kSampleIntervalMax;
+    if (minMs < kSampleIntervalMin || maxMs < minMs) {
+        response["error"] = "invalid interval";
+        return false;
+    }
+    current->sampler.setIntervals(minMs, maxMs);
+    response["min_ms"] = minMs;
+    response["max_ms"] = maxMs;
+    return true;
+}
+
+bool cmd_flush_buffer(JsonObjectConst, JsonObject response) {
+    current->client.flush();
+    MqttOutbox::Stats stats = current->client.stats();
+    response["queued"] = stats.depth;
+    response["in_flight"] = stats.inflight;
+    return true;
+}
+
+bool cmd_get_stats(JsonObjectConst, JsonObject response) {
+    AdaptiveSampler::Stats samplerStats = current->sampler.stats();
+    JsonObject sampling = response.createNestedObject("sampling");
+    sampling["samples"] = samplerStats.samplesTaken;
+    sampling["interval_ms"] = current->sampler.intervalMs();
+    MqttOutbox::Stats mqttStats = current->client.stats();
+    JsonObject mqttSection = response.createNestedObject("mqtt");
+    mqttSection["delivered"] = mqttStats.delivered;
+    mqttSection["retransmitted"] = mqttStats.retransmitted;
+    mqttSection["expired"] = mqttStats.expired;
+    mqttSection["queued"] = mqttStats.depth;
+    mqttSection["bytes_out"] = current->client.bytesOut();
+    mqttSection["protocol"] = current->client.protocol();
+    mqttSection["state_updates"] = current->stateFilter.updates();
+    response["uptime_ms"] = now_ms();
+    return true;
+}
+
+bool cmd_reboot(JsonObjectConst, JsonObject response) {
+    current->rebootAtMs = now_ms() + 1000;
+    response["reboot_in_ms"] = 1000;
+    return true;
+}
+
+constexpr command::Entry commandTable[] = {
+    COMMAND_ENTRY("set-interval", cmd_set_interval),
+    COMMAND_ENTRY("read-now", cmd_read_now),
+    COMMAND_ENTRY("flush-buffer", cmd_flush_buffer),
+    COMMAND_ENTRY("get-stats", cmd_get_stats),
+    COMMAND_ENTRY("reboot", cmd_reboot),
+};
+
+CommandDispatcher dispatcher(commandTable, sizeof(commandTable) / sizeof(commandTable[0]), micros_now);
+
+void handle_command(uint8_t* payload, size_t length) {
+    StaticJsonDocument<256> request;
+    StaticJsonDocument<512> response;
+    dispatcher.dispatch(payload, length, request, response);
+    response["dispatch_us"] = dispatcher.stats().lastUs;
+    const char* replyTo = request["reply_to"] | current->topics.responses();
+    char buffer[512];
+    size_t written = serializeJson(response, buffer, sizeof(buffer));
+    if (!current->client.publish(replyTo, (const uint8_t*)buffer, written, false)) {
+        current->client.enqueue(replyTo, (const uint8_t*)buffer, written, false);
+    }
+    counters.commands++;
+}
+
+void on_message(char* topic, uint8_t* payload, unsigned int length) {
+    size_t topicLength = strlen(topic);
+    for (const TopicMatcher& matcher : current->commandTopics) {
+        if (matcher.matches(topic, topicLength)) {
+            handle_command(payload, length);
+            return;
+        }
+    }
+}
+
+void publish_presence(Device& device, bool online) {
+    char buffer[128];
+    size_t length = telemetry::writePresence(online, epoch_ms(), true, buffer, sizeof(buffer));
+    if (length > 0 && !device.client.publish(device.topics.status(), (const uint8_t*)buffer, length, true) &&
+        online) {
+        device.client.enqueue(device.topics.status(), (const uint8_t*)buffer, length, true);
+    }
+}
+
+void on_connected() {
+    Device& device = *current;
+    device.attemptPending = false;
+    counters.connects++;
+    connectLatencyUs.push_back((uint32_t)(clock_us() - device.attemptStartUs));
+    for (const TopicMatcher& matcher : device.commandTopics) {
+        device.client.subscribe(matcher.topic());
+    }
+    publish_presence(device, true);
+}
+
+// --- The firmware's loop(), one pass -----------------------------------------
+
+// reconnect() in src/main.cpp
+void reconnect(Device& device, uint32_t now) {
+    if (device.client.connected() || device.client.connecting()) {
+        return;
+    }
+    if (device.attemptPending) {
+        device.attemptPending = false;
+        counters.connectFailures++;
+    }
+    if (device.attempted && now - device.lastAttemptMs < kReconnectDelay) {
+        return;
+    }
+    device.attempted = true;
+    device.lastAttemptMs = now;
+    device.attemptStartUs = clock_us();
+    counters.connectAttempts++;
+    device.attemptPending = device.client.connect(device.clientId);
+    if (!device.attemptPending) {
+        counters.connectFailures++;
+    }
+}
+
+void sample(Device& device, uint32_t now) {
+    int64_t epochMs = epoch_ms();
+    float temperature;
+    float humidity;
+    device.dht.read(device.rng, &temperature, &humidity);
+    float channels[2] = {temperature, humidity};
+
+    AnomalyDetector::Event events[AnomalyDetector::kMaxChannels];
+    uint8_t eventCount = device.detector.update(channels, events);
+    for (uint8_t i = 0; i < eventCount; i++) {
+        telemetry::Alert alert = {
+            device.deviceId,
+            epochMs,
+            true,
+            kChannelNames[events[i].channel],
+            AnomalyDetector::kindName(events[i].kind),
+            events[i].value,
+            events[i].mean,
+            events[i].z,
+        };
+        char buffer[256];
+        size_t length = telemetry::writeAlert(alert, buffer, sizeof(buffer));
+        // As the firmware: QoS 0 at once, the outbox if that fails
+        if (length > 0 && (device.client.publish(device.topics.alerts(), (const uint8_t*)buffer, length, false) ||
+                           device.client.enqueue(device.topics.alerts(), (const uint8_t*)buffer, length, false))) {
+            counters.alerts++;
+        }
+    }
+    if (eventCount > 0) {
+        device.sampler.forceFast();
+    }
+
+    // Sampled and published in the same step, so no publish delay
+    telemetry::Reading reading = {device.deviceId, epochMs, true, temperature, humidity,
+                                  heat_index(temperature, humidity), device.rssi, device.seq++, 0};
+    if (device.stateFilter.changed(temperature, humidity)) {
+        char buffer[192];
+        size_t length = telemetry::writeState(reading, buffer, sizeof(buffer));
+        if (length > 0 && device.client.enqueue(device.topics.state(), (const uint8_t*)buffer, length, true)) {
+            device.stateFilter.accept(temperature, humidity);
+            counters.stateUpdates++;
+        }
+    }
+
+    uint32_t delay = device.sampler.update(channels, now);
+    if (device.client.congested()) {
+        delay = std::min<uint32_t>(delay * 2, kSampleIntervalMax);
+    }
+    device.nextSampleMs = now + delay;
+
+    char buffer[256];
+    size_t length = telemetry::writeReading(reading, buffer, sizeof(buffer));
+    if (length > 0 && device.client.enqueue(device.topics.telemetry(), (const uint8_t*)buffer, length, false)) {
+        counters.readings++;
+    } else {
+        counters.queueFailures++;
+    }
+}
+
+struct Wake {
+    uint32_t atMs;
+    uint32_t index;
+    bool operator>(const Wake& other) const { return (int32_t)(atMs - other.atMs) > 0; }
+};
+std::priority_queue<Wake, std::vector<Wake>, std::greater<Wake>> timers;
+
+uint32_t earlier(uint32_t at, uint32_t candidate) {
+    return candidate != 0 && (int32_t)(candidate - at) < 0 ? candidate : at;
+}
+
+// One live timer per device; a wake that is superseded by an earlier one is
+// skipped when it comes off the heap
+void schedule(Device& device, uint32_t now) {
+    uint32_t at = now + kTickMs;
+    if (device.offlineUntilMs != 0) {
+        at = earlier(at, device.offlineUntilMs);
+    } else {
+        at = earlier(at, device.rebootAtMs);
+        at = earlier(at, device.nextSampleMs);
+    }
+    if ((int32_t)(at - now) <= 0) {
+        at = now + 1;
+    }
+    if (device.wakeMs != 0 && (int32_t)(device.wakeMs - at) <= 0) {
+        return;
+    }
+    device.wakeMs = at;
+    timers.push({at, device.index});
+}
+
+void step(Device& device) {
+    current = &device;
+    uint32_t now = now_ms();
+
+    if (device.rebootAtMs != 0 && (int32_t)(now - device.rebootAtMs) >= 0) {
+        // schedule_reboot() then the reboot path in loop(): offline, DISCONNECT
+        device.rebootAtMs = 0;
+        if (device.client.connected()) {
+            publish_presence(device, false);
+            device.client.disconnect();
+        }
+        device.wasConnected = false;
+        device.attempted = false;
+        device.attemptPending = false;
+        device.offlineUntilMs = now + kRebootMs;
+        device.seq = 0;
+        counters.reboots++;
+    }
+    if (device.offlineUntilMs != 0) {
+        if ((int32_t)(now - device.offlineUntilMs) < 0) {
+            schedule(device, now);
+            return;
+        }
+        device.offlineUntilMs = 0;
+        device.nextSampleMs = now;
+    }
+
+    reconnect(device, now);
+    device.client.loop();
+    if (device.wasConnected && !device.client.connected()) {
+        counters.disconnects++;
+    }
+    device.wasConnected = device.client.connected();
+
+    if ((int32_t)(now - device.nextSampleMs) >= 0) {
+        sample(device, now);
+    }
+    schedule(device, now);
+}
+
+uint32_t percentile(std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+double cpu_seconds() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+struct Totals {
+    uint64_t delivered;
+    uint64_t retransmitted;
+    uint64_t expired;
+    uint64_t bytesOut;
+    uint32_t connected;
+};
+
+Totals totals() {
+    Totals t = {};
+    for (const std::unique_ptr<Device>& device : fleet) {
+        MqttOutbox::Stats stats = device->client.stats();
+        t.delivered += stats.delivered;
+        t.retransmitted += stats.retransmitted;
+        t.expired += stats.expired;
+        t.bytesOut += device->client.bytesOut();
+        t.connected += device->wasConnected ? 1 : 0;
+    }
+    return t;
+}
+
+void report(double elapsedS, double intervalS, const Counters& before, const Totals& totalsBefore,
+            const Totals& now) {
+    std::vector<uint32_t> latencies = connectLatencyUs;
+    std::sort(latencies.begin(), latencies.end());
+    printf("%6.0f s  %6u up  %8.0f pub/s  %8.0f ack/s  %7.1f KB/s out  connect p50 %6.1f p99 %7.1f max %7.1f ms  "
+           "%llu failed  %llu dropped  %llu alerts  %llu state  %llu commands\n",
+           elapsedS, now.connected, (counters.readings - before.readings) / intervalS,
+           (now.delivered - totalsBefore.delivered) / intervalS,
+           (now.bytesOut - totalsBefore.bytesOut) / intervalS / 1024, percentile(latencies, 0.50) / 1000.0,
+           percentile(latencies, 0.99) / 1000.0, (latencies.empty() ? 0 : latencies.back()) / 1000.0,
+           (unsigned long long)counters.connectFailures, (unsigned long long)counters.disconnects,
+           (unsigned long long)counters.alerts, (unsigned long long)counters.stateUpdates,
+           (unsigned long long)counters.commands);
+    fflush(stdout);
+}
+
+bool parse_options(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) {
+            return false;
+        }
+        i++;
+        if (!strcmp(arg, "--host")) {
+            options.host = value;
+        } else if (!strcmp(arg, "--port")) {
+            options.port = atoi(value);
+        } else if (!strcmp(arg, "--devices")) {
+            options.devices = strtoul(value, nullptr, 10);
+        } else if (!strcmp(arg, "--duration")) {
+            options.durationS = strtoul(value, nullptr, 10);
+        } else if (!strcmp(arg, "--ramp")) {
+            options.ramp = std::max(1ul, strtoul(value, nullptr, 10));
+        } else if (!strcmp(arg, "--protocol")) {
+            options.protocol = atoi(value) == 4 ? mqtt::kProtocol311 : mqtt::kProtocol5;
+        } else if (!strcmp(arg, "--sites")) {
+            options.sites = std::max(1ul, strtoul(value, nullptr, 10));
+        } else if (!strcmp(arg, "--outbox")) {
+            options.outbox = std::min(64ul, std::max(1ul, strtoul(value, nullptr, 10)));
+        } else if (!strcmp(arg, "--report")) {
+            options.reportS = std::max(1ul, strtoul(value, nullptr, 10));
+        } else if (!strcmp(arg, "--seed")) {
+            options.seed = strtoul(value, nullptr, 10);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool resolve_broker() {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(options.host, nullptr, &hints, &result) != 0 || result == nullptr) {
+        return false;
+    }
+    brokerAddress = *(sockaddr_in*)result->ai_addr;
+    brokerAddress.sin_port = htons(options.port);
+    freeaddrinfo(result);
+    return true;
+}
+
+// One descriptor per device plus a few for stdio and epoll
+void raise_fd_limit() {
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < options.devices + 16) {
+        uint32_t fit = limit.rlim_cur > 16 ? limit.rlim_cur - 16 : 0;
+        fprintf(stderr, "open file limit %llu: simulating %u devices (raise ulimit -n for more)\n",
+                (unsigned long long)limit.rlim_cur, fit);
+        options.devices = fit;
+    }
+}
+
+void on_signal(int) {
+    stopRequested = 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (!parse_options(argc, argv)) {
+        fprintf(stderr,
+                "usage: %s [--host H] [--port P] [--devices N] [--duration S] [--ramp N/s] [--protocol 4|5]\n"
+                "          [--sites N] [--outbox N] [--report S] [--seed N]\n",
+                argv[0]);
+        return 2;
+    }
+    if (!resolve_broker()) {
+        fprintf(stderr, "cannot resolve %s\n", options.host);
+        return 1;
+    }
+    raise_fd_limit();
+    signal(SIGINT, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    int epoll = epoll_create1(0);
+    nowUs = clock_us();
+    fleet.reserve(options.devices);
+    for (uint32_t i = 0; i < options.devices; i++) {
+        fleet.emplace_back(new Device(i, options));
+        Device& device = *fleet.back();
+        device.transport.attach(epoll, &device);
+        device.client.setCallback(on_message);
+        device.client.setConnectedCallback(on_connected);
+    }
+    connectLatencyUs.reserve(options.devices * 2);
+    printf("%u devices on %s:%u, MQTT %s, %u sites, ramp %u/s, %u s, %zu KB per device\n", options.devices,
+           options.host, options.port, options.protocol == mqtt::kProtocol5 ? "5" : "3.1.1", options.sites,
+           options.ramp, options.durationS, sizeof(Device) / 1024 + options.outbox * sizeof(MqttOutbox::Slot) / 1024);
+
+    const uint64_t startUs = nowUs;
+    const uint64_t endUs = startUs + (uint64_t)options.durationS * 1000000;
+    uint64_t nextReportUs = startUs + (uint64_t)options.reportS * 1000000;
+    uint64_t lastReportUs = startUs;
+    double cpuStart = cpu_seconds();
+    Counters before = counters;
+    Totals totalsBefore = totals();
+    uint32_t started = 0;
+    std::vector<epoll_event> events(1024);
+
+    while (!stopRequested && nowUs < endUs) {
+        // Bring devices up at the ramp rate, as a fleet powering on would
+        uint32_t due = std::min<uint64_t>(options.devices, (nowUs - startUs) * options.ramp / 1000000 + 1);
+        for (; started < due; started++) {
+            fleet[started]->nextSampleMs = now_ms();
+            step(*fleet[started]);
+        }
+
+        int timeout = 10;
+        if (!timers.empty()) {
+            int32_t untilNext = (int32_t)(timers.top().atMs - now_ms());
+            timeout = std::max(0, std::min(timeout, untilNext));
+        }
+        int n = epoll_wait(epoll, events.data(), events.size(), timeout);
+        nowUs = clock_us();
+        for (int i = 0; i < n; i++) {
+            Device* device = (Device*)events[i].data.ptr;
+            device->transport.onEvent(events[i].events);
+            step(*device);
+        }
+
+        uint32_t now = now_ms();
+        while (!timers.empty() && (int32_t)(timers.top().atMs - now) <= 0) {
+            Wake wake = timers.top();
+            timers.pop();
+            Device& device = *fleet[wake.index];
+            if (wake.atMs != device.wakeMs) {
+                continue;   // superseded by an earlier wake
+            }
+            device.wakeMs = 0;
+            step(device);
+        }
+
+        if (nowUs >= nextReportUs) {
+            Totals now = totals();
+            report((nowUs - startUs) / 1e6, (nowUs - lastReportUs) / 1e6, before, totalsBefore, now);
+            before = counters;
+            totalsBefore = now;
+            lastReportUs = nowUs;
+            nextReportUs += (uint64_t)options.reportS * 1000000;
+        }
+    }
+
+    double elapsedS = (nowUs - startUs) / 1e6;
+    double cpuS = cpu_seconds() - cpuStart;
+    Totals end = totals();
+    std::sort(connectLatencyUs.begin(), connectLatencyUs.end());
+    printf("\n%u devices started, %u connected at the end, %.0f s\n", started, end.connected, elapsedS);
+    printf("readings queued  %llu (%.0f/s), %llu could not be queued\n", (unsigned long long)counters.readings,
+           counters.readings / elapsedS, (unsigned long long)counters.queueFailures);
+    printf("acknowledged     %llu (%.0f/s), %llu retransmitted, %llu expired\n", (unsigned long long)end.delivered,
+           end.delivered / elapsedS, (unsigned long long)end.retransmitted, (unsigned long long)end.expired);
+    printf("retained state   %llu updates, %llu alerts, %llu commands, %llu reboots\n",
+           (unsigned long long)counters.stateUpdates, (unsigned long long)counters.alerts,
+           (unsigned long long)counters.commands, (unsigned long long)counters.reboots);
+    printf("connections      %llu attempts, %llu connected, %llu failed, %llu dropped\n",
+           (unsigned long long)counters.connectAttempts, (unsigned long long)counters.connects,
+           (unsigned long long)counters.connectFailures, (unsigned long long)counters.disconnects);
+    printf("connect latency  p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+           percentile(connectLatencyUs, 0.50) / 1000.0, percentile(connectLatencyUs, 0.90) / 1000.0,
+           percentile(connectLatencyUs, 0.99) / 1000.0,
+           (connectLatencyUs.empty() ? 0 : connectLatencyUs.back()) / 1000.0);
+    printf("bytes out        %.1f MB (%.1f KB/s)\n", end.bytesOut / 1048576.0, end.bytesOut / elapsedS / 1024);
+    printf("cpu              %.2f s for %.0f s, %.1f%% of one core, ~%.0f devices per core at this rate\n", cpuS,
+           elapsedS, 100 * cpuS / elapsedS, cpuS > 0 ? started * elapsedS / cpuS : 0.0);
+    return 0;
+}
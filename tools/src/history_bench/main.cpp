@@ -0,0 +1,132 @@
+// Range queries and aggregates over weeks of 5 s readings held in an
+// emulated flash, with and without the per-sector index.
+#include <RamFlash.h>
+#include <ReadingLog.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+const int64_t kStartMs = 1757000000000LL;
+const int64_t kPeriodMs = 5000;
+const int kWeeks = 3;
+const uint32_t kRecords = kWeeks * 7 * 24 * 3600 / (kPeriodMs / 1000);
+const int kQueries = 200;
+
+struct Cost {
+    double us;
+    uint64_t bytesRead;
+    uint32_t reads;
+    uint64_t matched;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_us(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// Same answer as readRange() but touching every record
+uint64_t scan_range(ReadingLog& log, int64_t fromMs, int64_t toMs) {
+    uint64_t matched = 0;
+    for (uint32_t seq = log.firstSeq(); seq < log.nextSeq(); seq++) {
+        LogRecord record;
+        if (log.read(seq, &record) && (record.flags & LogRecord::kTimeSynced) && record.timestampMs >= fromMs &&
+            record.timestampMs < toMs) {
+            matched++;
+        }
+    }
+    return matched;
+}
+
+uint64_t indexed_range(ReadingLog& log, int64_t fromMs, int64_t toMs) {
+    LogRecord buffer[64];
+    uint64_t matched = 0;
+    uint32_t cursor = log.seek(fromMs);
+    while (cursor < log.nextSeq()) {
+        matched += log.readRange(&cursor, log.nextSeq(), fromMs, toMs, buffer, 64);
+    }
+    return matched;
+}
+
+uint64_t indexed_aggregate(ReadingLog& log, int64_t fromMs, int64_t toMs) {
+    RangeAggregate aggregate;
+    log.aggregate(fromMs, toMs, &aggregate);
+    return aggregate.count;
+}
+
+template <typename Query>
+Cost run(RamFlash& flash, ReadingLog& log, int64_t windowMs, Query query) {
+    Cost cost = {};
+    srand(42);
+    flash.resetStats();
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < kQueries; i++) {
+        int64_t span = (int64_t)(kRecords - 1) * kPeriodMs - windowMs;
+        int64_t fromMs = kStartMs + (int64_t)((double)rand() / RAND_MAX * span);
+        cost.matched += query(log, fromMs, fromMs + windowMs);
+    }
+    cost.us = elapsed_us(start) / kQueries;
+    cost.bytesRead = flash.stats().bytesRead / kQueries;
+    cost.reads = flash.stats().reads / kQueries;
+    return cost;
+}
+
+void report(const char* name, const Cost& scan, const Cost& indexed) {
+    printf("%-22s %10.0f us %9llu B %7u reads | %8.1f us %7llu B %5u reads | %5.0fx fewer bytes\n", name, scan.us,
+           (unsigned long long)scan.bytesRead, scan.reads, indexed.us, (unsigned long long)indexed.bytesRead,
+           indexed.reads, (double)scan.bytesRead / (indexed.bytesRead > 0 ? indexed.bytesRead : 1));
+    if (scan.matched != indexed.matched) {
+        printf("  MISMATCH: scan found %llu, index %llu\n", (unsigned long long)scan.matched,
+               (unsigned long long)indexed.matched);
+        exit(1);
+    }
+}
+
+}  // namespace
+
+int main() {
+    const uint32_t sectorSize = 4096;
+    uint32_t sectors = kRecords / ((sectorSize - 48) / sizeof(LogRecord)) + 2;
+    std::vector<uint8_t> memory((size_t)sectors * sectorSize);
+    RamFlash flash(memory.data(), memory.size(), sectorSize);
+    ReadingLog log(flash);
+    log.begin();
+
+    Clock::time_point start = Clock::now();
+    for (uint32_t i = 0; i < kRecords; i++) {
+        double hours = i * kPeriodMs / 3600000.0;
+        LogRecord record = {};
+        record.timestampMs = kStartMs + (int64_t)i * kPeriodMs;
+        record.temperatureCenti = (int16_t)(2200 + 400 * sin(hours / 24 * 2 * M_PI) + rand() % 20);
+        record.humidityCenti = (uint16_t)(5500 - 1000 * sin(hours / 24 * 2 * M_PI) + rand() % 50);
+        record.rssi = -60;
+        record.flags = LogRecord::kTimeSynced;
+        log.append(record);
+    }
+    printf("%u readings (%d weeks at %lld s) in %u sectors, %.2f MB; appended in %.0f ms, %u erases\n",
+           log.nextSeq() - log.firstSeq(), kWeeks, (long long)(kPeriodMs / 1000), sectors,
+           memory.size() / 1048576.0, elapsed_us(start) / 1000, flash.stats().erases);
+
+    start = Clock::now();
+    ReadingLog reopened(flash);
+    reopened.begin();
+    printf("begin() after reboot: %.0f us, %llu B read\n\n", elapsed_us(start),
+           (unsigned long long)flash.stats().bytesRead);
+
+    printf("%-22s %40s | %32s\n", "per query", "full scan", "sparse index");
+    const int64_t minute = 60000;
+    report("range 15 min", run(flash, log, 15 * minute, scan_range), run(flash, log, 15 * minute, indexed_range));
+    report("range 6 h", run(flash, log, 360 * minute, scan_range), run(flash, log, 360 * minute, indexed_range));
+    report("aggregate 15 min", run(flash, log, 15 * minute, scan_range),
+           run(flash, log, 15 * minute, indexed_aggregate));
+    report("aggregate 1 day", run(flash, log, 1440 * minute, scan_range),
+           run(flash, log, 1440 * minute, indexed_aggregate));
+    report("aggregate 1 week", run(flash, log, 10080 * minute, scan_range),
+           run(flash, log, 10080 * minute, indexed_aggregate));
+    return 0;
+}
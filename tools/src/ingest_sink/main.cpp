@@ -0,0 +1,772 @@
+// Ingest sink: subscribes to the fleet's telemetry and writes every reading
+// into the temperature table (database/models/temperature.py) in batches.
+//
+// The firmware's MqttClient receives the payloads, which are appended one per
+// line to a pending batch; BatchDecoder (tools/lib) turns a batch into columns
+// and those go to PostgreSQL as one binary COPY. libpq does not allow COPY in
+// pipeline mode, so the connection is non-blocking instead: while a COPY is
+// being sent and committed the loop keeps reading MQTT and the next batch
+// fills up behind it, one COPY in flight at a time.
+//
+// The batch size adapts to the commit latency: while there is a backlog it
+// grows as long as commits stay under --target-ms and shrinks when they go
+// over. With no backlog a batch goes out once it is full or --linger-ms after
+// its first message arrived, whichever comes first.
+//
+//   program [--host 127.0.0.1] [--port 1883] [--topic +/+/+/telemetry]
+//           [--db postgresql://...] [--target-ms 100] [--linger-ms 250]
+//           [--min-batch 50] [--max-batch 20000] [--duration 0] [--report 5]
+//           [--archive readings.rds] [--trace trace.json] [--trace-every 1]
+//
+// --db defaults to $DATABASE_URL, as for Alembic. Rows map as: temperature and
+// humidity in °C and %RH, location = device_id, timestamp = the reading's own
+// when the device clock was synced and the batch's cut time otherwise.
+// Readings with a null temperature or humidity are skipped (the columns are
+// NOT NULL). Prints rows/s, commit latency and end-to-end lag (reading
+// timestamp to commit) every --report seconds. --archive also appends every
+// decoded reading, nulls included, to a ReadingStore file (tools/lib).
+//
+// Readings carry the device's seq and publish_delay (ReadingSchema.h); with
+// the arrival time of each message here - the broker's delivery, which on the
+// same host is the broker's receive to well under a millisecond - and the
+// commit time, the end report splits a reading's age into hops: sample to
+// publish (device clock), publish to broker (device and host clocks, synced
+// readings only) and broker to commit (host clock). It also counts seq gaps,
+// i.e. readings lost on the way, and repeats. --trace writes every reading's
+// hops as Chrome trace events (chrome://tracing, ui.perfetto.dev), one track
+// per device; --trace-every N keeps the readings whose seq is a multiple of N.
+#include <BatchDecoder.h>
+#include <Histogram.h>
+#include <MqttClient.h>
+#include <ReadingStore.h>
+#include <TcpTransport.h>
+
+#include <libpq-fe.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <poll.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+const char* const kCopy =
+    "COPY temperature (temperature, humidity, location, \"timestamp\") FROM STDIN (FORMAT binary)";
+// Milliseconds from the Unix epoch to PostgreSQL's, 2000-01-01
+const int64_t kPostgresEpochMs = 946684800000LL;
+const size_t kCopyChunk = 64 * 1024;
+const uint32_t kReconnectDelayMs = 5000;
+
+struct Options {
+    const char* host = "127.0.0.1";
+    uint16_t port = 1883;
+    const char* topic = "+/+/+/telemetry";
+    const char* db = nullptr;
+    uint32_t targetMs = 100;
+    uint32_t lingerMs = 250;
+    uint32_t minBatch = 50;
+    uint32_t maxBatch = 20000;
+    uint32_t durationS = 0;
+    uint32_t reportS = 5;
+    const char* archive = nullptr;
+    const char* trace = nullptr;
+    uint32_t traceEvery = 1;
+};
+
+Options options;
+volatile sig_atomic_t stopRequested = 0;
+
+uint64_t clock_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t now_ms() {
+    return (uint32_t)(clock_us() / 1000);
+}
+
+int64_t wall_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Payloads waiting for the next COPY, one per line as BatchDecoder reads them
+struct Inbox {
+    std::string lines;
+    std::vector<size_t> ends;       // offset past each message's newline
+    std::vector<int64_t> arrivalMs; // wall clock at each message's arrival
+    uint64_t firstUs = 0;           // arrival of the oldest message
+
+    size_t size() const { return ends.size(); }
+
+    void add(const uint8_t* payload, size_t length) {
+        if (ends.empty()) {
+            firstUs = clock_us();
+        }
+        size_t at = lines.size();
+        lines.append((const char*)payload, length);
+        // A newline inside a payload would split it; in JSON it is whitespace
+        std::replace(lines.begin() + at, lines.end(), '\n', ' ');
+        lines.push_back('\n');
+        ends.push_back(lines.size());
+        arrivalMs.push_back(wall_ms());
+    }
+
+    // Moves the first count messages into batch and their arrivals into arrivals
+    void take(size_t count, std::string& batch, std::vector<int64_t>& arrivals) {
+        size_t cut = ends[count - 1];
+        batch.assign(lines, 0, cut);
+        lines.erase(0, cut);
+        ends.erase(ends.begin(), ends.begin() + count);
+        arrivals.assign(arrivalMs.begin(), arrivalMs.begin() + count);
+        arrivalMs.erase(arrivalMs.begin(), arrivalMs.begin() + count);
+        for (size_t& end : ends) {
+            end -= cut;
+        }
+    }
+};
+
+// Grows the batch while commits keep under the target and there is a backlog
+// to fill it, shrinks it when they do not. A batch that was not full says
+// nothing about a bigger one.
+struct BatchSizer {
+    uint32_t size;
+
+    void update(size_t rows, double latencyMs) {
+        if (latencyMs > options.targetMs) {
+            size = std::max<uint32_t>(options.minBatch, size * 3 / 4);
+        } else if (rows >= size) {
+            size = std::min<uint32_t>(options.maxBatch, size + size / 4 + 1);
+        }
+    }
+};
+
+void put16(std::string& out, uint16_t value) {
+    value = htons(value);
+    out.append((const char*)&value, 2);
+}
+
+void put32(std::string& out, uint32_t value) {
+    value = htonl(value);
+    out.append((const char*)&value, 4);
+}
+
+void put64(std::string& out, uint64_t value) {
+    put32(out, (uint32_t)(value >> 32));
+    put32(out, (uint32_t)value);
+}
+
+void put_double(std::string& out, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put32(out, 8);
+    put64(out, bits);
+}
+
+// PostgreSQL's binary COPY stream for the rows of columns, unsynced readings
+// stamped nowWallMs; returns how many rows it holds
+size_t copy_data(const ingest::Columns& columns, int64_t nowWallMs, std::string& out, size_t* skipped) {
+    out.assign("PGCOPY\n\377\r\n\0", 11);
+    put32(out, 0);      // flags
+    put32(out, 0);      // header extension
+    size_t rows = 0;
+    *skipped = 0;
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns.temperatureCenti[i] == ingest::kNull || columns.humidityCenti[i] == ingest::kNull) {
+            (*skipped)++;
+            continue;
+        }
+        const std::string& device = columns.deviceIds[columns.device[i]];
+        int64_t timestampMs = columns.timeSynced[i] ? columns.timestampMs[i] : nowWallMs;
+        put16(out, 4);
+        put_double(out, columns.temperatureCenti[i] / 100.0);
+        put_double(out, columns.humidityCenti[i] / 100.0);
+        put32(out, device.size());
+        out.append(device);
+        put32(out, 8);
+        put64(out, (uint64_t)((timestampMs - kPostgresEpochMs) * 1000));
+        rows++;
+    }
+    put16(out, 0xFFFF);
+    return rows;
+}
+
+// One COPY at a time over a non-blocking libpq connection
+class CopySink {
+public:
+    enum Phase : uint8_t { kIdle, kAwaitCopyIn, kSending, kFlushing, kAwaitResult };
+
+    struct Done {
+        bool ok;
+        size_t rows;
+        double latencyMs;
+    };
+
+    ~CopySink() {
+        if (conn_ != nullptr) {
+            PQfinish(conn_);
+        }
+    }
+
+    bool open(const char* conninfo) {
+        conn_ = PQconnectdb(conninfo);
+        if (PQstatus(conn_) != CONNECTION_OK) {
+            fprintf(stderr, "database: %s", PQerrorMessage(conn_));
+            return false;
+        }
+        const char* integerTimes = PQparameterStatus(conn_, "integer_datetimes");
+        if (integerTimes == nullptr || strcmp(integerTimes, "on") != 0) {
+            fprintf(stderr, "database: server without integer datetimes\n");
+            return false;
+        }
+        return PQsetnonblocking(conn_, 1) == 0;
+    }
+
+    bool busy() const { return phase_ != kIdle; }
+    int fd() const { return PQsocket(conn_); }
+    bool wantsWrite() const { return phase_ == kSending || phase_ == kFlushing; }
+
+    // Takes over data, a whole COPY stream holding rows rows
+    bool start(std::string& data, size_t rows) {
+        if (PQstatus(conn_) == CONNECTION_BAD) {
+            PQreset(conn_);
+            if (PQstatus(conn_) != CONNECTION_OK || PQsetnonblocking(conn_, 1) != 0) {
+                return false;
+            }
+        }
+        if (!PQsendQuery(conn_, kCopy)) {
+            fprintf(stderr, "database: %s", PQerrorMessage(conn_));
+            return false;
+        }
+        data_.swap(data);
+        sent_ = 0;
+        rows_ = rows;
+        startUs_ = clock_us();
+        phase_ = kAwaitCopyIn;
+        return true;
+    }
+
+    // Moves the COPY along; true with *done filled when it has finished
+    bool poll(Done* done) {
+        if (phase_ == kIdle) {
+            return false;
+        }
+        if (!PQconsumeInput(conn_)) {
+            return finish(false, done);
+        }
+        if (phase_ == kAwaitCopyIn && !PQisBusy(conn_)) {
+            PGresult* result = PQgetResult(conn_);
+            bool copyIn = PQresultStatus(result) == PGRES_COPY_IN;
+            if (!copyIn) {
+                fprintf(stderr, "database: %s", PQresultErrorMessage(result));
+            }
+            PQclear(result);
+            if (!copyIn) {
+                drain();
+                return finish(false, done);
+            }
+            phase_ = kSending;
+        }
+        while (phase_ == kSending && sent_ < data_.size()) {
+            size_t n = std::min(kCopyChunk, data_.size() - sent_);
+            int queued = PQputCopyData(conn_, data_.data() + sent_, (int)n);
+            if (queued < 0) {
+                return finish(false, done);
+            }
+            if (queued == 0) {
+                return false;       // libpq's buffer is full, wait for the socket
+            }
+            sent_ += n;
+        }
+        if (phase_ == kSending) {
+            int ended = PQputCopyEnd(conn_, nullptr);
+            if (ended < 0) {
+                return finish(false, done);
+            }
+            if (ended == 0) {
+                return false;
+            }
+            phase_ = kFlushing;
+        }
+        if (phase_ == kFlushing) {
+            int flushed = PQflush(conn_);
+            if (flushed < 0) {
+                return finish(false, done);
+            }
+            if (flushed > 0) {
+                return false;
+            }
+            phase_ = kAwaitResult;
+        }
+        if (phase_ == kAwaitResult && !PQisBusy(conn_)) {
+            PGresult* result = PQgetResult(conn_);
+            bool ok = PQresultStatus(result) == PGRES_COMMAND_OK;
+            if (!ok) {
+                fprintf(stderr, "database: %s", PQresultErrorMessage(result));
+            }
+            PQclear(result);
+            drain();
+            return finish(ok, done);
+        }
+        return false;
+    }
+
+private:
+    // Reads what is left of the command so the connection is ready again
+    void drain() {
+        PGresult* result;
+        while (PQstatus(conn_) == CONNECTION_OK && (result = PQgetResult(conn_)) != nullptr) {
+            if (PQresultStatus(result) == PGRES_COPY_IN) {
+                PQputCopyEnd(conn_, "aborted");
+            }
+            PQclear(result);
+        }
+    }
+
+    bool finish(bool ok, Done* done) {
+        done->ok = ok;
+        done->rows = rows_;
+        done->latencyMs = (clock_us() - startUs_) / 1000.0;
+        phase_ = kIdle;
+        return true;
+    }
+
+    PGconn* conn_ = nullptr;
+    Phase phase_ = kIdle;
+    std::string data_;
+    size_t sent_ = 0;
+    size_t rows_ = 0;
+    uint64_t startUs_ = 0;
+};
+
+// A committed row on its way through, times in wall clock ms
+struct Traced {
+    uint32_t device;
+    int64_t seq;                // kNoSeq for payloads without one
+    bool synced;
+    int64_t sampleMs;
+    int32_t publishDelayMs;     // kNoDelay for payloads without one
+    int64_t arrivalMs;          // -1 if the batch's rows did not map onto its messages
+};
+
+// Chrome trace events (the JSON Array Format with "X" complete events), one
+// thread per device, timestamps in µs since the Unix epoch
+class TraceFile {
+public:
+    bool open(const char* path) {
+        file_ = fopen(path, "w");
+        if (file_ == nullptr) {
+            return false;
+        }
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+              "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"fleet\"}}",
+              file_);
+        return true;
+    }
+
+    bool isOpen() const { return file_ != nullptr; }
+
+    // Names the device's thread the first time it shows up
+    void device(uint32_t tid, const std::string& id) {
+        if (tid < named_.size() && named_[tid]) {
+            return;
+        }
+        if (tid >= named_.size()) {
+            named_.resize(tid + 1, false);
+        }
+        named_[tid] = true;
+        std::string name;
+        for (char c : id) {
+            if (c == '"' || c == '\\') {
+                name.push_back('\\');
+            }
+            if ((unsigned char)c >= 0x20) {
+                name.push_back(c);
+            }
+        }
+        fprintf(file_, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", tid,
+                name.c_str());
+    }
+
+    void span(const char* name, uint32_t tid, int64_t startMs, int64_t endMs, int64_t seq) {
+        fprintf(file_,
+                ",\n{\"name\":\"%s\",\"cat\":\"reading\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld,"
+                "\"args\":{\"seq\":%lld}}",
+                name, tid, (long long)startMs * 1000, (long long)std::max<int64_t>(endMs - startMs, 0) * 1000,
+                (long long)seq);
+    }
+
+    bool close() {
+        if (file_ == nullptr) {
+            return true;
+        }
+        fputs("\n]}\n", file_);
+        bool ok = ferror(file_) == 0;
+        ok = fclose(file_) == 0 && ok;
+        file_ = nullptr;
+        return ok;
+    }
+
+private:
+    FILE* file_ = nullptr;
+    std::vector<bool> named_;
+};
+
+struct Counters {
+    uint64_t messages = 0;
+    uint64_t rows = 0;
+    uint64_t rejected = 0;
+    uint64_t skipped = 0;
+    uint64_t batches = 0;
+    uint64_t failedBatches = 0;
+    uint64_t lostRows = 0;
+    // From the readings' seq, in arrival order per device
+    uint64_t seqGaps = 0;
+    uint64_t seqMissing = 0;
+    uint64_t seqRepeats = 0;        // redelivered or out of order
+    uint64_t seqRestarts = 0;       // back to 0: the device rebooted
+    // Committed rows without seq, or whose arrival is unknown
+    uint64_t untraced = 0;
+    // Synced rows that reached the broker before they were published by the
+    // device's clock, i.e. clocks apart by more than the hop
+    uint64_t skewed = 0;
+};
+
+TcpTransport transport;
+MqttOutbox::Slot outboxSlot;
+MqttOutbox outbox(&outboxSlot, 1, 1, 60000);
+MqttClient client(transport, outbox, now_ms);
+Inbox inbox;
+CopySink sink;
+ingest::BatchDecoder decoder;
+ingest::Columns columns;
+store::Writer archive;
+BatchSizer sizer;
+Counters counters;
+Histogram commitMs;
+Histogram lagMs;
+Histogram intervalCommitMs;
+Histogram intervalLagMs;
+Histogram samplePublishMs;
+Histogram publishBrokerMs;
+Histogram brokerCommitMs;
+// Rows of the COPY in flight, timed once it commits
+std::vector<Traced> inflight;
+std::vector<int64_t> lastSeq;       // by device index, -1 before the first
+TraceFile trace;
+
+void on_message(char*, uint8_t* payload, unsigned int length) {
+    inbox.add(payload, length);
+    counters.messages++;
+}
+
+void on_connected() {
+    client.subscribe(options.topic, 1);
+}
+
+// Counts gaps and repeats in the seq of every decoded row
+void check_sequence(const ingest::Columns& batch) {
+    lastSeq.resize(batch.deviceIds.size(), -1);
+    for (size_t i = 0; i < batch.size(); i++) {
+        int64_t seq = batch.seq[i];
+        int64_t& last = lastSeq[batch.device[i]];
+        if (seq == ingest::kNoSeq) {
+            continue;
+        }
+        if (last < 0 || seq == last + 1) {
+            // In order, or the first one seen
+        } else if (seq > last + 1) {
+            counters.seqGaps++;
+            counters.seqMissing += seq - last - 1;
+        } else if (seq == 0) {
+            counters.seqRestarts++;
+        } else {
+            counters.seqRepeats++;
+            continue;
+        }
+        last = seq;
+    }
+}
+
+// Cuts the next batch once it is full or has waited long enough
+void send_batch(bool force) {
+    if (sink.busy() || inbox.size() == 0) {
+        return;
+    }
+    bool full = inbox.size() >= sizer.size;
+    bool lingered = clock_us() - inbox.firstUs >= (uint64_t)options.lingerMs * 1000;
+    if (!full && !lingered && !force) {
+        return;
+    }
+    std::string lines;
+    std::vector<int64_t> arrivals;
+    inbox.take(std::min<size_t>(inbox.size(), sizer.size), lines, arrivals);
+
+    uint64_t rejectedBefore = decoder.stats().rejected;
+    columns.clear();
+    decoder.decode(lines.data(), lines.size(), columns);
+    counters.rejected += decoder.stats().rejected - rejectedBefore;
+    if (options.archive != nullptr && !archive.append(columns)) {
+        fprintf(stderr, "archive: write failed\n");
+    }
+    check_sequence(columns);
+
+    int64_t nowWallMs = wall_ms();
+    std::string data;
+    size_t skipped;
+    size_t rows = copy_data(columns, nowWallMs, data, &skipped);
+    counters.skipped += skipped;
+    if (rows == 0) {
+        return;
+    }
+    // A row per message unless the decoder dropped some (malformed, blank);
+    // then which arrival goes with which row is not known
+    bool mapped = columns.size() == arrivals.size();
+    inflight.clear();
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns.temperatureCenti[i] != ingest::kNull && columns.humidityCenti[i] != ingest::kNull) {
+            inflight.push_back({columns.device[i], columns.seq[i], columns.timeSynced[i] != 0,
+                                columns.timestampMs[i], columns.publishDelayMs[i], mapped ? arrivals[i] : -1});
+        }
+    }
+    if (!sink.start(data, rows)) {
+        counters.failedBatches++;
+        counters.lostRows += rows;
+    }
+}
+
+// The hops of one committed row, into the histograms and the trace
+void trace_row(const Traced& row, int64_t committedMs) {
+    if (row.seq == ingest::kNoSeq || row.arrivalMs < 0) {
+        counters.untraced++;
+        return;
+    }
+    int64_t publishedMs = row.sampleMs + row.publishDelayMs;
+    samplePublishMs.add(row.publishDelayMs);
+    brokerCommitMs.add(committedMs - row.arrivalMs);
+    if (row.synced) {
+        publishBrokerMs.add(row.arrivalMs - publishedMs);
+        counters.skewed += row.arrivalMs < publishedMs ? 1 : 0;
+    }
+    if (!trace.isOpen() || row.seq % options.traceEvery != 0) {
+        return;
+    }
+    trace.device(row.device, columns.deviceIds[row.device]);
+    if (row.synced) {
+        trace.span("sample to publish", row.device, row.sampleMs, publishedMs, row.seq);
+        trace.span("publish to broker", row.device, publishedMs, row.arrivalMs, row.seq);
+    }
+    trace.span("broker to commit", row.device, row.arrivalMs, committedMs, row.seq);
+}
+
+void on_committed(const CopySink::Done& done) {
+    if (!done.ok) {
+        counters.failedBatches++;
+        counters.lostRows += done.rows;
+        return;
+    }
+    counters.batches++;
+    counters.rows += done.rows;
+    commitMs.add((int64_t)done.latencyMs);
+    intervalCommitMs.add((int64_t)done.latencyMs);
+    int64_t committedMs = wall_ms();
+    for (const Traced& row : inflight) {
+        if (row.synced) {
+            lagMs.add(committedMs - row.sampleMs);
+            intervalLagMs.add(committedMs - row.sampleMs);
+        }
+        trace_row(row, committedMs);
+    }
+    sizer.update(done.rows, done.latencyMs);
+}
+
+void report(double elapsedS, double intervalS, const Counters& before) {
+    printf("%6.0f s  %8.0f msg/s  %8.0f rows/s  batch %5u  commit p50 %5u p99 %5u ms  lag p50 %5u p99 %5u ms  "
+           "%llu rejected  %llu skipped  %llu failed  %zu waiting\n",
+           elapsedS, (counters.messages - before.messages) / intervalS, (counters.rows - before.rows) / intervalS,
+           sizer.size, intervalCommitMs.percentile(0.50), intervalCommitMs.percentile(0.99),
+           intervalLagMs.percentile(0.50), intervalLagMs.percentile(0.99), (unsigned long long)counters.rejected,
+           (unsigned long long)counters.skipped, (unsigned long long)counters.failedBatches, inbox.size());
+    fflush(stdout);
+    intervalCommitMs.clear();
+    intervalLagMs.clear();
+}
+
+bool parse_options(int argc, char** argv) {
+    options.db = getenv("DATABASE_URL");
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) {
+            return false;
+        }
+        i++;
+        if (!strcmp(arg, "--host")) {
+            options.host = value;
+        } else if (!strcmp(arg, "--port")) {
+            options.port = atoi(value);
+        } else if (!strcmp(arg, "--topic")) {
+            options.topic = value;
+        } else if (!strcmp(arg, "--db")) {
+            options.db = value;
+        } else if (!strcmp(arg, "--target-ms")) {
+            options.targetMs = std::max(1ul, strtoul(value, nullptr, 10));
+        } else if (!strcmp(arg, "--linger-ms")) {
+            options.lingerMs = strtoul(value, nullptr, 10);
+        } else if (!strcmp(arg, "--min-batch")) {
+            options.minBatch = std::max(1ul, strtoul(value, nullptr, 10));
+        } else if (!strcmp(arg, "--max-batch")) {
+            options.maxBatch = std::max(1ul, strtoul(value, nullptr, 10));
+        } else if (!strcmp(arg, "--duration")) {
+            options.durationS = strtoul(value, nullptr, 10);
+        } else if (!strcmp(arg, "--report")) {
+            options.reportS = std::max(1ul, strtoul(value, nullptr, 10));
+        } else if (!strcmp(arg, "--archive")) {
+            options.archive = value;
+        } else if (!strcmp(arg, "--trace")) {
+            options.trace = value;
+        } else if (!strcmp(arg, "--trace-every")) {
+            options.traceEvery = std::max(1ul, strtoul(value, nullptr, 10));
+        } else {
+            return false;
+        }
+    }
+    options.maxBatch = std::max(options.minBatch, options.maxBatch);
+    return options.db != nullptr;
+}
+
+void on_signal(int) {
+    stopRequested = 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (!parse_options(argc, argv)) {
+        fprintf(stderr,
+                "usage: %s [--host H] [--port P] [--topic FILTER] [--db CONNINFO] [--target-ms MS]\n"
+                "          [--linger-ms MS] [--min-batch N] [--max-batch N] [--duration S] [--report S]\n"
+                "          [--archive FILE] [--trace FILE] [--trace-every N]\n"
+                "--db or DATABASE_URL is required\n",
+                argv[0]);
+        return 2;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!sink.open(options.db)) {
+        return 1;
+    }
+    if (options.archive != nullptr && !archive.open(options.archive)) {
+        perror(options.archive);
+        return 1;
+    }
+    if (options.trace != nullptr && !trace.open(options.trace)) {
+        perror(options.trace);
+        return 1;
+    }
+    sizer.size = options.minBatch;
+    columns.reserve(options.maxBatch);
+
+    char clientId[32];
+    snprintf(clientId, sizeof(clientId), "ingest-sink-%d", (int)getpid());
+    client.setServer(options.host, options.port);
+    client.setCallback(on_message);
+    client.setConnectedCallback(on_connected);
+    printf("%s:%u %s -> temperature, commit target %u ms, batch %u..%u\n", options.host, options.port,
+           options.topic, options.targetMs, options.minBatch, options.maxBatch);
+
+    const uint64_t startUs = clock_us();
+    const uint64_t endUs = options.durationS > 0 ? startUs + (uint64_t)options.durationS * 1000000 : UINT64_MAX;
+    uint64_t nextReportUs = startUs + (uint64_t)options.reportS * 1000000;
+    uint64_t lastReportUs = startUs;
+    uint32_t lastAttemptMs = 0;
+    bool attempted = false;
+    Counters before = counters;
+
+    // After a stop, keep going until what was received is in the database
+    while (!(stopRequested || clock_us() >= endUs) || inbox.size() > 0 || sink.busy()) {
+        bool stopping = stopRequested || clock_us() >= endUs;
+        if (stopping && client.connected()) {
+            client.disconnect();
+        }
+        if (!stopping && !client.connected() && !client.connecting() &&
+            (!attempted || now_ms() - lastAttemptMs >= kReconnectDelayMs)) {
+            attempted = true;
+            lastAttemptMs = now_ms();
+            client.connect(clientId);
+        }
+        client.loop();
+
+        CopySink::Done done;
+        if (sink.poll(&done)) {
+            on_committed(done);
+        }
+        send_batch(stopping);
+
+        pollfd fds[2] = {};
+        fds[0].fd = transport.fd();
+        fds[0].events = POLLIN | (transport.wantsWrite() ? POLLOUT : 0);
+        fds[1].fd = sink.busy() ? sink.fd() : -1;
+        fds[1].events = POLLIN | (sink.wantsWrite() ? POLLOUT : 0);
+        int timeout = inbox.size() > 0 && !sink.busy() ? 5 : 50;
+        ::poll(fds, 2, timeout);
+
+        uint64_t nowUs = clock_us();
+        if (nowUs >= nextReportUs) {
+            report((nowUs - startUs) / 1e6, (nowUs - lastReportUs) / 1e6, before);
+            before = counters;
+            lastReportUs = nowUs;
+            nextReportUs += (uint64_t)options.reportS * 1000000;
+            // Chunks a minute past their end get no more rows in practice
+            if (options.archive != nullptr) {
+                archive.flushBefore(wall_ms() - 60000);
+            }
+        }
+    }
+    if (options.archive != nullptr && !archive.close()) {
+        fprintf(stderr, "archive: write failed\n");
+    }
+    if (!trace.close()) {
+        fprintf(stderr, "trace: write failed\n");
+    }
+
+    double elapsedS = (clock_us() - startUs) / 1e6;
+    printf("\nmessages     %llu (%.0f/s), %llu rejected by the decoder, %llu with null values skipped\n",
+           (unsigned long long)counters.messages, counters.messages / elapsedS,
+           (unsigned long long)counters.rejected, (unsigned long long)counters.skipped);
+    printf("rows         %llu committed (%.0f/s) in %llu COPYs, %llu rows in %llu failed\n",
+           (unsigned long long)counters.rows, counters.rows / elapsedS, (unsigned long long)counters.batches,
+           (unsigned long long)counters.lostRows, (unsigned long long)counters.failedBatches);
+    printf("commit       p50 %u ms, p90 %u ms, p99 %u ms, last batch size %u\n", commitMs.percentile(0.50),
+           commitMs.percentile(0.90), commitMs.percentile(0.99), sizer.size);
+    printf("lag          p50 %u ms, p90 %u ms, p99 %u ms (reading timestamp to commit)\n", lagMs.percentile(0.50),
+           lagMs.percentile(0.90), lagMs.percentile(0.99));
+    uint64_t traced = counters.rows - counters.untraced;
+    if (traced > 0) {
+        printf("hop sample   p50 %u ms, p90 %u ms, p99 %u ms (sample to publish, device clock)\n",
+               samplePublishMs.percentile(0.50), samplePublishMs.percentile(0.90), samplePublishMs.percentile(0.99));
+        printf("hop broker   p50 %u ms, p90 %u ms, p99 %u ms (publish to broker, %llu of %llu rows with the device "
+               "clock ahead)\n",
+               publishBrokerMs.percentile(0.50), publishBrokerMs.percentile(0.90), publishBrokerMs.percentile(0.99),
+               (unsigned long long)counters.skewed, (unsigned long long)publishBrokerMs.count);
+        printf("hop commit   p50 %u ms, p90 %u ms, p99 %u ms (broker to commit)\n", brokerCommitMs.percentile(0.50),
+               brokerCommitMs.percentile(0.90), brokerCommitMs.percentile(0.99));
+        printf("sequence     %llu readings missing in %llu gaps, %llu repeated or out of order, %llu restarts; "
+               "%llu rows untraced\n",
+               (unsigned long long)counters.seqMissing, (unsigned long long)counters.seqGaps,
+               (unsigned long long)counters.seqRepeats, (unsigned long long)counters.seqRestarts,
+               (unsigned long long)counters.untraced);
+    }
+    return counters.failedBatches == 0 ? 0 : 1;
+}
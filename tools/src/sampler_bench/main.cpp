@@ -0,0 +1,240 @@
+// The adaptive sampling controller (lib/AdaptiveSampler) against traces as a
+// DHT22 logged every 2 s, its fastest rate, would record them: quiet hours, a
+// door opening and an HVAC failure. The sampler reads the trace at the times
+// it picks, as on the device. Checks the hysteresis (one entry into fast mode
+// per event and none while flat, no flapping), that events bring the interval
+// down to the minimum and that quiet stretches stretch it to the maximum, and
+// reports how many readings it took against the fixed schedule.
+#include <AdaptiveSampler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+// Firmware defaults from include/config_defaults.h, tauMs and growFactor
+// from src/main.cpp
+const uint32_t kSampleIntervalMin = 2000;
+const uint32_t kSampleIntervalMax = 60000;
+const uint32_t kPublishInterval = 5000;
+
+const AdaptiveSampler::Config kSamplerConfig = {
+    kSampleIntervalMin,
+    kSampleIntervalMax,
+    kPublishInterval,
+    60000,
+    1.5f,
+    3,
+    2,
+    {
+        {0.05f, 0.01f, 0.30f, 0.15f},
+        {0.25f, 0.05f, 1.50f, 0.75f},
+    },
+};
+
+const uint32_t kRecordMs = 2000;
+const uint32_t kHourMs = 3600000;
+// From the start of an event to the minimum interval: two readings at the
+// maximum interval, as a slow ramp only stands out from the noise in the
+// second, then one at the minimum
+const uint32_t kReactMs = 2 * kSampleIntervalMax + kSampleIntervalMin;
+// How long after an event the sampler may take to relax to the maximum again
+const uint32_t kSettleMs = 2 * kHourMs;
+
+struct Record {
+    float temperature;
+    float humidity;
+};
+
+struct Trace {
+    const char* name;
+    std::vector<Record> records;    // one every kRecordMs
+    uint32_t eventStartMs;          // 0 when the trace is flat throughout
+    uint32_t eventEndMs;
+    uint32_t expectedEntries;       // calm -> fast transitions
+};
+
+// DHT22 noise and its 0.1 resolution; the seed is fixed so every run records
+// the same trace
+struct Sensor {
+    uint64_t rng;
+
+    double gauss() {
+        double sum = 0;
+        for (int i = 0; i < 4; i++) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            sum += (double)(rng >> 11) / 9007199254740992.0;
+        }
+        return (sum - 2) * sqrt(3.0);
+    }
+    Record read(double temperature, double humidity) {
+        return {roundf((float)(temperature + 0.05 * gauss()) * 10) / 10,
+                roundf((float)(humidity + 0.3 * gauss()) * 10) / 10};
+    }
+};
+
+// Towards target with time constant tau, from value at start
+double settle(double start, double target, double tauS, double elapsedS) {
+    return target + (start - target) * exp(-elapsedS / tauS);
+}
+
+// An office at 22 °C through six quiet hours, with the slow drift of the
+// building over the day
+Trace flat() {
+    Trace trace = {"flat", {}, 0, 0, 0};
+    Sensor sensor = {11};
+    for (uint32_t t = 0; t < 6 * kHourMs; t += kRecordMs) {
+        double drift = sin(2 * M_PI * t / (24.0 * kHourMs));
+        trace.records.push_back(sensor.read(22 + 0.5 * drift, 45 - 1.5 * drift));
+    }
+    return trace;
+}
+
+// A cold-room door left open for two minutes: the air near the sensor heads
+// for 8 °C and 80 %RH within a minute or so, then recovers over half an hour
+// once it closes
+Trace door() {
+    const uint32_t openMs = 2 * kHourMs;
+    const uint32_t closeMs = openMs + 120000;
+    Trace trace = {"door", {}, openMs, closeMs, 1};
+    Sensor sensor = {23};
+    double closedT = 0, closedH = 0;
+    for (uint32_t t = 0; t < 5 * kHourMs; t += kRecordMs) {
+        double temperature = 22, humidity = 45;
+        if (t >= openMs && t < closeMs) {
+            double s = (t - openMs) / 1000.0;
+            temperature = closedT = settle(22, 8, 45, s);
+            humidity = closedH = settle(45, 80, 45, s);
+        } else if (t >= closeMs) {
+            double s = (t - closeMs) / 1000.0;
+            temperature = settle(closedT, 22, 600, s);
+            humidity = settle(closedH, 45, 600, s);
+        }
+        trace.records.push_back(sensor.read(temperature, humidity));
+    }
+    return trace;
+}
+
+// A server room whose cooling stops: 22 °C climbing towards 35 over the next
+// hours, humidity falling as the air warms
+Trace hvac_failure() {
+    const uint32_t failMs = 2 * kHourMs;
+    Trace trace = {"hvac failure", {}, failMs, 5 * kHourMs, 1};
+    Sensor sensor = {37};
+    for (uint32_t t = 0; t < 8 * kHourMs; t += kRecordMs) {
+        double temperature = 22, humidity = 45;
+        if (t >= failMs) {
+            double s = (t - failMs) / 1000.0;
+            temperature = settle(22, 35, 1200, s);
+            humidity = settle(45, 28, 1200, s);
+        }
+        trace.records.push_back(sensor.read(temperature, humidity));
+    }
+    return trace;
+}
+
+struct Run {
+    AdaptiveSampler::Stats stats;
+    uint32_t entries;           // calm -> fast, counted here from isActive()
+    uint32_t exits;
+    int64_t reactMs;            // event start to the minimum interval, -1 if never
+    int64_t maxBeforeMs;        // first time at the maximum before the event
+    int64_t maxAfterMs;         // and after it ends
+    uint32_t atMaxMs;           // time spent at the maximum interval
+    uint32_t durationMs;
+};
+
+Run run(const Trace& trace) {
+    AdaptiveSampler sampler(kSamplerConfig);
+    Run result = {};
+    result.reactMs = -1;
+    result.maxBeforeMs = -1;
+    result.maxAfterMs = -1;
+    result.durationMs = (uint32_t)trace.records.size() * kRecordMs;
+    bool event = trace.eventStartMs > 0;
+    bool wasActive = true;
+
+    uint32_t t = 0;
+    while (t < result.durationMs) {
+        const Record& record = trace.records[t / kRecordMs];
+        float values[2] = {record.temperature, record.humidity};
+        uint32_t delay = sampler.update(values, t);
+
+        if (sampler.isActive() != wasActive) {
+            (sampler.isActive() ? result.entries : result.exits)++;
+            wasActive = sampler.isActive();
+        }
+        if (delay == kSampleIntervalMax) {
+            result.atMaxMs += std::min(delay, result.durationMs - t);
+            if (!event || t < trace.eventStartMs) {
+                if (result.maxBeforeMs < 0) {
+                    result.maxBeforeMs = t;
+                }
+            } else if (t >= trace.eventEndMs && result.maxAfterMs < 0) {
+                result.maxAfterMs = t;
+            }
+        }
+        if (event && t >= trace.eventStartMs && result.reactMs < 0 && delay == kSampleIntervalMin) {
+            result.reactMs = t - trace.eventStartMs;
+        }
+        t += delay;
+    }
+    result.stats = sampler.stats();
+    return result;
+}
+
+struct Check {
+    const char* trace;
+    const char* name;
+    bool passed;
+};
+
+}  // namespace
+
+int main() {
+    std::vector<Trace> traces = {flat(), door(), hvac_failure()};
+    std::vector<Check> checks;
+
+    printf("%-13s %6s %8s %8s %6s %9s %9s %9s %8s\n", "trace", "hours", "samples", "fixed", "ratio", "entries",
+           "react s", "relax s", "at max");
+    for (const Trace& trace : traces) {
+        Run r = run(trace);
+        bool event = trace.eventStartMs > 0;
+        char react[24] = "-";
+        char relax[24] = "-";
+        if (event && r.reactMs >= 0) {
+            snprintf(react, sizeof(react), "%lld", (long long)r.reactMs / 1000);
+        }
+        if (event && r.maxAfterMs >= 0) {
+            snprintf(relax, sizeof(relax), "%lld", (long long)(r.maxAfterMs - trace.eventEndMs) / 1000);
+        }
+        printf("%-13s %6.1f %8u %8u %5.1f%% %5u/%-3u %9s %9s %7.0f%%\n", trace.name, r.durationMs / 3.6e6,
+               r.stats.samplesTaken, r.stats.fixedScheduleSamples,
+               100.0 * r.stats.samplesTaken / r.stats.fixedScheduleSamples, r.entries, trace.expectedEntries, react,
+               relax, 100.0 * r.atMaxMs / r.durationMs);
+
+        // The sampler's own count of entries has to agree with what we saw
+        checks.push_back({trace.name, "no flapping",
+                          r.entries == trace.expectedEntries && r.stats.fastEntries == r.entries &&
+                              r.exits <= r.entries + 1});
+        checks.push_back({trace.name, "maximum while flat",
+                          r.maxBeforeMs >= 0 && (!event || r.maxAfterMs >= 0) &&
+                              (!event || r.maxAfterMs - trace.eventEndMs <= kSettleMs)});
+        if (event) {
+            checks.push_back({trace.name, "minimum on the event", r.reactMs >= 0 && r.reactMs <= kReactMs});
+        }
+        checks.push_back({trace.name, "fewer than fixed", r.stats.samplesTaken < r.stats.fixedScheduleSamples});
+    }
+
+    int failures = 0;
+    printf("\n");
+    for (const Check& check : checks) {
+        printf("  %-13s %-22s %s\n", check.trace, check.name, check.passed ? "ok" : "FAILED");
+        failures += check.passed ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
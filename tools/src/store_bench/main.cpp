@@ -0,0 +1,593 @@
+// Size and scan speed of a day of fleet readings kept as raw JSON payloads
+// (one per line, as captured from MQTT), as CSV and in the columnar
+// ReadingStore (tools/lib). Each format is written to a file and scanned
+// from a warm mmap into per-device averages; the store is also queried for
+// one device over two hours, skipping blocks by their headers.
+//
+//   program [directory]     benchmark, files in directory (/tmp by default)
+//   program readings.rds    summary of a store, e.g. ingest_sink's --archive
+#include <BatchDecoder.h>
+#include <HeatIndex.h>
+#include <ReadingSchema.h>
+#include <ReadingStore.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+const size_t kDevices = 300;
+const int64_t kDayMs = 24 * 3600 * 1000LL;
+const int64_t kStartMs = 1757635200000LL;   // midnight UTC
+const size_t kIngestBatch = 10000;          // rows per Writer::append, as the sink would
+const int kRounds = 3;
+
+uint32_t rng = 88172645u;
+uint32_t next() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+float uniform() {
+    return (next() >> 8) * (1.0f / 16777216.0f);
+}
+
+struct Room {
+    float temperature;
+    float humidity;
+    float temperatureTarget;
+    float humidityTarget;
+    int rssi;
+    int64_t nextMs;
+    uint32_t fastUntil;     // readings left at the fast interval
+};
+
+// A day of the fleet in arrival order: rooms drifting with the odd step
+// change, which sends the sampler from 30 s down to 2 s for a while
+ingest::Columns make_day() {
+    ingest::Columns columns;
+    std::vector<Room> rooms(kDevices);
+    for (size_t i = 0; i < kDevices; i++) {
+        char id[32];
+        snprintf(id, sizeof(id), "ESP32-02:00:00:00:%02X:%02X", (unsigned)(i >> 8), (unsigned)(i & 0xFF));
+        columns.deviceIds.push_back(id);
+        Room& room = rooms[i];
+        room.temperatureTarget = room.temperature = 18 + uniform() * 8;
+        room.humidityTarget = room.humidity = 35 + uniform() * 25;
+        room.rssi = -45 - (int)(next() % 40);
+        room.nextMs = kStartMs + next() % 30000;
+        room.fastUntil = 0;
+    }
+    typedef std::pair<int64_t, uint32_t> Due;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due;
+    for (uint32_t i = 0; i < kDevices; i++) {
+        due.push({rooms[i].nextMs, i});
+    }
+    while (!due.empty()) {
+        uint32_t i = due.top().second;
+        due.pop();
+        Room& room = rooms[i];
+        if (uniform() < 0.002f) {
+            room.temperatureTarget += (uniform() - 0.5f) * 8;
+            room.humidityTarget += (uniform() - 0.5f) * 20;
+            room.fastUntil = 60;
+        }
+        room.temperature += (room.temperatureTarget - room.temperature) * 0.05f + (uniform() - 0.5f) * 0.08f;
+        room.humidity += (room.humidityTarget - room.humidity) * 0.05f + (uniform() - 0.5f) * 0.3f;
+        room.humidity = std::min(100.0f, std::max(0.0f, room.humidity));
+        float t = roundf(room.temperature * 10) / 10;
+        float h = roundf(room.humidity * 10) / 10;
+        columns.device.push_back(i);
+        columns.timestampMs.push_back(room.nextMs);
+        columns.timeSynced.push_back(1);
+        columns.temperatureCenti.push_back(lroundf(t * 100));
+        columns.humidityCenti.push_back(lroundf(h * 100));
+        columns.heatIndexCenti.push_back(lroundf(heat_index(t, h) * 100));
+        columns.rssi.push_back(room.rssi + (int)(next() % 5) - 2);
+
+        uint32_t interval = room.fastUntil > 0 ? 2000 : 30000;
+        room.fastUntil -= room.fastUntil > 0 ? 1 : 0;
+        room.nextMs += interval + next() % 40;      // loop jitter
+        if (room.nextMs < kStartMs + kDayMs) {
+            due.push({room.nextMs, i});
+        }
+    }
+    return columns;
+}
+
+// Generated readings carry no seq column and go out as soon as they are taken
+telemetry::Reading reading_at(const ingest::Columns& c, size_t i, uint32_t seq) {
+    return {c.deviceIds[c.device[i]].c_str(),
+            c.timestampMs[i],
+            c.timeSynced[i] != 0,
+            c.temperatureCenti[i] / 100.0f,
+            c.humidityCenti[i] / 100.0f,
+            c.heatIndexCenti[i] / 100.0f,
+            c.rssi[i],
+            seq,
+            0};
+}
+
+bool write_file(const std::string& path, const std::string& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    bool ok = file != nullptr && fwrite(data.data(), 1, data.size(), file) == data.size();
+    return file != nullptr && fclose(file) == 0 && ok;
+}
+
+struct Mapped {
+    const char* data = nullptr;
+    size_t length = 0;
+
+    explicit Mapped(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = (const char*)p;
+                length = st.st_size;
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    ~Mapped() {
+        if (data != nullptr) {
+            munmap((void*)data, length);
+        }
+    }
+};
+
+// Per-device average temperature, the scan every format answers
+struct Averages {
+    std::vector<int64_t> sum;
+    std::vector<uint32_t> count;
+
+    void reset(size_t devices) {
+        sum.assign(devices, 0);
+        count.assign(devices, 0);
+    }
+    void add(const ingest::Columns& c, const std::vector<uint32_t>* remap) {
+        for (size_t i = 0; i < c.size(); i++) {
+            uint32_t d = remap != nullptr ? (*remap)[c.device[i]] : c.device[i];
+            if (c.temperatureCenti[i] != ingest::kNull) {
+                sum[d] += c.temperatureCenti[i];
+                count[d]++;
+            }
+        }
+    }
+    bool operator==(const Averages& other) const { return sum == other.sum && count == other.count; }
+};
+
+// Device index in reference order for a dictionary built elsewhere
+std::vector<uint32_t> remap(const std::vector<std::string>& ids, const std::vector<std::string>& reference) {
+    std::vector<uint32_t> map(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        map[i] = std::find(reference.begin(), reference.end(), ids[i]) - reference.begin();
+    }
+    return map;
+}
+
+// Fixed-point hundredths of "-12.3" or "45.67"
+int64_t parse_centi(const char*& p) {
+    bool negative = *p == '-';
+    p += negative ? 1 : 0;
+    int64_t value = 0;
+    while (*p >= '0' && *p <= '9') {
+        value = value * 10 + (*p++ - '0');
+    }
+    int digits = 0;
+    if (*p == '.') {
+        p++;
+        while (*p >= '0' && *p <= '9') {
+            if (digits < 2) {
+                value = value * 10 + (*p - '0');
+                digits++;
+            }
+            p++;
+        }
+    }
+    for (; digits < 2; digits++) {
+        value *= 10;
+    }
+    return negative ? -value : value;
+}
+
+// A hand-written CSV reader, so the comparison is not against strtod
+void scan_csv(const Mapped& file, const std::vector<std::string>& devices, Averages& out) {
+    const char* p = (const char*)memchr(file.data, '\n', file.length) + 1;
+    const char* end = file.data + file.length;
+    out.reset(devices.size());
+    std::unordered_map<std::string_view, uint32_t> index;
+    for (uint32_t i = 0; i < devices.size(); i++) {
+        index.emplace(devices[i], i);
+    }
+    while (p < end) {
+        const char* comma = (const char*)memchr(p, ',', end - p);
+        uint32_t device = index.find(std::string_view(p, comma - p))->second;
+        p = comma + 1;
+        p = (const char*)memchr(p, ',', end - p) + 1;      // timestamp
+        p = (const char*)memchr(p, ',', end - p) + 1;      // time_synced
+        int64_t temperature = parse_centi(p);
+        out.sum[device] += temperature;
+        out.count[device]++;
+        p = (const char*)memchr(p, '\n', end - p) + 1;
+    }
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename F>
+double best_s(F&& run) {
+    double best = 1e300;
+    for (int round = 0; round < kRounds; round++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, seconds_since(start));
+    }
+    return best;
+}
+
+// Bytes per value of XOR with the previous value, varint-coded, per device
+double xor_varint_bytes(const ingest::Columns& c, const std::vector<int16_t>& column) {
+    std::vector<int32_t> previous(c.deviceIds.size(), -1);
+    size_t bytes = 0;
+    for (size_t i = 0; i < c.size(); i++) {
+        uint16_t value = (uint16_t)column[i];
+        uint32_t x = previous[c.device[i]] < 0 ? value : value ^ (uint16_t)previous[c.device[i]];
+        previous[c.device[i]] = value;
+        bytes += x < 0x80 ? 1 : x < 0x4000 ? 2 : 3;
+    }
+    return (double)bytes / c.size();
+}
+
+struct Check {
+    const char* name;
+    bool passed;
+};
+
+int summarize(const char* path) {
+    store::Reader reader;
+    if (!reader.open(path)) {
+        fprintf(stderr, "%s: not a reading store\n", path);
+        return 1;
+    }
+    int64_t first = INT64_MAX;
+    int64_t last = INT64_MIN;
+    size_t synced = 0;
+    for (const store::Reader::Block& block : reader.blocks()) {
+        first = std::min(first, block.header->firstMs);
+        last = std::max(last, block.header->lastMs);
+        synced += block.header->syncedRows;
+    }
+    printf("%s: %zu readings (%zu with a synced clock) from %zu devices in %zu blocks, %.2f bytes each\n", path,
+           reader.rows(), synced, reader.devices().size(), reader.blocks().size(),
+           reader.rows() > 0 ? (double)reader.fileBytes() / reader.rows() : 0.0);
+    if (reader.rows() > 0) {
+        printf("timestamps %lld .. %lld ms (%.1f h)\n", (long long)first, (long long)last, (last - first) / 3.6e6);
+    }
+    if (reader.tornBytes() > 0) {
+        printf("%zu bytes of an unfinished block at the end\n", reader.tornBytes());
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    struct stat target;
+    if (argc > 1 && stat(argv[1], &target) == 0 && S_ISREG(target.st_mode)) {
+        return summarize(argv[1]);
+    }
+    std::string directory = argc > 1 ? argv[1] : "/tmp";
+    std::string jsonPath = directory + "/store_bench.ndjson";
+    std::string csvPath = directory + "/store_bench.csv";
+    std::string storePath = directory + "/store_bench.rds";
+
+    ingest::Columns day = make_day();
+    size_t rows = day.size();
+    printf("%zu devices, one day, %zu readings\n\n", kDevices, rows);
+
+    // --- Write the three formats ---
+    std::string json;
+    std::string csv = "device_id,timestamp,time_synced,temperature,humidity,heat_index,wifi_rssi\n";
+    char line[256];
+    std::vector<uint32_t> seqs(day.deviceIds.size(), 0);
+    for (size_t i = 0; i < rows; i++) {
+        telemetry::Reading r = reading_at(day, i, seqs[day.device[i]]++);
+        size_t n = codec::encodeJson(telemetry::kReadingSchema, r, line, sizeof(line));
+        json.append(line, n);
+        json.push_back('\n');
+        n = snprintf(line, sizeof(line), "%s,%lld,%d,%.2f,%.2f,%.2f,%d\n", r.deviceId, (long long)r.timestampMs,
+                     r.timeSynced ? 1 : 0, day.temperatureCenti[i] / 100.0, day.humidityCenti[i] / 100.0,
+                     day.heatIndexCenti[i] / 100.0, r.rssi);
+        csv.append(line, n);
+    }
+    unlink(storePath.c_str());
+    store::Writer writer;
+    bool written = write_file(jsonPath, json) && write_file(csvPath, csv) && writer.open(storePath.c_str());
+    auto writeStart = std::chrono::steady_clock::now();
+    ingest::Columns batch;
+    for (size_t start = 0; start < rows && written; start += kIngestBatch) {
+        batch.clear();
+        batch.deviceIds = day.deviceIds;
+        for (size_t i = start; i < std::min(rows, start + kIngestBatch); i++) {
+            batch.device.push_back(day.device[i]);
+            batch.timestampMs.push_back(day.timestampMs[i]);
+            batch.timeSynced.push_back(day.timeSynced[i]);
+            batch.temperatureCenti.push_back(day.temperatureCenti[i]);
+            batch.humidityCenti.push_back(day.humidityCenti[i]);
+            batch.heatIndexCenti.push_back(day.heatIndexCenti[i]);
+            batch.rssi.push_back(day.rssi[i]);
+        }
+        written = writer.append(batch) && writer.flushBefore(batch.timestampMs.back() - 60000);
+    }
+    written = writer.close() && written;
+    double writeS = seconds_since(writeStart);
+    if (!written) {
+        fprintf(stderr, "cannot write to %s\n", directory.c_str());
+        return 1;
+    }
+
+    store::Reader reader;
+    reader.open(storePath.c_str());
+    std::vector<Check> checks;
+
+    // Every row back, per device in arrival order
+    ingest::Columns decoded;
+    bool decodedOk = true;
+    for (const store::Reader::Block& block : reader.blocks()) {
+        decodedOk = reader.decode(block, decoded) && decodedOk;
+    }
+    std::vector<uint32_t> toDay = remap(decoded.deviceIds, day.deviceIds);
+    auto byDevice = [](const ingest::Columns& c, const std::vector<uint32_t>* map) {
+        std::vector<size_t> order(c.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            uint32_t da = map != nullptr ? (*map)[c.device[a]] : c.device[a];
+            uint32_t db = map != nullptr ? (*map)[c.device[b]] : c.device[b];
+            return da < db;
+        });
+        return order;
+    };
+    std::vector<size_t> expected = byDevice(day, nullptr);
+    std::vector<size_t> got = byDevice(decoded, &toDay);
+    bool same = decodedOk && decoded.size() == rows;
+    for (size_t k = 0; k < rows && same; k++) {
+        size_t a = expected[k];
+        size_t b = got[k];
+        same = day.device[a] == toDay[decoded.device[b]] && day.timestampMs[a] == decoded.timestampMs[b] &&
+               day.timeSynced[a] == decoded.timeSynced[b] && day.temperatureCenti[a] == decoded.temperatureCenti[b] &&
+               day.humidityCenti[a] == decoded.humidityCenti[b] && day.heatIndexCenti[a] == decoded.heatIndexCenti[b] &&
+               day.rssi[a] == decoded.rssi[b];
+    }
+    checks.push_back({"every row round-trips", same});
+
+    bool rangesOk = true;
+    for (const store::Reader::Block& block : reader.blocks()) {
+        ingest::Columns one;
+        reader.decode(block, one);
+        const store::BlockHeader& h = *block.header;
+        for (size_t i = 0; i < one.size(); i++) {
+            rangesOk = rangesOk && one.timestampMs[i] >= h.firstMs && one.timestampMs[i] <= h.lastMs &&
+                       one.temperatureCenti[i] >= h.minTemperature && one.temperatureCenti[i] <= h.maxTemperature &&
+                       one.humidityCenti[i] >= h.minHumidity && one.humidityCenti[i] <= h.maxHumidity &&
+                       one.rssi[i] >= h.minRssi && one.rssi[i] <= h.maxRssi;
+        }
+        rangesOk = rangesOk && h.lastMs - h.firstMs < writer.kDefaultConfig.chunkMs;
+    }
+    checks.push_back({"block statistics", rangesOk});
+
+    // Extreme values and nulls, in a file of their own
+    std::string oddPath = directory + "/store_bench_odd.rds";
+    unlink(oddPath.c_str());
+    ingest::Columns odd;
+    odd.deviceIds = {"a", "b"};
+    int64_t timestamps[] = {INT64_MIN, INT64_MAX, 0, -1, 1757635200000LL, 1757635200000LL};
+    int16_t values[] = {ingest::kNull, INT16_MAX, -1, 0, 2150, ingest::kNull};
+    for (size_t i = 0; i < 6; i++) {
+        odd.device.push_back(0);
+        odd.timestampMs.push_back(timestamps[i]);
+        odd.timeSynced.push_back(i % 2);
+        odd.temperatureCenti.push_back(values[i]);
+        odd.humidityCenti.push_back(values[5 - i]);
+        odd.heatIndexCenti.push_back(ingest::kNull);
+        odd.rssi.push_back(i == 0 ? ingest::kNullRssi : (int8_t)-(int)i);
+    }
+    odd.device.push_back(1);
+    odd.timestampMs.push_back(42);
+    odd.timeSynced.push_back(0);
+    odd.temperatureCenti.push_back(ingest::kNull);
+    odd.humidityCenti.push_back(ingest::kNull);
+    odd.heatIndexCenti.push_back(ingest::kNull);
+    odd.rssi.push_back(ingest::kNullRssi);
+    store::Writer oddWriter(store::Writer::Config{INT64_MAX, 4});
+    bool oddOk = oddWriter.open(oddPath.c_str()) && oddWriter.append(odd) && oddWriter.close();
+    store::Reader oddReader;
+    ingest::Columns oddBack;
+    oddOk = oddOk && oddReader.open(oddPath.c_str());
+    for (const store::Reader::Block& block : oddReader.blocks()) {
+        oddOk = oddOk && oddReader.decode(block, oddBack);
+    }
+    oddOk = oddOk && oddBack.timestampMs == odd.timestampMs && oddBack.temperatureCenti == odd.temperatureCenti &&
+            oddBack.humidityCenti == odd.humidityCenti && oddBack.rssi == odd.rssi &&
+            oddBack.timeSynced == odd.timeSynced && oddReader.blocks().back().header->minTemperature >
+                                                        oddReader.blocks().back().header->maxTemperature;
+    checks.push_back({"extremes and nulls", oddOk});
+
+    // A crash in the middle of a block: the reader stops before it and the
+    // next writer cuts it off and carries on
+    struct stat st;
+    stat(oddPath.c_str(), &st);
+    bool tornOk = truncate(oddPath.c_str(), st.st_size - 5) == 0;
+    store::Reader tornReader;
+    tornOk = tornOk && tornReader.open(oddPath.c_str()) && tornReader.tornBytes() > 0 &&
+             tornReader.blocks().size() == oddReader.blocks().size() - 1;
+    store::Writer again;
+    tornOk = tornOk && again.open(oddPath.c_str()) && again.append(odd) && again.close();
+    store::Reader afterReader;
+    tornOk = tornOk && afterReader.open(oddPath.c_str()) && afterReader.tornBytes() == 0 &&
+             afterReader.blocks().size() == 2 * oddReader.blocks().size() - 1;
+    checks.push_back({"torn last block", tornOk});
+    unlink(oddPath.c_str());
+
+    int failures = 0;
+    for (const Check& check : checks) {
+        printf("  %-22s %s\n", check.name, check.passed ? "ok" : "FAILED");
+        failures += check.passed ? 0 : 1;
+    }
+
+    // --- Scans ---
+    Averages reference;
+    reference.reset(kDevices);
+    reference.add(day, nullptr);
+
+    Mapped jsonFile(jsonPath);
+    Mapped csvFile(csvPath);
+    Averages jsonAverages;
+    ingest::Columns jsonColumns;
+    double jsonS = best_s([&] {
+        ingest::BatchDecoder decoder;
+        jsonColumns = ingest::Columns();
+        jsonColumns.reserve(rows);
+        decoder.decode(jsonFile.data, jsonFile.length, jsonColumns);
+        std::vector<uint32_t> map = remap(jsonColumns.deviceIds, day.deviceIds);
+        jsonAverages.reset(kDevices);
+        jsonAverages.add(jsonColumns, &map);
+    });
+    Averages csvAverages;
+    double csvS = best_s([&] { scan_csv(csvFile, day.deviceIds, csvAverages); });
+    Averages storeAverages;
+    double storeS = best_s([&] {
+        store::Reader r;
+        r.open(storePath.c_str());
+        std::vector<uint32_t> map = remap(r.devices(), day.deviceIds);
+        storeAverages.reset(kDevices);
+        ingest::Columns c;
+        for (const store::Reader::Block& block : r.blocks()) {
+            c.clear();
+            r.decode(block, c);
+            storeAverages.add(c, &map);
+        }
+    });
+    Averages projectedAverages;
+    double projectedS = best_s([&] {
+        store::Reader r;
+        r.open(storePath.c_str());
+        std::vector<uint32_t> map = remap(r.devices(), day.deviceIds);
+        projectedAverages.reset(kDevices);
+        std::vector<int64_t> temperature;
+        for (const store::Reader::Block& block : r.blocks()) {
+            r.decode(block, store::kTemperature, temperature);
+            uint32_t d = map[block.device];
+            for (int64_t value : temperature) {
+                if (value != ingest::kNull) {
+                    projectedAverages.sum[d] += value;
+                    projectedAverages.count[d]++;
+                }
+            }
+        }
+    });
+    bool scansAgree = jsonAverages == reference && csvAverages == reference && storeAverages == reference &&
+                      projectedAverages == reference;
+
+    // One device, two hours in the afternoon
+    const std::string& wanted = day.deviceIds[kDevices / 2];
+    int64_t from = kStartMs + 14 * 3600000LL + 1800000;
+    int64_t to = from + 2 * 3600000LL;
+    size_t matched = 0;
+    size_t blocksRead = 0;
+    double queryS = best_s([&] {
+        store::Reader r;
+        r.open(storePath.c_str());
+        uint32_t device = std::find(r.devices().begin(), r.devices().end(), wanted) - r.devices().begin();
+        ingest::Columns c;
+        matched = 0;
+        blocksRead = 0;
+        for (const store::Reader::Block& block : r.blocks()) {
+            if (block.device != device || block.header->lastMs < from || block.header->firstMs >= to) {
+                continue;
+            }
+            c.clear();
+            r.decode(block, c);
+            blocksRead++;
+            for (size_t i = 0; i < c.size(); i++) {
+                matched += c.timestampMs[i] >= from && c.timestampMs[i] < to;
+            }
+        }
+    });
+    size_t expectedMatches = 0;
+    for (size_t i = 0; i < rows; i++) {
+        expectedMatches += day.deviceIds[day.device[i]] == wanted && day.timestampMs[i] >= from && day.timestampMs[i] < to;
+    }
+
+    printf("\n%-14s %10s %9s %8s %12s %10s\n", "", "MB", "bytes/row", "vs JSON", "scan rows/s", "scan MB/s");
+    struct Line {
+        const char* name;
+        size_t bytes;
+        double seconds;
+    } lines[] = {
+        {"JSON (NDJSON)", json.size(), jsonS},
+        {"CSV", csv.size(), csvS},
+        {"ReadingStore", reader.fileBytes(), storeS},
+        {"  1 column", reader.fileBytes(), projectedS},
+    };
+    for (const Line& l : lines) {
+        printf("%-14s %10.1f %9.2f %7.1fx %12.0f %10.0f\n", l.name, l.bytes / 1048576.0, (double)l.bytes / rows,
+               (double)json.size() / l.bytes, rows / l.seconds, l.bytes / l.seconds / 1048576.0);
+    }
+    printf("scans agree    %s (CSV parses only up to temperature; the store decodes every column, or just\n"
+           "               temperature on the last line)\n",
+           scansAgree ? "yes" : "NO");
+    failures += scansAgree ? 0 : 1;
+
+    // Where the store's bytes go
+    size_t columnBytes[store::kColumns] = {};
+    size_t headerBytes = 0;
+    for (const store::Reader::Block& block : reader.blocks()) {
+        const store::BlockHeader& h = *block.header;
+        headerBytes += h.columnOffset[0];
+        for (int c = 0; c < store::kColumns; c++) {
+            columnBytes[c] += (c + 1 < store::kColumns ? h.columnOffset[c + 1] : h.bytes) - h.columnOffset[c];
+        }
+    }
+    const char* names[store::kColumns] = {"timestamp", "time_synced", "temperature", "humidity", "heat_index",
+                                          "wifi_rssi"};
+    printf("\n%zu blocks, %.1f rows each, written at %.0f rows/s; bytes per row:\n", reader.blocks().size(),
+           (double)rows / reader.blocks().size(), rows / writeS);
+    printf("  %-12s %6.2f\n", "headers, ids", (double)headerBytes / rows);
+    for (int c = 0; c < store::kColumns; c++) {
+        printf("  %-12s %6.2f\n", names[c], (double)columnBytes[c] / rows);
+    }
+    printf("  XOR + varint would take %.2f for temperature and %.2f for humidity\n",
+           xor_varint_bytes(day, day.temperatureCenti), xor_varint_bytes(day, day.humidityCenti));
+
+    printf("\none device, two hours: %zu of %zu blocks read, %zu rows in %.1f us with the open (%s)\n", blocksRead,
+           reader.blocks().size(), matched, queryS * 1e6, matched == expectedMatches ? "match" : "DIFFER");
+    failures += matched == expectedMatches ? 0 : 1;
+
+    unlink(jsonPath.c_str());
+    unlink(csvPath.c_str());
+    unlink(storePath.c_str());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,460 @@
+// Traffic replay: records the fleet's telemetry and commands off a broker and
+// plays them back, at the recorded pace or faster, to load a broker and
+// whatever consumes it (ingest_sink, the API) with traffic that looks real.
+//
+//   program record capture.ttc [--host 127.0.0.1] [--port 1883] [--topic F]...
+//                  [--duration 0] [--report 5]
+//   program replay capture.ttc [--host 127.0.0.1] [--port 1883]
+//                  [--speed 1 | --speed max | --fit S] [--report 5]
+//   program info capture.ttc
+//
+// record subscribes with the firmware's MqttClient to +/+/+/telemetry and the
+// three command levels (device, site, tenant) unless --topic is given, and
+// appends every message with its arrival time to a TrafficCapture file
+// (tools/lib) until Ctrl-C or --duration seconds.
+//
+// replay publishes the messages on one connection in the order they arrived,
+// so the interleaving of devices is the recorded one, message i going out at
+// start + (arrival_i - arrival_0) / speed. --speed max sends as fast as the
+// broker takes them and --fit S picks the speed that plays the capture in S
+// seconds: a day recorded off the fleet becomes a one-minute stress test with
+// --fit 60. Everything goes out at QoS 0 without retain, as telemetry does.
+// Prints the rate and the speed actually reached, and how far behind schedule
+// messages went out, every --report seconds and at the end.
+#include <MqttClient.h>
+#include <Histogram.h>
+#include <TcpTransport.h>
+#include <TrafficCapture.h>
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <poll.h>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+const uint32_t kReconnectDelayMs = 5000;
+const uint32_t kConnectTimeoutMs = 5000;
+// Room for a burst of publishes between two flushes at --speed max
+const size_t kReplayBuffer = 256 * 1024;
+
+struct Options {
+    const char* mode = nullptr;
+    const char* path = nullptr;
+    const char* host = "127.0.0.1";
+    uint16_t port = 1883;
+    std::vector<const char*> topics;
+    uint32_t durationS = 0;
+    uint32_t reportS = 5;
+    double speed = 1;           // 0 is as fast as possible
+    double fitS = 0;
+};
+
+Options options;
+volatile sig_atomic_t stopRequested = 0;
+
+uint64_t clock_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t now_ms() {
+    return (uint32_t)(clock_us() / 1000);
+}
+
+int64_t wall_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Waits for the socket to be readable, or writable when output is pending,
+// for at most timeoutUs
+void wait_socket(TcpTransport& transport, uint64_t timeoutUs) {
+    pollfd fd = {};
+    fd.fd = transport.fd();
+    fd.events = POLLIN | (transport.wantsWrite() ? POLLOUT : 0);
+    timespec timeout;
+    timeout.tv_sec = timeoutUs / 1000000;
+    timeout.tv_nsec = (timeoutUs % 1000000) * 1000;
+    ppoll(&fd, 1, &timeout, nullptr);
+}
+
+// Last level of a topic: telemetry, commands, ...
+std::string kind_of(const std::string& topic) {
+    size_t slash = topic.rfind('/');
+    return slash == std::string::npos ? topic : topic.substr(slash + 1);
+}
+
+std::string format_wall(int64_t ms) {
+    time_t seconds = ms / 1000;
+    tm utc;
+    gmtime_r(&seconds, &utc);
+    char text[32];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S UTC", &utc);
+    return text;
+}
+
+// --- Record ---
+
+TcpTransport recordTransport;
+MqttOutbox::Slot recordSlot;
+MqttOutbox recordOutbox(&recordSlot, 1, 1, 60000);
+MqttClient recorder(recordTransport, recordOutbox, now_ms);
+capture::Writer writer;
+uint64_t recordStartUs = 0;
+bool writeFailed = false;
+
+void on_recorded(char* topic, uint8_t* payload, unsigned int length) {
+    if (!writer.add(clock_us() - recordStartUs, topic, payload, length)) {
+        writeFailed = true;
+    }
+}
+
+void on_record_connected() {
+    for (const char* topic : options.topics) {
+        recorder.subscribe(topic, 0);
+    }
+}
+
+int record() {
+    if (!writer.open(options.path, wall_ms())) {
+        perror(options.path);
+        return 1;
+    }
+    recordStartUs = clock_us();
+    char clientId[32];
+    snprintf(clientId, sizeof(clientId), "traffic-record-%d", (int)getpid());
+    recorder.setServer(options.host, options.port);
+    recorder.setCallback(on_recorded);
+    recorder.setConnectedCallback(on_record_connected);
+    printf("%s:%u", options.host, options.port);
+    for (const char* topic : options.topics) {
+        printf(" %s", topic);
+    }
+    printf(" -> %s\n", options.path);
+
+    const uint64_t endUs = options.durationS > 0 ? recordStartUs + (uint64_t)options.durationS * 1000000 : UINT64_MAX;
+    uint64_t nextReportUs = recordStartUs + (uint64_t)options.reportS * 1000000;
+    uint64_t lastMessages = 0;
+    uint32_t lastAttemptMs = 0;
+    bool attempted = false;
+    while (!stopRequested && clock_us() < endUs && !writeFailed) {
+        if (!recorder.connected() && !recorder.connecting() &&
+            (!attempted || now_ms() - lastAttemptMs >= kReconnectDelayMs)) {
+            attempted = true;
+            lastAttemptMs = now_ms();
+            recorder.connect(clientId);
+        }
+        recorder.loop();
+        wait_socket(recordTransport, 50000);
+
+        uint64_t nowUs = clock_us();
+        if (nowUs >= nextReportUs) {
+            printf("%6.0f s  %8.0f msg/s  %10llu messages  %7zu topics  %8.1f MB%s\n",
+                   (nowUs - recordStartUs) / 1e6, (writer.messages() - lastMessages) / (double)options.reportS,
+                   (unsigned long long)writer.messages(), writer.topics(), writer.bytes() / 1e6,
+                   recorder.connected() ? "" : "  (not connected)");
+            fflush(stdout);
+            lastMessages = writer.messages();
+            nextReportUs += (uint64_t)options.reportS * 1000000;
+        }
+    }
+    recorder.disconnect();
+    if (!writer.close() || writeFailed) {
+        fprintf(stderr, "%s: write failed\n", options.path);
+        return 1;
+    }
+    double elapsedS = (clock_us() - recordStartUs) / 1e6;
+    printf("\nrecorded %llu messages on %zu topics in %.0f s, %.1f MB (%.1f bytes/message)\n",
+           (unsigned long long)writer.messages(), writer.topics(), elapsedS, writer.bytes() / 1e6,
+           writer.messages() > 0 ? (double)writer.bytes() / writer.messages() : 0.0);
+    return 0;
+}
+
+// --- Replay ---
+
+TcpTransport replayTransport(kReplayBuffer);
+MqttOutbox::Slot replaySlot;
+MqttOutbox replayOutbox(&replaySlot, 1, 1, 60000);
+MqttClient player(replayTransport, replayOutbox, now_ms);
+capture::Reader reader;
+
+struct Progress {
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint64_t captureUs = 0;     // capture time covered by what was sent
+};
+
+int replay() {
+    if (!reader.open(options.path)) {
+        fprintf(stderr, "%s: not a capture\n", options.path);
+        return 1;
+    }
+    // A first pass for the totals --fit and the reports need
+    capture::Message message;
+    uint64_t total = 0;
+    uint64_t spanUs = 0;
+    uint64_t firstUs = 0;
+    while (reader.next(message)) {
+        firstUs = total == 0 ? message.atUs : firstUs;
+        spanUs = message.atUs - firstUs;
+        total++;
+    }
+    if (total == 0) {
+        fprintf(stderr, "%s: no messages\n", options.path);
+        return 1;
+    }
+    if (options.fitS > 0) {
+        options.speed = spanUs / 1e6 / options.fitS;
+    }
+    reader.rewind();
+
+    char clientId[32];
+    snprintf(clientId, sizeof(clientId), "traffic-replay-%d", (int)getpid());
+    player.setServer(options.host, options.port);
+    player.setProtocol(mqtt::kProtocol5);
+    uint32_t connectStart = now_ms();
+    player.connect(clientId);
+    while (!player.connected() && now_ms() - connectStart < kConnectTimeoutMs && !stopRequested) {
+        if (!player.connecting()) {
+            break;
+        }
+        player.loop();
+        wait_socket(replayTransport, 10000);
+    }
+    if (!player.connected()) {
+        fprintf(stderr, "cannot connect to %s:%u\n", options.host, options.port);
+        return 1;
+    }
+    char speed[32];
+    if (options.speed > 0) {
+        snprintf(speed, sizeof(speed), "%gx", options.speed);
+    } else {
+        snprintf(speed, sizeof(speed), "max");
+    }
+    printf("%s: %llu messages over %.0f s -> %s:%u at %s\n", options.path, (unsigned long long)total,
+           spanUs / 1e6, options.host, options.port, speed);
+
+    Progress progress;
+    Progress before;
+    Histogram behindMs;
+    Histogram intervalBehindMs;
+    int64_t maxBehindMs = 0;
+    uint64_t tooLarge = 0;
+    const uint64_t startUs = clock_us();
+    uint64_t nextReportUs = startUs + (uint64_t)options.reportS * 1000000;
+    uint64_t lastReportUs = startUs;
+    bool have = reader.next(message);
+    auto due_us = [&](const capture::Message& m) {
+        return options.speed > 0 ? startUs + (uint64_t)((m.atUs - firstUs) / options.speed) : startUs;
+    };
+
+    while (have && !stopRequested) {
+        if (!player.connected()) {
+            fprintf(stderr, "connection lost after %llu messages\n", (unsigned long long)progress.messages);
+            break;
+        }
+        uint64_t nowUs = clock_us();
+        bool blocked = false;
+        while (have && due_us(message) <= nowUs) {
+            const std::string& topic = reader.topics()[message.topic];
+            if (topic.size() + message.length + 16 > kReplayBuffer) {
+                tooLarge++;
+            } else if (!player.publish(topic.c_str(), message.payload, message.length, false)) {
+                blocked = true;
+                break;
+            } else {
+                int64_t behind = options.speed > 0 ? (int64_t)(nowUs - due_us(message)) / 1000 : 0;
+                behindMs.add(behind);
+                intervalBehindMs.add(behind);
+                maxBehindMs = std::max(maxBehindMs, behind);
+                progress.messages++;
+                progress.bytes += message.length;
+                progress.captureUs = message.atUs - firstUs;
+            }
+            have = reader.next(message);
+        }
+        player.loop();
+
+        nowUs = clock_us();
+        if (nowUs >= nextReportUs) {
+            double intervalS = (nowUs - lastReportUs) / 1e6;
+            printf("%6.0f s  %9.0f msg/s  %7.1f MB/s  speed %8.1fx  behind p50 %5u p99 %5u ms  %5.1f%% sent\n",
+                   (nowUs - startUs) / 1e6, (progress.messages - before.messages) / intervalS,
+                   (progress.bytes - before.bytes) / intervalS / 1e6,
+                   (progress.captureUs - before.captureUs) / 1e6 / intervalS, intervalBehindMs.percentile(0.50),
+                   intervalBehindMs.percentile(0.99), 100.0 * progress.messages / total);
+            fflush(stdout);
+            before = progress;
+            lastReportUs = nowUs;
+            nextReportUs += (uint64_t)options.reportS * 1000000;
+            intervalBehindMs.clear();
+        }
+        // Sleep until the next message is due, the socket drains or a report
+        uint64_t wakeUs = std::min(nextReportUs, have ? due_us(message) : nowUs);
+        if (blocked || replayTransport.wantsWrite()) {
+            wait_socket(replayTransport, 100000);
+        } else if (wakeUs > nowUs) {
+            wait_socket(replayTransport, wakeUs - nowUs);
+        }
+    }
+    // What is still buffered counts as sent once it has left
+    uint32_t drainStart = now_ms();
+    while (player.connected() && replayTransport.wantsWrite() && now_ms() - drainStart < kConnectTimeoutMs) {
+        player.loop();
+        wait_socket(replayTransport, 10000);
+    }
+    double elapsedS = (clock_us() - startUs) / 1e6;
+    player.disconnect();
+
+    printf("\nsent         %llu of %llu messages, %.1f MB in %.2f s (%.0f msg/s, %.1f MB/s)\n",
+           (unsigned long long)progress.messages, (unsigned long long)total, progress.bytes / 1e6, elapsedS,
+           progress.messages / elapsedS, progress.bytes / 1e6 / elapsedS);
+    printf("speed        %.1fx reached", progress.captureUs / 1e6 / elapsedS);
+    if (options.speed > 0) {
+        printf(" of %gx asked; behind schedule p50 %u ms, p99 %u ms, max %lld ms", options.speed,
+               behindMs.percentile(0.50), behindMs.percentile(0.99), (long long)maxBehindMs);
+    }
+    printf("\n");
+    if (tooLarge > 0) {
+        printf("skipped      %llu messages larger than the send buffer\n", (unsigned long long)tooLarge);
+    }
+    return progress.messages + tooLarge == total ? 0 : 1;
+}
+
+// --- Info ---
+
+int info() {
+    if (!reader.open(options.path)) {
+        fprintf(stderr, "%s: not a capture\n", options.path);
+        return 1;
+    }
+    capture::Message message;
+    uint64_t messages = 0;
+    uint64_t payloadBytes = 0;
+    uint64_t firstUs = 0;
+    uint64_t lastUs = 0;
+    // Busiest second, to size a replay speed against a broker's capacity
+    uint64_t second = 0;
+    uint64_t inSecond = 0;
+    uint64_t peak = 0;
+    std::vector<uint64_t> perTopic;
+    while (reader.next(message)) {
+        if (messages == 0) {
+            firstUs = message.atUs;
+        }
+        lastUs = message.atUs;
+        messages++;
+        payloadBytes += message.length;
+        if (message.topic >= perTopic.size()) {
+            perTopic.resize(message.topic + 1, 0);
+        }
+        perTopic[message.topic]++;
+        if (message.atUs / 1000000 != second) {
+            second = message.atUs / 1000000;
+            inSecond = 0;
+        }
+        peak = std::max(peak, ++inSecond);
+    }
+    std::unordered_map<std::string, std::pair<uint64_t, uint64_t>> kinds;    // topics, messages
+    for (size_t i = 0; i < perTopic.size(); i++) {
+        auto& kind = kinds[kind_of(reader.topics()[i])];
+        kind.first++;
+        kind.second += perTopic[i];
+    }
+    double spanS = (lastUs - firstUs) / 1e6;
+    printf("%s: %.1f MB, recorded %s\n", options.path, reader.fileBytes() / 1e6,
+           format_wall(reader.startMs()).c_str());
+    printf("messages     %llu over %.0f s, %.0f/s on average, %llu in the busiest second\n",
+           (unsigned long long)messages, spanS, spanS > 0 ? messages / spanS : 0.0, (unsigned long long)peak);
+    printf("bytes        %.1f per message, %.1f of them payload\n",
+           messages > 0 ? (double)(reader.fileBytes() - reader.tornBytes()) / messages : 0.0,
+           messages > 0 ? (double)payloadBytes / messages : 0.0);
+    for (const auto& kind : kinds) {
+        printf("%-12s %llu topics, %llu messages\n", kind.first.c_str(), (unsigned long long)kind.second.first,
+               (unsigned long long)kind.second.second);
+    }
+    if (reader.tornBytes() > 0) {
+        printf("torn         %zu bytes after the last whole message\n", reader.tornBytes());
+    }
+    return 0;
+}
+
+bool parse_options(int argc, char** argv) {
+    if (argc < 3) {
+        return false;
+    }
+    options.mode = argv[1];
+    options.path = argv[2];
+    for (int i = 3; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) {
+            return false;
+        }
+        i++;
+        if (!strcmp(arg, "--host")) {
+            options.host = value;
+        } else if (!strcmp(arg, "--port")) {
+            options.port = atoi(value);
+        } else if (!strcmp(arg, "--topic")) {
+            options.topics.push_back(value);
+        } else if (!strcmp(arg, "--duration")) {
+            options.durationS = strtoul(value, nullptr, 10);
+        } else if (!strcmp(arg, "--report")) {
+            options.reportS = std::max(1ul, strtoul(value, nullptr, 10));
+        } else if (!strcmp(arg, "--speed")) {
+            options.speed = !strcmp(value, "max") ? 0 : atof(value);
+            if (options.speed < 0 || (options.speed == 0 && strcmp(value, "max") != 0)) {
+                return false;
+            }
+        } else if (!strcmp(arg, "--fit")) {
+            options.fitS = atof(value);
+            if (options.fitS <= 0) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    if (options.topics.empty()) {
+        options.topics = {"+/+/+/telemetry", "+/+/+/commands", "+/+/commands", "+/commands"};
+    }
+    return !strcmp(options.mode, "record") || !strcmp(options.mode, "replay") || !strcmp(options.mode, "info");
+}
+
+void on_signal(int) {
+    stopRequested = 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (!parse_options(argc, argv)) {
+        fprintf(stderr,
+                "usage: %s record FILE [--host H] [--port P] [--topic FILTER]... [--duration S] [--report S]\n"
+                "       %s replay FILE [--host H] [--port P] [--speed N|max] [--fit S] [--report S]\n"
+                "       %s info FILE\n",
+                argv[0], argv[0], argv[0]);
+        return 2;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+    if (!strcmp(options.mode, "record")) {
+        return record();
+    }
+    if (!strcmp(options.mode, "replay")) {
+        return replay();
+    }
+    return info();
+}